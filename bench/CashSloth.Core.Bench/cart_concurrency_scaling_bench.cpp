@@ -0,0 +1,131 @@
+#include "cashsloth_core.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+constexpr int kItemCount = 256;
+
+std::string build_catalog() {
+  std::string json = "{\"items\":[";
+  for (int i = 0; i < kItemCount; ++i) {
+    if (i > 0) {
+      json += ",";
+    }
+    json += "{\"id\":\"SKU-" + std::to_string(i) + "\",\"name\":\"Item " + std::to_string(i) +
+            "\",\"unit_cents\":" + std::to_string(100 + i) + "}";
+  }
+  json += "]}";
+  return json;
+}
+
+// Stock for every item, more than any run sells, so each add reserves and each clear returns.
+std::string build_stock() {
+  std::string json = "{\"items\":[";
+  for (int i = 0; i < kItemCount; ++i) {
+    if (i > 0) {
+      json += ",";
+    }
+    json += "{\"id\":\"SKU-" + std::to_string(i) + "\",\"available\":1000000000000}";
+  }
+  json += "]}";
+  return json;
+}
+
+void require(int result, const char* what) {
+  if (result != CS_SUCCESS) {
+    std::cerr << what << " failed: " << cs_last_error() << "\n";
+    std::exit(1);
+  }
+}
+
+// Each thread runs sales on its own slice of `carts`: ten adds, a total and a clear per sale.
+double run_ms(const std::vector<cs_cart_t>& carts, const std::vector<std::string>& ids,
+              int threads, int sales_per_thread) {
+  const size_t slice = carts.size() / static_cast<size_t>(threads);
+  const auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> workers;
+  for (int t = 0; t < threads; ++t) {
+    workers.emplace_back([&, t] {
+      uint32_t random = 1u + static_cast<uint32_t>(t);
+      long long cents = 0;
+      for (int sale = 0; sale < sales_per_thread; ++sale) {
+        const cs_cart_t cart = carts[static_cast<size_t>(t) * slice + sale % slice];
+        for (int line = 0; line < 10; ++line) {
+          random = random * 1664525u + 1013904223u;
+          require(cs_cart_add_item_by_id(cart, ids[(random >> 8) % ids.size()].c_str(), 1),
+                  "cs_cart_add_item_by_id");
+        }
+        require(cs_cart_get_total_cents(cart, &cents), "cs_cart_get_total_cents");
+        require(cs_cart_clear(cart), "cs_cart_clear");
+      }
+    });
+  }
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start)
+      .count();
+}
+}  // namespace
+
+// Usage: CashSlothCoreCartConcurrencyScalingBench [carts_per_thread] [sales_per_thread] [stock]
+// A non-zero `stock` runs the same sales against a stock ledger that limits every item.
+int main(int argc, char** argv) {
+  const int carts_per_thread = argc > 1 ? std::atoi(argv[1]) : 64;
+  const int sales_per_thread = argc > 2 ? std::atoi(argv[2]) : 20000;
+  const bool stock = argc > 3 && std::atoi(argv[3]) != 0;
+  if (carts_per_thread <= 0 || sales_per_thread <= 0) {
+    std::cerr << "carts_per_thread and sales_per_thread must be positive.\n";
+    return 1;
+  }
+
+  if (cs_init() != CS_SUCCESS) {
+    std::cerr << "cs_init failed: " << cs_last_error() << "\n";
+    return 1;
+  }
+  require(cs_catalog_load_json(build_catalog().c_str()), "cs_catalog_load_json");
+  cs_catalog_t catalog = nullptr;
+  require(cs_catalog_get_default(&catalog), "cs_catalog_get_default");
+  if (stock) {
+    require(cs_catalog_set_stock_json(catalog, build_stock().c_str()),
+            "cs_catalog_set_stock_json");
+  }
+  std::vector<std::string> ids;
+  for (int i = 0; i < kItemCount; ++i) {
+    ids.push_back("SKU-" + std::to_string(i));
+  }
+
+  const int max_threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+  std::cout << "hardware_threads=" << max_threads << " carts_per_thread=" << carts_per_thread
+            << " sales_per_thread=" << sales_per_thread << " stock=" << stock << "\n";
+
+  double serial_rate = 0;
+  for (int threads = 1; threads <= std::max(8, max_threads); threads *= 2) {
+    std::vector<cs_cart_t> carts(static_cast<size_t>(threads * carts_per_thread), nullptr);
+    for (cs_cart_t& cart : carts) {
+      require(cs_cart_new_concurrent(catalog, &cart), "cs_cart_new_concurrent");
+    }
+    run_ms(carts, ids, threads, std::min(sales_per_thread, 1000));
+    const double ms = run_ms(carts, ids, threads, sales_per_thread);
+    const double sales_per_sec = threads * static_cast<double>(sales_per_thread) / (ms / 1000.0);
+    if (threads == 1) {
+      serial_rate = sales_per_sec;
+    }
+    std::cout << "threads=" << threads << " run_ms=" << ms
+              << " sales_per_sec=" << static_cast<long long>(sales_per_sec)
+              << " speedup=" << sales_per_sec / serial_rate << "\n";
+    for (cs_cart_t cart : carts) {
+      cs_cart_free(cart);
+    }
+  }
+
+  cs_shutdown();
+  return 0;
+}
@@ -0,0 +1,80 @@
+#include "cashsloth_core.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+std::string build_catalog(int item_count) {
+  std::string json;
+  json.reserve(static_cast<size_t>(item_count) * 64);
+  json += "{\"items\":[";
+  for (int i = 0; i < item_count; ++i) {
+    if (i > 0) {
+      json += ",";
+    }
+    json += "{\"id\":\"SKU-";
+    json += std::to_string(i);
+    json += "\",\"name\":\"Item ";
+    json += std::to_string(i);
+    json += "\",\"unit_cents\":";
+    json += std::to_string(100 + (i % 5000));
+    json += "}";
+  }
+  json += "]}";
+  return json;
+}
+
+double best_load_ms(const std::string& json, int repetitions) {
+  double best = 0;
+  for (int r = 0; r < repetitions; ++r) {
+    const auto start = std::chrono::steady_clock::now();
+    if (cs_catalog_load_json(json.c_str()) != CS_SUCCESS) {
+      std::cerr << "cs_catalog_load_json failed: " << cs_last_error() << "\n";
+      std::exit(1);
+    }
+    const auto end = std::chrono::steady_clock::now();
+    const double ms = std::chrono::duration<double, std::milli>(end - start).count();
+    best = r == 0 ? ms : std::min(best, ms);
+  }
+  return best;
+}
+}  // namespace
+
+// Usage: CashSlothCoreCatalogLoadScalingBench [item_count] [repetitions]
+int main(int argc, char** argv) {
+  const int item_count = argc > 1 ? std::atoi(argv[1]) : 200000;
+  const int repetitions = argc > 2 ? std::atoi(argv[2]) : 5;
+  if (item_count <= 0 || repetitions <= 0) {
+    std::cerr << "item_count and repetitions must be positive.\n";
+    return 1;
+  }
+
+  if (cs_init() != CS_SUCCESS) {
+    std::cerr << "cs_init failed: " << cs_last_error() << "\n";
+    return 1;
+  }
+
+  const std::string json = build_catalog(item_count);
+  std::cout << "items=" << item_count << " bytes=" << json.size()
+            << " repetitions=" << repetitions << "\n";
+
+  double serial_ms = 0;
+  for (int threads : {1, 2, 4, 8}) {
+    cs_catalog_set_load_threads(threads);
+    const double ms = best_load_ms(json, repetitions);
+    if (threads == 1) {
+      serial_ms = ms;
+    }
+    std::cout << "threads=" << threads << " load_ms=" << ms
+              << " items_per_sec=" << static_cast<long long>(item_count / (ms / 1000.0))
+              << " speedup=" << serial_ms / ms << "\n";
+  }
+
+  cs_catalog_set_load_threads(1);
+  cs_shutdown();
+  return 0;
+}
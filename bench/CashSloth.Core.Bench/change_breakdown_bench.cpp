@@ -0,0 +1,92 @@
+#include "cashsloth_core.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+constexpr long long kEurDenominations[] = {50000, 20000, 10000, 5000, 2000, 1000, 500, 200,
+                                           100,   50,    20,    10,   5,    2,    1};
+
+void require(int result, const char* what) {
+  if (result != CS_SUCCESS) {
+    std::cerr << what << " failed: " << cs_last_error() << "\n";
+    std::exit(1);
+  }
+}
+
+// A EUR drawer holding `max_count` or fewer of each denomination, drawn from `random`.
+std::string drawer_json(unsigned random, int max_count) {
+  std::string json = "{\"currency\":\"EUR\",\"counts\":[";
+  bool first = true;
+  for (long long cents : kEurDenominations) {
+    random = random * 1664525u + 1013904223u;
+    json += first ? "{\"cents\":" : ",{\"cents\":";
+    first = false;
+    json += std::to_string(cents) + ",\"count\":" +
+            std::to_string((random >> 8) % static_cast<unsigned>(max_count + 1)) + "}";
+  }
+  return json + "]}";
+}
+}  // namespace
+
+// Usage: CashSlothCoreChangeBreakdownBench [breakdowns]
+// Times cs_payment_get_change_breakdown for change from 0.01 to 200.00, from a full drawer and
+// from sparse ones where greedy picks often fail and the solver has to back off.
+int main(int argc, char** argv) {
+  const int breakdowns = argc > 1 ? std::atoi(argv[1]) : 200000;
+  if (breakdowns <= 0) {
+    std::cerr << "breakdowns must be positive.\n";
+    return 1;
+  }
+
+  require(cs_init(), "cs_init");
+  cs_catalog_t catalog = nullptr;
+  cs_cart_t cart = nullptr;
+  require(cs_catalog_new("drawer_bench", &catalog), "cs_catalog_new");
+  require(cs_catalog_instance_load_json(
+              catalog, "{\"items\":[{\"id\":\"X\",\"name\":\"X\",\"unit_cents\":1}]}"),
+          "cs_catalog_instance_load_json");
+  require(cs_cart_new_for_catalog(catalog, &cart), "cs_cart_new_for_catalog");
+  require(cs_cart_add_item_by_id(cart, "X", 1), "cs_cart_add_item_by_id");
+
+  for (int max_count : {50, 3, 1}) {
+    unsigned random = 1;
+    int exact = 0;
+    std::vector<double> call_ns(static_cast<size_t>(breakdowns));
+    const auto start = std::chrono::steady_clock::now();
+    for (int b = 0; b < breakdowns; ++b) {
+      if (b % 1000 == 0) {
+        require(cs_drawer_set_json(drawer_json(random + static_cast<unsigned>(b), max_count)
+                                       .c_str()),
+                "cs_drawer_set_json");
+      }
+      random = random * 1664525u + 1013904223u;
+      require(cs_payment_set_given_cents(cart, 2 + (random >> 8) % 20000),
+              "cs_payment_set_given_cents");
+      char* json = nullptr;
+      const auto call_start = std::chrono::steady_clock::now();
+      exact += cs_payment_get_change_breakdown(cart, &json) == CS_SUCCESS ? 1 : 0;
+      call_ns[static_cast<size_t>(b)] =
+          std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - call_start)
+              .count();
+      cs_free(json);
+    }
+    const double ns =
+        std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start)
+            .count();
+    std::sort(call_ns.begin(), call_ns.end());
+    std::cout << "max_count=" << max_count << " ns_per_breakdown=" << ns / breakdowns
+              << " p99_ns=" << call_ns[call_ns.size() * 99 / 100]
+              << " p999_ns=" << call_ns[call_ns.size() * 999 / 1000] << " max_ns=" << call_ns.back()
+              << " exact=" << exact << "/" << breakdowns << "\n";
+  }
+
+  cs_cart_free(cart);
+  cs_catalog_free(catalog);
+  cs_shutdown();
+  return 0;
+}
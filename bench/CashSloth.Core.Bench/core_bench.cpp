@@ -0,0 +1,495 @@
+#include "cashsloth_core.h"
+
+#include "mini_json.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#elif defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+namespace {
+// Core-side allocations are counted through cs_set_allocator, so the numbers cover exactly what the
+// core asks for (returned buffers, snapshots, carts, parser scratch) and nothing the harness does.
+std::atomic<unsigned long long> g_bytes_allocated{0};
+std::atomic<unsigned long long> g_allocations{0};
+
+void* counting_allocate(void*, size_t size, size_t alignment) {
+  g_bytes_allocated.fetch_add(size, std::memory_order_relaxed);
+  g_allocations.fetch_add(1, std::memory_order_relaxed);
+  if (alignment > __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+    return ::operator new(size, std::align_val_t(alignment), std::nothrow);
+  }
+  return ::operator new(size, std::nothrow);
+}
+
+void counting_deallocate(void*, void* ptr, size_t, size_t alignment) {
+  if (alignment > __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+    ::operator delete(ptr, std::align_val_t(alignment));
+  } else {
+    ::operator delete(ptr);
+  }
+}
+
+// Process-wide high-water mark; it only ever grows, so later benchmarks report at least the peak of
+// earlier ones.
+unsigned long long peak_rss_bytes() {
+#if defined(_WIN32)
+  PROCESS_MEMORY_COUNTERS counters;
+  if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+    return counters.PeakWorkingSetSize;
+  }
+  return 0;
+#elif defined(__APPLE__)
+  rusage usage;
+  return getrusage(RUSAGE_SELF, &usage) == 0 ? static_cast<unsigned long long>(usage.ru_maxrss) : 0;
+#elif defined(__unix__)
+  rusage usage;
+  return getrusage(RUSAGE_SELF, &usage) == 0
+             ? static_cast<unsigned long long>(usage.ru_maxrss) * 1024ULL
+             : 0;
+#else
+  return 0;
+#endif
+}
+
+// Allocation patterns and timings are only comparable against a baseline from the same compiler and
+// standard library.
+std::string toolchain() {
+  std::string result;
+#if defined(__clang__)
+  result = "clang";
+#elif defined(_MSC_VER)
+  result = "msvc";
+#elif defined(__GNUC__)
+  result = "gcc";
+#else
+  result = "unknown";
+#endif
+#if defined(_LIBCPP_VERSION)
+  result += "/libc++";
+#elif defined(__GLIBCXX__)
+  result += "/libstdc++";
+#elif defined(_MSVC_STL_VERSION)
+  result += "/msvc-stl";
+#endif
+  return result;
+}
+
+#if defined(NDEBUG)
+constexpr bool kOptimizedBuild = true;
+#else
+constexpr bool kOptimizedBuild = false;
+#endif
+
+// splitmix64: the same seed yields the same catalogs and carts on every platform.
+class Generator {
+ public:
+  explicit Generator(uint64_t seed) : state_(seed) {}
+
+  uint64_t next() {
+    uint64_t z = (state_ += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+  }
+
+  int next_int(int lo, int hi) {
+    return lo + static_cast<int>(next() % static_cast<uint64_t>(hi - lo + 1));
+  }
+
+ private:
+  uint64_t state_;
+};
+
+std::string item_id(int index) {
+  char buffer[32];
+  std::snprintf(buffer, sizeof(buffer), "SKU-%07d", index);
+  return buffer;
+}
+
+// Every fourth item carries localized names so the locale path is part of the measured load.
+std::string generate_catalog(int item_count) {
+  static const char* const kWords[] = {"Coffee", "Tea",    "Croissant", "Bagel", "Water",
+                                       "Juice",  "Muffin", "Sandwich",  "Salad", "Soup",
+                                       "Large",  "Small",  "Organic",   "Vegan", "Classic"};
+  constexpr int kWordCount = static_cast<int>(sizeof(kWords) / sizeof(kWords[0]));
+  Generator generator(0x5107CA5EULL + static_cast<uint64_t>(item_count));
+  std::string json;
+  json.reserve(static_cast<size_t>(item_count) * 96);
+  json += "{\"items\":[";
+  for (int i = 0; i < item_count; ++i) {
+    if (i > 0) {
+      json += ",";
+    }
+    json += "{\"id\":\"" + item_id(i) + "\",\"name\":\"";
+    json += kWords[generator.next_int(0, kWordCount - 1)];
+    json += " ";
+    json += kWords[generator.next_int(0, kWordCount - 1)];
+    json += "\",\"unit_cents\":" + std::to_string(generator.next_int(50, 99999));
+    if (i % 4 == 0) {
+      json += ",\"names\":{\"de\":\"Artikel " + std::to_string(i) + "\",\"fr\":\"Article " +
+              std::to_string(i) + "\"}";
+    }
+    json += "}";
+  }
+  json += "]}";
+  return json;
+}
+
+// Distinct ids spread over the catalog: 7919 is prime, so the stride visits every index once.
+std::vector<std::string> generate_cart_ids(int line_count, int catalog_size) {
+  std::vector<std::string> ids;
+  ids.reserve(static_cast<size_t>(line_count));
+  for (int i = 0; i < line_count; ++i) {
+    ids.push_back(item_id(static_cast<int>((static_cast<long long>(i) * 7919) % catalog_size)));
+  }
+  return ids;
+}
+
+void require(int result, const char* what) {
+  if (result != CS_SUCCESS) {
+    std::cerr << what << " failed: " << cs_last_error() << "\n";
+    std::exit(1);
+  }
+}
+
+struct Options {
+  bool quick = false;
+  double min_time_s = 0.25;
+  int repetitions = 5;
+  std::string filter;
+  std::string json_path;
+  std::string compare_path;
+  bool compare_time = true;
+  double time_tolerance = 0.25;
+  double bytes_tolerance = 0.05;
+};
+
+struct Result {
+  std::string name;
+  long long ops = 0;
+  double ns_per_op = 0;
+  double ops_per_sec = 0;
+  double bytes_per_op = 0;
+  double allocations_per_op = 0;
+  unsigned long long peak_rss_bytes = 0;
+};
+
+// `batch` performs `ops_per_batch` operations. Batches repeat until `min_time_s` has elapsed, the
+// per-op time of each repetition is recorded, and the median is reported.
+Result measure(const std::string& name, const Options& options, long long ops_per_batch,
+               const std::function<void()>& batch) {
+  using clock = std::chrono::steady_clock;
+  batch();
+
+  std::vector<double> samples;
+  long long total_ops = 0;
+  const unsigned long long bytes_before = g_bytes_allocated.load();
+  const unsigned long long allocations_before = g_allocations.load();
+  for (int r = 0; r < options.repetitions; ++r) {
+    long long ops = 0;
+    const auto start = clock::now();
+    double elapsed_s = 0;
+    do {
+      batch();
+      ops += ops_per_batch;
+      elapsed_s = std::chrono::duration<double>(clock::now() - start).count();
+    } while (elapsed_s < options.min_time_s / options.repetitions);
+    samples.push_back(elapsed_s * 1e9 / static_cast<double>(ops));
+    total_ops += ops;
+  }
+  std::sort(samples.begin(), samples.end());
+
+  Result result;
+  result.name = name;
+  result.ops = total_ops;
+  result.ns_per_op = samples[samples.size() / 2];
+  result.ops_per_sec = 1e9 / result.ns_per_op;
+  result.bytes_per_op =
+      static_cast<double>(g_bytes_allocated.load() - bytes_before) / static_cast<double>(total_ops);
+  result.allocations_per_op =
+      static_cast<double>(g_allocations.load() - allocations_before) / static_cast<double>(total_ops);
+  result.peak_rss_bytes = peak_rss_bytes();
+  return result;
+}
+
+std::vector<Result> run_benchmarks(const Options& options) {
+  const std::vector<int> catalog_sizes =
+      options.quick ? std::vector<int>{1000, 10000} : std::vector<int>{1000, 10000, 100000};
+  const std::vector<int> cart_sizes =
+      options.quick ? std::vector<int>{10, 100, 1000} : std::vector<int>{10, 100, 1000, 10000};
+  constexpr int kCartCatalogSize = 10000;
+
+  std::vector<Result> results;
+  auto selected = [&options](const std::string& name) {
+    return options.filter.empty() || name.find(options.filter) != std::string::npos;
+  };
+
+  for (int items : catalog_sizes) {
+    const std::string json = generate_catalog(items);
+    const std::string load_name = "catalog_load_json/items=" + std::to_string(items);
+    if (selected(load_name)) {
+      results.push_back(measure(load_name, options, 1, [&json] {
+        require(cs_catalog_load_json(json.c_str()), "cs_catalog_load_json");
+      }));
+    }
+    const std::string get_name = "catalog_get_json/items=" + std::to_string(items);
+    if (selected(get_name)) {
+      require(cs_catalog_load_json(json.c_str()), "cs_catalog_load_json");
+      results.push_back(measure(get_name, options, 1, [] {
+        char* out = nullptr;
+        require(cs_catalog_get_json(&out), "cs_catalog_get_json");
+        cs_free(out);
+      }));
+    }
+  }
+
+  require(cs_catalog_load_json(generate_catalog(kCartCatalogSize).c_str()), "cs_catalog_load_json");
+  cs_cart_t cart = nullptr;
+  require(cs_cart_new(&cart), "cs_cart_new");
+  for (int lines : cart_sizes) {
+    const std::vector<std::string> ids = generate_cart_ids(lines, kCartCatalogSize);
+    const std::string add_name = "cart_add_item_by_id/lines=" + std::to_string(lines);
+    if (selected(add_name)) {
+      // One op is one add; each batch fills the cart to `lines` distinct lines and clears it.
+      results.push_back(measure(add_name, options, lines, [cart, &ids] {
+        for (const std::string& id : ids) {
+          require(cs_cart_add_item_by_id(cart, id.c_str(), 1), "cs_cart_add_item_by_id");
+        }
+        require(cs_cart_clear(cart), "cs_cart_clear");
+      }));
+    }
+    const std::string fast_name = "cart_add_item_by_id_fast/lines=" + std::to_string(lines);
+    if (selected(fast_name)) {
+      results.push_back(measure(fast_name, options, lines, [cart, &ids] {
+        for (const std::string& id : ids) {
+          require(cs_cart_add_item_by_id_fast(cart, id.c_str(), 1), "cs_cart_add_item_by_id_fast");
+        }
+        require(cs_cart_clear_fast(cart), "cs_cart_clear_fast");
+      }));
+    }
+    const std::string lines_name = "cart_get_lines_json/lines=" + std::to_string(lines);
+    if (selected(lines_name)) {
+      require(cs_cart_clear(cart), "cs_cart_clear");
+      for (const std::string& id : ids) {
+        require(cs_cart_add_item_by_id(cart, id.c_str(), 2), "cs_cart_add_item_by_id");
+      }
+      results.push_back(measure(lines_name, options, 1, [cart] {
+        char* out = nullptr;
+        require(cs_cart_get_lines_json(cart, &out), "cs_cart_get_lines_json");
+        cs_free(out);
+      }));
+      require(cs_cart_clear(cart), "cs_cart_clear");
+    }
+  }
+  cs_cart_free(cart);
+  return results;
+}
+
+std::string results_json(const std::vector<Result>& results, const Options& options) {
+  std::ostringstream out;
+  out.precision(12);
+  out << "{\n  \"schema\": 1,\n  \"toolchain\": \"" << toolchain() << "\",\n  \"optimized\": "
+      << (kOptimizedBuild ? "true" : "false") << ",\n  \"quick\": " << (options.quick ? "true" : "false")
+      << ",\n  \"benchmarks\": [";
+  for (size_t i = 0; i < results.size(); ++i) {
+    const Result& r = results[i];
+    out << (i == 0 ? "\n" : ",\n") << "    {\"name\": \"" << r.name << "\", \"ops\": " << r.ops
+        << ", \"ns_per_op\": " << r.ns_per_op << ", \"ops_per_sec\": " << r.ops_per_sec
+        << ", \"bytes_allocated_per_op\": " << r.bytes_per_op
+        << ", \"allocations_per_op\": " << r.allocations_per_op
+        << ", \"peak_rss_bytes\": " << r.peak_rss_bytes << "}";
+  }
+  out << "\n  ]\n}\n";
+  return out.str();
+}
+
+void print_results(const std::vector<Result>& results) {
+  std::printf("%-34s %14s %14s %14s %12s %12s\n", "benchmark", "ns/op", "ops/sec", "bytes/op",
+              "allocs/op", "peak_rss_mb");
+  for (const Result& r : results) {
+    std::printf("%-34s %14.1f %14.0f %14.1f %12.2f %12.1f\n", r.name.c_str(), r.ns_per_op,
+                r.ops_per_sec, r.bytes_per_op, r.allocations_per_op,
+                static_cast<double>(r.peak_rss_bytes) / (1024.0 * 1024.0));
+  }
+}
+
+const mini_json::Value* member(const mini_json::Value& object, const char* key) {
+  if (!object.is_object()) {
+    return nullptr;
+  }
+  auto it = object.as_object().find(mini_json::String(key, object.resource()));
+  return it == object.as_object().end() ? nullptr : &it->second;
+}
+
+// Returns the number of regressions, or -1 when the baseline cannot be read.
+int compare_with_baseline(const std::vector<Result>& results, const Options& options) {
+  std::ifstream file(options.compare_path, std::ios::binary);
+  if (!file) {
+    std::cerr << "Unable to read baseline " << options.compare_path << "\n";
+    return -1;
+  }
+  std::stringstream contents;
+  contents << file.rdbuf();
+  const std::string text = contents.str();
+  mini_json::Value baseline;
+  std::string error;
+  if (!mini_json::parse(text, &baseline, &error)) {
+    std::cerr << "Invalid baseline " << options.compare_path << ": " << error << "\n";
+    return -1;
+  }
+  const mini_json::Value* baseline_toolchain = member(baseline, "toolchain");
+  const mini_json::Value* benchmarks = member(baseline, "benchmarks");
+  if (!baseline_toolchain || !baseline_toolchain->is_string() || !benchmarks ||
+      !benchmarks->is_array()) {
+    std::cerr << "Baseline " << options.compare_path << " lacks toolchain or benchmarks.\n";
+    return -1;
+  }
+  if (std::string(baseline_toolchain->as_string()) != toolchain()) {
+    std::cout << "Baseline was recorded with " << baseline_toolchain->as_string()
+              << "; this build uses " << toolchain() << ". Skipping comparison.\n";
+    return 0;
+  }
+  const bool compare_time = kOptimizedBuild && options.compare_time;
+  if (!kOptimizedBuild) {
+    std::cout << "Unoptimized build: comparing allocations only, not timings.\n";
+  } else if (!compare_time) {
+    std::cout << "Comparing allocations only, not timings.\n";
+  }
+
+  int regressions = 0;
+  for (const Result& r : results) {
+    const mini_json::Value* entry = nullptr;
+    for (const mini_json::Value& candidate : benchmarks->as_array()) {
+      const mini_json::Value* name = member(candidate, "name");
+      if (name && name->is_string() && std::string(name->as_string()) == r.name) {
+        entry = &candidate;
+        break;
+      }
+    }
+    if (!entry) {
+      std::cout << "NEW         " << r.name << "\n";
+      continue;
+    }
+    const mini_json::Value* ns = member(*entry, "ns_per_op");
+    const mini_json::Value* bytes = member(*entry, "bytes_allocated_per_op");
+    bool regressed = false;
+    if (compare_time && ns && ns->is_number()) {
+      const double limit = static_cast<double>(ns->as_number()) * (1.0 + options.time_tolerance);
+      if (r.ns_per_op > limit) {
+        std::cout << "REGRESSION  " << r.name << ": " << r.ns_per_op << " ns/op vs baseline "
+                  << static_cast<double>(ns->as_number()) << "\n";
+        regressed = true;
+      }
+    }
+    if (bytes && bytes->is_number()) {
+      // The slack of 64 bytes keeps tiny per-op counts from tripping on a single allocation.
+      const double limit =
+          static_cast<double>(bytes->as_number()) * (1.0 + options.bytes_tolerance) + 64.0;
+      if (r.bytes_per_op > limit) {
+        std::cout << "REGRESSION  " << r.name << ": " << r.bytes_per_op << " bytes/op vs baseline "
+                  << static_cast<double>(bytes->as_number()) << "\n";
+        regressed = true;
+      }
+    }
+    if (regressed) {
+      ++regressions;
+    } else {
+      std::cout << "OK          " << r.name << "\n";
+    }
+  }
+  return regressions;
+}
+
+bool parse_options(int argc, char** argv, Options* options) {
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    const bool has_value = i + 1 < argc;
+    if (arg == "--quick") {
+      options->quick = true;
+      options->min_time_s = 0.05;
+      options->repetitions = 3;
+    } else if (arg == "--filter" && has_value) {
+      options->filter = argv[++i];
+    } else if (arg == "--json" && has_value) {
+      options->json_path = argv[++i];
+    } else if (arg == "--compare" && has_value) {
+      options->compare_path = argv[++i];
+    } else if (arg == "--allocations-only") {
+      options->compare_time = false;
+    } else if (arg == "--time-tolerance" && has_value) {
+      options->time_tolerance = std::atof(argv[++i]);
+    } else if (arg == "--bytes-tolerance" && has_value) {
+      options->bytes_tolerance = std::atof(argv[++i]);
+    } else if (arg == "--min-time" && has_value) {
+      options->min_time_s = std::atof(argv[++i]);
+    } else {
+      return false;
+    }
+  }
+  return options->min_time_s > 0 && options->time_tolerance >= 0 && options->bytes_tolerance >= 0;
+}
+}  // namespace
+
+// Usage: CashSlothCoreBench [--quick] [--filter substring] [--min-time seconds] [--json path]
+//                           [--compare baseline.json] [--allocations-only]
+//                           [--time-tolerance fraction] [--bytes-tolerance fraction]
+int main(int argc, char** argv) {
+  Options options;
+  if (!parse_options(argc, argv, &options)) {
+    std::cerr << "Usage: CashSlothCoreBench [--quick] [--filter substring] [--min-time seconds]"
+                 " [--json path] [--compare baseline.json] [--allocations-only]"
+                 " [--time-tolerance fraction] [--bytes-tolerance fraction]\n";
+    return 1;
+  }
+
+  const cs_allocator allocator = {counting_allocate, counting_deallocate, nullptr};
+  require(cs_set_allocator(&allocator), "cs_set_allocator");
+  require(cs_init(), "cs_init");
+
+  const std::vector<Result> results = run_benchmarks(options);
+  print_results(results);
+
+  if (!options.json_path.empty()) {
+    std::ofstream out(options.json_path, std::ios::binary);
+    out << results_json(results, options);
+    if (!out) {
+      std::cerr << "Unable to write " << options.json_path << "\n";
+      cs_shutdown();
+      return 1;
+    }
+  }
+
+  int exit_code = 0;
+  if (!options.compare_path.empty()) {
+    const int regressions = compare_with_baseline(results, options);
+    if (regressions != 0) {
+      std::cerr << (regressions < 0 ? std::string("Baseline comparison failed.")
+                                    : std::to_string(regressions) + " benchmark(s) regressed.")
+                << "\n";
+      exit_code = 1;
+    }
+  }
+
+  cs_shutdown();
+  return exit_code;
+}
@@ -0,0 +1,125 @@
+#include "cashsloth_core.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+namespace {
+constexpr int kItems = 5000;
+constexpr int kCategories = 50;
+constexpr int kCartLines = 20;
+
+std::string catalog_json() {
+  std::string json = "{\"items\":[";
+  for (int i = 0; i < kItems; ++i) {
+    json += i > 0 ? "," : "";
+    json += "{\"id\":\"SKU-" + std::to_string(i) + "\",\"name\":\"Item " + std::to_string(i) +
+            "\",\"unit_cents\":" + std::to_string(100 + i % 900) + ",\"category\":\"C" +
+            std::to_string(i % kCategories) + "\"}";
+  }
+  return json + "]}";
+}
+
+// A promotion calendar: per-item percent and fixed-price rules, with an item multi-buy every 10
+// rules and an item bundle every 50, spread over the catalog, plus one multi-buy per category.
+// Each item is named by about rules / kItems rules, so a change's cost should not grow with the
+// rules loaded for other items.
+std::string rules_json(int rules) {
+  std::string json = "{\"rules\":[";
+  for (int c = 0; c < kCategories; ++c) {
+    json += c > 0 ? "," : "";
+    json += "{\"id\":\"C" + std::to_string(c) + "\",\"type\":\"multibuy\",\"categories\":[\"C" +
+            std::to_string(c) + "\"],\"buy\":3,\"pay\":2}";
+  }
+  for (int r = 0; r < rules; ++r) {
+    const std::string id = std::to_string(r);
+    const std::string item = "\"SKU-" + std::to_string(r * 7 % kItems) + "\"";
+    const std::string other = "\"SKU-" + std::to_string((r * 7 + 1) % kItems) + "\"";
+    if (r % 50 == 49) {
+      json += ",{\"id\":\"B" + id + "\",\"type\":\"bundle\",\"components\":[{\"items\":[" + item +
+              "]},{\"items\":[" + other + "]}],\"price_cents\":500}";
+    } else if (r % 10 == 9) {
+      json += ",{\"id\":\"M" + id + "\",\"type\":\"multibuy\",\"items\":[" + item + "," + other +
+              "],\"buy\":3,\"pay\":2}";
+    } else if (r % 2 == 0) {
+      json += ",{\"id\":\"P" + id + "\",\"type\":\"percent\",\"items\":[" + item +
+              "],\"percent\":10}";
+    } else {
+      json += ",{\"id\":\"U" + id + "\",\"type\":\"unit_price\",\"items\":[" + item +
+              "],\"unit_cents\":99}";
+    }
+  }
+  return json + "]}";
+}
+
+void require(int result, const char* what) {
+  if (result != CS_SUCCESS) {
+    std::cerr << what << " failed: " << cs_last_error() << "\n";
+    std::exit(1);
+  }
+}
+
+// Nanoseconds per cart change on a cart that keeps about kCartLines lines.
+double mutation_ns(cs_catalog_t catalog, int mutations) {
+  cs_cart_t cart = nullptr;
+  require(cs_cart_new_for_catalog(catalog, &cart), "cs_cart_new_for_catalog");
+  // Distinct items, so each is its own line. A removed line's item is added back at the end.
+  std::string ids[kCartLines];
+  for (int i = 0; i < kCartLines; ++i) {
+    ids[i] = "SKU-" + std::to_string(i * 251 % kItems);
+    require(cs_cart_add_item_by_id(cart, ids[i].c_str(), 1), "cs_cart_add_item_by_id");
+  }
+  unsigned random = 1;
+  const auto start = std::chrono::steady_clock::now();
+  for (int m = 0; m < mutations; m += 3) {
+    random = random * 1664525u + 1013904223u;
+    require(cs_cart_set_line_qty(cart, static_cast<int>((random >> 8) % kCartLines),
+                                 1 + static_cast<int>((random >> 4) % 5)),
+            "cs_cart_set_line_qty");
+    require(cs_cart_remove_line(cart, 0), "cs_cart_remove_line");
+    require(cs_cart_add_item_by_id(cart, ids[m / 3 % kCartLines].c_str(), 1),
+            "cs_cart_add_item_by_id");
+  }
+  const double ns =
+      std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+  cs_cart_free(cart);
+  return ns / ((mutations + 2) / 3 * 3);
+}
+}  // namespace
+
+// Usage: CashSlothCorePricingRulesBench [mutations]
+int main(int argc, char** argv) {
+  const int mutations = argc > 1 ? std::atoi(argv[1]) : 200000;
+  if (mutations <= 0) {
+    std::cerr << "mutations must be positive.\n";
+    return 1;
+  }
+
+  require(cs_init(), "cs_init");
+  cs_catalog_t catalog = nullptr;
+  require(cs_catalog_new("pricing_bench", &catalog), "cs_catalog_new");
+  require(cs_catalog_instance_load_json(catalog, catalog_json().c_str()),
+          "cs_catalog_instance_load_json");
+
+  for (int rules : {10, 100, 1000, 5000}) {
+    const std::string json = rules_json(rules);
+    const auto start = std::chrono::steady_clock::now();
+    require(cs_catalog_set_pricing_json(catalog, json.c_str()), "cs_catalog_set_pricing_json");
+    const double compile_ms =
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start)
+            .count();
+    double best = 0;
+    for (int r = 0; r < 3; ++r) {
+      const double ns = mutation_ns(catalog, mutations);
+      best = r == 0 ? ns : std::min(best, ns);
+    }
+    std::cout << "rules=" << rules << " compile_ms=" << compile_ms << " ns_per_change=" << best
+              << "\n";
+  }
+
+  cs_catalog_free(catalog);
+  cs_shutdown();
+  return 0;
+}
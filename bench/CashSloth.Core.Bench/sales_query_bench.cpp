@@ -0,0 +1,170 @@
+#include "cashsloth_core.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+namespace {
+constexpr int kEvents = 20;
+constexpr int kRegisters = 8;
+constexpr int kOperators = 30;
+constexpr int kItems = 200;
+
+// Encoding of docs/ABI.md "Sale journal". Writing the file directly avoids a disk flush per sale
+// while generating hundreds of thousands of them.
+uint32_t crc32(uint32_t crc, const char* data, size_t size) {
+  crc = ~crc;
+  for (size_t i = 0; i < size; ++i) {
+    crc ^= static_cast<unsigned char>(data[i]);
+    for (int bit = 0; bit < 8; ++bit) {
+      crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1u)));
+    }
+  }
+  return ~crc;
+}
+
+void put_fixed(std::string& out, uint64_t value, int bytes) {
+  for (int i = 0; i < bytes; ++i) {
+    out += static_cast<char>((value >> (8 * i)) & 0xFFu);
+  }
+}
+
+void put_varint(std::string& out, uint64_t value) {
+  while (value >= 0x80) {
+    out += static_cast<char>((value & 0x7Fu) | 0x80u);
+    value >>= 7;
+  }
+  out += static_cast<char>(value);
+}
+
+void put_cents(std::string& out, long long value) {
+  put_varint(out, static_cast<uint64_t>(value) << 1);
+}
+
+void put_text(std::string& out, const std::string& text) {
+  put_varint(out, text.size());
+  out += text;
+}
+
+// Sales run through the events in order, as they would over a season.
+void write_journal(const char* path, int sales) {
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  file.write("CSJRNL01", 8);
+  uint32_t random = 1;
+  std::string payload;
+  std::string frame;
+  for (int s = 0; s < sales; ++s) {
+    payload.clear();
+    put_fixed(payload, static_cast<uint64_t>(s) + 1, 8);
+    put_varint(payload, 1700000000000ull + static_cast<uint64_t>(s) * 1000);
+    const int lines = 1 + s % 4;
+    long long subtotal = 0;
+    std::string encoded_lines;
+    for (int l = 0; l < lines; ++l) {
+      random = random * 1664525u + 1013904223u;
+      const int item = static_cast<int>((random >> 8) % kItems);
+      const int qty = 1 + static_cast<int>((random >> 4) % 3);
+      const long long unit = 100 + item * 10;
+      subtotal += unit * qty;
+      put_text(encoded_lines, "SKU-" + std::to_string(item));
+      put_text(encoded_lines, "Item " + std::to_string(item));
+      put_cents(encoded_lines, unit);
+      put_varint(encoded_lines, static_cast<uint64_t>(qty));
+      put_cents(encoded_lines, unit * qty);
+    }
+    const long long tip = s % 5 == 0 ? 100 : 0;
+    const long long given = (subtotal + tip + 999) / 1000 * 1000;
+    put_cents(payload, subtotal);
+    put_cents(payload, tip);
+    put_cents(payload, subtotal + tip);
+    put_cents(payload, given);
+    put_cents(payload, given - subtotal - tip);
+    payload += static_cast<char>(s % 50 == 0 ? 1 : 0);
+    put_text(payload, "Event " + std::to_string(s * kEvents / sales));
+    put_text(payload, "R" + std::to_string(s % kRegisters));
+    put_text(payload, "op" + std::to_string((s / 7) % kOperators));
+    put_text(payload, s % 3 == 0 ? "Card" : "Cash");
+    put_varint(payload, static_cast<uint64_t>(lines));
+    payload += encoded_lines;
+
+    frame.clear();
+    put_fixed(frame, payload.size(), 4);
+    put_fixed(frame, crc32(crc32(0, frame.data(), 4), payload.data(), payload.size()), 4);
+    frame += payload;
+    file.write(frame.data(), static_cast<std::streamsize>(frame.size()));
+  }
+}
+
+double best_query_ms(const char* filter_json, const char* group_by, int repetitions) {
+  double best = 0;
+  for (int r = 0; r < repetitions; ++r) {
+    char* json = nullptr;
+    const auto start = std::chrono::steady_clock::now();
+    if (cs_sales_query_json(filter_json, group_by, &json) != CS_SUCCESS) {
+      std::cerr << "cs_sales_query_json failed: " << cs_last_error() << "\n";
+      std::exit(1);
+    }
+    const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() -
+                                                                start)
+                          .count();
+    cs_free(json);
+    best = r == 0 ? ms : std::min(best, ms);
+  }
+  return best;
+}
+}  // namespace
+
+// Usage: CashSlothCoreSalesQueryBench [sales] [repetitions]
+int main(int argc, char** argv) {
+  const int sales = argc > 1 ? std::atoi(argv[1]) : 500000;
+  const int repetitions = argc > 2 ? std::atoi(argv[2]) : 10;
+  if (sales <= 0 || repetitions <= 0) {
+    std::cerr << "sales and repetitions must be positive.\n";
+    return 1;
+  }
+
+  const char* path = "cashsloth_sales_query_bench.bin";
+  write_journal(path, sales);
+  if (cs_init() != CS_SUCCESS) {
+    std::cerr << "cs_init failed: " << cs_last_error() << "\n";
+    return 1;
+  }
+  const auto start = std::chrono::steady_clock::now();
+  char* report = nullptr;
+  if (cs_journal_open(path, 0, &report) != CS_SUCCESS) {
+    std::cerr << "cs_journal_open failed: " << cs_last_error() << "\n";
+    return 1;
+  }
+  const double open_ms =
+      std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  std::cout << "sales=" << sales << " open_ms=" << open_ms << " report=" << report << "\n";
+  cs_free(report);
+
+  const struct {
+    const char* name;
+    const char* filter_json;
+    const char* group_by;
+  } queries[] = {
+      {"all", nullptr, nullptr},
+      {"all_by_register", "{\"include_showcase\":true}", "register"},
+      {"event", "{\"event\":\"Event 7\"}", nullptr},
+      {"event_by_operator", "{\"event\":\"Event 7\"}", "operator"},
+      {"event_register", "{\"event\":\"event 7\",\"register\":\"r3\"}", nullptr},
+      {"time_window", "{\"from_unix_ms\":1700000100000,\"to_unix_ms\":1700000200000}", nullptr},
+  };
+  for (const auto& query : queries) {
+    std::cout << "query=" << query.name
+              << " best_ms=" << best_query_ms(query.filter_json, query.group_by, repetitions)
+              << "\n";
+  }
+
+  cs_journal_close();
+  cs_shutdown();
+  std::remove(path);
+  return 0;
+}
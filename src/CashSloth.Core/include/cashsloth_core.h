@@ -1,11 +1,15 @@
 #pragma once
 
+#include <stddef.h>
+
 #if defined(_WIN32)
   #if defined(CS_BUILD_DLL)
     #define CS_API __declspec(dllexport)
   #else
     #define CS_API __declspec(dllimport)
   #endif
+#elif defined(__GNUC__)
+  #define CS_API __attribute__((visibility("default")))
 #else
   #define CS_API
 #endif
@@ -18,29 +22,189 @@ enum {
   CS_SUCCESS = 0,
   CS_ERROR_INVALID_ARGUMENT = 1,
   CS_ERROR_OUT_OF_MEMORY = 2,
+  CS_ERROR_NOT_SUPPORTED = 3,
   CS_ERROR_INTERNAL = 100
 };
 
+/* Detailed error codes: cs_last_error_code() after a failed call, and the return value of the
+   *_fast functions. Each one belongs to exactly one CS_ERROR_* code (see docs/ABI.md). */
+enum {
+  CS_ERRC_NONE = 0,
+  CS_ERRC_NULL_ARGUMENT = 1001,
+  CS_ERRC_INVALID_HANDLE = 1002,
+  CS_ERRC_UNKNOWN_ITEM = 1003,
+  CS_ERRC_UNKNOWN_CATALOG = 1004,
+  CS_ERRC_QTY_OUT_OF_RANGE = 1005,
+  CS_ERRC_LINE_INDEX_OUT_OF_RANGE = 1006,
+  CS_ERRC_AMOUNT_OUT_OF_RANGE = 1007,
+  CS_ERRC_OVERFLOW = 1008,
+  CS_ERRC_INVALID_VALUE = 1009,
+  CS_ERRC_INVALID_CATALOG = 1010,
+  CS_ERRC_NAME_IN_USE = 1011,
+  CS_ERRC_INVALID_STATE = 1012,
+  CS_ERRC_IO = 1013,
+  CS_ERRC_OUT_OF_MEMORY = 1014,
+  CS_ERRC_NOT_SUPPORTED = 1015,
+  CS_ERRC_INTERNAL = 1016,
+  CS_ERRC_OUT_OF_STOCK = 1017
+};
+
 typedef void* cs_cart_t;
+typedef void* cs_catalog_t;
+typedef void* cs_load_ticket_t;
+typedef void* cs_display_t;
+
+enum {
+  CS_LOAD_PENDING = 0,
+  CS_LOAD_RUNNING = 1,
+  CS_LOAD_SUCCEEDED = 2,
+  CS_LOAD_FAILED = 3,
+  CS_LOAD_CANCELLED = 4
+};
+
+enum {
+  CS_REPRICE_KEEP_VANISHED = 0,
+  CS_REPRICE_REMOVE_VANISHED = 1
+};
+
+typedef void (*cs_catalog_load_callback)(cs_load_ticket_t ticket, int state, void* user_data);
 
+typedef struct cs_allocator {
+  void* (*allocate)(void* user_data, size_t size, size_t alignment);
+  void (*deallocate)(void* user_data, void* ptr, size_t size, size_t alignment);
+  void* user_data;
+} cs_allocator;
+
+/* Sale details stored by cs_cart_commit_sale. Set struct_size to sizeof(cs_sale_meta); later
+   versions only append fields. Null strings are stored as empty. */
+typedef struct cs_sale_meta {
+  unsigned int struct_size;
+  const char* event_name;
+  const char* register_name;
+  const char* operator_username;
+  /* "Cash" (any case) sales must have given_cents cover the total and tip; others need not. */
+  const char* payment_method;
+  long long tip_cents;
+  /* Milliseconds since the Unix epoch; 0 stores the commit time. */
+  long long completed_unix_ms;
+  int is_showcase;
+} cs_sale_meta;
+
+CS_API int cs_set_allocator(const cs_allocator* allocator);
 CS_API int cs_init();
 CS_API void cs_shutdown();
 CS_API const char* cs_last_error();
+CS_API int cs_last_error_code();
 CS_API void cs_free(void* p);
 CS_API int cs_get_version(char** out_json);
 CS_API int cs_catalog_load_json(const char* json);
 CS_API int cs_catalog_get_json(char** out_json);
+CS_API int cs_catalog_set_load_threads(int threads);
+CS_API int cs_catalog_load_json_async(cs_catalog_t catalog, const char* json,
+                                      cs_catalog_load_callback callback, void* user_data,
+                                      cs_load_ticket_t* out_ticket);
+CS_API int cs_catalog_load_file_async(cs_catalog_t catalog, const char* path,
+                                      cs_catalog_load_callback callback, void* user_data,
+                                      cs_load_ticket_t* out_ticket);
+CS_API int cs_load_ticket_poll(cs_load_ticket_t ticket, int* out_state);
+CS_API int cs_load_ticket_wait(cs_load_ticket_t ticket, int timeout_ms, int* out_state);
+CS_API int cs_load_ticket_cancel(cs_load_ticket_t ticket);
+CS_API int cs_load_ticket_free(cs_load_ticket_t ticket);
+
+CS_API int cs_catalog_new(const char* name, cs_catalog_t* out_catalog);
+CS_API int cs_catalog_free(cs_catalog_t catalog);
+CS_API int cs_catalog_get_default(cs_catalog_t* out_catalog);
+CS_API int cs_catalog_find(const char* name, cs_catalog_t* out_catalog);
+CS_API int cs_catalog_instance_load_json(cs_catalog_t catalog, const char* json);
+CS_API int cs_catalog_instance_get_json(cs_catalog_t catalog, char** out_json);
+CS_API int cs_catalog_set_display_locale(cs_catalog_t catalog, const char* locale);
+CS_API int cs_catalog_get_generation(cs_catalog_t catalog, unsigned long long* out_generation);
 
 CS_API int cs_cart_new(cs_cart_t* out_cart);
+CS_API int cs_cart_new_for_catalog(cs_catalog_t catalog, cs_cart_t* out_cart);
+/* A cart that may be used from several threads at once; see docs/ABI.md. */
+CS_API int cs_cart_new_concurrent(cs_catalog_t catalog, cs_cart_t* out_cart);
+CS_API int cs_cart_bind_catalog(cs_cart_t cart, cs_catalog_t catalog);
+CS_API int cs_cart_set_display_locale(cs_cart_t cart, const char* locale);
 CS_API int cs_cart_free(cs_cart_t cart);
 CS_API int cs_cart_clear(cs_cart_t cart);
 CS_API int cs_cart_add_item_by_id(cs_cart_t cart, const char* item_id, int qty);
 CS_API int cs_cart_remove_line(cs_cart_t cart, int line_index);
+CS_API int cs_cart_set_line_qty(cs_cart_t cart, int line_index, int qty);
+CS_API int cs_cart_reprice(cs_cart_t cart, int policy, char** out_report_json);
 CS_API int cs_cart_get_total_cents(cs_cart_t cart, long long* out_total_cents);
 CS_API int cs_cart_get_lines_json(cs_cart_t cart, char** out_json);
 CS_API int cs_payment_set_given_cents(cs_cart_t cart, long long given_cents);
 CS_API int cs_payment_get_change_cents(cs_cart_t cart, long long* out_change_cents);
 CS_API int cs_payment_get_given_cents(cs_cart_t cart, long long* out_given_cents);
+/* Cash drawer: one per process, with live counts per denomination. See docs/ABI.md. */
+CS_API int cs_drawer_set_json(const char* drawer_json);
+CS_API int cs_drawer_get_json(char** out_json);
+CS_API int cs_payment_get_change_breakdown(cs_cart_t cart, char** out_json);
+/* Undo history and cart copies; see docs/ABI.md. */
+CS_API int cs_cart_checkpoint(cs_cart_t cart);
+CS_API int cs_cart_undo(cs_cart_t cart);
+CS_API int cs_cart_redo(cs_cart_t cart);
+CS_API int cs_cart_clone(cs_cart_t cart, cs_cart_t* out_cart);
+
+/* Hot-path variants: return a CS_ERRC_* code and leave the thread's last error untouched on
+   success. */
+CS_API int cs_cart_clear_fast(cs_cart_t cart);
+CS_API int cs_cart_add_item_by_id_fast(cs_cart_t cart, const char* item_id, int qty);
+CS_API int cs_cart_remove_line_fast(cs_cart_t cart, int line_index);
+CS_API int cs_cart_set_line_qty_fast(cs_cart_t cart, int line_index, int qty);
+CS_API int cs_cart_get_total_cents_fast(cs_cart_t cart, long long* out_total_cents);
+CS_API int cs_payment_set_given_cents_fast(cs_cart_t cart, long long given_cents);
+CS_API int cs_payment_get_change_cents_fast(cs_cart_t cart, long long* out_change_cents);
+CS_API int cs_payment_get_given_cents_fast(cs_cart_t cart, long long* out_given_cents);
+
+/* Durable sale journal: one open journal per process; commits block until their record is on
+   disk. See docs/ABI.md. */
+CS_API int cs_journal_open(const char* path, int max_commit_delay_ms, char** out_report_json);
+CS_API int cs_journal_close();
+CS_API int cs_journal_read_json(const char* path, unsigned long long from_sequence, int max_sales,
+                                char** out_json);
+CS_API int cs_cart_commit_sale(cs_cart_t cart, const cs_sale_meta* meta,
+                               unsigned long long* out_sequence);
+CS_API int cs_sales_query_json(const char* filter_json, const char* group_by, char** out_json);
+CS_API int cs_live_metrics_json(long long now_unix_ms, int top_n, char** out_json);
+
+/* Persistent carts: lines and payment live in a memory-mapped state file that survives a crash
+   of the process. See docs/ABI.md. */
+CS_API int cs_cart_persist(cs_cart_t cart, const char* path);
+CS_API int cs_cart_recover(cs_catalog_t catalog, const char* path, cs_cart_t* out_cart);
+CS_API int cs_cart_flush(cs_cart_t cart);
+
+/* Published carts: a read-only copy of the lines JSON that display readers, also in other
+   processes, read without blocking the cart. See docs/ABI.md. */
+CS_API int cs_cart_publish(cs_cart_t cart, const char* shared_name, int capacity_bytes,
+                           cs_display_t* out_display);
+CS_API int cs_display_open(const char* shared_name, cs_display_t* out_display);
+CS_API int cs_display_get_version(cs_display_t display, unsigned long long* out_version);
+CS_API int cs_display_read(cs_display_t display, char* buffer, int buffer_size, int* out_size,
+                           unsigned long long* out_version);
+CS_API int cs_display_close(cs_display_t display);
+
+/* Pricing rules: percent and fixed-price discounts, multi-buys and bundles, optionally gated by
+   a code or a weekly time window. Carts pick up new rules on reprice or rebind; the context sets
+   a cart's codes and its local time (0 = system clock). See docs/ABI.md. */
+CS_API int cs_catalog_set_pricing_json(cs_catalog_t catalog, const char* rules_json);
+CS_API int cs_cart_set_pricing_context(cs_cart_t cart, const char* codes, long long local_time_ms);
+
+/* Stock ledger: per-item available counts that carts reserve from as lines are added and sell
+   on commit, so no two carts sell the same last unit. Items it does not list are not limited.
+   See docs/ABI.md. */
+CS_API int cs_catalog_set_stock_json(cs_catalog_t catalog, const char* stock_json);
+CS_API int cs_stock_snapshot_json(cs_catalog_t catalog, char** out_json);
+
+CS_API int cs_debug_get_allocation_count(unsigned long long* out_count);
+CS_API int cs_stats_get_json(char** out_json);
+CS_API int cs_stats_reset();
+CS_API int cs_trace_set_enabled(int enabled);
+CS_API int cs_trace_dump(const char* path);
+CS_API int cs_memory_usage_json(char** out_json);
+CS_API int cs_record_start(const char* path);
+CS_API int cs_record_stop();
 
 #ifdef __cplusplus
 }
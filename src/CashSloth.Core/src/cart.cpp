@@ -0,0 +1,513 @@
+#include "cart.h"
+
+#include <algorithm>
+#include <new>
+
+#include "errors.h"
+
+namespace cashsloth {
+
+CartPool::~CartPool() {
+  for (auto& entry : slabs_) {
+    Slab* slab = entry.load(std::memory_order_relaxed);
+    if (slab) {
+      std::pmr::memory_resource* resource = slab->resource;
+      slab->~Slab();
+      resource->deallocate(slab, sizeof(Slab), alignof(Slab));
+    }
+  }
+}
+
+Cart* CartPool::acquire(CatalogPtr catalog, bool concurrent, cs_cart_t* out_handle) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (free_.empty() && !grow()) {
+    return nullptr;
+  }
+  const uint32_t index = free_.back();
+  free_.pop_back();
+  Slot& slot = slot_at(index);
+  slot.cart.reset(std::move(catalog));
+  slot.concurrent.store(concurrent, std::memory_order_release);
+  open_carts_.fetch_add(1, std::memory_order_relaxed);
+  const uint32_t generation = slot.tag.load(std::memory_order_relaxed) >> 1;
+  slot.tag.store((generation << 1) | 1u, std::memory_order_release);
+  *out_handle = reinterpret_cast<cs_cart_t>(
+      (static_cast<uintptr_t>(generation) << kIndexBits) | (static_cast<uintptr_t>(index) + 1));
+  return &slot.cart;
+}
+
+bool CartPool::release(cs_cart_t handle) {
+  // A concurrent cart stays locked while it is released, so calls in flight finish first.
+  std::unique_lock<std::mutex> cart_lock;
+  if (!lock(handle, &cart_lock)) {
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  Slot* slot = live_slot(handle);
+  if (!slot) {
+    return false;
+  }
+  const uint32_t generation = ((slot->tag.load(std::memory_order_relaxed) >> 1) + 1) &
+                              kGenerationMask;
+  slot->tag.store(generation << 1, std::memory_order_release);
+  slot->cart.release();
+  open_carts_.fetch_sub(1, std::memory_order_relaxed);
+  // A wrapped generation would make the slot's first handles live again, so the slot is retired.
+  if (generation != 0) {
+    const uintptr_t index_plus_one = reinterpret_cast<uintptr_t>(handle) & kIndexMask;
+    free_.push_back(static_cast<uint32_t>(index_plus_one - 1));
+  }
+  return true;
+}
+
+bool CartPool::grow() {
+  if (slab_count_ == kMaxSlabs) {
+    return false;
+  }
+  // Reserve first so a failure here leaves no slab behind.
+  free_.reserve(free_.size() + kSlabSize);
+  std::pmr::memory_resource* resource = core_resource(MemoryCategory::kCarts);
+  void* memory = resource->allocate(sizeof(Slab), alignof(Slab));
+  Slab* slab = nullptr;
+  try {
+    slab = new (memory) Slab(resource);
+  } catch (...) {
+    resource->deallocate(memory, sizeof(Slab), alignof(Slab));
+    throw;
+  }
+  const uint32_t base = static_cast<uint32_t>(slab_count_ * kSlabSize);
+  for (size_t i = kSlabSize; i > 0; --i) {
+    free_.push_back(base + static_cast<uint32_t>(i - 1));
+  }
+  slabs_[slab_count_++].store(slab, std::memory_order_release);
+  return true;
+}
+
+int new_cart(CatalogPtr catalog, bool concurrent, cs_cart_t* out_cart) {
+  if (!cart_pool().acquire(std::move(catalog), concurrent, out_cart)) {
+    set_last_error(CS_ERRC_OUT_OF_MEMORY, "Cart pool exhausted.");
+    return CS_ERROR_OUT_OF_MEMORY;
+  }
+  clear_last_error();
+  return CS_SUCCESS;
+}
+
+bool compute_total_cents(const Cart& cart, long long* out_total_cents) {
+  long long total = 0;
+  for (const auto& line : cart.lines) {
+    if (!line_total_fits(line.unit_cents, line.qty)) {
+      return false;
+    }
+    const long long line_total_cents = line.unit_cents * static_cast<long long>(line.qty);
+    if (total > kMaxCents - line_total_cents) {
+      return false;
+    }
+    total += line_total_cents;
+  }
+  const long long discount = cart.pricing.discount_cents(cart);
+  if (cart.tax.enabled() && !cart.snapshot->prices_include_tax) {
+    long long gross = 0;
+    bool fits = true;
+    fits = cart.tax.for_each_class(cart, [&gross, &fits](const TaxTotal& total) {
+      fits = fits && gross <= kMaxCents - total.gross_cents;
+      gross += fits ? total.gross_cents : 0;
+    }) && fits;
+    if (!fits) {
+      return false;
+    }
+    *out_total_cents = gross;
+    return true;
+  }
+  *out_total_cents = total > discount ? total - discount : 0;
+  return true;
+}
+
+int cart_clear(cs_cart_t cart) {
+  CartAccess access(cart);
+  Cart* cart_ptr = access.get();
+  if (!cart_ptr) {
+    set_last_error(CS_ERRC_INVALID_HANDLE, invalid_cart_message(cart));
+    return CS_ERRC_INVALID_HANDLE;
+  }
+
+  if (cart_ptr->recording()) {
+    // The cleared lines' ids stay in the arena for undo.
+    cart_ptr->record_clear();
+    cart_ptr->lines.clear();
+  } else {
+    cart_ptr->clear_lines();
+  }
+  cart_ptr->given_cents = 0;
+  cart_ptr->pricing.cleared();
+  cart_ptr->tax.cleared();
+  cart_ptr->stock.release_all();
+  cart_ptr->state_file.rewrite(*cart_ptr);
+  cart_ptr->display.publish(*cart_ptr);
+  return CS_ERRC_NONE;
+}
+
+int cart_add_item_by_id(cs_cart_t cart, const char* item_id, int qty) {
+  CartAccess access(cart);
+  Cart* cart_ptr = access.get();
+  if (!cart_ptr) {
+    set_last_error(CS_ERRC_INVALID_HANDLE, invalid_cart_message(cart));
+    return CS_ERRC_INVALID_HANDLE;
+  }
+  if (!item_id || item_id[0] == '\0') {
+    set_last_error(CS_ERRC_NULL_ARGUMENT, "item_id must not be null or empty.");
+    return CS_ERRC_NULL_ARGUMENT;
+  }
+  if (qty <= 0) {
+    set_last_error(CS_ERRC_QTY_OUT_OF_RANGE, "qty must be greater than zero.");
+    return CS_ERRC_QTY_OUT_OF_RANGE;
+  }
+
+  const std::string_view item_id_view(item_id);
+  const CatalogSnapshot& snapshot = cart_ptr->refresh_snapshot();
+  const uint32_t item_index = snapshot.position_of(item_id_view);
+  if (item_index == kNoItem) {
+    set_last_error(CS_ERRC_UNKNOWN_ITEM, "Unknown item_id: ", item_id_view);
+    return CS_ERRC_UNKNOWN_ITEM;
+  }
+  const CatalogItem& item = snapshot.items[item_index];
+  cart_ptr->stock.follow(*cart_ptr);
+
+  auto& lines = cart_ptr->lines;
+  for (size_t i = 0; i < lines.size(); ++i) {
+    CartLine& line = lines[i];
+    if (line.item_index == item_index) {
+      if (line.qty > std::numeric_limits<int>::max() - qty ||
+          !line_total_fits(line.unit_cents, line.qty + qty)) {
+        set_last_error(CS_ERRC_OVERFLOW, "qty would overflow the line: ", item_id_view);
+        return CS_ERRC_OVERFLOW;
+      }
+      const int stock = cart_ptr->stock.change(item_id_view, qty);
+      if (stock != CS_ERRC_NONE) {
+        return stock;
+      }
+      if (cart_ptr->recording()) {
+        CartLine after = line;
+        after.qty += qty;
+        try {
+          cart_ptr->record_line(CartChange::kSetLine, i, line, after);
+        } catch (...) {
+          cart_ptr->stock.change(item_id_view, -qty);
+          throw;
+        }
+      }
+      line.qty += qty;
+      cart_ptr->pricing.item_changed(*cart_ptr, item_id_view, item_index);
+      cart_ptr->tax.line_changed(*cart_ptr, line, qty, 0);
+      cart_ptr->state_file.qty_changed(*cart_ptr, i);
+      cart_ptr->display.publish(*cart_ptr);
+      return CS_ERRC_NONE;
+    }
+  }
+
+  if (!line_total_fits(item.unit_cents, qty)) {
+    set_last_error(CS_ERRC_OVERFLOW, "qty would overflow the line: ", item_id_view);
+    return CS_ERRC_OVERFLOW;
+  }
+  const int stock = cart_ptr->stock.change(item_id_view, qty);
+  if (stock != CS_ERRC_NONE) {
+    return stock;
+  }
+  CartLine added;
+  try {
+    added = CartLine{cart_ptr->store_id(item_id_view), item_index, qty, item.unit_cents};
+    if (cart_ptr->recording()) {
+      cart_ptr->record_line(CartChange::kInsertLine, lines.size(), CartLine(), added);
+    }
+    lines.push_back(added);
+  } catch (...) {
+    cart_ptr->stock.change(item_id_view, -qty);
+    throw;
+  }
+  cart_ptr->pricing.item_changed(*cart_ptr, item_id_view, item_index);
+  cart_ptr->tax.line_changed(*cart_ptr, added, qty, 1);
+  cart_ptr->state_file.line_added(*cart_ptr);
+  cart_ptr->display.publish(*cart_ptr);
+  return CS_ERRC_NONE;
+}
+
+int cart_remove_line(cs_cart_t cart, int line_index) {
+  CartAccess access(cart);
+  Cart* cart_ptr = access.get();
+  if (!cart_ptr) {
+    set_last_error(CS_ERRC_INVALID_HANDLE, invalid_cart_message(cart));
+    return CS_ERRC_INVALID_HANDLE;
+  }
+  if (line_index < 0 || static_cast<size_t>(line_index) >= cart_ptr->lines.size()) {
+    set_last_error(CS_ERRC_LINE_INDEX_OUT_OF_RANGE, "line_index out of range.");
+    return CS_ERRC_LINE_INDEX_OUT_OF_RANGE;
+  }
+
+  // The removed line's id stays in the arena until the next id is stored.
+  const CartLine removed = cart_ptr->lines[static_cast<size_t>(line_index)];
+  cart_ptr->stock.follow(*cart_ptr);
+  if (cart_ptr->recording()) {
+    cart_ptr->record_line(CartChange::kEraseLine, static_cast<size_t>(line_index), removed,
+                          CartLine());
+  }
+  cart_ptr->lines.erase(cart_ptr->lines.begin() + line_index);
+  cart_ptr->stock.change(cart_ptr->id_of(removed), -static_cast<long long>(removed.qty));
+  cart_ptr->pricing.item_changed(*cart_ptr, cart_ptr->id_of(removed), removed.item_index);
+  cart_ptr->tax.line_changed(*cart_ptr, removed, -static_cast<long long>(removed.qty), -1);
+  cart_ptr->state_file.line_removed(*cart_ptr, static_cast<size_t>(line_index));
+  cart_ptr->display.publish(*cart_ptr);
+  return CS_ERRC_NONE;
+}
+
+int cart_set_line_qty(cs_cart_t cart, int line_index, int qty) {
+  CartAccess access(cart);
+  Cart* cart_ptr = access.get();
+  if (!cart_ptr) {
+    set_last_error(CS_ERRC_INVALID_HANDLE, invalid_cart_message(cart));
+    return CS_ERRC_INVALID_HANDLE;
+  }
+  if (line_index < 0 || static_cast<size_t>(line_index) >= cart_ptr->lines.size()) {
+    set_last_error(CS_ERRC_LINE_INDEX_OUT_OF_RANGE, "line_index out of range.");
+    return CS_ERRC_LINE_INDEX_OUT_OF_RANGE;
+  }
+  if (qty <= 0) {
+    set_last_error(CS_ERRC_QTY_OUT_OF_RANGE, "qty must be greater than zero.");
+    return CS_ERRC_QTY_OUT_OF_RANGE;
+  }
+
+  CartLine& line = cart_ptr->lines[static_cast<size_t>(line_index)];
+  if (!line_total_fits(line.unit_cents, qty)) {
+    set_last_error(CS_ERRC_OVERFLOW, "qty would overflow the line total.");
+    return CS_ERRC_OVERFLOW;
+  }
+  // More units are reserved before the change and fewer returned after it.
+  cart_ptr->stock.follow(*cart_ptr);
+  const long long qty_delta = static_cast<long long>(qty) - line.qty;
+  const int stock = qty_delta > 0 ? cart_ptr->stock.change(cart_ptr->id_of(line), qty_delta)
+                                  : CS_ERRC_NONE;
+  if (stock != CS_ERRC_NONE) {
+    return stock;
+  }
+  if (cart_ptr->recording()) {
+    CartLine after = line;
+    after.qty = qty;
+    try {
+      cart_ptr->record_line(CartChange::kSetLine, static_cast<size_t>(line_index), line, after);
+    } catch (...) {
+      cart_ptr->stock.change(cart_ptr->id_of(line), qty_delta > 0 ? -qty_delta : 0);
+      throw;
+    }
+  }
+  const int previous_qty = line.qty;
+  line.qty = qty;
+  if (qty_delta < 0) {
+    cart_ptr->stock.change(cart_ptr->id_of(line), qty_delta);
+  }
+  cart_ptr->pricing.item_changed(*cart_ptr, cart_ptr->id_of(line), line.item_index);
+  cart_ptr->tax.line_changed(*cart_ptr, line, static_cast<long long>(qty) - previous_qty, 0);
+  cart_ptr->state_file.qty_changed(*cart_ptr, static_cast<size_t>(line_index));
+  cart_ptr->display.publish(*cart_ptr);
+  return CS_ERRC_NONE;
+}
+
+int cart_get_total_cents(cs_cart_t cart, long long* out_total_cents) {
+  CartAccess access(cart);
+  Cart* cart_ptr = access.get();
+  if (!cart_ptr) {
+    set_last_error(CS_ERRC_INVALID_HANDLE, invalid_cart_message(cart));
+    return CS_ERRC_INVALID_HANDLE;
+  }
+  if (!out_total_cents) {
+    set_last_error(CS_ERRC_NULL_ARGUMENT, "out_total_cents must not be null.");
+    return CS_ERRC_NULL_ARGUMENT;
+  }
+  if (!compute_total_cents(*cart_ptr, out_total_cents)) {
+    set_last_error(CS_ERRC_OVERFLOW, "Cart total overflows.");
+    return CS_ERRC_OVERFLOW;
+  }
+  return CS_ERRC_NONE;
+}
+
+int payment_set_given_cents(cs_cart_t cart, long long given_cents) {
+  CartAccess access(cart);
+  Cart* cart_ptr = access.get();
+  if (!cart_ptr) {
+    set_last_error(CS_ERRC_INVALID_HANDLE, invalid_cart_message(cart));
+    return CS_ERRC_INVALID_HANDLE;
+  }
+  if (given_cents < 0) {
+    set_last_error(CS_ERRC_AMOUNT_OUT_OF_RANGE, "given_cents must be non-negative.");
+    return CS_ERRC_AMOUNT_OUT_OF_RANGE;
+  }
+
+  if (cart_ptr->recording()) {
+    cart_ptr->record_given(given_cents);
+  }
+  cart_ptr->given_cents = given_cents;
+  cart_ptr->state_file.given_changed(*cart_ptr);
+  cart_ptr->display.publish(*cart_ptr);
+  return CS_ERRC_NONE;
+}
+
+int payment_get_change_cents(cs_cart_t cart, long long* out_change_cents) {
+  CartAccess access(cart);
+  Cart* cart_ptr = access.get();
+  if (!cart_ptr) {
+    set_last_error(CS_ERRC_INVALID_HANDLE, invalid_cart_message(cart));
+    return CS_ERRC_INVALID_HANDLE;
+  }
+  if (!out_change_cents) {
+    set_last_error(CS_ERRC_NULL_ARGUMENT, "out_change_cents must not be null.");
+    return CS_ERRC_NULL_ARGUMENT;
+  }
+
+  long long total = 0;
+  if (!compute_total_cents(*cart_ptr, &total)) {
+    set_last_error(CS_ERRC_OVERFLOW, "Cart total overflows.");
+    return CS_ERRC_OVERFLOW;
+  }
+  // Both amounts are non-negative, so the difference cannot overflow.
+  *out_change_cents = cart_ptr->given_cents - total;
+  return CS_ERRC_NONE;
+}
+
+int payment_get_given_cents(cs_cart_t cart, long long* out_given_cents) {
+  CartAccess access(cart);
+  Cart* cart_ptr = access.get();
+  if (!cart_ptr) {
+    set_last_error(CS_ERRC_INVALID_HANDLE, invalid_cart_message(cart));
+    return CS_ERRC_INVALID_HANDLE;
+  }
+  if (!out_given_cents) {
+    set_last_error(CS_ERRC_NULL_ARGUMENT, "out_given_cents must not be null.");
+    return CS_ERRC_NULL_ARGUMENT;
+  }
+
+  *out_given_cents = cart_ptr->given_cents;
+  return CS_ERRC_NONE;
+}
+
+int step_history(cs_cart_t cart, bool forward) {
+  CartAccess access(cart);
+  Cart* cart_ptr = access.get();
+  if (!cart_ptr) {
+    set_last_error(CS_ERRC_INVALID_HANDLE, invalid_cart_message(cart));
+    return CS_ERRC_INVALID_HANDLE;
+  }
+
+  cart_ptr->refresh_snapshot();
+  cart_ptr->stock.follow(*cart_ptr);
+  const bool open_step = cart_ptr->recording() &&
+                         cart_ptr->undo_log.back().kind == CartChange::kCheckpoint;
+  if (!(forward ? cart_ptr->redo() : cart_ptr->undo())) {
+    set_last_error(CS_ERRC_INVALID_STATE, forward ? "Nothing to redo." : "Nothing to undo.");
+    return CS_ERRC_INVALID_STATE;
+  }
+  // A step that needs more stock than is left is taken back. Lines and history end up as they
+  // were, including a checkpoint that had no changes after it yet.
+  auto take_back = [cart_ptr, forward, open_step] {
+    if (forward) {
+      cart_ptr->undo();
+    } else {
+      cart_ptr->redo();
+      if (open_step) {
+        cart_ptr->checkpoint();
+      }
+    }
+  };
+  int stock = CS_ERRC_NONE;
+  try {
+    stock = cart_ptr->stock.sync(*cart_ptr);
+  } catch (...) {
+    take_back();
+    throw;
+  }
+  if (stock != CS_ERRC_NONE) {
+    take_back();
+    return stock;
+  }
+  cart_ptr->pricing.refresh(*cart_ptr);
+  cart_ptr->tax.recount(*cart_ptr);
+  cart_ptr->state_file.rewrite(*cart_ptr);
+  cart_ptr->display.publish(*cart_ptr);
+  return CS_ERRC_NONE;
+}
+
+bool append_lines_json(const Cart& cart, std::pmr::string& json) {
+  long long total = 0;
+  if (!compute_total_cents(cart, &total)) {
+    return false;
+  }
+  const CatalogSnapshot& snapshot = *cart.snapshot;
+  const size_t column = cart.name_column();
+  const long long given_cents = cart.given_cents;
+  std::pmr::vector<LineDiscount> discounts(json.get_allocator().resource());
+  cart.pricing.line_discounts(cart, &discounts);
+  size_t next_discount = 0;
+  long long subtotal = 0;
+  json += "{\"lines\":[";
+  for (size_t i = 0; i < cart.lines.size(); ++i) {
+    const auto& line = cart.lines[i];
+    const long long line_total_cents = line.unit_cents * static_cast<long long>(line.qty);
+    const CatalogItem* item = cart.item_of(line);
+    if (i > 0) {
+      json += ",";
+    }
+    json += "{\"id\":\"";
+    append_json_escaped(json, cart.id_of(line));
+    json += "\",\"name\":\"";
+    if (item) {
+      append_json_escaped(json, snapshot.name_of(line.item_index, column));
+    }
+    json += "\",\"unit_cents\":";
+    append_integer(json, line.unit_cents);
+    json += ",\"qty\":";
+    append_integer(json, line.qty);
+    json += ",\"line_total_cents\":";
+    append_integer(json, line_total_cents);
+    subtotal += line_total_cents;
+    if (next_discount < discounts.size() && discounts[next_discount].line == i) {
+      json += ",\"discounts\":[";
+      for (bool first = true;
+           next_discount < discounts.size() && discounts[next_discount].line == i;
+           ++next_discount, first = false) {
+        json += first ? "{\"rule\":\"" : ",{\"rule\":\"";
+        append_json_escaped(json, cart.pricing.rule_id(discounts[next_discount].rule));
+        json += "\",\"cents\":";
+        append_integer(json, discounts[next_discount].cents);
+        json += "}";
+      }
+      json += "]";
+    }
+    json += "}";
+  }
+  json += "]";
+  const long long discount = std::min(subtotal, cart.pricing.discount_cents(cart));
+  if (discount > 0) {
+    json += ",\"discount_cents\":";
+    append_integer(json, discount);
+  }
+  json += ",\"total_cents\":";
+  append_integer(json, total);
+  json += ",\"given_cents\":";
+  append_integer(json, given_cents);
+  const long long change_cents =
+      given_cents > total ? given_cents - total : 0;
+  json += ",\"change_cents\":";
+  append_integer(json, change_cents);
+  if (cart.tax.enabled()) {
+    json += ",\"taxes\":[";
+    bool first = true;
+    const bool taxes_ok = cart.tax.for_each_class(cart, [&](const TaxTotal& tax) {
+      append_tax_total_json(json, snapshot, tax, first);
+      first = false;
+    });
+    if (!taxes_ok) {
+      return false;
+    }
+    json += "]";
+  }
+  json += "}";
+  return true;
+}
+
+}  // namespace cashsloth
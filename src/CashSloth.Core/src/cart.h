@@ -0,0 +1,559 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory_resource>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "cart_state_file.h"
+#include "cashsloth_core.h"
+#include "catalog.h"
+#include "display_region.h"
+#include "encoding.h"
+#include "memory.h"
+#include "money.h"
+#include "pricing.h"
+#include "stock_ledger.h"
+#include "tax.h"
+
+namespace cashsloth {
+
+// Checkpoints a cart's undo history keeps; checkpointing more drops the oldest step.
+constexpr size_t kMaxUndoSteps = 64;
+
+// Trivially copyable so removing or compacting lines never allocates. The id lives in the owning
+// cart's id arena.
+struct CartLine {
+  StringRef item_id;
+  uint32_t item_index = kNoItem;
+  int qty = 0;
+  long long unit_cents = 0;
+};
+
+// One recorded change to a cart's lines or given amount, enough to revert or reapply it. A
+// kCheckpoint entry starts each undo step.
+struct CartChange {
+  enum Kind : unsigned char { kCheckpoint, kInsertLine, kEraseLine, kSetLine, kSetGiven };
+
+  Kind kind = kCheckpoint;
+  uint32_t index = 0;
+  CartLine before;
+  CartLine after;
+  long long given_before = 0;
+  long long given_after = 0;
+};
+
+class Cart {
+ public:
+  // Pool slots construct their carts when a slab is created, from the then-current resource.
+  Cart()
+      : lines(core_resource(MemoryCategory::kLines)),
+        line_ids(lines.get_allocator().resource()),
+        display_locale(lines.get_allocator().resource()),
+        undo_log(lines.get_allocator().resource()),
+        redo_log(lines.get_allocator().resource()),
+        spare_ids_(lines.get_allocator().resource()) {}
+
+  // Prepares a pooled cart for a new sale. Line storage keeps its capacity from earlier sales.
+  void reset(CatalogPtr bound_catalog) {
+    lines.clear();
+    line_ids.clear();
+    given_cents = 0;
+    display_locale.clear();
+    catalog = std::move(bound_catalog);
+    snapshot = catalog->acquire();
+    pricing.pin(catalog->acquire_pricing());
+    tax.recount(*this);
+    stock.drop();
+  }
+
+  // Drops catalog references when the cart returns to the pool so old snapshots can be freed.
+  void release() {
+    display.close();
+    state_file.close();
+    pricing.release();
+    stock.drop();
+    drop_history();
+    lines.clear();
+    line_ids.clear();
+    catalog.reset();
+    snapshot.reset();
+  }
+
+  // Re-pins the cart to the catalog's latest generation. The steady state is a single atomic
+  // load; the catalog mutex is only touched after a reload.
+  const CatalogSnapshot& refresh_snapshot() {
+    if (snapshot->generation != catalog->generation.load(std::memory_order_acquire)) {
+      migrate_lines(catalog->acquire());
+    }
+    return *snapshot;
+  }
+
+  void bind(CatalogPtr new_catalog) {
+    catalog = std::move(new_catalog);
+    pricing.pin(catalog->acquire_pricing());
+    migrate_lines(catalog->acquire());
+  }
+
+  // Re-points line item positions at `next`. Uses the snapshot's remap table when the cart is
+  // exactly one generation behind and falls back to id lookups otherwise (rebinds, carts that
+  // skipped a generation, or lines whose item had vanished).
+  void migrate_lines(SnapshotPtr next) {
+    const std::pmr::vector<uint32_t>* remap = next->remap_from(*snapshot);
+    for (auto& line : lines) {
+      if (remap && line.item_index != kNoItem) {
+        line.item_index = (*remap)[line.item_index];
+      } else {
+        line.item_index = next->position_of(id_of(line));
+      }
+    }
+    snapshot = std::move(next);
+    // Categories and tax classes may have changed with the generation.
+    pricing.refresh(*this);
+    tax.recount(*this);
+  }
+
+  std::string_view id_of(const CartLine& line) const {
+    return std::string_view(line_ids.data() + line.item_id.offset, line.item_id.length);
+  }
+
+  // Copies `item_id` into the id arena. Ids of removed lines and dropped history steps stay
+  // behind as garbage until the arena would have to grow; compacting first keeps a warm cart
+  // from reallocating.
+  StringRef store_id(std::string_view item_id) {
+    if (line_ids.size() + item_id.size() > line_ids.capacity()) {
+      if (recording()) {
+        compact_recorded_ids();
+      } else {
+        compact_ids();
+      }
+    }
+    StringRef ref;
+    ref.offset = static_cast<uint32_t>(line_ids.size());
+    ref.length = static_cast<uint32_t>(item_id.size());
+    line_ids.append(item_id.data(), item_id.size());
+    return ref;
+  }
+
+  void clear_lines() {
+    lines.clear();
+    line_ids.clear();
+  }
+
+  // Undo history (cs_cart_checkpoint). Changes are recorded, before they are made, only while a
+  // checkpoint exists; recording one discards the redo steps. Recorded lines keep their ids in
+  // the arena. At most kMaxUndoSteps checkpoints are kept, so a cart that checkpoints every tap
+  // reuses the same history storage.
+  bool recording() const { return undo_log.size() > undo_head_; }
+
+  void checkpoint() {
+    if (!recording() || undo_log.back().kind != CartChange::kCheckpoint) {
+      if (undo_steps_ == kMaxUndoSteps) {
+        drop_oldest_step();
+      }
+      undo_log.push_back(CartChange());
+      ++undo_steps_;
+    }
+  }
+
+  // Makes room for `count` more recorded changes, so recording them cannot fail halfway.
+  void reserve_changes(size_t count) { undo_log.reserve(undo_log.size() + count); }
+
+  void record_line(CartChange::Kind kind, size_t index, const CartLine& before,
+                   const CartLine& after) {
+    CartChange change;
+    change.kind = kind;
+    change.index = static_cast<uint32_t>(index);
+    change.before = before;
+    change.after = after;
+    undo_log.push_back(change);
+    redo_log.clear();
+  }
+
+  void record_given(long long given_after) {
+    CartChange change;
+    change.kind = CartChange::kSetGiven;
+    change.given_before = given_cents;
+    change.given_after = given_after;
+    undo_log.push_back(change);
+    redo_log.clear();
+  }
+
+  // Records clearing the cart as erasing its lines from the back, then zeroing the given amount.
+  void record_clear() {
+    reserve_changes(lines.size() + 1);
+    for (size_t i = lines.size(); i > 0; --i) {
+      record_line(CartChange::kEraseLine, i - 1, lines[i - 1], CartLine());
+    }
+    record_given(0);
+  }
+
+  void drop_history() {
+    undo_log.clear();
+    redo_log.clear();
+    undo_head_ = 0;
+    undo_steps_ = 0;
+  }
+
+  // Reverts the latest step with changes, keeping its checkpoint so later changes start a new
+  // step from there. False when there is nothing to undo. Storage is reserved up front so a
+  // step is never left half applied.
+  bool undo() {
+    size_t end = undo_log.size();
+    while (end > undo_head_ && undo_log[end - 1].kind == CartChange::kCheckpoint) {
+      --end;
+    }
+    if (end == undo_head_) {
+      return false;
+    }
+    size_t begin = end - 1;
+    while (undo_log[begin].kind != CartChange::kCheckpoint) {
+      --begin;
+    }
+    redo_log.reserve(redo_log.size() + (end - begin));
+    lines.reserve(lines.size() + (end - begin));
+    redo_log.insert(redo_log.end(), undo_log.begin() + static_cast<std::ptrdiff_t>(begin),
+                    undo_log.begin() + static_cast<std::ptrdiff_t>(end));
+    for (size_t i = end; i > begin + 1; --i) {
+      apply(undo_log[i - 1], false);
+    }
+    undo_steps_ -= undo_log.size() - end;
+    undo_log.resize(begin + 1);
+    return true;
+  }
+
+  // Reapplies the step undone last. False when there is none.
+  bool redo() {
+    if (redo_log.empty()) {
+      return false;
+    }
+    size_t begin = redo_log.size() - 1;
+    while (redo_log[begin].kind != CartChange::kCheckpoint) {
+      --begin;
+    }
+    reserve_changes(redo_log.size() - begin);
+    lines.reserve(lines.size() + (redo_log.size() - begin));
+    checkpoint();
+    for (size_t i = begin + 1; i < redo_log.size(); ++i) {
+      apply(redo_log[i], true);
+      undo_log.push_back(redo_log[i]);
+    }
+    redo_log.resize(begin);
+    return true;
+  }
+
+  const CatalogItem* item_of(const CartLine& line) const {
+    return line.item_index == kNoItem ? nullptr : &snapshot->items[line.item_index];
+  }
+
+  // Name column for line JSON: the cart's own locale if set, otherwise the catalog's.
+  size_t name_column() const {
+    return snapshot->name_column(display_locale.empty() ? catalog->display_locale()
+                                                        : display_locale);
+  }
+
+  std::pmr::vector<CartLine> lines;
+  std::pmr::string line_ids;
+  long long given_cents = 0;
+  CatalogPtr catalog;
+  SnapshotPtr snapshot;
+  std::pmr::string display_locale;
+  CartStateFile state_file;
+  CartDisplay display;
+  CartPricing pricing;
+  CartTax tax;
+  CartStock stock;
+  std::pmr::vector<CartChange> undo_log;
+  std::pmr::vector<CartChange> redo_log;
+
+ private:
+  // Forgets the first step; the state after it becomes the oldest one undo returns to. Only the
+  // head moves; dropped entries are moved out once they fill half the log, so each kept entry is
+  // moved once per as many entries dropped.
+  void drop_oldest_step() {
+    size_t next = undo_head_ + 1;
+    while (next < undo_log.size() && undo_log[next].kind != CartChange::kCheckpoint) {
+      ++next;
+    }
+    undo_head_ = next;
+    --undo_steps_;
+    if (undo_head_ * 2 >= undo_log.size()) {
+      undo_log.erase(undo_log.begin(),
+                     undo_log.begin() + static_cast<std::ptrdiff_t>(undo_head_));
+      undo_head_ = 0;
+    }
+  }
+
+  // Item positions are looked up again, since the catalog may have reloaded since the change.
+  void apply(const CartChange& change, bool forward) {
+    CartLine line = forward ? change.after : change.before;
+    switch (change.kind) {
+      case CartChange::kInsertLine:
+      case CartChange::kEraseLine:
+        if ((change.kind == CartChange::kInsertLine) == forward) {
+          line.item_index = snapshot->position_of(id_of(line));
+          lines.insert(lines.begin() + change.index, line);
+        } else {
+          lines.erase(lines.begin() + change.index);
+        }
+        break;
+      case CartChange::kSetLine:
+        line.item_index = snapshot->position_of(id_of(line));
+        lines[change.index] = line;
+        break;
+      case CartChange::kSetGiven:
+        given_cents = forward ? change.given_after : change.given_before;
+        break;
+      case CartChange::kCheckpoint:
+        break;
+    }
+  }
+
+  // Lines are kept in arena order, so sliding each id down to the write cursor is safe in place.
+  void compact_ids() {
+    size_t cursor = 0;
+    for (auto& line : lines) {
+      if (line.item_id.offset != cursor) {
+        std::memmove(&line_ids[cursor], line_ids.data() + line.item_id.offset,
+                     line.item_id.length);
+        line.item_id.offset = static_cast<uint32_t>(cursor);
+      }
+      cursor += line.item_id.length;
+    }
+    line_ids.resize(cursor);
+  }
+
+  // History refers to ids out of arena order, so the ids still referred to are copied into the
+  // spare arena instead, which then becomes the arena. A change whose before and after share an
+  // id copies it once.
+  void compact_recorded_ids() {
+    spare_ids_.clear();
+    spare_ids_.reserve(line_ids.capacity());
+    const auto move_id = [this](StringRef& ref, StringRef& last, StringRef& moved) {
+      if (ref.length == 0) {
+        ref.offset = 0;
+        return;
+      }
+      if (ref.offset == last.offset && ref.length == last.length) {
+        ref = moved;
+        return;
+      }
+      last = ref;
+      ref.offset = static_cast<uint32_t>(spare_ids_.size());
+      spare_ids_.append(line_ids.data() + last.offset, last.length);
+      moved = ref;
+    };
+    StringRef last{0, 0};
+    StringRef moved{0, 0};
+    for (auto& line : lines) {
+      move_id(line.item_id, last, moved);
+    }
+    const auto move_change = [&](CartChange& change) {
+      move_id(change.before.item_id, last, moved);
+      move_id(change.after.item_id, last, moved);
+    };
+    for (size_t i = undo_head_; i < undo_log.size(); ++i) {
+      move_change(undo_log[i]);
+    }
+    for (auto& change : redo_log) {
+      move_change(change);
+    }
+    line_ids.swap(spare_ids_);
+  }
+
+  // undo_log entries before undo_head_ belong to dropped steps.
+  size_t undo_head_ = 0;
+  size_t undo_steps_ = 0;
+  // compact_recorded_ids() scratch; keeps its capacity, swapped with line_ids.
+  std::pmr::string spare_ids_;
+};
+
+template <typename Visit>
+bool CartTax::for_each_class(const Cart& cart, Visit&& visit) const {
+  const CatalogSnapshot& snapshot = *cart.snapshot;
+  discounts_.assign(sums_.size(), 0);
+  if (cart.pricing.discount_cents(cart) > 0) {
+    line_discounts_.clear();
+    cart.pricing.line_discounts(cart, &line_discounts_);
+    for (const LineDiscount& discount : line_discounts_) {
+      long long& slot = discounts_[slot_of(cart, cart.lines[discount.line])];
+      slot = add_capped(slot, discount.cents);
+    }
+  }
+  for (size_t c = 0; c < sums_.size(); ++c) {
+    if (sums_[c].lines == 0) {
+      continue;
+    }
+    TaxTotal total;
+    total.tax_class = c + 1 == sums_.size() ? kNoTaxClass : static_cast<uint32_t>(c);
+    const long long rate = total.tax_class == kNoTaxClass ? 0 : snapshot.tax_rates[c];
+    // A class never goes below zero, however far stacked discounts reach.
+    const long long lines_cents = static_cast<long long>(sums_[c].cents);
+    const long long amount = lines_cents > discounts_[c] ? lines_cents - discounts_[c] : 0;
+    if (snapshot.prices_include_tax) {
+      total.gross_cents = amount;
+      total.tax_cents = tax_share(amount, rate, kMaxTaxRate + rate);
+      total.net_cents = amount - total.tax_cents;
+    } else {
+      total.net_cents = amount;
+      total.tax_cents = tax_share(amount, rate, kMaxTaxRate);
+      if (amount > kMaxCents - total.tax_cents) {
+        return false;
+      }
+      total.gross_cents = amount + total.tax_cents;
+    }
+    visit(total);
+  }
+  return true;
+}
+
+// Carts live in fixed-size slabs that are never returned to the heap. Handles pack the slot
+// index (plus one, so no live handle is null) into the low bits and the slot's generation into
+// the high bits; freeing a cart bumps the generation, so stale or double-freed handles fail the
+// O(1) check in lock() instead of touching reused memory. A slot whose generation wraps is
+// retired rather than reused, so no stale handle ever matches again. That happens after 2^31
+// carts in one slot on 64-bit builds, but after 4096 on 32-bit builds, whose handles keep 12
+// generation bits; a 32-bit pool thus serves about 10^9 carts in total.
+//
+// Concurrent carts are guarded by their slot's mutex. Since slots outlive their carts, a call
+// that loses a race with cs_cart_free can still take the mutex safely and then sees the bumped
+// generation.
+class CartPool {
+ public:
+  static constexpr unsigned kHandleBits = sizeof(uintptr_t) * 8;
+  static constexpr unsigned kIndexBits = kHandleBits >= 64 ? 32 : 20;
+  static constexpr uintptr_t kIndexMask = (uintptr_t(1) << kIndexBits) - 1;
+  // The slot tag holds the generation and the live bit in 32 bits.
+  static constexpr unsigned kGenerationBits =
+      kHandleBits - kIndexBits < 31 ? kHandleBits - kIndexBits : 31;
+  static constexpr uint32_t kGenerationMask = (uint32_t(1) << kGenerationBits) - 1;
+  static constexpr size_t kSlabSize = 64;
+  static constexpr size_t kMaxSlabs = 4096;
+
+  CartPool() : free_(core_resource(MemoryCategory::kCarts)) {}
+
+  ~CartPool();
+
+  // Returns nullptr when the pool is exhausted; allocation failures throw std::bad_alloc.
+  Cart* acquire(CatalogPtr catalog, bool concurrent, cs_cart_t* out_handle);
+
+  // Resolves a live handle, locking concurrent carts into `cart_lock`. The handle is checked again
+  // after the mode is read and the lock taken: if the slot was freed or reused in between, the
+  // new generation is visible by then and the handle is rejected.
+  Cart* lock(cs_cart_t handle, std::unique_lock<std::mutex>* cart_lock) const {
+    Slot* slot = live_slot(handle);
+    if (!slot) {
+      return nullptr;
+    }
+    if (slot->concurrent.load(std::memory_order_acquire)) {
+      *cart_lock = std::unique_lock<std::mutex>(slot->mutex);
+    }
+    return live_slot(handle) == slot ? &slot->cart : nullptr;
+  }
+
+  bool release(cs_cart_t handle);
+
+  size_t open_carts() const { return open_carts_.load(std::memory_order_relaxed); }
+
+ private:
+  struct Slot {
+    Cart cart;
+    // (generation << 1) | live.
+    std::atomic<uint32_t> tag{0};
+    // Set for carts created by cs_cart_new_concurrent; only those take `mutex`.
+    std::atomic<bool> concurrent{false};
+    mutable std::mutex mutex;
+  };
+
+  struct Slab {
+    explicit Slab(std::pmr::memory_resource* owner) : resource(owner) {}
+
+    std::pmr::memory_resource* resource;
+    Slot slots[kSlabSize];
+  };
+
+  Slot& slot_at(uint32_t index) const {
+    return slabs_[index / kSlabSize].load(std::memory_order_acquire)->slots[index % kSlabSize];
+  }
+
+  Slot* live_slot(cs_cart_t handle) const {
+    const uintptr_t bits = reinterpret_cast<uintptr_t>(handle);
+    const uintptr_t index_plus_one = bits & kIndexMask;
+    if (index_plus_one == 0 || index_plus_one > kSlabSize * kMaxSlabs) {
+      return nullptr;
+    }
+    const uintptr_t index = index_plus_one - 1;
+    Slab* slab = slabs_[index / kSlabSize].load(std::memory_order_acquire);
+    if (!slab) {
+      return nullptr;
+    }
+    const uintptr_t generation = bits >> kIndexBits;
+    if (generation > kGenerationMask) {
+      return nullptr;
+    }
+    Slot& slot = slab->slots[index % kSlabSize];
+    const uint32_t expected = (static_cast<uint32_t>(generation) << 1) | 1u;
+    return slot.tag.load(std::memory_order_acquire) == expected ? &slot : nullptr;
+  }
+
+  bool grow();
+
+  std::mutex mutex_;
+  std::atomic<Slab*> slabs_[kMaxSlabs] = {};
+  size_t slab_count_ = 0;
+  std::atomic<size_t> open_carts_{0};
+  std::pmr::vector<uint32_t> free_;
+};
+
+inline CartPool& cart_pool() {
+  static CartPool pool;
+  return pool;
+}
+
+// A cart resolved for one call. Concurrent carts stay locked until the access goes out of scope.
+class CartAccess {
+ public:
+  explicit CartAccess(cs_cart_t handle) : cart_(cart_pool().lock(handle, &lock_)) {}
+
+  Cart* get() const { return cart_; }
+
+ private:
+  std::unique_lock<std::mutex> lock_;
+  Cart* cart_;
+};
+
+inline const char* invalid_cart_message(cs_cart_t cart) {
+  return cart ? "cart is not a live cart handle." : "cart must not be null.";
+}
+
+// Takes a cart from the pool for `catalog`. Returns a CS_ERROR_* result.
+int new_cart(CatalogPtr catalog, bool concurrent, cs_cart_t* out_cart);
+
+// False when a line total or their sum does not fit in a long long. Pricing rule discounts are
+// taken off the sum, down to zero. When the catalog's prices exclude tax, the total is the sum
+// of the tax classes' gross amounts instead.
+bool compute_total_cents(const Cart& cart, long long* out_total_cents);
+
+// Cart and payment operations behind both the regular entry points and their _fast variants.
+// Each reports its own failure and returns a CS_ERRC_* code; success leaves the last error alone.
+int cart_clear(cs_cart_t cart);
+int cart_add_item_by_id(cs_cart_t cart, const char* item_id, int qty);
+int cart_remove_line(cs_cart_t cart, int line_index);
+int cart_set_line_qty(cs_cart_t cart, int line_index, int qty);
+int cart_get_total_cents(cs_cart_t cart, long long* out_total_cents);
+int payment_set_given_cents(cs_cart_t cart, long long given_cents);
+int payment_get_change_cents(cs_cart_t cart, long long* out_change_cents);
+int payment_get_given_cents(cs_cart_t cart, long long* out_given_cents);
+
+// Undo and redo share everything but the step they take.
+int step_history(cs_cart_t cart, bool forward);
+
+// The cs_cart_get_lines_json document. Returns false when the cart total overflows.
+bool append_lines_json(const Cart& cart, std::pmr::string& json);
+
+}  // namespace cashsloth
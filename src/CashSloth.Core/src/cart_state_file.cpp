@@ -0,0 +1,410 @@
+#include "cart_state_file.h"
+
+#include <cstring>
+#include <string>
+
+#if defined(_WIN32)
+#include <fcntl.h>
+#include <io.h>
+#include <sys/stat.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "cart.h"
+#include "encoding.h"
+#include "errors.h"
+#include "files.h"
+#include "money.h"
+
+namespace cashsloth {
+namespace {
+
+constexpr char kCartStateMagic[8] = {'C', 'S', 'C', 'A', 'R', 'T', '0', '1'};
+constexpr uint64_t kCartStateHeader = 64;
+// Crc, payload size, op.
+constexpr size_t kCartStateRecordHeader = 9;
+constexpr size_t kCartStateLineFields = 12;
+constexpr unsigned kCartStateMinShift = 16;
+constexpr unsigned kCartStateMaxShift = 30;
+
+}  // namespace
+
+int CartStateFile::create(const char* path, const Cart& cart) {
+  uint64_t size = 0;
+  if (!open_file(path, true, &size)) {
+    close();
+    set_last_error(CS_ERRC_IO, "Unable to open cart state file: ", path);
+    return CS_ERROR_INVALID_ARGUMENT;
+  }
+  if (size != 0) {
+    close();
+    set_last_error(CS_ERRC_INVALID_STATE, "File already holds a cart state: ", path);
+    return CS_ERROR_INVALID_ARGUMENT;
+  }
+  shift_ = kCartStateMinShift;
+  if (!map(kCartStateHeader + (uint64_t(2) << shift_))) {
+    close();
+    set_last_error(CS_ERRC_IO, "Unable to map cart state file: ", path);
+    return CS_ERROR_INTERNAL;
+  }
+  std::memcpy(base_, kCartStateMagic, sizeof(kCartStateMagic));
+  set_generation(0);
+  active_ = 1;
+  rewrite(cart);
+  sync_parent_directory(path);
+  if (failed_) {
+    close();
+    set_last_error(CS_ERRC_IO, "Unable to write cart state file: ", path);
+    return CS_ERROR_INTERNAL;
+  }
+  return CS_SUCCESS;
+}
+
+// Replays the active half into `cart`, which must be empty. A record cut short, failing its
+// checksum or not applying to the cart so far ends the log.
+int CartStateFile::recover(const char* path, Cart* cart) {
+  uint64_t size = 0;
+  if (!open_file(path, false, &size)) {
+    close();
+    set_last_error(CS_ERRC_IO, "Unable to open cart state file: ", path);
+    return CS_ERROR_INVALID_ARGUMENT;
+  }
+  if (size < kCartStateHeader || !map(size)) {
+    close();
+    set_last_error(CS_ERRC_INVALID_VALUE, "Not a cart state file: ", path);
+    return CS_ERROR_INVALID_ARGUMENT;
+  }
+  const uint64_t word = load_fixed(base_ + 8, 8);
+  shift_ = static_cast<unsigned>((word >> 1) & 0x7Fu);
+  active_ = static_cast<unsigned>(word & 1u);
+  set_generation(word >> 8);
+  if (std::memcmp(base_, kCartStateMagic, sizeof(kCartStateMagic)) != 0 ||
+      shift_ < kCartStateMinShift || shift_ > kCartStateMaxShift ||
+      size < kCartStateHeader + (uint64_t(2) << shift_)) {
+    close();
+    set_last_error(CS_ERRC_INVALID_VALUE, "Not a cart state file: ", path);
+    return CS_ERROR_INVALID_ARGUMENT;
+  }
+
+  const char* log = half(active_);
+  const uint64_t log_size = half_size();
+  uint64_t pos = 0;
+  while (log_size - pos >= kCartStateRecordHeader) {
+    const char* record = log + pos;
+    const uint64_t payload_size = load_fixed(record + 4, 4);
+    if (payload_size > log_size - pos - kCartStateRecordHeader ||
+        load_fixed(record, 4) != record_crc(record, payload_size)) {
+      break;
+    }
+    const char* payload = record + kCartStateRecordHeader;
+    auto& lines = cart->lines;
+    const uint64_t line_index = payload_size >= 4 ? load_fixed(payload, 4) : 0;
+    bool applied = false;
+    switch (static_cast<unsigned char>(record[8])) {
+      case kAddLine:
+        if (payload_size > kCartStateLineFields) {
+          const long long unit_cents = static_cast<long long>(load_fixed(payload, 8));
+          const int qty = static_cast<int>(load_fixed(payload + 8, 4));
+          const std::string_view id(payload + kCartStateLineFields,
+                                    payload_size - kCartStateLineFields);
+          applied = unit_cents >= 0 && qty > 0 && line_total_fits(unit_cents, qty);
+          if (applied) {
+            lines.push_back(CartLine{cart->store_id(id), cart->snapshot->position_of(id), qty,
+                                     unit_cents});
+          }
+        }
+        break;
+      case kSetQty:
+        if (payload_size == 8 && line_index < lines.size()) {
+          const int qty = static_cast<int>(load_fixed(payload + 4, 4));
+          applied = qty > 0 && line_total_fits(lines[line_index].unit_cents, qty);
+          if (applied) {
+            lines[line_index].qty = qty;
+          }
+        }
+        break;
+      case kRemoveLine:
+        applied = payload_size == 4 && line_index < lines.size();
+        if (applied) {
+          lines.erase(lines.begin() + static_cast<std::ptrdiff_t>(line_index));
+        }
+        break;
+      case kSetGiven:
+        if (payload_size == 8) {
+          const long long given_cents = static_cast<long long>(load_fixed(payload, 8));
+          applied = given_cents >= 0;
+          if (applied) {
+            cart->given_cents = given_cents;
+          }
+        }
+        break;
+      default:
+        break;
+    }
+    if (!applied) {
+      break;
+    }
+    pos += kCartStateRecordHeader + payload_size;
+  }
+
+  // Continue in the other half, leaving the recovered log untouched until the switch.
+  rewrite(*cart);
+  if (failed_) {
+    close();
+    set_last_error(CS_ERRC_IO, "Unable to write cart state file: ", path);
+    return CS_ERROR_INTERNAL;
+  }
+  return CS_SUCCESS;
+}
+
+void CartStateFile::line_added(const Cart& cart) {
+  if (!base_) {
+    return;
+  }
+  const CartLine& line = cart.lines.back();
+  const std::string_view id = cart.id_of(line);
+  char* payload = begin_record(cart, kAddLine, kCartStateLineFields + id.size());
+  if (payload) {
+    store_fixed(payload, static_cast<uint64_t>(line.unit_cents), 8);
+    store_fixed(payload + 8, static_cast<uint32_t>(line.qty), 4);
+    std::memcpy(payload + kCartStateLineFields, id.data(), id.size());
+    seal_record(payload - kCartStateRecordHeader, kCartStateLineFields + id.size());
+  }
+}
+
+void CartStateFile::qty_changed(const Cart& cart, size_t line_index) {
+  if (!base_) {
+    return;
+  }
+  char* payload = begin_record(cart, kSetQty, 8);
+  if (payload) {
+    store_fixed(payload, line_index, 4);
+    store_fixed(payload + 4, static_cast<uint32_t>(cart.lines[line_index].qty), 4);
+    seal_record(payload - kCartStateRecordHeader, 8);
+  }
+}
+
+void CartStateFile::line_removed(const Cart& cart, size_t line_index) {
+  if (!base_) {
+    return;
+  }
+  char* payload = begin_record(cart, kRemoveLine, 4);
+  if (payload) {
+    store_fixed(payload, line_index, 4);
+    seal_record(payload - kCartStateRecordHeader, 4);
+  }
+}
+
+void CartStateFile::given_changed(const Cart& cart) {
+  if (!base_) {
+    return;
+  }
+  char* payload = begin_record(cart, kSetGiven, 8);
+  if (payload) {
+    store_fixed(payload, static_cast<uint64_t>(cart.given_cents), 8);
+    seal_record(payload - kCartStateRecordHeader, 8);
+  }
+}
+
+// Writes the whole cart into the inactive half under the next generation, growing the file
+// first when it does not fit, then switches to it.
+void CartStateFile::rewrite(const Cart& cart) {
+  if (!base_) {
+    return;
+  }
+  uint64_t needed = kCartStateRecordHeader + 8;
+  for (const auto& line : cart.lines) {
+    needed += kCartStateRecordHeader + kCartStateLineFields + line.item_id.length;
+  }
+  unsigned shift = shift_;
+  while (needed > (uint64_t(1) << shift)) {
+    if (shift == kCartStateMaxShift) {
+      fail();
+      return;
+    }
+    ++shift;
+  }
+  if (shift != shift_) {
+    // The new second half starts past the end of the old file, so the active log stays intact.
+    if (!map(kCartStateHeader + (uint64_t(2) << shift))) {
+      fail();
+      return;
+    }
+    shift_ = shift;
+    active_ = 0;
+  }
+
+  set_generation(generation_ + 1);
+  active_ ^= 1u;
+  tail_ = 0;
+  char* log = half(active_);
+  for (const auto& line : cart.lines) {
+    const std::string_view id = cart.id_of(line);
+    char* record = log + tail_;
+    char* payload = record + kCartStateRecordHeader;
+    record[8] = static_cast<char>(kAddLine);
+    store_fixed(payload, static_cast<uint64_t>(line.unit_cents), 8);
+    store_fixed(payload + 8, static_cast<uint32_t>(line.qty), 4);
+    std::memcpy(payload + kCartStateLineFields, id.data(), id.size());
+    seal_record(record, kCartStateLineFields + id.size());
+  }
+  if (cart.given_cents != 0) {
+    char* record = log + tail_;
+    record[8] = static_cast<char>(kSetGiven);
+    store_fixed(record + kCartStateRecordHeader, static_cast<uint64_t>(cart.given_cents), 8);
+    seal_record(record, 8);
+  }
+  publish();
+}
+
+bool CartStateFile::flush() {
+  if (failed_ || !base_) {
+    return false;
+  }
+#if defined(_WIN32)
+  return FlushViewOfFile(base_, 0) && FlushFileBuffers(file_);
+#else
+  return ::msync(base_, mapped_size_, MS_SYNC) == 0;
+#endif
+}
+
+void CartStateFile::close() {
+  unmap();
+#if defined(_WIN32)
+  if (file_ != INVALID_HANDLE_VALUE) {
+    CloseHandle(file_);
+    file_ = INVALID_HANDLE_VALUE;
+  }
+#else
+  if (fd_ >= 0) {
+    ::close(fd_);
+    fd_ = -1;
+  }
+#endif
+  attached_ = false;
+  failed_ = false;
+}
+
+bool CartStateFile::open_file(const char* path, bool create, uint64_t* out_size) {
+#if defined(_WIN32)
+  file_ = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr,
+                      create ? OPEN_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  LARGE_INTEGER size;
+  if (file_ == INVALID_HANDLE_VALUE || !GetFileSizeEx(file_, &size)) {
+    return false;
+  }
+  *out_size = static_cast<uint64_t>(size.QuadPart);
+#else
+  fd_ = ::open(path, O_RDWR | O_CLOEXEC | (create ? O_CREAT : 0), 0644);
+  struct stat info;
+  if (fd_ < 0 || ::fstat(fd_, &info) != 0) {
+    return false;
+  }
+  *out_size = static_cast<uint64_t>(info.st_size);
+#endif
+  attached_ = true;
+  return true;
+}
+
+// Maps the first `size` bytes, extending the file when it is shorter.
+bool CartStateFile::map(uint64_t size) {
+  unmap();
+#if defined(_WIN32)
+  mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READWRITE, static_cast<DWORD>(size >> 32),
+                                static_cast<DWORD>(size), nullptr);
+  if (!mapping_) {
+    return false;
+  }
+  base_ = static_cast<char*>(MapViewOfFile(mapping_, FILE_MAP_ALL_ACCESS, 0, 0,
+                                           static_cast<SIZE_T>(size)));
+#else
+  struct stat info;
+  if (::fstat(fd_, &info) != 0 ||
+      (static_cast<uint64_t>(info.st_size) < size &&
+       ::ftruncate(fd_, static_cast<off_t>(size)) != 0)) {
+    return false;
+  }
+  void* memory = ::mmap(nullptr, static_cast<size_t>(size), PROT_READ | PROT_WRITE, MAP_SHARED,
+                        fd_, 0);
+  base_ = memory == MAP_FAILED ? nullptr : static_cast<char*>(memory);
+#endif
+  mapped_size_ = base_ ? size : 0;
+  return base_ != nullptr;
+}
+
+void CartStateFile::unmap() {
+#if defined(_WIN32)
+  if (base_) {
+    UnmapViewOfFile(base_);
+  }
+  if (mapping_) {
+    CloseHandle(mapping_);
+    mapping_ = nullptr;
+  }
+#else
+  if (base_) {
+    ::munmap(base_, static_cast<size_t>(mapped_size_));
+  }
+#endif
+  base_ = nullptr;
+  mapped_size_ = 0;
+}
+
+char* CartStateFile::half(unsigned index) const {
+  return base_ + kCartStateHeader + index * half_size();
+}
+
+// Returns where the payload goes, or nullptr when the active half is full and the cart, which
+// already includes the change, was rewritten instead.
+char* CartStateFile::begin_record(const Cart& cart, Op op, size_t payload_size) {
+  if (kCartStateRecordHeader + payload_size > half_size() - tail_) {
+    rewrite(cart);
+    return nullptr;
+  }
+  char* record = half(active_) + tail_;
+  record[8] = static_cast<char>(op);
+  return record + kCartStateRecordHeader;
+}
+
+// Stores the size and, last, the checksum, then moves the tail past the record.
+void CartStateFile::seal_record(char* record, size_t payload_size) {
+  store_fixed(record + 4, payload_size, 4);
+  store_fixed(record, record_crc(record, payload_size), 4);
+  tail_ += kCartStateRecordHeader + payload_size;
+}
+
+// Seeded with the generation, so records left over from an older use of a half never verify.
+uint32_t CartStateFile::record_crc(const char* record, size_t payload_size) const {
+  return crc32(seed_crc_, record + 4, 5 + payload_size);
+}
+
+void CartStateFile::set_generation(uint64_t generation) {
+  char seed[8];
+  store_fixed(seed, generation, 8);
+  generation_ = generation;
+  seed_crc_ = crc32(0, seed, sizeof(seed));
+}
+
+// The state word packs the generation, the half size's shift and the active half, so readers
+// see either the old or the new log.
+void CartStateFile::publish() {
+  char bytes[8];
+  store_fixed(bytes, (generation_ << 8) | (uint64_t(shift_) << 1) | active_, 8);
+  uint64_t word = 0;
+  std::memcpy(&word, bytes, sizeof(word));
+  std::atomic_thread_fence(std::memory_order_release);
+  *reinterpret_cast<volatile uint64_t*>(base_ + 8) = word;
+}
+
+// Stops logging after a remap failed; cs_cart_flush reports it until the cart is freed.
+void CartStateFile::fail() {
+  unmap();
+  failed_ = true;
+}
+
+}  // namespace cashsloth
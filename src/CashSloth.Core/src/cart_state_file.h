@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "platform.h"
+
+namespace cashsloth {
+
+class Cart;
+
+// The memory-mapped state file of a persistent cart (cs_cart_persist). After the header come two
+// log halves; the active one holds records that replay to the cart's lines and given amount.
+// Each change appends one checksummed record with plain stores into the mapping, so a crashed
+// process loses nothing; only cs_cart_flush forces the pages to disk. A full half, a clear or a
+// reprice rewrites the cart into the other half and then switches halves with one 8-byte store.
+class CartStateFile {
+ public:
+  CartStateFile() = default;
+  CartStateFile(const CartStateFile&) = delete;
+  CartStateFile& operator=(const CartStateFile&) = delete;
+  ~CartStateFile() { close(); }
+
+  bool attached() const { return attached_; }
+
+  // Both return a CS_ERROR_* result and set the last error on failure.
+  int create(const char* path, const Cart& cart);
+  int recover(const char* path, Cart* cart);
+
+  // Called after the cart changed. No-ops unless the cart is persistent.
+  void line_added(const Cart& cart);
+  void qty_changed(const Cart& cart, size_t line_index);
+  void line_removed(const Cart& cart, size_t line_index);
+  void given_changed(const Cart& cart);
+  void rewrite(const Cart& cart);
+
+  // False when the file could not be flushed or an earlier remap failed.
+  bool flush();
+  void close();
+
+ private:
+  enum Op : unsigned char { kAddLine = 1, kSetQty = 2, kRemoveLine = 3, kSetGiven = 4 };
+
+  bool open_file(const char* path, bool create, uint64_t* out_size);
+  bool map(uint64_t size);
+  void unmap();
+  char* half(unsigned index) const;
+  uint64_t half_size() const { return uint64_t(1) << shift_; }
+  char* begin_record(const Cart& cart, Op op, size_t payload_size);
+  void seal_record(char* record, size_t payload_size);
+  uint32_t record_crc(const char* record, size_t payload_size) const;
+  void set_generation(uint64_t generation);
+  void publish();
+  void fail();
+
+  char* base_ = nullptr;
+  uint64_t mapped_size_ = 0;
+  uint64_t generation_ = 0;
+  // CRC-32 of the generation, the start of every record checksum.
+  uint32_t seed_crc_ = 0;
+  uint64_t tail_ = 0;
+  unsigned shift_ = 0;
+  unsigned active_ = 0;
+  bool attached_ = false;
+  bool failed_ = false;
+#if defined(_WIN32)
+  HANDLE file_ = INVALID_HANDLE_VALUE;
+  HANDLE mapping_ = nullptr;
+#else
+  int fd_ = -1;
+#endif
+};
+
+}  // namespace cashsloth
@@ -0,0 +1,398 @@
+#include "cash_drawer.h"
+
+#include <algorithm>
+#include <iterator>
+#include <limits>
+
+#include "encoding.h"
+#include "errors.h"
+#include "mini_json.hpp"
+#include "money.h"
+
+namespace cashsloth {
+
+struct Currency {
+  const char* code;
+  const long long* denominations;
+  size_t count;
+};
+
+namespace {
+
+// Larger counts would let a drawer total overflow.
+constexpr long long kMaxDrawerCount = 1000000000;
+// Search steps before the change solver builds its tables, and before it then settles for the
+// best breakdown found so far.
+constexpr long long kQuickChangeSearchSteps = 512;
+constexpr long long kChangeSearchSteps = 1 << 16;
+// Larger amounts are searched without payable-sum tables, which would take 2 MB and more.
+constexpr long long kMaxChangeTableCents = 1 << 20;
+
+constexpr long long kChfDenominations[] = {100000, 20000, 10000, 5000, 2000, 1000, 500,
+                                           200,    100,   50,    20,   10,   5};
+constexpr long long kEurDenominations[] = {50000, 20000, 10000, 5000, 2000, 1000, 500, 200,
+                                           100,   50,    20,    10,   5,    2,    1};
+constexpr long long kGbpDenominations[] = {5000, 2000, 1000, 500, 200, 100,
+                                           50,   20,   10,   5,   2,   1};
+constexpr long long kUsdDenominations[] = {10000, 5000, 2000, 1000, 500, 200,
+                                           100,   50,   25,   10,   5,   1};
+
+constexpr Currency kCurrencies[] = {
+    {"CHF", kChfDenominations, std::size(kChfDenominations)},
+    {"EUR", kEurDenominations, std::size(kEurDenominations)},
+    {"GBP", kGbpDenominations, std::size(kGbpDenominations)},
+    {"USD", kUsdDenominations, std::size(kUsdDenominations)},
+};
+
+const Currency* find_currency(std::string_view code) {
+  for (const Currency& currency : kCurrencies) {
+    if (code == currency.code) {
+      return &currency;
+    }
+  }
+  return nullptr;
+}
+
+// Fewest pieces that pay an amount exactly from limited counts. A depth-first search over the
+// denominations, largest first, that takes as many of each as fit before trying fewer, so its
+// first answer is the greedy one, and cuts branches that cannot beat the best answer found.
+// That ends most searches within a few steps. Searches that do not are run again after marking,
+// per denomination, the sums the pieces from there on can pay (bounded-count subset sums over a
+// bitset), so the search never enters a branch without an answer and fails at once when there
+// is none.
+class ChangeSolver {
+ public:
+  ChangeSolver(const Currency& currency, const long long* available,
+               std::pmr::vector<uint64_t>* scratch)
+      : denominations_(currency.denominations),
+        available_(available),
+        count_(currency.count),
+        payable_(scratch) {
+    reach_[count_] = 0;
+    for (size_t i = count_; i-- > 0;) {
+      reach_[i] = reach_[i + 1] + available_[i] * denominations_[i];
+    }
+  }
+
+  // False when no combination of the available pieces pays `amount`.
+  bool solve(long long amount, long long* out_counts) {
+    best_pieces_ = -1;
+    words_ = 0;
+    steps_ = 0;
+    step_limit_ = kQuickChangeSearchSteps;
+    search(0, amount, 0);
+    if (steps_ > step_limit_) {
+      mark_payable(amount);
+      steps_ = 0;
+      step_limit_ = kChangeSearchSteps;
+      if (payable(0, amount)) {
+        search(0, amount, 0);
+      }
+    }
+    if (best_pieces_ < 0) {
+      return false;
+    }
+    std::copy(best_, best_ + count_, out_counts);
+    return true;
+  }
+
+ private:
+  void mark_payable(long long amount) {
+    words_ = amount <= kMaxChangeTableCents ? static_cast<size_t>(amount) / 64 + 1 : 0;
+    payable_->assign((count_ + 1) * words_, 0);
+    if (words_ == 0) {
+      return;
+    }
+    (*payable_)[count_ * words_] = 1;
+    for (size_t i = count_; i-- > 0;) {
+      uint64_t* bits = payable_->data() + i * words_;
+      std::copy(bits + words_, bits + 2 * words_, bits);
+      // Counts 0..most as a sum of parts 1, 2, 4, ... and the rest.
+      long long most = std::min(available_[i], amount / denominations_[i]);
+      for (long long part = 1; most > 0; part *= 2) {
+        const long long take = std::min(part, most);
+        most -= take;
+        shift_or(bits, static_cast<size_t>(take * denominations_[i]));
+      }
+    }
+  }
+
+  // bits |= bits << shift, dropping what passes the amount.
+  void shift_or(uint64_t* bits, size_t shift) const {
+    const size_t word_shift = shift / 64;
+    const unsigned bit_shift = static_cast<unsigned>(shift % 64);
+    for (size_t w = words_; w-- > word_shift;) {
+      uint64_t moved = bits[w - word_shift] << bit_shift;
+      if (bit_shift != 0 && w > word_shift) {
+        moved |= bits[w - word_shift - 1] >> (64 - bit_shift);
+      }
+      bits[w] |= moved;
+    }
+  }
+
+  // Whether the pieces from `index` on can pay `amount`; without tables, whether they are worth
+  // enough.
+  bool payable(size_t index, long long amount) const {
+    if (amount > reach_[index]) {
+      return false;
+    }
+    if (words_ == 0) {
+      return true;
+    }
+    const size_t bit = static_cast<size_t>(amount);
+    return ((*payable_)[index * words_ + bit / 64] >> (bit % 64) & 1) != 0;
+  }
+
+  void search(size_t index, long long remaining, long long pieces) {
+    if (remaining == 0) {
+      if (best_pieces_ < 0 || pieces < best_pieces_) {
+        best_pieces_ = pieces;
+        std::copy(take_, take_ + count_, best_);
+      }
+      return;
+    }
+    if (index == count_ || ++steps_ > step_limit_) {
+      return;
+    }
+    const long long denomination = denominations_[index];
+    const long long most = std::min(available_[index], remaining / denomination);
+    for (long long take = most; take >= 0; --take) {
+      const long long rest = remaining - take * denomination;
+      // Taking fewer only leaves more to pay, and at least as many pieces more than it saves.
+      if (rest > reach_[index + 1]) {
+        break;
+      }
+      if (best_pieces_ >= 0 && index + 1 < count_ &&
+          pieces + take + (rest + denominations_[index + 1] - 1) / denominations_[index + 1] >=
+              best_pieces_) {
+        break;
+      }
+      if (!payable(index + 1, rest)) {
+        continue;
+      }
+      take_[index] = take;
+      search(index + 1, rest, pieces + take);
+    }
+    take_[index] = 0;
+  }
+
+  const long long* denominations_;
+  const long long* available_;
+  size_t count_;
+  // Value of all available pieces from a denomination on.
+  long long reach_[kMaxDenominations + 1];
+  // Per denomination, bit s is set when the pieces from there on can pay s; empty for amounts
+  // above kMaxChangeTableCents.
+  std::pmr::vector<uint64_t>* payable_;
+  size_t words_ = 0;
+  long long take_[kMaxDenominations] = {};
+  long long best_[kMaxDenominations] = {};
+  long long best_pieces_ = -1;
+  long long steps_ = 0;
+  long long step_limit_ = 0;
+};
+
+// The index of the denomination `object` counts, or kMaxDenominations when it is invalid.
+size_t parse_drawer_count(const mini_json::Value::Object& object, const Currency& currency,
+                          long long* counts) {
+  auto cents_it = object.find("cents");
+  auto count_it = object.find("count");
+  if (object.size() != 2 || cents_it == object.end() || count_it == object.end() ||
+      !cents_it->second.is_number() || !count_it->second.is_number() ||
+      !count_it->second.number_is_integer() || count_it->second.as_number() < 0 ||
+      count_it->second.as_number() > static_cast<long double>(kMaxDrawerCount)) {
+    return kMaxDenominations;
+  }
+  for (size_t i = 0; i < currency.count; ++i) {
+    if (cents_it->second.as_number() == static_cast<long double>(currency.denominations[i])) {
+      counts[i] = static_cast<long long>(count_it->second.as_number());
+      return i;
+    }
+  }
+  return kMaxDenominations;
+}
+
+}  // namespace
+
+bool is_cash_payment(std::string_view method) {
+  constexpr std::string_view kCash = "cash";
+  if (method.size() != kCash.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < method.size(); ++i) {
+    const char c = method[i] >= 'A' && method[i] <= 'Z' ? static_cast<char>(method[i] + 32)
+                                                        : method[i];
+    if (c != kCash[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+int CashDrawer::set_json(const char* json) {
+  if (!json || json[0] == '\0') {
+    std::lock_guard<std::mutex> lock(mutex_);
+    currency_ = nullptr;
+    return CS_ERRC_NONE;
+  }
+  mini_json::Value root(core_resource(MemoryCategory::kParser));
+  std::string parse_error;
+  if (!mini_json::parse(json, &root, &parse_error) || !root.is_object()) {
+    set_last_error(CS_ERRC_INVALID_VALUE, "drawer_json must be a JSON object.");
+    return CS_ERRC_INVALID_VALUE;
+  }
+  const auto& object = root.as_object();
+  auto currency_it = object.find("currency");
+  const Currency* currency = currency_it != object.end() && currency_it->second.is_string()
+                                 ? find_currency(currency_it->second.as_string())
+                                 : nullptr;
+  if (!currency) {
+    set_last_error(CS_ERRC_INVALID_VALUE, "Drawer currency must be one of CHF, EUR, GBP, USD.");
+    return CS_ERRC_INVALID_VALUE;
+  }
+  long long counts[kMaxDenominations] = {};
+  bool seen[kMaxDenominations] = {};
+  long long uncounted_cents = 0;
+  for (const auto& entry : object) {
+    const mini_json::Value& value = entry.second;
+    if (entry.first == "currency" || (entry.first == "total_cents" && value.is_number())) {
+      continue;
+    }
+    if (entry.first == "uncounted_cents" && value.is_number() && value.number_is_integer() &&
+        value.as_number() >= static_cast<long double>(std::numeric_limits<long long>::min()) &&
+        value.as_number() <= static_cast<long double>(kMaxCents)) {
+      uncounted_cents = static_cast<long long>(value.as_number());
+      continue;
+    }
+    if (entry.first != "counts" || !value.is_array()) {
+      set_last_error(CS_ERRC_INVALID_VALUE, "Unknown drawer field: ", entry.first);
+      return CS_ERRC_INVALID_VALUE;
+    }
+    for (const auto& count_value : value.as_array()) {
+      const size_t index = count_value.is_object()
+                               ? parse_drawer_count(count_value.as_object(), *currency, counts)
+                               : kMaxDenominations;
+      if (index == kMaxDenominations || seen[index]) {
+        set_last_error(CS_ERRC_INVALID_VALUE,
+                       "Drawer counts need one {\"cents\",\"count\"} per denomination of the "
+                       "currency, with a count from 0 to 1000000000.");
+        return CS_ERRC_INVALID_VALUE;
+      }
+      seen[index] = true;
+    }
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  currency_ = currency;
+  std::copy(counts, counts + kMaxDenominations, counts_);
+  uncounted_cents_ = uncounted_cents;
+  return CS_ERRC_NONE;
+}
+
+int CashDrawer::append_json(std::pmr::string& json) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!currency_) {
+    set_last_error(CS_ERRC_INVALID_STATE, "No cash drawer is set.");
+    return CS_ERRC_INVALID_STATE;
+  }
+  long long total = 0;
+  for (size_t i = 0; i < currency_->count; ++i) {
+    total += counts_[i] * currency_->denominations[i];
+  }
+  json += "{\"currency\":\"";
+  json += currency_->code;
+  json += "\",\"total_cents\":";
+  append_integer(json, total);
+  json += ",\"uncounted_cents\":";
+  append_integer(json, uncounted_cents_);
+  json += ",\"counts\":[";
+  for (size_t i = 0; i < currency_->count; ++i) {
+    json += i == 0 ? "{\"cents\":" : ",{\"cents\":";
+    append_integer(json, currency_->denominations[i]);
+    json += ",\"count\":";
+    append_integer(json, counts_[i]);
+    json += "}";
+  }
+  json += "]}";
+  return CS_ERRC_NONE;
+}
+
+int CashDrawer::append_breakdown_json(long long change_cents, std::pmr::string& json) const {
+  long long counts[kMaxDenominations] = {};
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!currency_) {
+    set_last_error(CS_ERRC_INVALID_STATE, "No cash drawer is set.");
+    return CS_ERRC_INVALID_STATE;
+  }
+  if (change_cents > 0 && !plan_change(change_cents, counts)) {
+    set_last_error(CS_ERRC_INVALID_STATE, "The drawer cannot make exact change.");
+    return CS_ERRC_INVALID_STATE;
+  }
+  long long pieces = 0;
+  for (size_t i = 0; i < currency_->count; ++i) {
+    pieces += counts[i];
+  }
+  json += "{\"change_cents\":";
+  append_integer(json, change_cents);
+  json += ",\"piece_count\":";
+  append_integer(json, pieces);
+  json += ",\"pieces\":[";
+  bool first = true;
+  for (size_t i = 0; i < currency_->count; ++i) {
+    if (counts[i] == 0) {
+      continue;
+    }
+    json += first ? "{\"cents\":" : ",{\"cents\":";
+    first = false;
+    append_integer(json, currency_->denominations[i]);
+    json += ",\"count\":";
+    append_integer(json, counts[i]);
+    json += "}";
+  }
+  json += "]}";
+  return CS_ERRC_NONE;
+}
+
+void CashDrawer::record_cash_sale(long long given_cents, long long change_cents) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!currency_) {
+    return;
+  }
+  long long rest = given_cents;
+  for (size_t i = 0; i < currency_->count; ++i) {
+    const long long denomination = currency_->denominations[i];
+    const long long take = std::min(rest / denomination, kMaxDrawerCount - counts_[i]);
+    counts_[i] += take;
+    rest -= take * denomination;
+  }
+  add_uncounted(rest);
+  long long counts[kMaxDenominations] = {};
+  if (change_cents > 0 && !plan_change(change_cents, counts)) {
+    add_uncounted(-change_cents);
+    return;
+  }
+  for (size_t i = 0; i < currency_->count; ++i) {
+    counts_[i] -= counts[i];
+  }
+}
+
+bool CashDrawer::plan_change(long long change_cents, long long* counts) const {
+  return ChangeSolver(*currency_, counts_, &scratch_).solve(change_cents, counts);
+}
+
+void CashDrawer::add_uncounted(long long cents) {
+  const long long lowest = std::numeric_limits<long long>::min();
+  if (uncounted_cents_ > 0 && cents > kMaxCents - uncounted_cents_) {
+    uncounted_cents_ = kMaxCents;
+  } else if (uncounted_cents_ < 0 && cents < lowest - uncounted_cents_) {
+    uncounted_cents_ = lowest;
+  } else {
+    uncounted_cents_ += cents;
+  }
+}
+
+CashDrawer& cash_drawer() {
+  static CashDrawer drawer;
+  return drawer;
+}
+
+}  // namespace cashsloth
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "memory.h"
+
+namespace cashsloth {
+
+// Cash drawer. Denominations are the coins and notes in circulation, largest first.
+constexpr size_t kMaxDenominations = 16;
+
+struct Currency;
+
+// Payment methods whose sales move cash, compared ASCII case-insensitively; "Cash" is the app's.
+bool is_cash_payment(std::string_view method);
+
+// The process's cash drawer: the live count of each denomination of its currency.
+class CashDrawer {
+ public:
+  // Replaces the currency and counts; null or empty removes the drawer. Takes the output of
+  // append_json, so a saved drawer loads back. Returns a CS_ERRC_* code.
+  int set_json(const char* json);
+
+  // Returns a CS_ERRC_* code.
+  int append_json(std::pmr::string& json) const;
+
+  // Appends the fewest-pieces breakdown of `change_cents` from the current counts. Returns a
+  // CS_ERRC_* code.
+  int append_breakdown_json(long long change_cents, std::pmr::string& json) const;
+
+  // A committed cash sale: the tendered amount goes in as its fewest pieces, then the change
+  // comes out as its fewest pieces from what the drawer then holds. Amounts the counts cannot
+  // show are kept in uncounted_cents.
+  void record_cash_sale(long long given_cents, long long change_cents);
+
+ private:
+  bool plan_change(long long change_cents, long long* counts) const;
+  void add_uncounted(long long cents);
+
+  mutable std::mutex mutex_;
+  const Currency* currency_ = nullptr;
+  long long counts_[kMaxDenominations] = {};
+  long long uncounted_cents_ = 0;
+  // Solver tables; keeps its capacity across breakdowns.
+  mutable std::pmr::vector<uint64_t> scratch_{core_resource(MemoryCategory::kBuffers)};
+};
+
+CashDrawer& cash_drawer();
+
+}  // namespace cashsloth
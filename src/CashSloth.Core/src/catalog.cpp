@@ -0,0 +1,618 @@
+#include "catalog.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <exception>
+#include <thread>
+#include <unordered_set>
+
+#include "errors.h"
+#include "mini_json.hpp"
+
+namespace cashsloth {
+namespace {
+
+// Per-item validation outcome. Checks run in the order the serial loader always used: shape
+// and id first, then the duplicate check, then price and names.
+enum class ItemError : unsigned char {
+  kNone,
+  kNotObject,
+  kIdNotString,
+  kIdEmpty,
+  kUnitNotInteger,
+  kUnitOutOfRange,
+  kNameNotString,
+  kNamesInvalid,
+  kCategoryNotString,
+  kTaxClassUnknown
+};
+
+bool is_id_error(ItemError error) {
+  return error == ItemError::kNotObject || error == ItemError::kIdNotString ||
+         error == ItemError::kIdEmpty;
+}
+
+const char* describe_item_error(ItemError error) {
+  switch (error) {
+    case ItemError::kNotObject:
+      return "Catalog items must be JSON objects.";
+    case ItemError::kIdNotString:
+      return "Catalog item id must be a string.";
+    case ItemError::kIdEmpty:
+      return "Catalog item id must not be empty.";
+    case ItemError::kUnitNotInteger:
+      return "Catalog item unit_cents must be an integer.";
+    case ItemError::kUnitOutOfRange:
+      return "Catalog item unit_cents must be non-negative.";
+    case ItemError::kNameNotString:
+      return "Catalog item name must be a string.";
+    case ItemError::kNamesInvalid:
+      return "Catalog item names must map non-empty locale codes to strings.";
+    case ItemError::kCategoryNotString:
+      return "Catalog item category must be a string.";
+    case ItemError::kTaxClassUnknown:
+      return "Catalog item tax_class must be the id of one of the catalog's tax_classes.";
+    case ItemError::kNone:
+      break;
+  }
+  return "";
+}
+
+// Load scratch for one item; the pointers view the parsed JSON tree.
+struct ItemScratch {
+  const mini_json::String* id = nullptr;
+  const mini_json::String* name = nullptr;
+  const mini_json::Value* names = nullptr;
+  const mini_json::String* category = nullptr;
+  long long unit_cents = 0;
+  uint32_t tax_class = kNoTaxClass;
+  size_t hash = 0;
+  // Bytes this item contributes to the string pool: only the id once validation failed.
+  size_t pool_bytes = 0;
+  ItemError error = ItemError::kNone;
+};
+
+ItemError validate_catalog_item(const mini_json::Value& item_value,
+                                const std::pmr::vector<std::pmr::string>& tax_class_ids,
+                                ItemScratch* out_item) {
+  if (!item_value.is_object()) {
+    return ItemError::kNotObject;
+  }
+  const auto& item_obj = item_value.as_object();
+  auto id_it = item_obj.find("id");
+  if (id_it == item_obj.end() || !id_it->second.is_string()) {
+    return ItemError::kIdNotString;
+  }
+  const mini_json::String& id = id_it->second.as_string();
+  if (id.empty()) {
+    return ItemError::kIdEmpty;
+  }
+  out_item->id = &id;
+  out_item->pool_bytes = id.size();
+  auto unit_it = item_obj.find("unit_cents");
+  if (unit_it == item_obj.end() || !unit_it->second.is_number() ||
+      !unit_it->second.number_is_integer()) {
+    return ItemError::kUnitNotInteger;
+  }
+  long double unit_value = unit_it->second.as_number();
+  if (unit_value < 0 ||
+      unit_value > static_cast<long double>(std::numeric_limits<long long>::max())) {
+    return ItemError::kUnitOutOfRange;
+  }
+  out_item->unit_cents = static_cast<long long>(unit_value);
+
+  size_t name_bytes = 0;
+  auto name_it = item_obj.find("name");
+  if (name_it != item_obj.end()) {
+    if (!name_it->second.is_string()) {
+      return ItemError::kNameNotString;
+    }
+    out_item->name = &name_it->second.as_string();
+    name_bytes += out_item->name->size();
+  }
+
+  auto names_it = item_obj.find("names");
+  if (names_it != item_obj.end()) {
+    if (!names_it->second.is_object()) {
+      return ItemError::kNamesInvalid;
+    }
+    for (const auto& entry : names_it->second.as_object()) {
+      if (entry.first.empty() || !entry.second.is_string()) {
+        return ItemError::kNamesInvalid;
+      }
+      name_bytes += entry.second.as_string().size();
+    }
+    out_item->names = &names_it->second;
+  }
+
+  auto category_it = item_obj.find("category");
+  if (category_it != item_obj.end()) {
+    if (!category_it->second.is_string()) {
+      return ItemError::kCategoryNotString;
+    }
+    out_item->category = &category_it->second.as_string();
+    name_bytes += out_item->category->size();
+  }
+
+  auto tax_class_it = item_obj.find("tax_class");
+  if (tax_class_it != item_obj.end()) {
+    if (!tax_class_it->second.is_string()) {
+      return ItemError::kTaxClassUnknown;
+    }
+    auto found = std::find(tax_class_ids.begin(), tax_class_ids.end(),
+                           std::string_view(tax_class_it->second.as_string()));
+    if (found == tax_class_ids.end()) {
+      return ItemError::kTaxClassUnknown;
+    }
+    out_item->tax_class = static_cast<uint32_t>(found - tax_class_ids.begin());
+  }
+
+  out_item->pool_bytes += name_bytes;
+  return ItemError::kNone;
+}
+
+// Below this many items the thread start-up cost outweighs any gain.
+constexpr size_t kParallelLoadMinItems = 2048;
+constexpr size_t kNoPosition = std::numeric_limits<size_t>::max();
+
+// Runs task(0..task_count-1), task 0 on the calling thread. The first exception thrown by any
+// task (an allocation failure, or a worker that could not be started) is rethrown here after
+// every started worker has been joined.
+template <typename Fn>
+void run_parallel(size_t task_count, Fn&& task) {
+  std::mutex failure_mutex;
+  std::exception_ptr failure;
+  auto guarded = [&](size_t t) {
+    if (t > 0) {
+      trace_name_thread("catalog build worker");
+    }
+    try {
+      task(t);
+    } catch (...) {
+      std::lock_guard<std::mutex> lock(failure_mutex);
+      if (!failure) {
+        failure = std::current_exception();
+      }
+    }
+  };
+
+  std::pmr::vector<std::thread> workers(core_resource());
+  try {
+    workers.reserve(task_count - 1);
+    for (size_t t = 1; t < task_count; ++t) {
+      workers.emplace_back(guarded, t);
+    }
+  } catch (...) {
+    failure = std::current_exception();
+  }
+  if (!failure) {
+    guarded(0);
+  }
+  for (auto& worker : workers) {
+    worker.join();
+  }
+  if (failure) {
+    std::rethrow_exception(failure);
+  }
+}
+
+size_t round_down_pow2(size_t value) {
+  size_t result = 1;
+  while (result * 2 <= value) {
+    result *= 2;
+  }
+  return result;
+}
+
+struct ChunkSummary {
+  explicit ChunkSummary(std::pmr::memory_resource* resource) : locales(resource) {}
+
+  size_t first_error = kNoPosition;
+  size_t pool_bytes = 0;
+  size_t pool_offset = 0;
+  std::pmr::unordered_set<std::string_view> locales;
+};
+
+// Builds the snapshot's items, string pool, name matrix and index from the parsed items array.
+//
+// Phase 1 validates chunks of items; phase 2 copies ids and names into the pool at per-chunk
+// offsets; phase 3 runs the duplicate check and fills the index with one thread per hash shard,
+// each walking items in document order. With one thread this is exactly the serial loader, and
+// with more the reported error is still the lowest failing position with the same per-item check
+// precedence, so messages never depend on the thread count.
+bool build_catalog_items(const mini_json::Value::Array& items, size_t threads,
+                         CatalogSnapshot* state, std::string* out_error) {
+  std::pmr::memory_resource* resource = core_resource(MemoryCategory::kParser);
+  const size_t count = items.size();
+  std::pmr::vector<ItemScratch> scratch(count, resource);
+  std::pmr::vector<ChunkSummary> chunks(resource);
+  chunks.reserve(threads);
+  for (size_t t = 0; t < threads; ++t) {
+    chunks.emplace_back(resource);
+  }
+  const size_t chunk = (count + threads - 1) / threads;
+  auto chunk_begin = [&](size_t t) { return std::min(count, t * chunk); };
+  auto chunk_end = [&](size_t t) { return std::min(count, t * chunk + chunk); };
+
+  run_parallel(threads, [&](size_t t) {
+    TraceSpan span("validate");
+    ChunkSummary& summary = chunks[t];
+    for (size_t i = chunk_begin(t); i < chunk_end(t); ++i) {
+      ItemScratch& item = scratch[i];
+      item.error = validate_catalog_item(items[i], state->tax_class_ids, &item);
+      if (item.id) {
+        item.hash = std::hash<std::string_view>{}(*item.id);
+      }
+      if (item.error != ItemError::kNone) {
+        if (summary.first_error == kNoPosition) {
+          summary.first_error = i;
+        }
+      } else if (item.names) {
+        for (const auto& entry : item.names->as_object()) {
+          summary.locales.insert(entry.first);
+        }
+      }
+      summary.pool_bytes += item.pool_bytes;
+    }
+  });
+
+  size_t item_error_at = kNoPosition;
+  size_t pool_size = 0;
+  std::pmr::unordered_set<std::string_view> locale_set(resource);
+  for (auto& summary : chunks) {
+    item_error_at = std::min(item_error_at, summary.first_error);
+    summary.pool_offset = pool_size;
+    pool_size += summary.pool_bytes;
+    locale_set.insert(summary.locales.begin(), summary.locales.end());
+  }
+  if (pool_size > std::numeric_limits<uint32_t>::max()) {
+    *out_error = "Catalog ids and names must not exceed 4 GiB.";
+    return false;
+  }
+
+  state->locales.assign(locale_set.begin(), locale_set.end());
+  std::sort(state->locales.begin(), state->locales.end());
+  std::pmr::unordered_map<std::string_view, size_t> column_by_locale(resource);
+  for (size_t i = 0; i < state->locales.size(); ++i) {
+    column_by_locale.emplace(state->locales[i], i + 1);
+  }
+
+  const size_t columns = state->locales.size() + 1;
+  state->strings.resize(pool_size);
+  state->items.resize(count);
+  state->names.resize(columns * count);
+
+  run_parallel(threads, [&](size_t t) {
+    TraceSpan span("string_pool");
+    char* pool = &state->strings[0];
+    size_t cursor = chunks[t].pool_offset;
+    auto copy = [pool, &cursor](const mini_json::String& value) {
+      StringRef ref{static_cast<uint32_t>(cursor), static_cast<uint32_t>(value.size())};
+      std::memcpy(pool + cursor, value.data(), value.size());
+      cursor += value.size();
+      return ref;
+    };
+    for (size_t i = chunk_begin(t); i < chunk_end(t); ++i) {
+      const ItemScratch& item = scratch[i];
+      if (item.id) {
+        state->items[i].id = copy(*item.id);
+      }
+      if (item.error != ItemError::kNone) {
+        continue;
+      }
+      state->items[i].unit_cents = item.unit_cents;
+      state->items[i].tax_class = item.tax_class;
+      const StringRef base = item.name ? copy(*item.name) : StringRef{static_cast<uint32_t>(cursor), 0};
+      for (size_t c = 0; c < columns; ++c) {
+        state->names[c * count + i] = base;
+      }
+      if (item.names) {
+        // Every locale was collected above. Workers share the map, so they only find() in it.
+        for (const auto& entry : item.names->as_object()) {
+          const size_t column = column_by_locale.find(entry.first)->second;
+          state->names[column * count + i] = copy(entry.second.as_string());
+        }
+      }
+      if (item.category) {
+        state->items[i].category = copy(*item.category);
+      }
+    }
+  });
+
+  const size_t shards = round_down_pow2(threads);
+  state->index_by_id.reset(shards);
+  std::pmr::vector<size_t> first_duplicate(shards, kNoPosition, resource);
+  run_parallel(shards, [&](size_t p) {
+    TraceSpan span("index_build");
+    CatalogIndex::Shard& shard = state->index_by_id.shard(p);
+    shard.reserve(count / shards + 1);
+    // Items past an earlier failure are never reached by the serial loop; skip them too.
+    for (size_t i = 0; i < count && i <= item_error_at; ++i) {
+      if (is_id_error(scratch[i].error) || state->index_by_id.shard_of(scratch[i].hash) != p) {
+        continue;
+      }
+      if (!shard.emplace(state->id_of(i), i).second) {
+        first_duplicate[p] = i;
+        break;
+      }
+    }
+  });
+
+  size_t duplicate_at = kNoPosition;
+  for (size_t position : first_duplicate) {
+    duplicate_at = std::min(duplicate_at, position);
+  }
+
+  if (item_error_at == kNoPosition && duplicate_at == kNoPosition) {
+    return true;
+  }
+  if (duplicate_at < item_error_at ||
+      (duplicate_at == item_error_at && !is_id_error(scratch[duplicate_at].error))) {
+    *out_error = "Duplicate catalog item id: ";
+    out_error->append(scratch[duplicate_at].id->data(), scratch[duplicate_at].id->size());
+  } else {
+    *out_error = describe_item_error(scratch[item_error_at].error);
+  }
+  return false;
+}
+
+// Reads the optional "tax_classes" and "prices_include_tax" members of the catalog root.
+bool parse_tax_classes(const mini_json::Value::Object& root_obj, CatalogSnapshot* state,
+                       std::string* out_error) {
+  auto include_it = root_obj.find("prices_include_tax");
+  if (include_it != root_obj.end()) {
+    if (!include_it->second.is_bool()) {
+      *out_error = "Catalog prices_include_tax must be a boolean.";
+      return false;
+    }
+    state->prices_include_tax = include_it->second.as_bool();
+  }
+  auto classes_it = root_obj.find("tax_classes");
+  if (classes_it == root_obj.end()) {
+    return true;
+  }
+  if (!classes_it->second.is_array() || classes_it->second.as_array().size() > kMaxTaxClasses) {
+    *out_error = "Catalog tax_classes must be an array of at most 64 entries.";
+    return false;
+  }
+  auto fail = [out_error]() {
+    *out_error =
+        "Catalog tax classes need a non-empty id and a rate_basis_points from 0 to 10000.";
+    return false;
+  };
+  for (const auto& entry : classes_it->second.as_array()) {
+    if (!entry.is_object()) {
+      return fail();
+    }
+    const auto& object = entry.as_object();
+    auto id_it = object.find("id");
+    auto rate_it = object.find("rate_basis_points");
+    if (id_it == object.end() || !id_it->second.is_string() ||
+        id_it->second.as_string().empty() || rate_it == object.end() || !rate_it->second.is_number() ||
+        !rate_it->second.number_is_integer() || rate_it->second.as_number() < 0 ||
+        rate_it->second.as_number() > static_cast<long double>(kMaxTaxRate)) {
+      return fail();
+    }
+    const std::string_view id = id_it->second.as_string();
+    if (std::find(state->tax_class_ids.begin(), state->tax_class_ids.end(), id) !=
+        state->tax_class_ids.end()) {
+      *out_error = "Duplicate catalog tax class id: ";
+      out_error->append(id.data(), id.size());
+      return false;
+    }
+    state->tax_class_ids.emplace_back(id);
+    state->tax_rates.push_back(static_cast<long long>(rate_it->second.as_number()));
+  }
+  return true;
+}
+
+}  // namespace
+
+std::mutex g_catalog_registry_mutex;
+std::atomic<int> g_catalog_load_threads{1};
+
+MutableSnapshotPtr make_snapshot() {
+  const CoreResources& resources = core_resources();
+  return std::allocate_shared<CatalogSnapshot>(
+      std::pmr::polymorphic_allocator<CatalogSnapshot>(
+          resources.resource(MemoryCategory::kCatalogItems)),
+      resources);
+}
+
+void Catalog::set_stock(StockPtr stock) {
+  std::lock_guard<std::mutex> restock(stock_mutex_);
+  if (stock) {
+    stock->slots.reserve(stock->ids.size());
+    for (uint32_t i = 0; i < stock->ids.size(); ++i) {
+      stock->slots.push_back(stock_slots_.find_or_add(stock->id(i)));
+    }
+    for (uint32_t i = 0; i < stock->ids.size(); ++i) {
+      stock->slots[i]->restock(stock->counts[i]);
+    }
+  }
+  CatalogLock lock(mutex);
+  stock_ = std::move(stock);
+  stock_version.fetch_add(1, std::memory_order_release);
+}
+
+CatalogPtr make_catalog(std::string_view name) {
+  std::pmr::memory_resource* resource = core_resource();
+  return std::allocate_shared<Catalog>(std::pmr::polymorphic_allocator<Catalog>(resource), name,
+                                       resource);
+}
+
+std::pmr::vector<CatalogPtr>& catalog_registry() {
+  static std::pmr::vector<CatalogPtr> catalogs(core_resource());
+  return catalogs;
+}
+
+const CatalogPtr& default_catalog() {
+  static const CatalogPtr catalog = make_catalog(kDefaultCatalogName);
+  return catalog;
+}
+
+CatalogPtr resolve_catalog(cs_catalog_t handle) {
+  if (!handle) {
+    return nullptr;
+  }
+  if (handle == default_catalog().get()) {
+    return default_catalog();
+  }
+  std::lock_guard<std::mutex> lock(g_catalog_registry_mutex);
+  for (const auto& catalog : catalog_registry()) {
+    if (catalog.get() == handle) {
+      return catalog;
+    }
+  }
+  return nullptr;
+}
+
+bool parse_catalog_json(const char* json, CatalogSnapshot* out_state, std::string* out_error) {
+  if (!json || json[0] == '\0') {
+    if (out_error) {
+      *out_error = "Catalog JSON must not be null or empty.";
+    }
+    return false;
+  }
+  if (!out_state) {
+    if (out_error) {
+      *out_error = "Catalog output state must not be null.";
+    }
+    return false;
+  }
+
+  // The parser category reports its peak over the most recent load.
+  memory_counter(MemoryCategory::kParser).reset_peak();
+  mini_json::Value root(core_resource(MemoryCategory::kParser));
+  std::string parse_error;
+  bool parsed = false;
+  {
+    TraceSpan span("parse");
+    parsed = mini_json::parse(json, &root, &parse_error);
+  }
+  if (!parsed) {
+    if (out_error) {
+      *out_error = "Invalid catalog JSON: " + parse_error;
+    }
+    return false;
+  }
+
+  if (!root.is_object()) {
+    if (out_error) {
+      *out_error = "Catalog JSON must be an object.";
+    }
+    return false;
+  }
+
+  const auto& root_obj = root.as_object();
+  auto items_it = root_obj.find("items");
+  if (items_it == root_obj.end() || !items_it->second.is_array()) {
+    if (out_error) {
+      *out_error = "Catalog JSON must include an items array.";
+    }
+    return false;
+  }
+
+  std::string error;
+  if (!parse_tax_classes(root_obj, out_state, &error)) {
+    if (out_error) {
+      *out_error = std::move(error);
+    }
+    return false;
+  }
+  const auto& items = items_it->second.as_array();
+  const size_t configured =
+      static_cast<size_t>(g_catalog_load_threads.load(std::memory_order_relaxed));
+  const size_t threads = items.size() >= kParallelLoadMinItems ? configured : 1;
+  if (!build_catalog_items(items, threads, out_state, &error)) {
+    if (out_error) {
+      *out_error = std::move(error);
+    }
+    return false;
+  }
+  return true;
+}
+
+int load_catalog(Catalog& catalog, const char* json) {
+  CatalogLoadTimer load_timer;
+  MutableSnapshotPtr new_state = make_snapshot();
+  std::string error;
+  if (!parse_catalog_json(json, new_state.get(), &error)) {
+    set_last_error_text(CS_ERRC_INVALID_CATALOG, error);
+    return CS_ERROR_INVALID_ARGUMENT;
+  }
+
+  catalog.publish(std::move(new_state));
+  clear_last_error();
+  return CS_SUCCESS;
+}
+
+int write_catalog_json(const Catalog& catalog, char** out_json) {
+  if (!out_json) {
+    set_last_error(CS_ERRC_NULL_ARGUMENT, "out_json must not be null.");
+    return CS_ERROR_INVALID_ARGUMENT;
+  }
+
+  const SnapshotPtr snapshot_ptr = catalog.acquire();
+  const CatalogSnapshot& snapshot = *snapshot_ptr;
+  const size_t column = snapshot.name_column(catalog.display_locale());
+  TraceSpan span("serialize");
+  std::pmr::string json(core_resource());
+  json.reserve(128);
+  json += "{\"items\":[";
+  for (size_t i = 0; i < snapshot.items.size(); ++i) {
+    const auto& item = snapshot.items[i];
+    if (i > 0) {
+      json += ",";
+    }
+    json += "{\"id\":\"";
+    append_json_escaped(json, snapshot.id_of(i));
+    json += "\",\"name\":\"";
+    append_json_escaped(json, snapshot.name_of(i, column));
+    json += "\",\"unit_cents\":";
+    append_integer(json, item.unit_cents);
+    if (item.category.length > 0) {
+      json += ",\"category\":\"";
+      append_json_escaped(json, snapshot.category_of(i));
+      json += "\"";
+    }
+    if (item.tax_class != kNoTaxClass) {
+      json += ",\"tax_class\":\"";
+      append_json_escaped(json, snapshot.tax_class_ids[item.tax_class]);
+      json += "\"";
+    }
+    bool first_name = true;
+    for (size_t l = 0; l < snapshot.locales.size(); ++l) {
+      if (!snapshot.has_explicit_name(i, l + 1)) {
+        continue;
+      }
+      json += first_name ? ",\"names\":{\"" : ",\"";
+      append_json_escaped(json, snapshot.locales[l]);
+      json += "\":\"";
+      append_json_escaped(json, snapshot.name_of(i, l + 1));
+      json += "\"";
+      first_name = false;
+    }
+    json += first_name ? "}" : "}}";
+  }
+  json += "]";
+  if (!snapshot.tax_class_ids.empty()) {
+    json += ",\"tax_classes\":[";
+    for (size_t c = 0; c < snapshot.tax_class_ids.size(); ++c) {
+      json += c == 0 ? "{\"id\":\"" : ",{\"id\":\"";
+      append_json_escaped(json, snapshot.tax_class_ids[c]);
+      json += "\",\"rate_basis_points\":";
+      append_integer(json, snapshot.tax_rates[c]);
+      json += "}";
+    }
+    json += "],\"prices_include_tax\":";
+    json += snapshot.prices_include_tax ? "true" : "false";
+  }
+  json += "}";
+
+  *out_json = copy_to_buffer(json);
+  clear_last_error();
+  return CS_SUCCESS;
+}
+
+}  // namespace cashsloth
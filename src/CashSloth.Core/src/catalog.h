@@ -0,0 +1,295 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "cashsloth_core.h"
+#include "diagnostics.h"
+#include "encoding.h"
+#include "memory.h"
+#include "pricing.h"
+#include "stock_ledger.h"
+
+namespace cashsloth {
+
+// Items without a tax class, and lines whose item left the catalog.
+constexpr uint32_t kNoTaxClass = std::numeric_limits<uint32_t>::max();
+constexpr size_t kMaxTaxClasses = 64;
+// Tax rates are in basis points: 1900 is 19 %.
+constexpr long long kMaxTaxRate = 10000;
+
+struct CatalogItem {
+  StringRef id;
+  // Empty for items without a category.
+  StringRef category;
+  long long unit_cents = 0;
+  // Position in the snapshot's tax classes.
+  uint32_t tax_class = kNoTaxClass;
+};
+
+// id -> item position, split into a power-of-two number of shards by id hash so that parallel
+// loads can build each shard on its own thread. Small catalogs use a single shard. Keys view
+// the owning snapshot's string pool.
+class CatalogIndex {
+ public:
+  using Shard = std::pmr::unordered_map<std::string_view, size_t>;
+
+  explicit CatalogIndex(std::pmr::memory_resource* resource) : shards_(resource) {}
+
+  void reset(size_t shard_count) {
+    shards_.assign(shard_count, Shard());
+    mask_ = shard_count - 1;
+  }
+
+  size_t shard_count() const { return shards_.size(); }
+  size_t shard_of(size_t hash) const { return hash & mask_; }
+  Shard& shard(size_t index) { return shards_[index]; }
+
+  const size_t* find(std::string_view item_id) const {
+    if (shards_.empty()) {
+      return nullptr;
+    }
+    const Shard& shard = shards_[shard_of(std::hash<std::string_view>{}(item_id))];
+    auto it = shard.find(item_id);
+    return it == shard.end() ? nullptr : &it->second;
+  }
+
+ private:
+  std::pmr::vector<Shard> shards_;
+  size_t mask_ = 0;
+};
+
+// Cart lines refer to catalog items by position in their pinned snapshot.
+constexpr uint32_t kNoItem = std::numeric_limits<uint32_t>::max();
+// Name column 0 holds the base `name`; column c > 0 holds locales[c - 1].
+constexpr size_t kBaseNameColumn = 0;
+
+inline std::atomic<unsigned long long> g_next_snapshot_id{1};
+
+// Immutable, reference-counted view of one catalog generation. Carts keep the snapshot they
+// resolved their lines against, so a reload only swaps a pointer and never waits on cart work.
+// Snapshots are built in place and never moved, so index keys can view `strings` directly.
+struct CatalogSnapshot {
+  explicit CatalogSnapshot(const CoreResources& resources)
+      : items(resources.resource(MemoryCategory::kCatalogItems)),
+        index_by_id(resources.resource(MemoryCategory::kIndex)),
+        strings(resources.resource(MemoryCategory::kStrings)),
+        locales(resources.resource(MemoryCategory::kStrings)),
+        names(resources.resource(MemoryCategory::kCatalogItems)),
+        tax_class_ids(resources.resource(MemoryCategory::kStrings)),
+        tax_rates(resources.resource(MemoryCategory::kCatalogItems)),
+        remap_from_previous(resources.resource(MemoryCategory::kIndex)) {}
+  CatalogSnapshot(const CatalogSnapshot&) = delete;
+  CatalogSnapshot& operator=(const CatalogSnapshot&) = delete;
+
+  // Process-unique, unlike `generation` which restarts for every catalog.
+  unsigned long long snapshot_id = g_next_snapshot_id.fetch_add(1, std::memory_order_relaxed);
+  unsigned long long generation = 0;
+  std::pmr::vector<CatalogItem> items;
+  CatalogIndex index_by_id;
+  // Every id and name of this generation, back to back.
+  std::pmr::string strings;
+  std::pmr::vector<std::pmr::string> locales;
+  // Locale-major (1 + locales.size()) x items.size() matrix. Items without a translation point
+  // at their base name, so a lookup never needs a fallback branch.
+  std::pmr::vector<StringRef> names;
+  // Tax classes in document order, with their rates in basis points. Item prices include the
+  // tax unless the catalog says otherwise.
+  std::pmr::vector<std::pmr::string> tax_class_ids;
+  std::pmr::vector<long long> tax_rates;
+  bool prices_include_tax = true;
+  // Old item position -> new item position (or kNoItem) for the snapshot this one replaced, so
+  // carts migrate their lines with one array read per line instead of an id lookup.
+  unsigned long long previous_snapshot_id = 0;
+  std::pmr::vector<uint32_t> remap_from_previous;
+
+  std::string_view view(StringRef ref) const {
+    return std::string_view(strings.data() + ref.offset, ref.length);
+  }
+
+  std::string_view id_of(size_t position) const { return view(items[position].id); }
+
+  std::string_view category_of(size_t position) const { return view(items[position].category); }
+
+  std::string_view name_of(size_t position, size_t column) const {
+    return view(names[column * items.size() + position]);
+  }
+
+  bool has_explicit_name(size_t position, size_t column) const {
+    const StringRef ref = names[column * items.size() + position];
+    const StringRef base = names[position];
+    return ref.offset != base.offset || ref.length != base.length;
+  }
+
+  // Exact locale match first, then the language part of a region tag ("de-CH" -> "de").
+  size_t name_column(std::string_view locale) const {
+    if (locale.empty()) {
+      return kBaseNameColumn;
+    }
+    for (size_t i = 0; i < locales.size(); ++i) {
+      if (locales[i] == locale) {
+        return i + 1;
+      }
+    }
+    const size_t dash = locale.find('-');
+    return dash == std::string_view::npos ? kBaseNameColumn : name_column(locale.substr(0, dash));
+  }
+
+  uint32_t position_of(std::string_view item_id) const {
+    const size_t* position = index_by_id.find(item_id);
+    return position ? static_cast<uint32_t>(*position) : kNoItem;
+  }
+
+  void link_previous(const CatalogSnapshot& previous) {
+    previous_snapshot_id = previous.snapshot_id;
+    remap_from_previous.resize(previous.items.size());
+    for (size_t i = 0; i < previous.items.size(); ++i) {
+      remap_from_previous[i] = position_of(previous.id_of(i));
+    }
+  }
+
+  const std::pmr::vector<uint32_t>* remap_from(const CatalogSnapshot& older) const {
+    return older.snapshot_id == previous_snapshot_id ? &remap_from_previous : nullptr;
+  }
+};
+
+using SnapshotPtr = std::shared_ptr<const CatalogSnapshot>;
+using MutableSnapshotPtr = std::shared_ptr<CatalogSnapshot>;
+
+MutableSnapshotPtr make_snapshot();
+
+class Catalog {
+ public:
+  Catalog(std::string_view catalog_name, std::pmr::memory_resource* resource)
+      : name(catalog_name, resource),
+        current(make_snapshot()),
+        display_locale_(resource),
+        stock_slots_(resource) {}
+
+  SnapshotPtr acquire() const {
+    CatalogLock lock(mutex);
+    return current;
+  }
+
+  void publish(MutableSnapshotPtr snapshot) {
+    TraceSpan span("snapshot_swap");
+    snapshot->link_previous(*acquire());
+    CatalogLock lock(mutex);
+    load_sequence.fetch_add(1, std::memory_order_relaxed);
+    swap_in(std::move(snapshot));
+  }
+
+  // Reserves a sequence number for a background load. Any later load, synchronous or not,
+  // supersedes it.
+  unsigned long long begin_load() {
+    return load_sequence.fetch_add(1, std::memory_order_relaxed) + 1;
+  }
+
+  bool is_latest_load(unsigned long long sequence) const {
+    return load_sequence.load(std::memory_order_relaxed) == sequence;
+  }
+
+  bool publish_if_latest(MutableSnapshotPtr snapshot, unsigned long long sequence) {
+    TraceSpan span("snapshot_swap");
+    snapshot->link_previous(*acquire());
+    CatalogLock lock(mutex);
+    if (!is_latest_load(sequence)) {
+      return false;
+    }
+    swap_in(std::move(snapshot));
+    return true;
+  }
+
+  std::pmr::string display_locale() const {
+    CatalogLock lock(mutex);
+    return display_locale_;
+  }
+
+  void set_display_locale(std::string_view locale) {
+    CatalogLock lock(mutex);
+    display_locale_.assign(locale.data(), locale.size());
+  }
+
+  // Null until rules are loaded. Carts pin the rules current when they start, rebind or reprice.
+  PricingPtr acquire_pricing() const {
+    CatalogLock lock(mutex);
+    return pricing_;
+  }
+
+  void set_pricing(PricingPtr pricing) {
+    CatalogLock lock(mutex);
+    pricing_ = std::move(pricing);
+  }
+
+  // Null while stock is not limited. Carts follow the current ledger (CartStock::follow).
+  StockPtr acquire_stock() const {
+    CatalogLock lock(mutex);
+    return stock_;
+  }
+
+  // Makes `stock` the current ledger; null lifts every limit. Each item it lists keeps its slot
+  // from earlier ledgers and is restocked to its new count, so units carts already hold are
+  // counted against it rather than sold twice.
+  void set_stock(StockPtr stock);
+
+  const std::pmr::string name;
+  // Bumped after every publish so carts can detect a stale snapshot without taking the mutex.
+  std::atomic<unsigned long long> generation{0};
+  // Bumped by every set_stock, so carts only take the mutex after a new ledger.
+  std::atomic<unsigned long long> stock_version{0};
+
+ private:
+  void swap_in(MutableSnapshotPtr snapshot) {
+    snapshot->generation = generation.load(std::memory_order_relaxed) + 1;
+    current = std::move(snapshot);
+    generation.store(current->generation, std::memory_order_release);
+  }
+
+  mutable std::mutex mutex;
+  SnapshotPtr current;
+  std::atomic<unsigned long long> load_sequence{0};
+  std::pmr::string display_locale_;
+  PricingPtr pricing_;
+  StockPtr stock_;
+  // Serializes set_stock; carts never take it.
+  std::mutex stock_mutex_;
+  StockSlots stock_slots_;
+};
+
+using CatalogPtr = std::shared_ptr<Catalog>;
+
+CatalogPtr make_catalog(std::string_view name);
+
+constexpr const char* kDefaultCatalogName = "default";
+
+// Guards catalog_registry(), the catalogs made by cs_catalog_new.
+extern std::mutex g_catalog_registry_mutex;
+
+// Long-lived structures are created on first use, after cs_set_allocator had its chance to run.
+std::pmr::vector<CatalogPtr>& catalog_registry();
+const CatalogPtr& default_catalog();
+
+// Null for handles that are not a live catalog.
+CatalogPtr resolve_catalog(cs_catalog_t handle);
+
+constexpr size_t kMaxLoadThreads = 64;
+// Worker threads a catalog load may use (cs_catalog_set_load_threads).
+extern std::atomic<int> g_catalog_load_threads;
+
+// Fills `out_state` in place. On failure its contents are unspecified and must be discarded.
+bool parse_catalog_json(const char* json, CatalogSnapshot* out_state, std::string* out_error);
+
+// Parses and publishes a new generation. Both return a CS_ERROR_* result.
+int load_catalog(Catalog& catalog, const char* json);
+int write_catalog_json(const Catalog& catalog, char** out_json);
+
+}  // namespace cashsloth
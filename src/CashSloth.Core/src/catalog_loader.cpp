@@ -0,0 +1,201 @@
+#include "catalog_loader.h"
+
+#include <new>
+
+#include "diagnostics.h"
+#include "files.h"
+
+namespace cashsloth {
+namespace {
+
+// Reported for failed tickets whose error text could not be stored.
+constexpr const char* kLoadOutOfMemory = "Out of memory loading catalog.";
+
+}  // namespace
+
+void CatalogLoader::submit(const TicketPtr& ticket, bool track) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (track) {
+    tickets_.emplace(ticket.get(), ticket);
+  }
+  try {
+    queue_.push_back(ticket);
+  } catch (...) {
+    tickets_.erase(ticket.get());
+    throw;
+  }
+  if (!worker_.joinable()) {
+    stopping_ = false;
+    worker_ = std::thread([this] { run(); });
+  }
+  wake_.notify_one();
+}
+
+TicketPtr CatalogLoader::find(cs_load_ticket_t handle) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = tickets_.find(static_cast<LoadTicket*>(handle));
+  return it == tickets_.end() ? nullptr : it->second;
+}
+
+bool CatalogLoader::release(cs_load_ticket_t handle) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return tickets_.erase(static_cast<LoadTicket*>(handle)) > 0;
+}
+
+void CatalogLoader::stop() {
+  std::pmr::deque<TicketPtr> abandoned(queue_.get_allocator().resource());
+  std::thread worker;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+    abandoned.swap(queue_);
+    worker = std::move(worker_);
+    wake_.notify_all();
+  }
+  if (worker.joinable()) {
+    worker.join();
+  }
+  for (const auto& ticket : abandoned) {
+    finish(*ticket, CS_LOAD_CANCELLED, "Catalog load cancelled by shutdown.");
+  }
+}
+
+void CatalogLoader::run() {
+  trace_name_thread("catalog loader");
+  for (;;) {
+    TicketPtr ticket;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      wake_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+      if (stopping_) {
+        return;
+      }
+      ticket = std::move(queue_.front());
+      queue_.pop_front();
+    }
+    process(*ticket);
+  }
+}
+
+void CatalogLoader::process(LoadTicket& ticket) {
+  TraceSpan span("background_load");
+  try {
+    build_and_publish(ticket);
+  } catch (const std::bad_alloc&) {
+    finish(ticket, CS_LOAD_FAILED, kLoadOutOfMemory, CS_ERRC_OUT_OF_MEMORY);
+  } catch (const std::exception& e) {
+    finish(ticket, CS_LOAD_FAILED, e.what(), CS_ERRC_INTERNAL);
+  }
+}
+
+void CatalogLoader::build_and_publish(LoadTicket& ticket) {
+  if (superseded(ticket)) {
+    finish(ticket, CS_LOAD_CANCELLED, "Catalog load was cancelled or superseded.");
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(ticket.mutex);
+    ticket.state = CS_LOAD_RUNNING;
+  }
+
+  std::pmr::string file_contents(core_resource(MemoryCategory::kParser));
+  if (ticket.payload_is_path && !read_file(ticket.payload, &file_contents)) {
+    std::string error = "Unable to read catalog file: ";
+    error += ticket.payload;
+    finish(ticket, CS_LOAD_FAILED, error, CS_ERRC_IO);
+    return;
+  }
+  const std::pmr::string& json = ticket.payload_is_path ? file_contents : ticket.payload;
+
+  CatalogLoadTimer load_timer;
+  MutableSnapshotPtr new_state = make_snapshot();
+  std::string error;
+  if (!parse_catalog_json(json.c_str(), new_state.get(), &error)) {
+    finish(ticket, CS_LOAD_FAILED, error, CS_ERRC_INVALID_CATALOG);
+    return;
+  }
+  if (superseded(ticket) ||
+      !ticket.catalog->publish_if_latest(std::move(new_state), ticket.sequence)) {
+    finish(ticket, CS_LOAD_CANCELLED, "Catalog load was cancelled or superseded.");
+    return;
+  }
+  finish(ticket, CS_LOAD_SUCCEEDED, std::string_view());
+}
+
+void CatalogLoader::finish(LoadTicket& ticket, int state, std::string_view error,
+                           int error_code) noexcept {
+  {
+    std::lock_guard<std::mutex> lock(ticket.mutex);
+    ticket.state = state;
+    ticket.error_code = error_code;
+    try {
+      ticket.error.assign(error.data(), error.size());
+    } catch (...) {
+      ticket.error.clear();
+    }
+  }
+  if (ticket.callback) {
+    ticket.callback(&ticket, state, ticket.user_data);
+  }
+  {
+    std::lock_guard<std::mutex> lock(ticket.mutex);
+    ticket.settled = true;
+  }
+  ticket.done.notify_all();
+}
+
+CatalogLoader& catalog_loader() {
+  static CatalogLoader loader;
+  return loader;
+}
+
+int submit_catalog_load(cs_catalog_t catalog, const char* payload, bool payload_is_path,
+                        cs_catalog_load_callback callback, void* user_data,
+                        cs_load_ticket_t* out_ticket) {
+  CatalogPtr catalog_ptr = resolve_catalog(catalog);
+  if (!catalog_ptr) {
+    set_last_error(CS_ERRC_INVALID_HANDLE, "catalog must be a live catalog handle.");
+    return CS_ERROR_INVALID_ARGUMENT;
+  }
+  if (!payload || payload[0] == '\0') {
+    set_last_error(CS_ERRC_NULL_ARGUMENT, payload_is_path ? "path must not be null or empty."
+                                                          : "Catalog JSON must not be null or empty.");
+    return CS_ERROR_INVALID_ARGUMENT;
+  }
+
+  std::pmr::memory_resource* resource = core_resource();
+  auto ticket = std::allocate_shared<LoadTicket>(
+      std::pmr::polymorphic_allocator<LoadTicket>(resource), resource);
+  ticket->payload = payload;
+  ticket->payload_is_path = payload_is_path;
+  ticket->callback = callback;
+  ticket->user_data = user_data;
+  ticket->sequence = catalog_ptr->begin_load();
+  ticket->catalog = std::move(catalog_ptr);
+  catalog_loader().submit(ticket, out_ticket != nullptr);
+  if (out_ticket) {
+    *out_ticket = ticket.get();
+  }
+  clear_last_error();
+  return CS_SUCCESS;
+}
+
+int report_ticket_state(LoadTicket& ticket, int* out_state) {
+  std::lock_guard<std::mutex> lock(ticket.mutex);
+  *out_state = ticket.state;
+  // A failed load surfaces its validation message through cs_last_error on the polling thread.
+  // The poll itself succeeded, so it is not counted as a failed call.
+  if (ticket.state == CS_LOAD_FAILED) {
+    if (ticket.error.empty()) {
+      set_last_error(CS_ERRC_OUT_OF_MEMORY, kLoadOutOfMemory);
+    } else {
+      set_last_error_text(ticket.error_code, ticket.error);
+    }
+    note_call_failed(false);
+  } else {
+    clear_last_error();
+  }
+  return CS_SUCCESS;
+}
+
+}  // namespace cashsloth
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+
+#include "cashsloth_core.h"
+#include "catalog.h"
+#include "errors.h"
+#include "memory.h"
+
+namespace cashsloth {
+
+struct LoadTicket {
+  explicit LoadTicket(std::pmr::memory_resource* resource) : payload(resource), error(resource) {}
+
+  CatalogPtr catalog;
+  unsigned long long sequence = 0;
+  std::pmr::string payload;
+  bool payload_is_path = false;
+  cs_catalog_load_callback callback = nullptr;
+  void* user_data = nullptr;
+  std::atomic<bool> cancel_requested{false};
+
+  std::mutex mutex;
+  std::condition_variable done;
+  int state = CS_LOAD_PENDING;
+  // CS_ERRC_* code of a failed load.
+  int error_code = CS_ERRC_NONE;
+  std::pmr::string error;
+  // Set once the completion callback has returned; waiters block on this rather than `state`.
+  bool settled = false;
+};
+
+using TicketPtr = std::shared_ptr<LoadTicket>;
+
+// Core-owned worker that parses and indexes catalogs off the caller's thread. Snapshots are
+// built completely before the swap, so carts keep resolving against the previous generation
+// until the single pointer exchange in Catalog::publish_if_latest.
+class CatalogLoader {
+ public:
+  CatalogLoader() : queue_(core_resource()), tickets_(core_resource()) {}
+  ~CatalogLoader() { stop(); }
+
+  void submit(const TicketPtr& ticket, bool track);
+  TicketPtr find(cs_load_ticket_t handle);
+  bool release(cs_load_ticket_t handle);
+
+  // Cancels queued work and joins the worker. Called from cs_shutdown; the worker restarts
+  // lazily on the next submit.
+  void stop();
+
+ private:
+  void run();
+
+  static bool superseded(const LoadTicket& ticket) {
+    return ticket.cancel_requested.load(std::memory_order_relaxed) ||
+           !ticket.catalog->is_latest_load(ticket.sequence);
+  }
+
+  // Allocation failures while building fail the ticket; the worker itself keeps running.
+  static void process(LoadTicket& ticket);
+  static void build_and_publish(LoadTicket& ticket);
+
+  // The message is dropped rather than failing when even the error text cannot be stored;
+  // report_ticket_state then falls back to kLoadOutOfMemory.
+  static void finish(LoadTicket& ticket, int state, std::string_view error,
+                     int error_code = CS_ERRC_NONE) noexcept;
+
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::pmr::deque<TicketPtr> queue_;
+  std::pmr::unordered_map<const LoadTicket*, TicketPtr> tickets_;
+  std::thread worker_;
+  bool stopping_ = false;
+};
+
+CatalogLoader& catalog_loader();
+
+// Shared by cs_catalog_load_json_async and cs_catalog_load_file_async.
+int submit_catalog_load(cs_catalog_t catalog, const char* payload, bool payload_is_path,
+                        cs_catalog_load_callback callback, void* user_data,
+                        cs_load_ticket_t* out_ticket);
+
+// Poll and wait report a ticket the same way, surfacing a failed load's message.
+int report_ticket_state(LoadTicket& ticket, int* out_state);
+
+}  // namespace cashsloth
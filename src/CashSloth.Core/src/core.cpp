@@ -1,559 +1,1720 @@
 #include "cashsloth_core.h"
 
-#include <cstdio>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
 #include <cstdlib>
 #include <cstring>
 #include <limits>
+#include <memory>
+#include <memory_resource>
 #include <mutex>
 #include <new>
 #include <string>
-#include <unordered_map>
-#include <unordered_set>
+#include <string_view>
 #include <vector>
 
+#include "cart.h"
+#include "cash_drawer.h"
+#include "catalog.h"
+#include "catalog_loader.h"
+#include "diagnostics.h"
+#include "display_region.h"
+#include "encoding.h"
+#include "errors.h"
+#include "files.h"
+#include "journal.h"
+#include "memory.h"
 #include "mini_json.hpp"
+#include "money.h"
+#include "recorder.h"
+#include "sale_record.h"
+
+// The C entry points. Each subsystem lives in its own translation unit under namespace
+// cashsloth; this file only validates arguments and maps results onto the C API.
+using namespace cashsloth;
 
 namespace {
-thread_local std::string g_last_error;
-
-void set_last_error(const char* message) {
-  if (message) {
-    g_last_error = message;
-  } else {
-    g_last_error.clear();
-  }
-}
-
-struct CartLine {
-  std::string item_id;
-  int qty = 0;
-  long long unit_cents = 0;
-};
-
-class Cart {
- public:
-  std::vector<CartLine> lines;
-  long long given_cents = 0;
-};
-
-struct CatalogItem {
-  std::string id;
-  std::string name;
-  long long unit_cents = 0;
-};
-
-struct CatalogState {
-  std::vector<CatalogItem> items;
-  std::unordered_map<std::string, size_t> index_by_id;
-};
-
-std::mutex g_catalog_mutex;
-CatalogState g_catalog;
-
-bool lookup_unit_cents(const std::string& item_id, long long* out_unit_cents) {
-  if (!out_unit_cents) {
-    return false;
-  }
-
-  std::lock_guard<std::mutex> lock(g_catalog_mutex);
-  auto it = g_catalog.index_by_id.find(item_id);
-  if (it == g_catalog.index_by_id.end()) {
-    return false;
-  }
-  *out_unit_cents = g_catalog.items[it->second].unit_cents;
-  return true;
-}
-
-bool lookup_item_name(const std::string& item_id, std::string* out_name) {
-  if (!out_name) {
-    return false;
-  }
-
-  std::lock_guard<std::mutex> lock(g_catalog_mutex);
-  auto it = g_catalog.index_by_id.find(item_id);
-  if (it == g_catalog.index_by_id.end()) {
-    return false;
-  }
-  *out_name = g_catalog.items[it->second].name;
-  return true;
-}
-
-Cart* as_cart(cs_cart_t cart) {
-  return static_cast<Cart*>(cart);
-}
-
-long long compute_total_cents(const Cart& cart) {
-  long long total = 0;
-  for (const auto& line : cart.lines) {
-    total += line.unit_cents * static_cast<long long>(line.qty);
-  }
-  return total;
-}
-
-std::string escape_json_string(const std::string& input) {
-  std::string output;
-  output.reserve(input.size());
-  for (unsigned char ch : input) {
-    switch (ch) {
-      case '\"':
-        output += "\\\"";
-        break;
-      case '\\':
-        output += "\\\\";
-        break;
-      case '\b':
-        output += "\\b";
-        break;
-      case '\f':
-        output += "\\f";
-        break;
-      case '\n':
-        output += "\\n";
-        break;
-      case '\r':
-        output += "\\r";
-        break;
-      case '\t':
-        output += "\\t";
-        break;
-      default:
-        if (ch < 0x20) {
-          char buffer[7];
-          std::snprintf(buffer, sizeof(buffer), "\\u%04x", ch);
-          output += buffer;
-        } else {
-          output += static_cast<char>(ch);
-        }
-        break;
-    }
+
+std::atomic<bool> g_initialized{false};
+
+}  // namespace
+
+int cs_set_allocator(const cs_allocator* allocator) try {
+  CS_ENTRY(cs_set_allocator);
+  if (g_initialized.load(std::memory_order_acquire)) {
+    set_last_error(CS_ERRC_INVALID_STATE, "cs_set_allocator must be called before cs_init.");
+    return CS_ERROR_INVALID_ARGUMENT;
+  }
+  if (!allocator) {
+    g_core_resources.store(&g_heap_resources, std::memory_order_release);
+    clear_last_error();
+    return CS_SUCCESS;
+  }
+  if (!allocator->allocate || !allocator->deallocate) {
+    set_last_error(CS_ERRC_INVALID_VALUE, "allocator must provide allocate and deallocate.");
+    return CS_ERROR_INVALID_ARGUMENT;
+  }
+
+  // Never freed: memory allocated through a hook resource may be returned to it at any time,
+  // up to static destruction.
+  HookResource* hooks = new (std::nothrow) HookResource(*allocator);
+  CoreResources* resources = hooks ? new (std::nothrow) CoreResources(hooks) : nullptr;
+  if (!resources) {
+    delete hooks;
+    set_last_error(CS_ERRC_OUT_OF_MEMORY, "Out of memory installing allocator.");
+    return CS_ERROR_OUT_OF_MEMORY;
   }
-  return output;
+  g_core_resources.store(resources, std::memory_order_release);
+  clear_last_error();
+  return CS_SUCCESS;
+} catch (...) {
+  return translate_exception();
 }
 
-bool parse_catalog_json(const char* json, CatalogState* out_state, std::string* out_error) {
-  if (!json || json[0] == '\0') {
-    if (out_error) {
-      *out_error = "Catalog JSON must not be null or empty.";
-    }
-    return false;
+int cs_init() try {
+  CS_ENTRY(cs_init);
+  g_initialized.store(true, std::memory_order_release);
+  clear_last_error();
+  return CS_SUCCESS;
+} catch (...) {
+  return translate_exception();
+}
+
+void cs_shutdown() {
+  CS_ENTRY(cs_shutdown);
+  catalog_loader().stop();
+  sale_journal().close();
+  cash_drawer().set_json(nullptr);
+  g_initialized.store(false, std::memory_order_release);
+  clear_last_error();
+}
+
+const char* cs_last_error() {
+  CS_ENTRY(cs_last_error);
+  try {
+    return formatted_last_error();
+  } catch (...) {
+    return "Out of memory formatting the last error.";
+  }
+}
+
+int cs_last_error_code() {
+  CS_ENTRY(cs_last_error_code);
+  return g_error.code;
+}
+
+void cs_free(void* p) {
+  CS_ENTRY(cs_free);
+  free_buffer(p);
+}
+
+int cs_get_version(char** out_json) try {
+  CS_ENTRY(cs_get_version);
+  if (!out_json) {
+    set_last_error(CS_ERRC_NULL_ARGUMENT, "out_json must not be null.");
+    return CS_ERROR_INVALID_ARGUMENT;
+  }
+
+  *out_json = copy_to_buffer("{\"version\":\"0.1.0\"}");
+  clear_last_error();
+  return CS_SUCCESS;
+} catch (...) {
+  return translate_exception();
+}
+
+int cs_catalog_load_json(const char* json) try {
+  CS_ENTRY(cs_catalog_load_json);
+  CS_RECORD(cs_catalog_load_json, json);
+  return load_catalog(*default_catalog(), json);
+} catch (...) {
+  return translate_exception();
+}
+
+int cs_catalog_get_json(char** out_json) try {
+  CS_ENTRY(cs_catalog_get_json);
+  CS_RECORD(cs_catalog_get_json, out_json);
+  return write_catalog_json(*default_catalog(), out_json);
+} catch (...) {
+  return translate_exception();
+}
+
+int cs_catalog_load_json_async(cs_catalog_t catalog, const char* json,
+                               cs_catalog_load_callback callback, void* user_data,
+                               cs_load_ticket_t* out_ticket) try {
+  CS_ENTRY(cs_catalog_load_json_async);
+  CS_RECORD(cs_catalog_load_json_async, catalog, json, out_ticket);
+  return submit_catalog_load(catalog, json, false, callback, user_data, out_ticket);
+} catch (...) {
+  return translate_exception();
+}
+
+int cs_catalog_load_file_async(cs_catalog_t catalog, const char* path,
+                               cs_catalog_load_callback callback, void* user_data,
+                               cs_load_ticket_t* out_ticket) try {
+  CS_ENTRY(cs_catalog_load_file_async);
+  CS_RECORD(cs_catalog_load_file_async, catalog, path, out_ticket);
+  return submit_catalog_load(catalog, path, true, callback, user_data, out_ticket);
+} catch (...) {
+  return translate_exception();
+}
+
+int cs_load_ticket_poll(cs_load_ticket_t ticket, int* out_state) try {
+  CS_ENTRY(cs_load_ticket_poll);
+  CS_RECORD(cs_load_ticket_poll, ticket, out_state);
+  TicketPtr ticket_ptr = catalog_loader().find(ticket);
+  if (!ticket_ptr) {
+    set_last_error(CS_ERRC_INVALID_HANDLE, "ticket must be a live load ticket.");
+    return CS_ERROR_INVALID_ARGUMENT;
   }
   if (!out_state) {
-    if (out_error) {
-      *out_error = "Catalog output state must not be null.";
+    set_last_error(CS_ERRC_NULL_ARGUMENT, "out_state must not be null.");
+    return CS_ERROR_INVALID_ARGUMENT;
+  }
+
+  return report_ticket_state(*ticket_ptr, out_state);
+} catch (...) {
+  return translate_exception();
+}
+
+int cs_load_ticket_wait(cs_load_ticket_t ticket, int timeout_ms, int* out_state) try {
+  CS_ENTRY(cs_load_ticket_wait);
+  CS_RECORD(cs_load_ticket_wait, ticket, timeout_ms, out_state);
+  TicketPtr ticket_ptr = catalog_loader().find(ticket);
+  if (!ticket_ptr) {
+    set_last_error(CS_ERRC_INVALID_HANDLE, "ticket must be a live load ticket.");
+    return CS_ERROR_INVALID_ARGUMENT;
+  }
+  if (!out_state) {
+    set_last_error(CS_ERRC_NULL_ARGUMENT, "out_state must not be null.");
+    return CS_ERROR_INVALID_ARGUMENT;
+  }
+
+  {
+    std::unique_lock<std::mutex> lock(ticket_ptr->mutex);
+    auto is_finished = [&ticket_ptr] { return ticket_ptr->settled; };
+    if (timeout_ms < 0) {
+      ticket_ptr->done.wait(lock, is_finished);
+    } else {
+      ticket_ptr->done.wait_for(lock, std::chrono::milliseconds(timeout_ms), is_finished);
     }
-    return false;
   }
+  return report_ticket_state(*ticket_ptr, out_state);
+} catch (...) {
+  return translate_exception();
+}
+
+int cs_load_ticket_cancel(cs_load_ticket_t ticket) try {
+  CS_ENTRY(cs_load_ticket_cancel);
+  CS_RECORD(cs_load_ticket_cancel, ticket);
+  TicketPtr ticket_ptr = catalog_loader().find(ticket);
+  if (!ticket_ptr) {
+    set_last_error(CS_ERRC_INVALID_HANDLE, "ticket must be a live load ticket.");
+    return CS_ERROR_INVALID_ARGUMENT;
+  }
+
+  ticket_ptr->cancel_requested.store(true, std::memory_order_relaxed);
+  clear_last_error();
+  return CS_SUCCESS;
+} catch (...) {
+  return translate_exception();
+}
+
+int cs_load_ticket_free(cs_load_ticket_t ticket) try {
+  CS_ENTRY(cs_load_ticket_free);
+  CS_RECORD(cs_load_ticket_free, ticket);
+  if (!ticket) {
+    clear_last_error();
+    return CS_SUCCESS;
+  }
+  if (!catalog_loader().release(ticket)) {
+    set_last_error(CS_ERRC_INVALID_HANDLE, "ticket must be a live load ticket.");
+    return CS_ERROR_INVALID_ARGUMENT;
+  }
+
+  clear_last_error();
+  return CS_SUCCESS;
+} catch (...) {
+  return translate_exception();
+}
 
-  mini_json::Value root;
-  std::string parse_error;
-  if (!mini_json::parse(json, &root, &parse_error)) {
-    if (out_error) {
-      *out_error = "Invalid catalog JSON: " + parse_error;
+int cs_catalog_set_load_threads(int threads) try {
+  CS_ENTRY(cs_catalog_set_load_threads);
+  CS_RECORD(cs_catalog_set_load_threads, threads);
+  if (threads < 0 || static_cast<size_t>(threads) > kMaxLoadThreads) {
+    set_last_error(CS_ERRC_INVALID_VALUE, "threads must be between 0 and 64.");
+    return CS_ERROR_INVALID_ARGUMENT;
+  }
+
+  g_catalog_load_threads.store(threads == 0 ? 1 : threads, std::memory_order_relaxed);
+  clear_last_error();
+  return CS_SUCCESS;
+} catch (...) {
+  return translate_exception();
+}
+
+int cs_catalog_new(const char* name, cs_catalog_t* out_catalog) try {
+  CS_ENTRY(cs_catalog_new);
+  CS_RECORD(cs_catalog_new, name, out_catalog);
+  if (!out_catalog) {
+    set_last_error(CS_ERRC_NULL_ARGUMENT, "out_catalog must not be null.");
+    return CS_ERROR_INVALID_ARGUMENT;
+  }
+
+  const std::string_view catalog_name = name ? name : "";
+  std::lock_guard<std::mutex> lock(g_catalog_registry_mutex);
+  auto& catalogs = catalog_registry();
+  if (!catalog_name.empty()) {
+    bool taken = catalog_name == kDefaultCatalogName;
+    for (const auto& catalog : catalogs) {
+      taken = taken || catalog->name == catalog_name;
+    }
+    if (taken) {
+      set_last_error(CS_ERRC_NAME_IN_USE, "Catalog name already in use: ", catalog_name);
+      return CS_ERROR_INVALID_ARGUMENT;
     }
-    return false;
   }
 
-  if (!root.is_object()) {
-    if (out_error) {
-      *out_error = "Catalog JSON must be an object.";
+  CatalogPtr catalog = make_catalog(catalog_name);
+  catalogs.push_back(catalog);
+  *out_catalog = catalog.get();
+  clear_last_error();
+  return CS_SUCCESS;
+} catch (...) {
+  return translate_exception();
+}
+
+int cs_catalog_free(cs_catalog_t catalog) try {
+  CS_ENTRY(cs_catalog_free);
+  CS_RECORD(cs_catalog_free, catalog);
+  if (!catalog) {
+    clear_last_error();
+    return CS_SUCCESS;
+  }
+  if (catalog == default_catalog().get()) {
+    set_last_error(CS_ERRC_INVALID_STATE, "The default catalog cannot be freed.");
+    return CS_ERROR_INVALID_ARGUMENT;
+  }
+
+  CatalogPtr released;
+  {
+    std::lock_guard<std::mutex> lock(g_catalog_registry_mutex);
+    auto& catalogs = catalog_registry();
+    auto it = std::find_if(catalogs.begin(), catalogs.end(),
+                           [catalog](const CatalogPtr& entry) { return entry.get() == catalog; });
+    if (it == catalogs.end()) {
+      set_last_error(CS_ERRC_INVALID_HANDLE, "catalog is not a live catalog handle.");
+      return CS_ERROR_INVALID_ARGUMENT;
     }
-    return false;
+    // Carts bound to this catalog keep their own reference, so the instance outlives the handle.
+    released = std::move(*it);
+    catalogs.erase(it);
   }
 
-  const auto& root_obj = root.as_object();
-  auto items_it = root_obj.find("items");
-  if (items_it == root_obj.end() || !items_it->second.is_array()) {
-    if (out_error) {
-      *out_error = "Catalog JSON must include an items array.";
+  clear_last_error();
+  return CS_SUCCESS;
+} catch (...) {
+  return translate_exception();
+}
+
+int cs_catalog_get_default(cs_catalog_t* out_catalog) try {
+  CS_ENTRY(cs_catalog_get_default);
+  CS_RECORD(cs_catalog_get_default, out_catalog);
+  if (!out_catalog) {
+    set_last_error(CS_ERRC_NULL_ARGUMENT, "out_catalog must not be null.");
+    return CS_ERROR_INVALID_ARGUMENT;
+  }
+
+  *out_catalog = default_catalog().get();
+  clear_last_error();
+  return CS_SUCCESS;
+} catch (...) {
+  return translate_exception();
+}
+
+int cs_catalog_find(const char* name, cs_catalog_t* out_catalog) try {
+  CS_ENTRY(cs_catalog_find);
+  CS_RECORD(cs_catalog_find, name, out_catalog);
+  if (!name || name[0] == '\0') {
+    set_last_error(CS_ERRC_NULL_ARGUMENT, "name must not be null or empty.");
+    return CS_ERROR_INVALID_ARGUMENT;
+  }
+  if (!out_catalog) {
+    set_last_error(CS_ERRC_NULL_ARGUMENT, "out_catalog must not be null.");
+    return CS_ERROR_INVALID_ARGUMENT;
+  }
+
+  if (std::strcmp(name, kDefaultCatalogName) == 0) {
+    *out_catalog = default_catalog().get();
+    clear_last_error();
+    return CS_SUCCESS;
+  }
+
+  std::lock_guard<std::mutex> lock(g_catalog_registry_mutex);
+  for (const auto& catalog : catalog_registry()) {
+    if (catalog->name == name) {
+      *out_catalog = catalog.get();
+      clear_last_error();
+      return CS_SUCCESS;
     }
-    return false;
   }
 
-  CatalogState new_state;
-  std::unordered_set<std::string> seen_ids;
-  const auto& items = items_it->second.as_array();
-  new_state.items.reserve(items.size());
+  set_last_error(CS_ERRC_UNKNOWN_CATALOG, "Unknown catalog name: ", name);
+  return CS_ERROR_INVALID_ARGUMENT;
+} catch (...) {
+  return translate_exception();
+}
 
-  for (const auto& item_value : items) {
-    if (!item_value.is_object()) {
-      if (out_error) {
-        *out_error = "Catalog items must be JSON objects.";
-      }
-      return false;
+int cs_catalog_instance_load_json(cs_catalog_t catalog, const char* json) try {
+  CS_ENTRY(cs_catalog_instance_load_json);
+  CS_RECORD(cs_catalog_instance_load_json, catalog, json);
+  CatalogPtr catalog_ptr = resolve_catalog(catalog);
+  if (!catalog_ptr) {
+    set_last_error(CS_ERRC_INVALID_HANDLE, "catalog must be a live catalog handle.");
+    return CS_ERROR_INVALID_ARGUMENT;
+  }
+
+  return load_catalog(*catalog_ptr, json);
+} catch (...) {
+  return translate_exception();
+}
+
+int cs_catalog_instance_get_json(cs_catalog_t catalog, char** out_json) try {
+  CS_ENTRY(cs_catalog_instance_get_json);
+  CS_RECORD(cs_catalog_instance_get_json, catalog, out_json);
+  CatalogPtr catalog_ptr = resolve_catalog(catalog);
+  if (!catalog_ptr) {
+    set_last_error(CS_ERRC_INVALID_HANDLE, "catalog must be a live catalog handle.");
+    return CS_ERROR_INVALID_ARGUMENT;
+  }
+
+  return write_catalog_json(*catalog_ptr, out_json);
+} catch (...) {
+  return translate_exception();
+}
+
+int cs_catalog_set_display_locale(cs_catalog_t catalog, const char* locale) try {
+  CS_ENTRY(cs_catalog_set_display_locale);
+  CS_RECORD(cs_catalog_set_display_locale, catalog, locale);
+  CatalogPtr catalog_ptr = resolve_catalog(catalog);
+  if (!catalog_ptr) {
+    set_last_error(CS_ERRC_INVALID_HANDLE, "catalog must be a live catalog handle.");
+    return CS_ERROR_INVALID_ARGUMENT;
+  }
+
+  catalog_ptr->set_display_locale(locale ? locale : "");
+  clear_last_error();
+  return CS_SUCCESS;
+} catch (...) {
+  return translate_exception();
+}
+
+int cs_catalog_set_pricing_json(cs_catalog_t catalog, const char* rules_json) try {
+  CS_ENTRY(cs_catalog_set_pricing_json);
+  CS_RECORD(cs_catalog_set_pricing_json, catalog, rules_json);
+  CatalogPtr catalog_ptr = resolve_catalog(catalog);
+  if (!catalog_ptr) {
+    set_last_error(CS_ERRC_INVALID_HANDLE, "catalog must be a live catalog handle.");
+    return CS_ERROR_INVALID_ARGUMENT;
+  }
+  if (!rules_json) {
+    set_last_error(CS_ERRC_NULL_ARGUMENT, "rules_json must not be null.");
+    return CS_ERROR_INVALID_ARGUMENT;
+  }
+
+  TraceSpan span("catalog_set_pricing");
+  std::pmr::memory_resource* resource = core_resource(MemoryCategory::kPricing);
+  auto rules = std::allocate_shared<PricingRules>(
+      std::pmr::polymorphic_allocator<PricingRules>(resource), resource);
+  const int code = compile_pricing_json(rules_json, rules.get());
+  if (code != CS_ERRC_NONE) {
+    return error_result(code);
+  }
+  catalog_ptr->set_pricing(std::move(rules));
+  clear_last_error();
+  return CS_SUCCESS;
+} catch (...) {
+  return translate_exception();
+}
+
+int cs_catalog_set_stock_json(cs_catalog_t catalog, const char* stock_json) try {
+  CS_ENTRY(cs_catalog_set_stock_json);
+  CS_RECORD(cs_catalog_set_stock_json, catalog, stock_json);
+  CatalogPtr catalog_ptr = resolve_catalog(catalog);
+  if (!catalog_ptr) {
+    set_last_error(CS_ERRC_INVALID_HANDLE, "catalog must be a live catalog handle.");
+    return CS_ERROR_INVALID_ARGUMENT;
+  }
+
+  // Null lifts every limit.
+  StockPtr stock;
+  if (stock_json) {
+    TraceSpan span("catalog_set_stock");
+    const int code = compile_stock_json(stock_json, &stock);
+    if (code != CS_ERRC_NONE) {
+      return error_result(code);
     }
-    const auto& item_obj = item_value.as_object();
-    auto id_it = item_obj.find("id");
-    if (id_it == item_obj.end() || !id_it->second.is_string()) {
-      if (out_error) {
-        *out_error = "Catalog item id must be a string.";
+  }
+  catalog_ptr->set_stock(std::move(stock));
+  clear_last_error();
+  return CS_SUCCESS;
+} catch (...) {
+  return translate_exception();
+}
+
+int cs_stock_snapshot_json(cs_catalog_t catalog, char** out_json) try {
+  CS_ENTRY(cs_stock_snapshot_json);
+  CS_RECORD(cs_stock_snapshot_json, catalog, out_json);
+  CatalogPtr catalog_ptr = resolve_catalog(catalog);
+  if (!catalog_ptr) {
+    set_last_error(CS_ERRC_INVALID_HANDLE, "catalog must be a live catalog handle.");
+    return CS_ERROR_INVALID_ARGUMENT;
+  }
+  if (!out_json) {
+    set_last_error(CS_ERRC_NULL_ARGUMENT, "out_json must not be null.");
+    return CS_ERROR_INVALID_ARGUMENT;
+  }
+
+  const StockPtr stock = catalog_ptr->acquire_stock();
+  std::pmr::string json(core_resource());
+  json.reserve(16 + (stock ? stock->ids.size() * 64 + stock->strings.size() : 0));
+  append_stock_json(stock.get(), json);
+  *out_json = copy_to_buffer(json);
+  clear_last_error();
+  return CS_SUCCESS;
+} catch (...) {
+  return translate_exception();
+}
+
+int cs_catalog_get_generation(cs_catalog_t catalog, unsigned long long* out_generation) try {
+  CS_ENTRY(cs_catalog_get_generation);
+  CS_RECORD(cs_catalog_get_generation, catalog, out_generation);
+  CatalogPtr catalog_ptr = resolve_catalog(catalog);
+  if (!catalog_ptr) {
+    set_last_error(CS_ERRC_INVALID_HANDLE, "catalog must be a live catalog handle.");
+    return CS_ERROR_INVALID_ARGUMENT;
+  }
+  if (!out_generation) {
+    set_last_error(CS_ERRC_NULL_ARGUMENT, "out_generation must not be null.");
+    return CS_ERROR_INVALID_ARGUMENT;
+  }
+
+  *out_generation = catalog_ptr->generation.load(std::memory_order_acquire);
+  clear_last_error();
+  return CS_SUCCESS;
+} catch (...) {
+  return translate_exception();
+}
+
+int cs_cart_new(cs_cart_t* out_cart) try {
+  CS_ENTRY(cs_cart_new);
+  CS_RECORD(cs_cart_new, out_cart);
+  if (!out_cart) {
+    set_last_error(CS_ERRC_NULL_ARGUMENT, "out_cart must not be null.");
+    return CS_ERROR_INVALID_ARGUMENT;
+  }
+
+  return new_cart(default_catalog(), false, out_cart);
+} catch (...) {
+  return translate_exception();
+}
+
+int cs_cart_new_for_catalog(cs_catalog_t catalog, cs_cart_t* out_cart) try {
+  CS_ENTRY(cs_cart_new_for_catalog);
+  CS_RECORD(cs_cart_new_for_catalog, catalog, out_cart);
+  CatalogPtr catalog_ptr = resolve_catalog(catalog);
+  if (!catalog_ptr) {
+    set_last_error(CS_ERRC_INVALID_HANDLE, "catalog must be a live catalog handle.");
+    return CS_ERROR_INVALID_ARGUMENT;
+  }
+  if (!out_cart) {
+    set_last_error(CS_ERRC_NULL_ARGUMENT, "out_cart must not be null.");
+    return CS_ERROR_INVALID_ARGUMENT;
+  }
+
+  return new_cart(std::move(catalog_ptr), false, out_cart);
+} catch (...) {
+  return translate_exception();
+}
+
+int cs_cart_new_concurrent(cs_catalog_t catalog, cs_cart_t* out_cart) try {
+  CS_ENTRY(cs_cart_new_concurrent);
+  CS_RECORD(cs_cart_new_concurrent, catalog, out_cart);
+  CatalogPtr catalog_ptr = resolve_catalog(catalog);
+  if (!catalog_ptr) {
+    set_last_error(CS_ERRC_INVALID_HANDLE, "catalog must be a live catalog handle.");
+    return CS_ERROR_INVALID_ARGUMENT;
+  }
+  if (!out_cart) {
+    set_last_error(CS_ERRC_NULL_ARGUMENT, "out_cart must not be null.");
+    return CS_ERROR_INVALID_ARGUMENT;
+  }
+
+  return new_cart(std::move(catalog_ptr), true, out_cart);
+} catch (...) {
+  return translate_exception();
+}
+
+int cs_cart_bind_catalog(cs_cart_t cart, cs_catalog_t catalog) try {
+  CS_ENTRY(cs_cart_bind_catalog);
+  CS_RECORD(cs_cart_bind_catalog, cart, catalog);
+  CartAccess access(cart);
+  Cart* cart_ptr = access.get();
+  if (!cart_ptr) {
+    set_last_error(CS_ERRC_INVALID_HANDLE, invalid_cart_message(cart));
+    return CS_ERROR_INVALID_ARGUMENT;
+  }
+  CatalogPtr catalog_ptr = resolve_catalog(catalog);
+  if (!catalog_ptr) {
+    set_last_error(CS_ERRC_INVALID_HANDLE, "catalog must be a live catalog handle.");
+    return CS_ERROR_INVALID_ARGUMENT;
+  }
+
+  // Lines keep their ids, so their units move to the new catalog's ledger as they are.
+  const int stock = cart_ptr->stock.rebind(*cart_ptr, *catalog_ptr);
+  if (stock != CS_ERRC_NONE) {
+    return error_result(stock);
+  }
+  cart_ptr->bind(std::move(catalog_ptr));
+  cart_ptr->display.publish(*cart_ptr);
+  clear_last_error();
+  return CS_SUCCESS;
+} catch (...) {
+  return translate_exception();
+}
+
+int cs_cart_set_display_locale(cs_cart_t cart, const char* locale) try {
+  CS_ENTRY(cs_cart_set_display_locale);
+  CS_RECORD(cs_cart_set_display_locale, cart, locale);
+  CartAccess access(cart);
+  Cart* cart_ptr = access.get();
+  if (!cart_ptr) {
+    set_last_error(CS_ERRC_INVALID_HANDLE, invalid_cart_message(cart));
+    return CS_ERROR_INVALID_ARGUMENT;
+  }
+
+  cart_ptr->display_locale = locale ? locale : "";
+  cart_ptr->display.publish(*cart_ptr);
+  clear_last_error();
+  return CS_SUCCESS;
+} catch (...) {
+  return translate_exception();
+}
+
+int cs_cart_set_pricing_context(cs_cart_t cart, const char* codes, long long local_time_ms) try {
+  CS_ENTRY(cs_cart_set_pricing_context);
+  CS_RECORD(cs_cart_set_pricing_context, cart, codes, local_time_ms);
+  CartAccess access(cart);
+  Cart* cart_ptr = access.get();
+  if (!cart_ptr) {
+    set_last_error(CS_ERRC_INVALID_HANDLE, invalid_cart_message(cart));
+    return CS_ERROR_INVALID_ARGUMENT;
+  }
+  if (local_time_ms < 0) {
+    set_last_error(CS_ERRC_INVALID_VALUE, "local_time_ms must not be negative.");
+    return CS_ERROR_INVALID_ARGUMENT;
+  }
+
+  cart_ptr->pricing.set_context(codes ? codes : "", local_time_ms);
+  cart_ptr->pricing.refresh(*cart_ptr);
+  cart_ptr->display.publish(*cart_ptr);
+  clear_last_error();
+  return CS_SUCCESS;
+} catch (...) {
+  return translate_exception();
+}
+
+int cs_cart_free(cs_cart_t cart) try {
+  CS_ENTRY(cs_cart_free);
+  CS_RECORD(cs_cart_free, cart);
+  if (!cart) {
+    clear_last_error();
+    return CS_SUCCESS;
+  }
+
+  if (!cart_pool().release(cart)) {
+    set_last_error(CS_ERRC_INVALID_HANDLE, invalid_cart_message(cart));
+    return CS_ERROR_INVALID_ARGUMENT;
+  }
+  clear_last_error();
+  return CS_SUCCESS;
+} catch (...) {
+  return translate_exception();
+}
+
+int cs_cart_clear(cs_cart_t cart) try {
+  CS_ENTRY(cs_cart_clear);
+  CS_RECORD(cs_cart_clear, cart);
+  return regular_result(cart_clear(cart));
+} catch (...) {
+  return translate_exception();
+}
+
+int cs_cart_clear_fast(cs_cart_t cart) try {
+  CS_ENTRY(cs_cart_clear_fast);
+  CS_RECORD(cs_cart_clear_fast, cart);
+  return cart_clear(cart);
+} catch (...) {
+  return exception_error_code();
+}
+
+int cs_cart_add_item_by_id(cs_cart_t cart, const char* item_id, int qty) try {
+  CS_ENTRY(cs_cart_add_item_by_id);
+  CS_RECORD(cs_cart_add_item_by_id, cart, item_id, qty);
+  return regular_result(cart_add_item_by_id(cart, item_id, qty));
+} catch (...) {
+  return translate_exception();
+}
+
+int cs_cart_add_item_by_id_fast(cs_cart_t cart, const char* item_id, int qty) try {
+  CS_ENTRY(cs_cart_add_item_by_id_fast);
+  CS_RECORD(cs_cart_add_item_by_id_fast, cart, item_id, qty);
+  return cart_add_item_by_id(cart, item_id, qty);
+} catch (...) {
+  return exception_error_code();
+}
+
+int cs_cart_remove_line(cs_cart_t cart, int line_index) try {
+  CS_ENTRY(cs_cart_remove_line);
+  CS_RECORD(cs_cart_remove_line, cart, line_index);
+  return regular_result(cart_remove_line(cart, line_index));
+} catch (...) {
+  return translate_exception();
+}
+
+int cs_cart_remove_line_fast(cs_cart_t cart, int line_index) try {
+  CS_ENTRY(cs_cart_remove_line_fast);
+  CS_RECORD(cs_cart_remove_line_fast, cart, line_index);
+  return cart_remove_line(cart, line_index);
+} catch (...) {
+  return exception_error_code();
+}
+
+int cs_cart_set_line_qty(cs_cart_t cart, int line_index, int qty) try {
+  CS_ENTRY(cs_cart_set_line_qty);
+  CS_RECORD(cs_cart_set_line_qty, cart, line_index, qty);
+  return regular_result(cart_set_line_qty(cart, line_index, qty));
+} catch (...) {
+  return translate_exception();
+}
+
+int cs_cart_set_line_qty_fast(cs_cart_t cart, int line_index, int qty) try {
+  CS_ENTRY(cs_cart_set_line_qty_fast);
+  CS_RECORD(cs_cart_set_line_qty_fast, cart, line_index, qty);
+  return cart_set_line_qty(cart, line_index, qty);
+} catch (...) {
+  return exception_error_code();
+}
+
+int cs_cart_reprice(cs_cart_t cart, int policy, char** out_report_json) try {
+  CS_ENTRY(cs_cart_reprice);
+  CS_RECORD(cs_cart_reprice, cart, policy, out_report_json);
+  CartAccess access(cart);
+  Cart* cart_ptr = access.get();
+  if (!cart_ptr) {
+    set_last_error(CS_ERRC_INVALID_HANDLE, invalid_cart_message(cart));
+    return CS_ERROR_INVALID_ARGUMENT;
+  }
+  if (policy != CS_REPRICE_KEEP_VANISHED && policy != CS_REPRICE_REMOVE_VANISHED) {
+    set_last_error(CS_ERRC_INVALID_VALUE, "policy must be CS_REPRICE_KEEP_VANISHED or CS_REPRICE_REMOVE_VANISHED.");
+    return CS_ERROR_INVALID_ARGUMENT;
+  }
+
+  const CatalogSnapshot& snapshot = cart_ptr->refresh_snapshot();
+  cart_ptr->stock.follow(*cart_ptr);
+  const bool remove_vanished = policy == CS_REPRICE_REMOVE_VANISHED;
+
+  // The report is built before the cart is touched so an allocation failure leaves it unchanged.
+  BufferPtr report;
+  if (out_report_json) {
+    TraceSpan span("serialize");
+    std::pmr::memory_resource* resource = core_resource();
+    std::pmr::string changed(resource);
+    std::pmr::string vanished(resource);
+    for (size_t i = 0; i < cart_ptr->lines.size(); ++i) {
+      const auto& line = cart_ptr->lines[i];
+      const CatalogItem* item = cart_ptr->item_of(line);
+      if (item && item->unit_cents == line.unit_cents) {
+        continue;
       }
-      return false;
-    }
-    const std::string& id = id_it->second.as_string();
-    if (id.empty()) {
-      if (out_error) {
-        *out_error = "Catalog item id must not be empty.";
+      std::pmr::string& target = item ? changed : vanished;
+      if (!target.empty()) {
+        target += ",";
       }
-      return false;
-    }
-    if (!seen_ids.insert(id).second) {
-      if (out_error) {
-        *out_error = "Duplicate catalog item id: " + id;
+      target += "{\"line_index\":";
+      append_integer(target, static_cast<long long>(i));
+      target += ",\"id\":\"";
+      append_json_escaped(target, cart_ptr->id_of(line));
+      target += "\",\"old_unit_cents\":";
+      append_integer(target, line.unit_cents);
+      if (item) {
+        target += ",\"new_unit_cents\":";
+        append_integer(target, item->unit_cents);
+      } else {
+        target += remove_vanished ? ",\"removed\":true" : ",\"removed\":false";
       }
-      return false;
+      target += "}";
     }
 
-    auto unit_it = item_obj.find("unit_cents");
-    if (unit_it == item_obj.end() || !unit_it->second.is_number() ||
-        !unit_it->second.number_is_integer()) {
-      if (out_error) {
-        *out_error = "Catalog item unit_cents must be an integer.";
-      }
-      return false;
+    std::pmr::string json(resource);
+    json.reserve(64 + changed.size() + vanished.size());
+    json += "{\"generation\":";
+    append_integer(json, static_cast<long long>(snapshot.generation));
+    json += ",\"changed\":[";
+    json += changed;
+    json += "],\"vanished\":[";
+    json += vanished;
+    json += "]}";
+
+    report.reset(copy_to_buffer(json));
+  }
+
+  auto& lines = cart_ptr->lines;
+  if (cart_ptr->recording()) {
+    size_t changes = 0;
+    for (const auto& line : lines) {
+      const CatalogItem* item = cart_ptr->item_of(line);
+      changes += item ? item->unit_cents != line.unit_cents : remove_vanished;
     }
-    long double unit_value = unit_it->second.as_number();
-    if (unit_value < 0 ||
-        unit_value > static_cast<long double>(std::numeric_limits<long long>::max())) {
-      if (out_error) {
-        *out_error = "Catalog item unit_cents must be non-negative.";
+    cart_ptr->reserve_changes(changes);
+    // New prices first, then vanished lines from the back, so each recorded index is valid.
+    for (size_t i = 0; i < lines.size(); ++i) {
+      const CatalogItem* item = cart_ptr->item_of(lines[i]);
+      if (item && item->unit_cents != lines[i].unit_cents) {
+        CartLine after = lines[i];
+        after.unit_cents = item->unit_cents;
+        cart_ptr->record_line(CartChange::kSetLine, i, lines[i], after);
       }
-      return false;
     }
-
-    std::string name;
-    auto name_it = item_obj.find("name");
-    if (name_it != item_obj.end()) {
-      if (!name_it->second.is_string()) {
-        if (out_error) {
-          *out_error = "Catalog item name must be a string.";
-        }
-        return false;
+    for (size_t i = lines.size(); i > 0 && remove_vanished; --i) {
+      if (!cart_ptr->item_of(lines[i - 1])) {
+        cart_ptr->record_line(CartChange::kEraseLine, i - 1, lines[i - 1], CartLine());
       }
-      name = name_it->second.as_string();
     }
+  }
+  size_t kept = 0;
+  for (size_t i = 0; i < lines.size(); ++i) {
+    const CatalogItem* item = cart_ptr->item_of(lines[i]);
+    if (item) {
+      lines[i].unit_cents = item->unit_cents;
+    } else if (remove_vanished) {
+      cart_ptr->stock.change(cart_ptr->id_of(lines[i]), -static_cast<long long>(lines[i].qty));
+      continue;
+    }
+    if (kept != i) {
+      lines[kept] = lines[i];
+    }
+    ++kept;
+  }
+  lines.erase(lines.begin() + static_cast<std::ptrdiff_t>(kept), lines.end());
+  cart_ptr->pricing.pin(cart_ptr->catalog->acquire_pricing());
+  cart_ptr->pricing.refresh(*cart_ptr);
+  cart_ptr->tax.recount(*cart_ptr);
+  cart_ptr->state_file.rewrite(*cart_ptr);
+  cart_ptr->display.publish(*cart_ptr);
+
+  if (out_report_json) {
+    *out_report_json = report.release();
+  }
+  clear_last_error();
+  return CS_SUCCESS;
+} catch (...) {
+  return translate_exception();
+}
 
-    CatalogItem item{id, name, static_cast<long long>(unit_value)};
-    new_state.index_by_id[id] = new_state.items.size();
-    new_state.items.push_back(std::move(item));
+int cs_cart_checkpoint(cs_cart_t cart) try {
+  CS_ENTRY(cs_cart_checkpoint);
+  CS_RECORD(cs_cart_checkpoint, cart);
+  CartAccess access(cart);
+  Cart* cart_ptr = access.get();
+  if (!cart_ptr) {
+    set_last_error(CS_ERRC_INVALID_HANDLE, invalid_cart_message(cart));
+    return CS_ERROR_INVALID_ARGUMENT;
   }
 
-  *out_state = std::move(new_state);
-  return true;
+  cart_ptr->checkpoint();
+  clear_last_error();
+  return CS_SUCCESS;
+} catch (...) {
+  return translate_exception();
 }
-}  // namespace
 
-int cs_init() {
-  set_last_error(nullptr);
+int cs_cart_undo(cs_cart_t cart) try {
+  CS_ENTRY(cs_cart_undo);
+  CS_RECORD(cs_cart_undo, cart);
+  return regular_result(step_history(cart, false));
+} catch (...) {
+  return translate_exception();
+}
+
+int cs_cart_redo(cs_cart_t cart) try {
+  CS_ENTRY(cs_cart_redo);
+  CS_RECORD(cs_cart_redo, cart);
+  return regular_result(step_history(cart, true));
+} catch (...) {
+  return translate_exception();
+}
+
+int cs_cart_clone(cs_cart_t cart, cs_cart_t* out_cart) try {
+  CS_ENTRY(cs_cart_clone);
+  CS_RECORD(cs_cart_clone, cart, out_cart);
+  CartAccess access(cart);
+  const Cart* source = access.get();
+  if (!source) {
+    set_last_error(CS_ERRC_INVALID_HANDLE, invalid_cart_message(cart));
+    return CS_ERROR_INVALID_ARGUMENT;
+  }
+  if (!out_cart) {
+    set_last_error(CS_ERRC_NULL_ARGUMENT, "out_cart must not be null.");
+    return CS_ERROR_INVALID_ARGUMENT;
+  }
+
+  cs_cart_t handle = nullptr;
+  Cart* copy = cart_pool().acquire(source->catalog, false, &handle);
+  if (!copy) {
+    set_last_error(CS_ERRC_OUT_OF_MEMORY, "Cart pool exhausted.");
+    return CS_ERROR_OUT_OF_MEMORY;
+  }
+  // The copy shares the source's catalog snapshot, so its item positions stay valid.
+  try {
+    copy->snapshot = source->snapshot;
+    copy->lines = source->lines;
+    copy->line_ids = source->line_ids;
+    copy->given_cents = source->given_cents;
+    copy->display_locale = source->display_locale;
+    copy->pricing.copy_context(source->pricing);
+    copy->pricing.refresh(*copy);
+    copy->tax.recount(*copy);
+    // The copy's lines need their own units, from the ledger the source holds in.
+    const int stock = copy->stock.sync(*copy);
+    if (stock != CS_ERRC_NONE) {
+      cart_pool().release(handle);
+      return error_result(stock);
+    }
+  } catch (...) {
+    cart_pool().release(handle);
+    throw;
+  }
+  *out_cart = handle;
+  clear_last_error();
   return CS_SUCCESS;
+} catch (...) {
+  return translate_exception();
 }
 
-void cs_shutdown() {
-  set_last_error(nullptr);
+int cs_cart_get_total_cents(cs_cart_t cart, long long* out_total_cents) try {
+  CS_ENTRY(cs_cart_get_total_cents);
+  CS_RECORD(cs_cart_get_total_cents, cart, out_total_cents);
+  return regular_result(cart_get_total_cents(cart, out_total_cents));
+} catch (...) {
+  return translate_exception();
 }
 
-const char* cs_last_error() {
-  return g_last_error.c_str();
+int cs_cart_get_total_cents_fast(cs_cart_t cart, long long* out_total_cents) try {
+  CS_ENTRY(cs_cart_get_total_cents_fast);
+  CS_RECORD(cs_cart_get_total_cents_fast, cart, out_total_cents);
+  return cart_get_total_cents(cart, out_total_cents);
+} catch (...) {
+  return exception_error_code();
 }
 
-void cs_free(void* p) {
-  std::free(p);
+int cs_cart_get_lines_json(cs_cart_t cart, char** out_json) try {
+  CS_ENTRY(cs_cart_get_lines_json);
+  CS_RECORD(cs_cart_get_lines_json, cart, out_json);
+  CartAccess access(cart);
+  Cart* cart_ptr = access.get();
+  if (!cart_ptr) {
+    set_last_error(CS_ERRC_INVALID_HANDLE, invalid_cart_message(cart));
+    return CS_ERROR_INVALID_ARGUMENT;
+  }
+  if (!out_json) {
+    set_last_error(CS_ERRC_NULL_ARGUMENT, "out_json must not be null.");
+    return CS_ERROR_INVALID_ARGUMENT;
+  }
+
+  TraceSpan span("serialize");
+  std::pmr::string json(core_resource());
+  json.reserve(128);
+  if (!append_lines_json(*cart_ptr, json)) {
+    set_last_error(CS_ERRC_OVERFLOW, "Cart total overflows.");
+    return CS_ERROR_INVALID_ARGUMENT;
+  }
+
+  *out_json = copy_to_buffer(json);
+  clear_last_error();
+  return CS_SUCCESS;
+} catch (...) {
+  return translate_exception();
 }
 
-int cs_get_version(char** out_json) {
+int cs_payment_set_given_cents(cs_cart_t cart, long long given_cents) try {
+  CS_ENTRY(cs_payment_set_given_cents);
+  CS_RECORD(cs_payment_set_given_cents, cart, given_cents);
+  return regular_result(payment_set_given_cents(cart, given_cents));
+} catch (...) {
+  return translate_exception();
+}
+
+int cs_payment_set_given_cents_fast(cs_cart_t cart, long long given_cents) try {
+  CS_ENTRY(cs_payment_set_given_cents_fast);
+  CS_RECORD(cs_payment_set_given_cents_fast, cart, given_cents);
+  return payment_set_given_cents(cart, given_cents);
+} catch (...) {
+  return exception_error_code();
+}
+
+int cs_payment_get_change_cents(cs_cart_t cart, long long* out_change_cents) try {
+  CS_ENTRY(cs_payment_get_change_cents);
+  CS_RECORD(cs_payment_get_change_cents, cart, out_change_cents);
+  return regular_result(payment_get_change_cents(cart, out_change_cents));
+} catch (...) {
+  return translate_exception();
+}
+
+int cs_payment_get_change_cents_fast(cs_cart_t cart, long long* out_change_cents) try {
+  CS_ENTRY(cs_payment_get_change_cents_fast);
+  CS_RECORD(cs_payment_get_change_cents_fast, cart, out_change_cents);
+  return payment_get_change_cents(cart, out_change_cents);
+} catch (...) {
+  return exception_error_code();
+}
+
+int cs_payment_get_given_cents(cs_cart_t cart, long long* out_given_cents) try {
+  CS_ENTRY(cs_payment_get_given_cents);
+  CS_RECORD(cs_payment_get_given_cents, cart, out_given_cents);
+  return regular_result(payment_get_given_cents(cart, out_given_cents));
+} catch (...) {
+  return translate_exception();
+}
+
+int cs_payment_get_given_cents_fast(cs_cart_t cart, long long* out_given_cents) try {
+  CS_ENTRY(cs_payment_get_given_cents_fast);
+  CS_RECORD(cs_payment_get_given_cents_fast, cart, out_given_cents);
+  return payment_get_given_cents(cart, out_given_cents);
+} catch (...) {
+  return exception_error_code();
+}
+
+int cs_payment_get_change_breakdown(cs_cart_t cart, char** out_json) try {
+  CS_ENTRY(cs_payment_get_change_breakdown);
+  CS_RECORD(cs_payment_get_change_breakdown, cart, out_json);
   if (!out_json) {
-    set_last_error("out_json must not be null.");
+    set_last_error(CS_ERRC_NULL_ARGUMENT, "out_json must not be null.");
     return CS_ERROR_INVALID_ARGUMENT;
   }
+  long long change_cents = 0;
+  const int change_result = payment_get_change_cents(cart, &change_cents);
+  if (change_result != CS_ERRC_NONE) {
+    return error_result(change_result);
+  }
 
-  constexpr const char* kVersionJson = "{\"version\":\"0.1.0\"}";
-  const size_t size = std::strlen(kVersionJson) + 1;
-  char* buffer = static_cast<char*>(std::malloc(size));
-  if (!buffer) {
-    set_last_error("Out of memory allocating version JSON.");
-    return CS_ERROR_OUT_OF_MEMORY;
+  std::pmr::string json(core_resource());
+  json.reserve(128);
+  const int result = cash_drawer().append_breakdown_json(std::max(change_cents, 0LL), json);
+  if (result != CS_ERRC_NONE) {
+    return error_result(result);
   }
+  *out_json = copy_to_buffer(json);
+  clear_last_error();
+  return CS_SUCCESS;
+} catch (...) {
+  return translate_exception();
+}
 
-  std::memcpy(buffer, kVersionJson, size);
-  *out_json = buffer;
-  set_last_error(nullptr);
+int cs_drawer_set_json(const char* drawer_json) try {
+  CS_ENTRY(cs_drawer_set_json);
+  CS_RECORD(cs_drawer_set_json, drawer_json);
+  const int result = cash_drawer().set_json(drawer_json);
+  if (result != CS_ERRC_NONE) {
+    return error_result(result);
+  }
+  clear_last_error();
   return CS_SUCCESS;
+} catch (...) {
+  return translate_exception();
 }
 
-int cs_catalog_load_json(const char* json) {
-  CatalogState new_state;
-  std::string error;
-  if (!parse_catalog_json(json, &new_state, &error)) {
-    set_last_error(error.c_str());
+int cs_drawer_get_json(char** out_json) try {
+  CS_ENTRY(cs_drawer_get_json);
+  CS_RECORD(cs_drawer_get_json, out_json);
+  if (!out_json) {
+    set_last_error(CS_ERRC_NULL_ARGUMENT, "out_json must not be null.");
     return CS_ERROR_INVALID_ARGUMENT;
   }
+  std::pmr::string json(core_resource());
+  json.reserve(512);
+  const int result = cash_drawer().append_json(json);
+  if (result != CS_ERRC_NONE) {
+    return error_result(result);
+  }
+  *out_json = copy_to_buffer(json);
+  clear_last_error();
+  return CS_SUCCESS;
+} catch (...) {
+  return translate_exception();
+}
 
-  {
-    std::lock_guard<std::mutex> lock(g_catalog_mutex);
-    g_catalog = std::move(new_state);
+int cs_journal_open(const char* path, int max_commit_delay_ms, char** out_report_json) try {
+  CS_ENTRY(cs_journal_open);
+  CS_RECORD(cs_journal_open, path, max_commit_delay_ms, out_report_json);
+  if (!path || path[0] == '\0') {
+    set_last_error(CS_ERRC_NULL_ARGUMENT, "path must not be null or empty.");
+    return CS_ERROR_INVALID_ARGUMENT;
+  }
+  if (max_commit_delay_ms < 0 || max_commit_delay_ms > kMaxCommitDelayMs) {
+    set_last_error(CS_ERRC_INVALID_VALUE, "max_commit_delay_ms must be between 0 and 10000.");
+    return CS_ERROR_INVALID_ARGUMENT;
+  }
+  if (out_report_json) {
+    *out_report_json = nullptr;
   }
 
-  set_last_error(nullptr);
+  TraceSpan span("journal_open");
+  std::pmr::string report(core_resource());
+  const int result = sale_journal().open(path, max_commit_delay_ms, &report);
+  if (result == CS_SUCCESS && out_report_json) {
+    *out_report_json = copy_to_buffer(report);
+  }
+  return result;
+} catch (...) {
+  return translate_exception();
+}
+
+int cs_journal_close() try {
+  CS_ENTRY(cs_journal_close);
+  CS_RECORD_NO_ARGS(cs_journal_close);
+  sale_journal().close();
+  clear_last_error();
   return CS_SUCCESS;
+} catch (...) {
+  return translate_exception();
 }
 
-int cs_catalog_get_json(char** out_json) {
+int cs_journal_read_json(const char* path, unsigned long long from_sequence, int max_sales,
+                         char** out_json) try {
+  CS_ENTRY(cs_journal_read_json);
+  CS_RECORD(cs_journal_read_json, path, static_cast<long long>(from_sequence), max_sales,
+            out_json);
+  if (!path || path[0] == '\0') {
+    set_last_error(CS_ERRC_NULL_ARGUMENT, "path must not be null or empty.");
+    return CS_ERROR_INVALID_ARGUMENT;
+  }
   if (!out_json) {
-    set_last_error("out_json must not be null.");
+    set_last_error(CS_ERRC_NULL_ARGUMENT, "out_json must not be null.");
+    return CS_ERROR_INVALID_ARGUMENT;
+  }
+  if (max_sales < 0) {
+    set_last_error(CS_ERRC_INVALID_VALUE, "max_sales must not be negative.");
     return CS_ERROR_INVALID_ARGUMENT;
   }
 
-  std::vector<CatalogItem> items_snapshot;
-  {
-    std::lock_guard<std::mutex> lock(g_catalog_mutex);
-    items_snapshot = g_catalog.items;
+  TraceSpan span("journal_read");
+  std::pmr::string image(core_resource(MemoryCategory::kJournal));
+  if (!read_file(std::pmr::string(path, core_resource()), &image)) {
+    set_last_error(CS_ERRC_IO, "Unable to read sale journal: ", path);
+    return CS_ERROR_INVALID_ARGUMENT;
+  }
+  if (image.size() < sizeof(kJournalMagic) ||
+      std::memcmp(image.data(), kJournalMagic, sizeof(kJournalMagic)) != 0) {
+    set_last_error(CS_ERRC_INVALID_VALUE, "Not a sale journal: ", path);
+    return CS_ERROR_INVALID_ARGUMENT;
   }
 
-  std::string json;
-  json.reserve(128);
-  json += "{\"items\":[";
-  for (size_t i = 0; i < items_snapshot.size(); ++i) {
-    const auto& item = items_snapshot[i];
-    if (i > 0) {
+  std::pmr::string json(core_resource());
+  json += "{\"sales\":[";
+  uint64_t next_sequence = std::max<uint64_t>(from_sequence, 1);
+  int emitted = 0;
+  bool corrupt = false;
+  scan_journal(image, [&](std::string_view payload) {
+    SaleView sale;
+    if (!decode_sale(payload, &sale)) {
+      corrupt = true;
+      return false;
+    }
+    if (sale.sequence < from_sequence) {
+      return true;
+    }
+    if (max_sales > 0 && emitted == max_sales) {
+      return false;
+    }
+    if (emitted++ > 0) {
       json += ",";
     }
-    json += "{\"id\":\"";
-    json += escape_json_string(item.id);
-    json += "\",\"name\":\"";
-    json += escape_json_string(item.name);
-    json += "\",\"unit_cents\":";
-    json += std::to_string(item.unit_cents);
-    json += "}";
-  }
-  json += "]}";
-
-  const size_t size = json.size() + 1;
-  char* buffer = static_cast<char*>(std::malloc(size));
-  if (!buffer) {
-    set_last_error("Out of memory allocating catalog JSON.");
-    return CS_ERROR_OUT_OF_MEMORY;
+    corrupt = !append_sale_json(json, sale);
+    next_sequence = sale.sequence + 1;
+    return !corrupt;
+  });
+  if (corrupt) {
+    set_last_error(CS_ERRC_INVALID_VALUE, "Corrupt sale record in journal: ", path);
+    return CS_ERROR_INVALID_ARGUMENT;
   }
+  json += "],\"next_sequence\":";
+  append_integer(json, static_cast<long long>(next_sequence));
+  json += "}";
 
-  std::memcpy(buffer, json.c_str(), size);
-  *out_json = buffer;
-  set_last_error(nullptr);
+  *out_json = copy_to_buffer(json);
+  clear_last_error();
   return CS_SUCCESS;
+} catch (...) {
+  return translate_exception();
 }
 
-int cs_cart_new(cs_cart_t* out_cart) {
-  if (!out_cart) {
-    set_last_error("out_cart must not be null.");
+int cs_cart_commit_sale(cs_cart_t cart, const cs_sale_meta* meta,
+                        unsigned long long* out_sequence) try {
+  CS_ENTRY(cs_cart_commit_sale);
+  CS_RECORD(cs_cart_commit_sale, cart, meta, out_sequence);
+  CartAccess access(cart);
+  Cart* cart_ptr = access.get();
+  if (!cart_ptr) {
+    set_last_error(CS_ERRC_INVALID_HANDLE, invalid_cart_message(cart));
+    return CS_ERROR_INVALID_ARGUMENT;
+  }
+  if (!meta) {
+    set_last_error(CS_ERRC_NULL_ARGUMENT, "meta must not be null.");
+    return CS_ERROR_INVALID_ARGUMENT;
+  }
+  if (meta->struct_size < sizeof(cs_sale_meta)) {
+    set_last_error(CS_ERRC_INVALID_VALUE, "meta->struct_size must be sizeof(cs_sale_meta).");
+    return CS_ERROR_INVALID_ARGUMENT;
+  }
+  if (meta->tip_cents < 0) {
+    set_last_error(CS_ERRC_AMOUNT_OUT_OF_RANGE, "tip_cents must not be negative.");
+    return CS_ERROR_INVALID_ARGUMENT;
+  }
+  if (meta->completed_unix_ms < 0) {
+    set_last_error(CS_ERRC_INVALID_VALUE, "completed_unix_ms must not be negative.");
     return CS_ERROR_INVALID_ARGUMENT;
   }
 
-  Cart* cart = new (std::nothrow) Cart();
-  if (!cart) {
-    set_last_error("Out of memory allocating cart.");
-    return CS_ERROR_OUT_OF_MEMORY;
+  long long subtotal = 0;
+  if (!compute_total_cents(*cart_ptr, &subtotal) || subtotal > kMaxCents - meta->tip_cents) {
+    set_last_error(CS_ERRC_OVERFLOW, "Sale total overflows.");
+    return CS_ERROR_INVALID_ARGUMENT;
+  }
+  if (cart_ptr->lines.empty()) {
+    set_last_error(CS_ERRC_INVALID_STATE, "Cannot commit an empty cart.");
+    return CS_ERROR_INVALID_ARGUMENT;
+  }
+  // Only cash is tendered at the register; other methods are settled elsewhere.
+  const bool cash = is_cash_payment(meta->payment_method ? meta->payment_method : "");
+  if (cash && cart_ptr->given_cents < subtotal + meta->tip_cents) {
+    set_last_error(CS_ERRC_AMOUNT_OUT_OF_RANGE, "given_cents does not cover the total and tip.");
+    return CS_ERROR_INVALID_ARGUMENT;
   }
 
-  *out_cart = cart;
-  set_last_error(nullptr);
+  uint64_t completed_unix_ms = static_cast<uint64_t>(meta->completed_unix_ms);
+  if (completed_unix_ms == 0) {
+    completed_unix_ms = static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch())
+            .count());
+  }
+  // Units of items limited since the cart's last change are claimed before the sale is written.
+  cart_ptr->stock.follow(*cart_ptr);
+  std::pmr::string payload(core_resource(MemoryCategory::kJournal));
+  payload.reserve(128 + cart_ptr->lines.size() * 48);
+  encode_sale(*cart_ptr, *meta, subtotal, completed_unix_ms, payload);
+
+  // The cart stays locked until the record is durable, so a concurrent cart cannot change
+  // between what was written and what is cleared.
+  uint64_t sequence = 0;
+  const int result = sale_journal().commit(payload, &sequence);
+  if (result != CS_SUCCESS) {
+    return result;
+  }
+  if (cash) {
+    cash_drawer().record_cash_sale(cart_ptr->given_cents,
+                                   cart_ptr->given_cents - subtotal - meta->tip_cents);
+  }
+  cart_ptr->stock.sell_all();
+  cart_ptr->drop_history();
+  cart_ptr->clear_lines();
+  cart_ptr->given_cents = 0;
+  cart_ptr->pricing.cleared();
+  cart_ptr->tax.cleared();
+  cart_ptr->state_file.rewrite(*cart_ptr);
+  cart_ptr->display.publish(*cart_ptr);
+  if (out_sequence) {
+    *out_sequence = sequence;
+  }
+  clear_last_error();
   return CS_SUCCESS;
+} catch (...) {
+  return translate_exception();
 }
 
-int cs_cart_free(cs_cart_t cart) {
-  if (!cart) {
-    set_last_error(nullptr);
-    return CS_SUCCESS;
+int cs_sales_query_json(const char* filter_json, const char* group_by, char** out_json) try {
+  CS_ENTRY(cs_sales_query_json);
+  CS_RECORD(cs_sales_query_json, filter_json, group_by, out_json);
+  if (!out_json) {
+    set_last_error(CS_ERRC_NULL_ARGUMENT, "out_json must not be null.");
+    return CS_ERROR_INVALID_ARGUMENT;
+  }
+
+  size_t group = kNoSalesGroup;
+  if (group_by && group_by[0] != '\0') {
+    const std::string_view name(group_by);
+    for (size_t d = 0; d < kSalesDimensionCount; ++d) {
+      if (name == kSalesDimensionNames[d]) {
+        group = d;
+      }
+    }
+    if (group == kNoSalesGroup) {
+      set_last_error(CS_ERRC_INVALID_VALUE, "Unknown group_by: ", name);
+      return CS_ERROR_INVALID_ARGUMENT;
+    }
   }
 
-  delete as_cart(cart);
-  set_last_error(nullptr);
+  SalesFilter filter;
+  if (filter_json && filter_json[0] != '\0') {
+    mini_json::Value root(core_resource(MemoryCategory::kParser));
+    std::string parse_error;
+    if (!mini_json::parse(filter_json, &root, &parse_error) || !root.is_object()) {
+      set_last_error(CS_ERRC_INVALID_VALUE, "filter_json must be a JSON object.");
+      return CS_ERROR_INVALID_ARGUMENT;
+    }
+    for (const auto& entry : root.as_object()) {
+      const std::string_view key(entry.first);
+      const mini_json::Value& value = entry.second;
+      size_t dimension = kNoSalesGroup;
+      for (size_t d = 0; d < kSalesDimensionCount; ++d) {
+        if (key == kSalesDimensionNames[d]) {
+          dimension = d;
+        }
+      }
+      if (dimension != kNoSalesGroup && value.is_string()) {
+        // An empty value does not filter, like the app's optional filters.
+        filter.has[dimension] = !value.as_string().empty();
+        filter.text[dimension].assign(value.as_string().data(), value.as_string().size());
+      } else if (key == "include_showcase" && value.is_bool()) {
+        filter.include_showcase = value.as_bool();
+      } else if ((key == "from_unix_ms" || key == "to_unix_ms") && value.is_number() &&
+                 value.number_is_integer() && value.as_number() >= 0 &&
+                 value.as_number() <= static_cast<long double>(kMaxCents)) {
+        (key == "from_unix_ms" ? filter.from_unix_ms : filter.to_unix_ms) =
+            static_cast<long long>(value.as_number());
+      } else {
+        set_last_error(CS_ERRC_INVALID_VALUE, "Invalid sales filter field: ", key);
+        return CS_ERROR_INVALID_ARGUMENT;
+      }
+    }
+  }
+
+  TraceSpan span("sales_query");
+  std::pmr::string json(core_resource());
+  json.reserve(512);
+  const int result = sales_store().query(filter, group, &json);
+  if (result != CS_ERRC_NONE) {
+    return error_result(result);
+  }
+  *out_json = copy_to_buffer(json);
+  clear_last_error();
   return CS_SUCCESS;
+} catch (...) {
+  return translate_exception();
 }
 
-int cs_cart_clear(cs_cart_t cart) {
-  Cart* cart_ptr = as_cart(cart);
-  if (!cart_ptr) {
-    set_last_error("cart must not be null.");
+int cs_live_metrics_json(long long now_unix_ms, int top_n, char** out_json) try {
+  CS_ENTRY(cs_live_metrics_json);
+  CS_RECORD(cs_live_metrics_json, now_unix_ms, top_n, out_json);
+  if (!out_json) {
+    set_last_error(CS_ERRC_NULL_ARGUMENT, "out_json must not be null.");
     return CS_ERROR_INVALID_ARGUMENT;
   }
+  if (now_unix_ms < 0) {
+    set_last_error(CS_ERRC_INVALID_VALUE, "now_unix_ms must not be negative.");
+    return CS_ERROR_INVALID_ARGUMENT;
+  }
+  if (top_n < 0 || static_cast<size_t>(top_n) > kHeavyHitterCounters) {
+    set_last_error(CS_ERRC_INVALID_VALUE, "top_n must be between 0 and 64.");
+    return CS_ERROR_INVALID_ARGUMENT;
+  }
+  if (now_unix_ms == 0) {
+    now_unix_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                      std::chrono::system_clock::now().time_since_epoch())
+                      .count();
+  }
 
-  cart_ptr->lines.clear();
-  cart_ptr->given_cents = 0;
-  set_last_error(nullptr);
+  std::pmr::string json(core_resource());
+  json.reserve(8192);
+  const int result = sales_store().live_metrics(now_unix_ms, static_cast<size_t>(top_n), &json);
+  if (result != CS_ERRC_NONE) {
+    return error_result(result);
+  }
+  *out_json = copy_to_buffer(json);
+  clear_last_error();
   return CS_SUCCESS;
+} catch (...) {
+  return translate_exception();
 }
 
-int cs_cart_add_item_by_id(cs_cart_t cart, const char* item_id, int qty) {
-  Cart* cart_ptr = as_cart(cart);
+int cs_cart_persist(cs_cart_t cart, const char* path) try {
+  CS_ENTRY(cs_cart_persist);
+  CS_RECORD(cs_cart_persist, cart, path);
+  CartAccess access(cart);
+  Cart* cart_ptr = access.get();
   if (!cart_ptr) {
-    set_last_error("cart must not be null.");
+    set_last_error(CS_ERRC_INVALID_HANDLE, invalid_cart_message(cart));
     return CS_ERROR_INVALID_ARGUMENT;
   }
-  if (!item_id || item_id[0] == '\0') {
-    set_last_error("item_id must not be null or empty.");
+  if (!path || path[0] == '\0') {
+    set_last_error(CS_ERRC_NULL_ARGUMENT, "path must not be null or empty.");
     return CS_ERROR_INVALID_ARGUMENT;
   }
-  if (qty <= 0) {
-    set_last_error("qty must be greater than zero.");
+  if (cart_ptr->state_file.attached()) {
+    set_last_error(CS_ERRC_INVALID_STATE, "cart is already persistent.");
     return CS_ERROR_INVALID_ARGUMENT;
   }
 
-  std::string item_id_str(item_id);
-  long long unit_cents = 0;
-  if (!lookup_unit_cents(item_id_str, &unit_cents)) {
-    g_last_error = "Unknown item_id: " + item_id_str;
+  const int result = cart_ptr->state_file.create(path, *cart_ptr);
+  if (result == CS_SUCCESS) {
+    clear_last_error();
+  }
+  return result;
+} catch (...) {
+  return translate_exception();
+}
+
+int cs_cart_recover(cs_catalog_t catalog, const char* path, cs_cart_t* out_cart) try {
+  CS_ENTRY(cs_cart_recover);
+  CS_RECORD(cs_cart_recover, catalog, path, RecordedFile{path}, out_cart);
+  CatalogPtr catalog_ptr = resolve_catalog(catalog);
+  if (!catalog_ptr) {
+    set_last_error(CS_ERRC_INVALID_HANDLE, "catalog must be a live catalog handle.");
+    return CS_ERROR_INVALID_ARGUMENT;
+  }
+  if (!path || path[0] == '\0' || !out_cart) {
+    set_last_error(CS_ERRC_NULL_ARGUMENT,
+                   out_cart ? "path must not be null or empty." : "out_cart must not be null.");
     return CS_ERROR_INVALID_ARGUMENT;
   }
 
-  for (auto& line : cart_ptr->lines) {
-    if (line.item_id == item_id_str) {
-      line.qty += qty;
-      set_last_error(nullptr);
-      return CS_SUCCESS;
+  cs_cart_t handle = nullptr;
+  const int created = new_cart(std::move(catalog_ptr), false, &handle);
+  if (created != CS_SUCCESS) {
+    return created;
+  }
+  int result = CS_ERROR_INTERNAL;
+  {
+    CartAccess access(handle);
+    result = access.get()->state_file.recover(path, access.get());
+    if (result == CS_SUCCESS) {
+      access.get()->pricing.refresh(*access.get());
+      access.get()->tax.recount(*access.get());
+      // Reservations do not survive the process; the recovered lines take theirs again.
+      result = error_result(access.get()->stock.sync(*access.get()));
     }
   }
-
-  cart_ptr->lines.push_back(CartLine{item_id_str, qty, unit_cents});
-  set_last_error(nullptr);
+  if (result != CS_SUCCESS) {
+    cart_pool().release(handle);
+    return result;
+  }
+  *out_cart = handle;
+  clear_last_error();
   return CS_SUCCESS;
+} catch (...) {
+  return translate_exception();
 }
 
-int cs_cart_remove_line(cs_cart_t cart, int line_index) {
-  Cart* cart_ptr = as_cart(cart);
+int cs_cart_flush(cs_cart_t cart) try {
+  CS_ENTRY(cs_cart_flush);
+  CS_RECORD(cs_cart_flush, cart);
+  CartAccess access(cart);
+  Cart* cart_ptr = access.get();
   if (!cart_ptr) {
-    set_last_error("cart must not be null.");
+    set_last_error(CS_ERRC_INVALID_HANDLE, invalid_cart_message(cart));
     return CS_ERROR_INVALID_ARGUMENT;
   }
-  if (line_index < 0 || static_cast<size_t>(line_index) >= cart_ptr->lines.size()) {
-    set_last_error("line_index out of range.");
+  if (!cart_ptr->state_file.attached()) {
+    set_last_error(CS_ERRC_INVALID_STATE, "cart is not persistent.");
     return CS_ERROR_INVALID_ARGUMENT;
   }
 
-  cart_ptr->lines.erase(cart_ptr->lines.begin() + line_index);
-  set_last_error(nullptr);
+  TraceSpan span("cart_flush");
+  if (!cart_ptr->state_file.flush()) {
+    set_last_error(CS_ERRC_IO, "Flushing the cart state file failed.");
+    return CS_ERROR_INTERNAL;
+  }
+  clear_last_error();
   return CS_SUCCESS;
+} catch (...) {
+  return translate_exception();
 }
 
-int cs_cart_get_total_cents(cs_cart_t cart, long long* out_total_cents) {
-  Cart* cart_ptr = as_cart(cart);
+int cs_cart_publish(cs_cart_t cart, const char* shared_name, int capacity_bytes,
+                    cs_display_t* out_display) try {
+  CS_ENTRY(cs_cart_publish);
+  CS_RECORD(cs_cart_publish, cart, shared_name, capacity_bytes, out_display);
+  CartAccess access(cart);
+  Cart* cart_ptr = access.get();
   if (!cart_ptr) {
-    set_last_error("cart must not be null.");
+    set_last_error(CS_ERRC_INVALID_HANDLE, invalid_cart_message(cart));
+    return CS_ERROR_INVALID_ARGUMENT;
+  }
+  if (capacity_bytes < 0 ||
+      static_cast<size_t>(capacity_bytes) > DisplayRegion::kMaxCapacity) {
+    set_last_error(CS_ERRC_INVALID_VALUE, "capacity_bytes must be between 0 and 16 MiB.");
     return CS_ERROR_INVALID_ARGUMENT;
   }
-  if (!out_total_cents) {
-    set_last_error("out_total_cents must not be null.");
+  if (cart_ptr->display.attached()) {
+    set_last_error(CS_ERRC_INVALID_STATE, "cart is already published.");
     return CS_ERROR_INVALID_ARGUMENT;
   }
 
-  *out_total_cents = compute_total_cents(*cart_ptr);
-  set_last_error(nullptr);
+  DisplayRegionPtr region = make_display_region();
+  const int result = region->create(
+      shared_name, capacity_bytes > 0 ? static_cast<size_t>(capacity_bytes)
+                                      : DisplayRegion::kDefaultCapacity);
+  if (result != CS_ERRC_NONE) {
+    return error_result(result);
+  }
+  cs_display_t handle = out_display ? register_display(region) : nullptr;
+  cart_ptr->display.attach(std::move(region), *cart_ptr);
+  if (out_display) {
+    *out_display = handle;
+  }
+  clear_last_error();
   return CS_SUCCESS;
+} catch (...) {
+  return translate_exception();
 }
 
-int cs_cart_get_lines_json(cs_cart_t cart, char** out_json) {
-  Cart* cart_ptr = as_cart(cart);
-  if (!cart_ptr) {
-    set_last_error("cart must not be null.");
-    return CS_ERROR_INVALID_ARGUMENT;
-  }
-  if (!out_json) {
-    set_last_error("out_json must not be null.");
+int cs_display_open(const char* shared_name, cs_display_t* out_display) try {
+  CS_ENTRY(cs_display_open);
+  CS_RECORD(cs_display_open, shared_name, out_display);
+  if (!shared_name || shared_name[0] == '\0' || !out_display) {
+    set_last_error(CS_ERRC_NULL_ARGUMENT, out_display ? "shared_name must not be null or empty."
+                                                      : "out_display must not be null.");
     return CS_ERROR_INVALID_ARGUMENT;
   }
 
-  long long total = 0;
-  const long long given_cents = cart_ptr->given_cents;
-  std::string json;
-  json.reserve(128);
-  json += "{\"lines\":[";
-  for (size_t i = 0; i < cart_ptr->lines.size(); ++i) {
-    const auto& line = cart_ptr->lines[i];
-    const long long line_total_cents = line.unit_cents * static_cast<long long>(line.qty);
-    total += line_total_cents;
-    std::string name;
-    if (!lookup_item_name(line.item_id, &name)) {
-      name.clear();
-    }
-    if (i > 0) {
-      json += ",";
-    }
-    json += "{\"id\":\"";
-    json += escape_json_string(line.item_id);
-    json += "\",\"name\":\"";
-    json += escape_json_string(name);
-    json += "\",\"unit_cents\":";
-    json += std::to_string(line.unit_cents);
-    json += ",\"qty\":";
-    json += std::to_string(line.qty);
-    json += ",\"line_total_cents\":";
-    json += std::to_string(line_total_cents);
-    json += "}";
-  }
-  json += "],\"total_cents\":";
-  json += std::to_string(total);
-  json += ",\"given_cents\":";
-  json += std::to_string(given_cents);
-  const long long change_cents =
-      given_cents > total ? given_cents - total : 0;
-  json += ",\"change_cents\":";
-  json += std::to_string(change_cents);
-  json += "}";
+  DisplayRegionPtr region = make_display_region();
+  const int result = region->open(shared_name);
+  if (result != CS_ERRC_NONE) {
+    return error_result(result);
+  }
+  *out_display = register_display(std::move(region));
+  clear_last_error();
+  return CS_SUCCESS;
+} catch (...) {
+  return translate_exception();
+}
 
-  const size_t size = json.size() + 1;
-  char* buffer = static_cast<char*>(std::malloc(size));
-  if (!buffer) {
-    set_last_error("Out of memory allocating cart JSON.");
-    return CS_ERROR_OUT_OF_MEMORY;
+int cs_display_get_version(cs_display_t display, unsigned long long* out_version) try {
+  CS_ENTRY(cs_display_get_version);
+  CS_RECORD(cs_display_get_version, display, out_version);
+  DisplayRegionPtr region = resolve_display(display);
+  if (!region) {
+    set_last_error(CS_ERRC_INVALID_HANDLE, "display must be a live display handle.");
+    return CS_ERROR_INVALID_ARGUMENT;
+  }
+  if (!out_version) {
+    set_last_error(CS_ERRC_NULL_ARGUMENT, "out_version must not be null.");
+    return CS_ERROR_INVALID_ARGUMENT;
   }
 
-  std::memcpy(buffer, json.c_str(), size);
-  *out_json = buffer;
-  set_last_error(nullptr);
+  *out_version = region->version();
+  clear_last_error();
   return CS_SUCCESS;
+} catch (...) {
+  return translate_exception();
 }
 
-int cs_payment_set_given_cents(cs_cart_t cart, long long given_cents) {
-  Cart* cart_ptr = as_cart(cart);
-  if (!cart_ptr) {
-    set_last_error("cart must not be null.");
+int cs_display_read(cs_display_t display, char* buffer, int buffer_size, int* out_size,
+                    unsigned long long* out_version) try {
+  CS_ENTRY(cs_display_read);
+  // The frame copied into `buffer` is not recorded; its size and version are.
+  CS_RECORD(cs_display_read, display, buffer_size, out_size, out_version);
+  DisplayRegionPtr region = resolve_display(display);
+  if (!region) {
+    set_last_error(CS_ERRC_INVALID_HANDLE, "display must be a live display handle.");
     return CS_ERROR_INVALID_ARGUMENT;
   }
-  if (given_cents < 0) {
-    set_last_error("given_cents must be non-negative.");
+  if (!out_size || (!buffer && buffer_size > 0)) {
+    set_last_error(CS_ERRC_NULL_ARGUMENT,
+                   out_size ? "buffer must not be null." : "out_size must not be null.");
     return CS_ERROR_INVALID_ARGUMENT;
   }
 
-  cart_ptr->given_cents = given_cents;
-  set_last_error(nullptr);
+  size_t size = 0;
+  uint64_t version = 0;
+  const int result =
+      region->read(buffer, buffer_size > 0 ? static_cast<size_t>(buffer_size) : 0, &size, &version);
+  if (result == CS_ERRC_NONE || result == CS_ERRC_INVALID_VALUE) {
+    *out_size = static_cast<int>(size);
+  }
+  if (result != CS_ERRC_NONE) {
+    return error_result(result);
+  }
+  if (out_version) {
+    *out_version = version;
+  }
+  clear_last_error();
   return CS_SUCCESS;
+} catch (...) {
+  return translate_exception();
 }
 
-int cs_payment_get_change_cents(cs_cart_t cart, long long* out_change_cents) {
-  Cart* cart_ptr = as_cart(cart);
-  if (!cart_ptr) {
-    set_last_error("cart must not be null.");
+int cs_display_close(cs_display_t display) try {
+  CS_ENTRY(cs_display_close);
+  CS_RECORD(cs_display_close, display);
+  if (!display) {
+    clear_last_error();
+    return CS_SUCCESS;
+  }
+
+  DisplayRegionPtr released;
+  {
+    std::lock_guard<std::mutex> lock(g_display_registry_mutex);
+    auto& displays = display_registry();
+    auto it = std::find_if(displays.begin(), displays.end(), [display](const DisplayRegionPtr& entry) {
+      return entry.get() == display;
+    });
+    if (it == displays.end()) {
+      set_last_error(CS_ERRC_INVALID_HANDLE, "display is not a live display handle.");
+      return CS_ERROR_INVALID_ARGUMENT;
+    }
+    released = std::move(*it);
+    displays.erase(it);
+  }
+
+  clear_last_error();
+  return CS_SUCCESS;
+} catch (...) {
+  return translate_exception();
+}
+
+int cs_debug_get_allocation_count(unsigned long long* out_count) try {
+  CS_ENTRY(cs_debug_get_allocation_count);
+  if (!out_count) {
+    set_last_error(CS_ERRC_NULL_ARGUMENT, "out_count must not be null.");
     return CS_ERROR_INVALID_ARGUMENT;
   }
-  if (!out_change_cents) {
-    set_last_error("out_change_cents must not be null.");
+#if defined(CASHSLOTH_COUNT_ALLOCATIONS)
+  *out_count = g_entry_allocations;
+  clear_last_error();
+  return CS_SUCCESS;
+#else
+  *out_count = 0;
+  set_last_error(CS_ERRC_NOT_SUPPORTED, "Allocation counting is not compiled in (CASHSLOTH_COUNT_ALLOCATIONS).");
+  return CS_ERROR_NOT_SUPPORTED;
+#endif
+} catch (...) {
+  return translate_exception();
+}
+
+int cs_stats_get_json(char** out_json) try {
+  CS_ENTRY(cs_stats_get_json);
+  if (!out_json) {
+    set_last_error(CS_ERRC_NULL_ARGUMENT, "out_json must not be null.");
     return CS_ERROR_INVALID_ARGUMENT;
   }
+#if defined(CASHSLOTH_STATS)
+  return write_stats_json(out_json);
+#else
+  *out_json = nullptr;
+  set_last_error(CS_ERRC_NOT_SUPPORTED, "Statistics are not compiled in (CASHSLOTH_STATS).");
+  return CS_ERROR_NOT_SUPPORTED;
+#endif
+} catch (...) {
+  return translate_exception();
+}
 
-  const long long total = compute_total_cents(*cart_ptr);
-  *out_change_cents = cart_ptr->given_cents - total;
-  set_last_error(nullptr);
+int cs_stats_reset() try {
+  CS_ENTRY(cs_stats_reset);
+#if defined(CASHSLOTH_STATS)
+  reset_stats();
+  clear_last_error();
   return CS_SUCCESS;
+#else
+  set_last_error(CS_ERRC_NOT_SUPPORTED, "Statistics are not compiled in (CASHSLOTH_STATS).");
+  return CS_ERROR_NOT_SUPPORTED;
+#endif
+} catch (...) {
+  return translate_exception();
 }
 
-int cs_payment_get_given_cents(cs_cart_t cart, long long* out_given_cents) {
-  Cart* cart_ptr = as_cart(cart);
-  if (!cart_ptr) {
-    set_last_error("cart must not be null.");
+int cs_trace_set_enabled(int enabled) try {
+  CS_ENTRY(cs_trace_set_enabled);
+  g_trace_enabled.store(enabled != 0, std::memory_order_relaxed);
+  clear_last_error();
+  return CS_SUCCESS;
+} catch (...) {
+  return translate_exception();
+}
+
+int cs_trace_dump(const char* path) try {
+  CS_ENTRY(cs_trace_dump);
+  if (!path || path[0] == '\0') {
+    set_last_error(CS_ERRC_NULL_ARGUMENT, "path must not be null or empty.");
     return CS_ERROR_INVALID_ARGUMENT;
   }
-  if (!out_given_cents) {
-    set_last_error("out_given_cents must not be null.");
+  return write_trace_file(path);
+} catch (...) {
+  return translate_exception();
+}
+
+int cs_memory_usage_json(char** out_json) try {
+  CS_ENTRY(cs_memory_usage_json);
+  if (!out_json) {
+    set_last_error(CS_ERRC_NULL_ARGUMENT, "out_json must not be null.");
     return CS_ERROR_INVALID_ARGUMENT;
   }
+  return write_memory_usage_json(out_json);
+} catch (...) {
+  return translate_exception();
+}
 
-  *out_given_cents = cart_ptr->given_cents;
-  set_last_error(nullptr);
-  return CS_SUCCESS;
+int cs_record_start(const char* path) try {
+  CS_ENTRY(cs_record_start);
+  if (!path || path[0] == '\0') {
+    set_last_error(CS_ERRC_NULL_ARGUMENT, "path must not be null or empty.");
+    return CS_ERROR_INVALID_ARGUMENT;
+  }
+  return record_writer().start(path);
+} catch (...) {
+  return translate_exception();
+}
+
+int cs_record_stop() try {
+  CS_ENTRY(cs_record_stop);
+  return record_writer().stop();
+} catch (...) {
+  return translate_exception();
+}
+
+#if defined(CASHSLOTH_COUNT_ALLOCATIONS)
+// Replacement global allocation functions. Only the scalar and array forms need replacing: the
+// standard nothrow forms forward to them.
+void* operator new(std::size_t size) {
+  if (g_entry_depth > 0) {
+    ++g_entry_allocations;
+  }
+  if (void* p = std::malloc(size ? size : 1)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+  return ::operator new(size);
+}
+
+void operator delete(void* p) noexcept {
+  std::free(p);
+}
+
+void operator delete[](void* p) noexcept {
+  std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+  std::free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept {
+  std::free(p);
 }
+#endif
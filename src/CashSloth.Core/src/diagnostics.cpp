@@ -0,0 +1,379 @@
+#include "diagnostics.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <memory_resource>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "encoding.h"
+#include "memory.h"
+
+namespace cashsloth {
+namespace {
+
+#if defined(CASHSLOTH_STATS)
+inline uint64_t stat_value(const StatCounter& counter) { return counter.get(); }
+inline uint64_t stat_value(uint64_t value) { return value; }
+
+// Calls `fn(total, source)` for every counter pair of two blocks.
+template <typename Source, typename Fn>
+void for_each_stat(StatsTotals& totals, const Source& source, Fn fn) {
+  for (size_t i = 0; i < kApiCount; ++i) {
+    auto& t = totals.api[i];
+    const auto& s = source.api[i];
+    fn(t.calls, s.calls);
+    fn(t.errors, s.errors);
+    fn(t.latency_samples, s.latency_samples);
+    fn(t.latency_ns, s.latency_ns);
+    for (size_t b = 0; b < kLatencyBuckets; ++b) {
+      fn(t.latency[b], s.latency[b]);
+    }
+  }
+  fn(totals.catalog_mutex_waits, source.catalog_mutex_waits);
+  fn(totals.catalog_mutex_wait_ns, source.catalog_mutex_wait_ns);
+  fn(totals.catalog_loads, source.catalog_loads);
+  fn(totals.catalog_load_ns, source.catalog_load_ns);
+  fn(totals.bytes_serialized, source.bytes_serialized);
+}
+
+template <typename Source>
+void add_stats(StatsTotals& totals, const Source& source) {
+  for_each_stat(totals, source, [](uint64_t& t, const auto& s) { t += stat_value(s); });
+}
+
+// cs_stats_reset records the current totals here instead of writing other threads' counters.
+struct StatsRegistry {
+  std::mutex mutex;
+  std::vector<ThreadStats*> live;
+  StatsTotals retired{};
+  StatsTotals baseline{};
+};
+
+// Leaked on purpose: threads may still exit and retire their counters during static destruction.
+StatsRegistry& stats_registry() {
+  static StatsRegistry* registry = new StatsRegistry();
+  return *registry;
+}
+
+// Shared fallback when a thread's counters cannot be allocated; its values are never reported.
+ThreadStats g_unregistered_stats;
+
+void retire_thread_stats(ThreadStats* stats) {
+  StatsRegistry& registry = stats_registry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  add_stats(registry.retired, *stats);
+  registry.live.erase(std::find(registry.live.begin(), registry.live.end(), stats));
+  delete stats;
+}
+// Folds the thread's counters into the retired totals at thread exit. Core calls made later in
+// the thread's teardown land in the unreported fallback block.
+struct ThreadStatsOwner {
+  ThreadStats* stats = nullptr;
+  ~ThreadStatsOwner() {
+    if (stats) {
+      g_thread_stats = &g_unregistered_stats;
+      retire_thread_stats(stats);
+    }
+  }
+};
+
+StatsTotals current_stats() {
+  StatsRegistry& registry = stats_registry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  StatsTotals totals = registry.retired;
+  for (const ThreadStats* stats : registry.live) {
+    add_stats(totals, *stats);
+  }
+  return totals;
+}
+#endif
+
+constexpr size_t kTraceRingEvents = 8192;
+
+const std::chrono::steady_clock::time_point g_trace_epoch = std::chrono::steady_clock::now();
+
+// A slot is a small seqlock: `sequence` is 0 while the owner rewrites it and the event's index + 1
+// once complete, so a dump running concurrently skips slots that are being overwritten.
+struct TraceSlot {
+  std::atomic<uint64_t> sequence{0};
+  std::atomic<const char*> name{nullptr};
+  std::atomic<uint64_t> start_ns{0};
+  std::atomic<uint64_t> duration_ns{0};
+  std::atomic<uint32_t> tid{0};
+  std::atomic<uint32_t> category{0};
+};
+
+// Rings outlive their threads so a dump still shows work done by exited threads. A new thread
+// reuses a released ring; events keep the tid they were recorded under.
+struct TraceRing {
+  std::atomic<bool> in_use{true};
+  std::atomic<uint32_t> tid{0};
+  std::atomic<const char*> thread_name{nullptr};
+  // Number of events ever written; the newest kTraceRingEvents of them are retained.
+  std::atomic<uint64_t> head{0};
+  TraceSlot slots[kTraceRingEvents];
+};
+
+struct TraceRegistry {
+  std::mutex mutex;
+  std::vector<TraceRing*> rings;
+};
+
+// Leaked on purpose, like the statistics registry.
+TraceRegistry& trace_registry() {
+  static TraceRegistry* registry = new TraceRegistry();
+  return *registry;
+}
+
+std::atomic<uint32_t> g_next_trace_tid{1};
+
+struct ThreadTrace {
+  TraceRing* ring = nullptr;
+  uint32_t tid = 0;
+  const char* name = nullptr;
+  ~ThreadTrace() {
+    if (ring) {
+      ring->in_use.store(false, std::memory_order_release);
+    }
+  }
+};
+
+thread_local ThreadTrace g_thread_trace;
+
+CS_NOINLINE TraceRing* claim_trace_ring(ThreadTrace& trace) {
+  if (trace.tid == 0) {
+    trace.tid = g_next_trace_tid.fetch_add(1, std::memory_order_relaxed);
+  }
+  TraceRegistry& registry = trace_registry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  TraceRing* ring = nullptr;
+  for (TraceRing* candidate : registry.rings) {
+    bool expected = false;
+    if (candidate->in_use.compare_exchange_strong(expected, true, std::memory_order_acq_rel)) {
+      ring = candidate;
+      break;
+    }
+  }
+  if (!ring) {
+    // Tracing is diagnostics outside cs_set_allocator; without memory the thread records nothing.
+    ring = new (std::nothrow) TraceRing();
+    if (!ring) {
+      return nullptr;
+    }
+    try {
+      registry.rings.push_back(ring);
+    } catch (const std::bad_alloc&) {
+      delete ring;
+      return nullptr;
+    }
+  }
+  ring->tid.store(trace.tid, std::memory_order_relaxed);
+  ring->thread_name.store(trace.name, std::memory_order_relaxed);
+  trace.ring = ring;
+  return ring;
+}
+
+}  // namespace
+
+#if defined(CASHSLOTH_STATS)
+CS_NOINLINE ThreadStats* register_thread_stats() {
+  // Statistics are bookkeeping outside cs_set_allocator, like cs_last_error text.
+  ThreadStats* stats = new (std::nothrow) ThreadStats();
+  if (!stats) {
+    return &g_unregistered_stats;
+  }
+  StatsRegistry& registry = stats_registry();
+  try {
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    registry.live.push_back(stats);
+  } catch (const std::bad_alloc&) {
+    delete stats;
+    return &g_unregistered_stats;
+  }
+  thread_local ThreadStatsOwner owner;
+  owner.stats = stats;
+  return stats;
+}
+
+void reset_stats() {
+  StatsTotals totals = current_stats();
+  StatsRegistry& registry = stats_registry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  registry.baseline = totals;
+}
+
+// Counts since the last cs_stats_reset. Functions that were never called are left out.
+int write_stats_json(char** out_json) {
+  StatsTotals totals = current_stats();
+  {
+    StatsRegistry& registry = stats_registry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    for_each_stat(totals, registry.baseline, [](uint64_t& t, uint64_t base) {
+      t = t > base ? t - base : 0;
+    });
+  }
+  auto append_count = [](std::pmr::string& json, uint64_t value) {
+    append_integer(json, static_cast<long long>(value));
+  };
+
+  TraceSpan span("serialize");
+  std::pmr::string json(core_resource());
+  json.reserve(1024);
+  json += "{\"latency_sample_interval\":";
+  append_count(json, kLatencySampleInterval);
+  json += ",\"apis\":{";
+  bool first_api = true;
+  for (size_t i = 0; i < kApiCount; ++i) {
+    const StatsTotals::Api& api = totals.api[i];
+    if (api.calls == 0) {
+      continue;
+    }
+    json += first_api ? "\"" : ",\"";
+    first_api = false;
+    json += kApiNames[i];
+    json += "\":{\"calls\":";
+    append_count(json, api.calls);
+    json += ",\"errors\":";
+    append_count(json, api.errors);
+    json += ",\"latency_samples\":";
+    append_count(json, api.latency_samples);
+    json += ",\"latency_total_ns\":";
+    append_count(json, api.latency_ns);
+    json += ",\"latency_buckets\":[";
+    bool first_bucket = true;
+    for (size_t b = 0; b < kLatencyBuckets; ++b) {
+      if (api.latency[b] == 0) {
+        continue;
+      }
+      json += first_bucket ? "{\"from_ns\":" : ",{\"from_ns\":";
+      first_bucket = false;
+      append_count(json, b == 0 ? 0 : uint64_t{1} << b);
+      if (b + 1 < kLatencyBuckets) {
+        json += ",\"to_ns\":";
+        append_count(json, uint64_t{1} << (b + 1));
+      }
+      json += ",\"count\":";
+      append_count(json, api.latency[b]);
+      json += "}";
+    }
+    json += "]}";
+  }
+  json += "},\"catalog_mutex\":{\"waits\":";
+  append_count(json, totals.catalog_mutex_waits);
+  json += ",\"wait_ns\":";
+  append_count(json, totals.catalog_mutex_wait_ns);
+  json += "},\"catalog_loads\":{\"count\":";
+  append_count(json, totals.catalog_loads);
+  json += ",\"total_ns\":";
+  append_count(json, totals.catalog_load_ns);
+  json += "},\"bytes_serialized\":";
+  append_count(json, totals.bytes_serialized);
+  json += "}";
+
+  *out_json = copy_to_buffer(json);
+  clear_last_error();
+  return CS_SUCCESS;
+}
+#endif
+
+uint64_t trace_now_ns() {
+  return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                   std::chrono::steady_clock::now() - g_trace_epoch)
+                                   .count());
+}
+
+void trace_record(const char* name, TraceCategory category, uint64_t start_ns, uint64_t end_ns) {
+  ThreadTrace& trace = g_thread_trace;
+  TraceRing* ring = trace.ring ? trace.ring : claim_trace_ring(trace);
+  if (!ring) {
+    return;
+  }
+  const uint64_t index = ring->head.load(std::memory_order_relaxed);
+  TraceSlot& slot = ring->slots[index % kTraceRingEvents];
+  slot.sequence.store(0, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  slot.name.store(name, std::memory_order_relaxed);
+  slot.start_ns.store(start_ns, std::memory_order_relaxed);
+  slot.duration_ns.store(end_ns - start_ns, std::memory_order_relaxed);
+  slot.tid.store(trace.tid, std::memory_order_relaxed);
+  slot.category.store(static_cast<uint32_t>(category), std::memory_order_relaxed);
+  slot.sequence.store(index + 1, std::memory_order_release);
+  ring->head.store(index + 1, std::memory_order_release);
+}
+
+void trace_name_thread(const char* name) {
+  ThreadTrace& trace = g_thread_trace;
+  trace.name = name;
+  if (trace.ring) {
+    trace.ring->thread_name.store(name, std::memory_order_relaxed);
+  }
+}
+
+// Writes every retained span. Rings keep recording while the dump runs; slots overwritten
+// mid-read are skipped.
+int write_trace_file(const char* path) {
+  std::FILE* file = std::fopen(path, "wb");
+  if (!file) {
+    set_last_error(CS_ERRC_IO, "Unable to open trace file: ", path);
+    return CS_ERROR_INVALID_ARGUMENT;
+  }
+
+  std::fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[", file);
+  const char* separator = "\n";
+  TraceRegistry& registry = trace_registry();
+  {
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    for (const TraceRing* ring : registry.rings) {
+      const char* thread_name = ring->thread_name.load(std::memory_order_relaxed);
+      if (thread_name) {
+        std::fprintf(file,
+                     "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+                     "\"args\":{\"name\":\"%s\"}}",
+                     separator, ring->tid.load(std::memory_order_relaxed), thread_name);
+        separator = ",\n";
+      }
+      const uint64_t head = ring->head.load(std::memory_order_acquire);
+      const uint64_t first = head > kTraceRingEvents ? head - kTraceRingEvents : 0;
+      for (uint64_t i = first; i < head; ++i) {
+        const TraceSlot& slot = ring->slots[i % kTraceRingEvents];
+        const uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+        if (sequence != i + 1) {
+          continue;
+        }
+        const char* name = slot.name.load(std::memory_order_relaxed);
+        const uint64_t start_ns = slot.start_ns.load(std::memory_order_relaxed);
+        const uint64_t duration_ns = slot.duration_ns.load(std::memory_order_relaxed);
+        const uint32_t tid = slot.tid.load(std::memory_order_relaxed);
+        const uint32_t category = slot.category.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.sequence.load(std::memory_order_relaxed) != sequence) {
+          continue;
+        }
+        // Trace-event timestamps are in microseconds.
+        std::fprintf(file,
+                     "%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,"
+                     "\"ts\":%llu.%03u,\"dur\":%llu.%03u}",
+                     separator, name,
+                     category == static_cast<uint32_t>(TraceCategory::kApi) ? "api" : "core", tid,
+                     static_cast<unsigned long long>(start_ns / 1000),
+                     static_cast<unsigned>(start_ns % 1000),
+                     static_cast<unsigned long long>(duration_ns / 1000),
+                     static_cast<unsigned>(duration_ns % 1000));
+        separator = ",\n";
+      }
+    }
+  }
+  std::fputs("\n]}\n", file);
+
+  const bool write_failed = std::ferror(file) != 0;
+  if (std::fclose(file) != 0 || write_failed) {
+    set_last_error(CS_ERRC_IO, "Unable to write trace file: ", path);
+    return CS_ERROR_INTERNAL;
+  }
+  clear_last_error();
+  return CS_SUCCESS;
+}
+
+}  // namespace cashsloth
@@ -0,0 +1,294 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+#include "errors.h"
+#include "platform.h"
+
+namespace cashsloth {
+
+// Every exported function. CS_ENTRY(name) at the top of each one tags the call for statistics.
+#define CS_API_FUNCTIONS(X)                                                                    \
+  X(cs_set_allocator) X(cs_init) X(cs_shutdown) X(cs_last_error) X(cs_free) X(cs_get_version)  \
+  X(cs_catalog_load_json) X(cs_catalog_get_json) X(cs_catalog_set_load_threads)                \
+  X(cs_catalog_load_json_async) X(cs_catalog_load_file_async) X(cs_load_ticket_poll)           \
+  X(cs_load_ticket_wait) X(cs_load_ticket_cancel) X(cs_load_ticket_free) X(cs_catalog_new)     \
+  X(cs_catalog_free) X(cs_catalog_get_default) X(cs_catalog_find)                              \
+  X(cs_catalog_instance_load_json) X(cs_catalog_instance_get_json)                             \
+  X(cs_catalog_set_display_locale) X(cs_catalog_get_generation) X(cs_cart_new)                 \
+  X(cs_cart_new_for_catalog) X(cs_cart_bind_catalog) X(cs_cart_set_display_locale)             \
+  X(cs_cart_free) X(cs_cart_clear) X(cs_cart_add_item_by_id) X(cs_cart_remove_line)            \
+  X(cs_cart_set_line_qty) X(cs_cart_reprice) X(cs_cart_get_total_cents)                        \
+  X(cs_cart_get_lines_json) X(cs_payment_set_given_cents) X(cs_payment_get_change_cents)       \
+  X(cs_payment_get_given_cents) X(cs_debug_get_allocation_count) X(cs_stats_get_json)          \
+  X(cs_stats_reset) X(cs_trace_set_enabled) X(cs_trace_dump) X(cs_memory_usage_json)          \
+  X(cs_record_start) X(cs_record_stop) X(cs_last_error_code) X(cs_cart_clear_fast)             \
+  X(cs_cart_add_item_by_id_fast) X(cs_cart_remove_line_fast) X(cs_cart_set_line_qty_fast)      \
+  X(cs_cart_get_total_cents_fast) X(cs_payment_set_given_cents_fast)                           \
+  X(cs_payment_get_change_cents_fast) X(cs_payment_get_given_cents_fast)                      \
+  X(cs_cart_new_concurrent) X(cs_journal_open) X(cs_journal_close) X(cs_journal_read_json)     \
+  X(cs_cart_commit_sale) X(cs_sales_query_json) X(cs_live_metrics_json) X(cs_cart_persist)     \
+  X(cs_cart_recover) X(cs_cart_flush) X(cs_cart_checkpoint) X(cs_cart_undo) X(cs_cart_redo)      \
+  X(cs_cart_clone) X(cs_cart_publish) X(cs_display_open) X(cs_display_get_version)              \
+  X(cs_display_read) X(cs_display_close) X(cs_catalog_set_pricing_json)                         \
+  X(cs_cart_set_pricing_context) X(cs_drawer_set_json) X(cs_drawer_get_json)                   \
+  X(cs_payment_get_change_breakdown) X(cs_catalog_set_stock_json) X(cs_stock_snapshot_json)
+
+enum class ApiId : uint16_t {
+#define CS_API_ID(name) name,
+  CS_API_FUNCTIONS(CS_API_ID)
+#undef CS_API_ID
+  kCount
+};
+
+constexpr size_t kApiCount = static_cast<size_t>(ApiId::kCount);
+
+inline constexpr const char* kApiNames[] = {
+#define CS_API_NAME(name) #name,
+    CS_API_FUNCTIONS(CS_API_NAME)
+#undef CS_API_NAME
+};
+
+#if defined(CASHSLOTH_STATS)
+// Statistics (CASHSLOTH_STATS builds only). Each thread owns a cache-line aligned block of
+// counters that only it writes; cs_stats_get_json sums the blocks of live threads with the totals
+// folded in by exited ones. Call and error counts are exact; latency is timed for one call in
+// kLatencySampleInterval per function and thread, so the clock stays off the hot path.
+constexpr size_t kLatencyBuckets = 32;
+constexpr uint64_t kLatencySampleInterval = 64;
+
+// Single writer: a relaxed load and store instead of a locked read-modify-write. Other threads
+// may read concurrently and see a slightly stale value.
+class StatCounter {
+ public:
+  void add(uint64_t n) {
+    value_.store(value_.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+  }
+  uint64_t get() const { return value_.load(std::memory_order_relaxed); }
+
+ private:
+  std::atomic<uint64_t> value_{0};
+};
+
+template <typename Counter>
+struct StatsBlock {
+  struct Api {
+    Counter calls{};
+    Counter errors{};
+    Counter latency_samples{};
+    Counter latency_ns{};
+    // Bucket b counts sampled calls that took [2^b, 2^(b+1)) ns; bucket 0 also takes 0 ns.
+    Counter latency[kLatencyBuckets]{};
+  };
+
+  Api api[kApiCount];
+  Counter catalog_mutex_waits{};
+  Counter catalog_mutex_wait_ns{};
+  Counter catalog_loads{};
+  Counter catalog_load_ns{};
+  Counter bytes_serialized{};
+};
+
+struct alignas(64) ThreadStats : StatsBlock<StatCounter> {};
+using StatsTotals = StatsBlock<uint64_t>;
+
+inline CS_FAST_TLS thread_local ThreadStats* g_thread_stats = nullptr;
+
+// Allocates and registers the calling thread's counters on its first counted call.
+ThreadStats* register_thread_stats();
+
+inline ThreadStats& thread_stats() {
+  ThreadStats* stats = g_thread_stats;
+  if (!stats) {
+    stats = register_thread_stats();
+    g_thread_stats = stats;
+  }
+  return *stats;
+}
+
+inline size_t latency_bucket(uint64_t ns) {
+  size_t bucket = 0;
+  while (ns > 1 && bucket + 1 < kLatencyBuckets) {
+    ns >>= 1;
+    ++bucket;
+  }
+  return bucket;
+}
+
+inline uint64_t elapsed_ns(std::chrono::steady_clock::time_point start) {
+  return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                   std::chrono::steady_clock::now() - start)
+                                   .count());
+}
+
+// Times a catalog parse and publish, synchronous or on the loader thread.
+class CatalogLoadTimer {
+ public:
+  CatalogLoadTimer() : start_(std::chrono::steady_clock::now()) {}
+  ~CatalogLoadTimer() {
+    ThreadStats& stats = thread_stats();
+    stats.catalog_loads.add(1);
+    stats.catalog_load_ns.add(elapsed_ns(start_));
+  }
+  CatalogLoadTimer(const CatalogLoadTimer&) = delete;
+  CatalogLoadTimer& operator=(const CatalogLoadTimer&) = delete;
+
+ private:
+  std::chrono::steady_clock::time_point start_;
+};
+
+inline void count_serialized_bytes(size_t bytes) { thread_stats().bytes_serialized.add(bytes); }
+
+// Counts since the last cs_stats_reset as JSON (cs_stats_get_json).
+int write_stats_json(char** out_json);
+
+// Makes the current totals the baseline that cs_stats_get_json counts from.
+void reset_stats();
+#else
+struct CatalogLoadTimer {
+  CatalogLoadTimer() {}
+};
+
+inline void count_serialized_bytes(size_t) {}
+#endif
+
+// Tracing. While cs_trace_set_enabled is on, entry points and internal phases record complete
+// spans into a fixed-size ring owned by the recording thread; cs_trace_dump writes them out as
+// Chrome trace-event JSON. While it is off, a span costs one relaxed load and a branch.
+inline std::atomic<bool> g_trace_enabled{false};
+
+enum class TraceCategory : uint32_t { kApi, kCore };
+
+uint64_t trace_now_ns();
+
+void trace_record(const char* name, TraceCategory category, uint64_t start_ns, uint64_t end_ns);
+
+// Labels the calling thread in dumps. `name` must be a string literal.
+void trace_name_thread(const char* name);
+
+// Writes every retained span as Chrome trace-event JSON (cs_trace_dump). Returns a CS_ERROR_*
+// result.
+int write_trace_file(const char* path);
+
+// Records [construction, destruction) under `name`, which must be a string literal.
+class TraceSpan {
+ public:
+  explicit TraceSpan(const char* name, TraceCategory category = TraceCategory::kCore)
+      : name_(g_trace_enabled.load(std::memory_order_relaxed) ? name : nullptr),
+        category_(category) {
+    if (name_) {
+      start_ns_ = trace_now_ns();
+    }
+  }
+  ~TraceSpan() {
+    if (name_) {
+      trace_record(name_, category_, start_ns_, trace_now_ns());
+    }
+  }
+  TraceSpan(const TraceSpan&) = delete;
+  TraceSpan& operator=(const TraceSpan&) = delete;
+
+ private:
+  const char* name_;
+  TraceCategory category_;
+  uint64_t start_ns_ = 0;
+};
+
+// Catalog snapshot mutex. Stats builds count contended acquisitions and the time spent waiting.
+class CatalogLock {
+ public:
+  explicit CatalogLock(std::mutex& mutex) : mutex_(mutex) {
+#if defined(CASHSLOTH_STATS)
+    if (mutex_.try_lock()) {
+      return;
+    }
+    const auto start = std::chrono::steady_clock::now();
+    mutex_.lock();
+    ThreadStats& stats = thread_stats();
+    stats.catalog_mutex_waits.add(1);
+    stats.catalog_mutex_wait_ns.add(elapsed_ns(start));
+#else
+    mutex_.lock();
+#endif
+  }
+  ~CatalogLock() { mutex_.unlock(); }
+  CatalogLock(const CatalogLock&) = delete;
+  CatalogLock& operator=(const CatalogLock&) = delete;
+
+ private:
+  std::mutex& mutex_;
+};
+
+#if defined(CASHSLOTH_COUNT_ALLOCATIONS)
+// Allocation counting (CASHSLOTH_COUNT_ALLOCATIONS builds only): the replacement operator new
+// in core.cpp counts allocations made on a thread while it is inside a core entry point.
+inline thread_local int g_entry_depth = 0;
+inline thread_local unsigned long long g_entry_allocations = 0;
+#endif
+
+// Opened by CS_ENTRY at the top of every exported function: trace span, call statistics and the
+// allocation-counting depth.
+class EntryScope {
+ public:
+  explicit EntryScope(ApiId api)
+      : trace_(kApiNames[static_cast<size_t>(api)], TraceCategory::kApi) {
+#if defined(CASHSLOTH_COUNT_ALLOCATIONS)
+    ++g_entry_depth;
+#endif
+#if defined(CASHSLOTH_STATS)
+    stats_ = &thread_stats().api[static_cast<size_t>(api)];
+    g_call_failed = false;
+    const uint64_t calls = stats_->calls.get();
+    stats_->calls.add(1);
+    sampled_ = calls % kLatencySampleInterval == 0;
+    if (sampled_) {
+      start_sample();
+    }
+#endif
+  }
+
+  ~EntryScope() {
+#if defined(CASHSLOTH_STATS)
+    if (g_call_failed) {
+      stats_->errors.add(1);
+    }
+    if (sampled_) {
+      finish_sample();
+    }
+#endif
+#if defined(CASHSLOTH_COUNT_ALLOCATIONS)
+    --g_entry_depth;
+#endif
+  }
+
+  EntryScope(const EntryScope&) = delete;
+  EntryScope& operator=(const EntryScope&) = delete;
+
+ private:
+  // First member, so the span covers the whole call including the statistics bookkeeping.
+  TraceSpan trace_;
+
+#if defined(CASHSLOTH_STATS)
+  // Out of line so the unsampled path of every entry point stays a handful of instructions.
+  CS_NOINLINE void start_sample() { start_ = std::chrono::steady_clock::now(); }
+
+  CS_NOINLINE void finish_sample() {
+    const uint64_t ns = elapsed_ns(start_);
+    stats_->latency_samples.add(1);
+    stats_->latency_ns.add(ns);
+    stats_->latency[latency_bucket(ns)].add(1);
+  }
+
+  ThreadStats::Api* stats_;
+  bool sampled_;
+  std::chrono::steady_clock::time_point start_;
+#endif
+};
+
+#define CS_ENTRY(api) EntryScope cs_entry_scope(ApiId::api)
+
+}  // namespace cashsloth
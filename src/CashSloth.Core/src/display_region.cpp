@@ -0,0 +1,308 @@
+#include "display_region.h"
+
+#include <cstring>
+#include <thread>
+
+#if !defined(_WIN32)
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "cart.h"
+#include "errors.h"
+
+namespace cashsloth {
+
+DisplayRegion::~DisplayRegion() {
+  drop_name();
+  unmap();
+}
+
+int DisplayRegion::create(const char* shared_name, size_t capacity) {
+  const size_t words = (capacity + 7) / 8;
+  const size_t size = kHeader + words * 8;
+  if (shared_name && shared_name[0] != '\0') {
+    const int result = map_shared(shared_name, size, true);
+    if (result != CS_ERRC_NONE) {
+      return result;
+    }
+  } else {
+    resource_ = core_resource(MemoryCategory::kBuffers);
+    base_ = static_cast<char*>(resource_->allocate(size, 64));
+    mapped_size_ = size;
+  }
+  for (size_t i = 0; i < kHeader / 8 + words; ++i) {
+    new (base_ + i * 8) std::atomic<uint64_t>(0);
+  }
+  capacity_ = words * 8;
+  word(kCapacityWord).store(capacity_, std::memory_order_relaxed);
+  std::memcpy(base_, kMagic, sizeof(kMagic));
+  return CS_ERRC_NONE;
+}
+
+int DisplayRegion::open(const char* shared_name) {
+  const int result = map_shared(shared_name, 0, false);
+  if (result != CS_ERRC_NONE) {
+    return result;
+  }
+  capacity_ = static_cast<size_t>(word(kCapacityWord).load(std::memory_order_relaxed));
+  if (std::memcmp(base_, kMagic, sizeof(kMagic)) != 0 || capacity_ % 8 != 0 ||
+      capacity_ > mapped_size_ - kHeader) {
+    unmap();
+    set_last_error(CS_ERRC_INVALID_VALUE, "Not a published cart: ", shared_name);
+    return CS_ERRC_INVALID_VALUE;
+  }
+  return CS_ERRC_NONE;
+}
+
+void DisplayRegion::write(std::string_view text, uint64_t flags) {
+  std::atomic<uint64_t>& sequence = word(kSequenceWord);
+  const uint64_t start = sequence.load(std::memory_order_relaxed);
+  sequence.store(start + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  if (text.size() > capacity_) {
+    text = std::string_view();
+    flags |= kOverflow;
+  }
+  std::atomic<uint64_t>* payload = payload_words();
+  for (size_t offset = 0; offset < text.size(); offset += 8) {
+    uint64_t value = 0;
+    std::memcpy(&value, text.data() + offset, std::min<size_t>(8, text.size() - offset));
+    payload[offset / 8].store(value, std::memory_order_relaxed);
+  }
+  word(kMetaWord).store(text.size() | flags, std::memory_order_relaxed);
+  sequence.store(start + 2, std::memory_order_release);
+}
+
+int DisplayRegion::read(char* buffer, size_t buffer_size, size_t* out_size,
+                        uint64_t* out_version) const {
+  const std::atomic<uint64_t>* payload = payload_words();
+  for (int attempt = 0; attempt < kReadAttempts; ++attempt) {
+    const uint64_t before = word(kSequenceWord).load(std::memory_order_acquire);
+    if (before & 1u) {
+      std::this_thread::yield();
+      continue;
+    }
+    const uint64_t meta = word(kMetaWord).load(std::memory_order_relaxed);
+    const size_t size = static_cast<size_t>(meta & kSizeMask);
+    const bool fits = size < buffer_size && size <= capacity_;
+    for (size_t offset = 0; fits && offset < size; offset += 8) {
+      const uint64_t value = payload[offset / 8].load(std::memory_order_relaxed);
+      std::memcpy(buffer + offset, &value, std::min<size_t>(8, size - offset));
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (word(kSequenceWord).load(std::memory_order_relaxed) != before) {
+      continue;
+    }
+
+    if (meta & kClosed) {
+      set_last_error(CS_ERRC_INVALID_STATE, "The cart is no longer published.");
+      return CS_ERRC_INVALID_STATE;
+    }
+    if (meta & kOverflow) {
+      set_last_error(CS_ERRC_OVERFLOW, "The cart does not fit the published region.");
+      return CS_ERRC_OVERFLOW;
+    }
+    *out_size = size;
+    *out_version = before >> 1;
+    if (!fits) {
+      set_last_error(CS_ERRC_INVALID_VALUE, "buffer_size is too small for the published cart.");
+      return CS_ERRC_INVALID_VALUE;
+    }
+    buffer[size] = '\0';
+    return CS_ERRC_NONE;
+  }
+  set_last_error(CS_ERRC_INVALID_STATE, "The published cart kept changing; try again.");
+  return CS_ERRC_INVALID_STATE;
+}
+
+void DisplayRegion::close_for_writer() {
+  drop_name();
+  write(std::string_view(), kClosed);
+}
+
+int DisplayRegion::map_shared(const char* shared_name, size_t size, bool create) {
+  if (std::strchr(shared_name, '/') || std::strchr(shared_name, '\\') ||
+      std::strlen(shared_name) > 200) {
+    set_last_error(CS_ERRC_INVALID_VALUE, "Invalid shared memory name: ", shared_name);
+    return CS_ERRC_INVALID_VALUE;
+  }
+#if defined(_WIN32)
+  name_ = "Local\\";
+  name_ += shared_name;
+  mapping_ = create ? CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+                                         static_cast<DWORD>(uint64_t(size) >> 32),
+                                         static_cast<DWORD>(size), name_.c_str())
+                    : OpenFileMappingA(FILE_MAP_READ, FALSE, name_.c_str());
+  if (create && mapping_ && GetLastError() == ERROR_ALREADY_EXISTS) {
+    CloseHandle(mapping_);
+    mapping_ = nullptr;
+    return name_in_use(shared_name);
+  }
+  if (mapping_) {
+    base_ = static_cast<char*>(
+        MapViewOfFile(mapping_, create ? FILE_MAP_ALL_ACCESS : FILE_MAP_READ, 0, 0, size));
+  }
+  MEMORY_BASIC_INFORMATION info;
+  if (base_ && VirtualQuery(base_, &info, sizeof(info)) != 0) {
+    mapped_size_ = static_cast<size_t>(info.RegionSize);
+  }
+#else
+  name_ = "/";
+  name_ += shared_name;
+  const int flags = create ? O_RDWR | O_CREAT | O_EXCL : O_RDONLY;
+  int fd = ::shm_open(name_.c_str(), flags, 0644);
+  if (fd < 0 && create && errno == EEXIST) {
+    if (!unlink_if_closed()) {
+      return name_in_use(shared_name);
+    }
+    fd = ::shm_open(name_.c_str(), flags, 0644);
+    if (fd < 0 && errno == EEXIST) {
+      return name_in_use(shared_name);
+    }
+  }
+  struct stat info;
+  if (fd >= 0 && (!create || ::ftruncate(fd, static_cast<off_t>(size)) == 0) &&
+      ::fstat(fd, &info) == 0 && static_cast<size_t>(info.st_size) >= kHeader) {
+    void* memory = ::mmap(nullptr, static_cast<size_t>(info.st_size),
+                          create ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+    if (memory != MAP_FAILED) {
+      base_ = static_cast<char*>(memory);
+      mapped_size_ = static_cast<size_t>(info.st_size);
+      device_ = info.st_dev;
+      inode_ = info.st_ino;
+    }
+  }
+  if (fd >= 0) {
+    ::close(fd);
+    if (create && !base_) {
+      ::shm_unlink(name_.c_str());
+    }
+  }
+#endif
+  if (!create) {
+    name_.clear();
+  }
+  if (!base_ || mapped_size_ < kHeader) {
+    name_.clear();
+    unmap();
+    set_last_error(CS_ERRC_IO, "Unable to map shared memory: ", shared_name);
+    return CS_ERRC_IO;
+  }
+  return CS_ERRC_NONE;
+}
+
+int DisplayRegion::name_in_use(const char* shared_name) {
+  name_.clear();
+  set_last_error(CS_ERRC_NAME_IN_USE, "Shared memory name already in use: ", shared_name);
+  return CS_ERRC_NAME_IN_USE;
+}
+
+#if !defined(_WIN32)
+bool DisplayRegion::unlink_if_closed() const {
+  const int fd = ::shm_open(name_.c_str(), O_RDONLY, 0);
+  if (fd < 0) {
+    return errno == ENOENT;
+  }
+  bool closed = false;
+  struct stat info;
+  if (::fstat(fd, &info) == 0 && static_cast<size_t>(info.st_size) >= kHeader) {
+    void* memory = ::mmap(nullptr, kHeader, PROT_READ, MAP_SHARED, fd, 0);
+    if (memory != MAP_FAILED) {
+      const char* header = static_cast<const char*>(memory);
+      const auto* words = reinterpret_cast<const std::atomic<uint64_t>*>(header);
+      closed = std::memcmp(header, kMagic, sizeof(kMagic)) == 0 &&
+               (words[kMetaWord].load(std::memory_order_acquire) & kClosed) != 0;
+      ::munmap(memory, kHeader);
+    }
+  }
+  ::close(fd);
+  return closed && (::shm_unlink(name_.c_str()) == 0 || errno == ENOENT);
+}
+
+void DisplayRegion::drop_name() {
+  if (!name_.empty() && names_this_region()) {
+    ::shm_unlink(name_.c_str());
+  }
+  name_.clear();
+}
+
+bool DisplayRegion::names_this_region() const {
+  const int fd = ::shm_open(name_.c_str(), O_RDONLY, 0);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat info;
+  const bool same = ::fstat(fd, &info) == 0 && info.st_dev == device_ && info.st_ino == inode_;
+  ::close(fd);
+  return same;
+}
+#endif
+
+void DisplayRegion::unmap() {
+  if (!base_) {
+#if defined(_WIN32)
+    if (mapping_) {
+      CloseHandle(mapping_);
+      mapping_ = nullptr;
+    }
+#endif
+    return;
+  }
+  if (resource_) {
+    resource_->deallocate(base_, mapped_size_, 64);
+  } else {
+#if defined(_WIN32)
+    UnmapViewOfFile(base_);
+    CloseHandle(mapping_);
+    mapping_ = nullptr;
+#else
+    ::munmap(base_, mapped_size_);
+#endif
+  }
+  base_ = nullptr;
+  mapped_size_ = 0;
+}
+
+void CartDisplay::render(const Cart& cart) {
+  text_.clear();
+  if (append_lines_json(cart, text_)) {
+    region_->write(text_, 0);
+  }
+}
+
+std::mutex g_display_registry_mutex;
+
+std::pmr::vector<DisplayRegionPtr>& display_registry() {
+  static std::pmr::vector<DisplayRegionPtr> displays(core_resource());
+  return displays;
+}
+
+DisplayRegionPtr make_display_region() {
+  return std::allocate_shared<DisplayRegion>(
+      std::pmr::polymorphic_allocator<DisplayRegion>(core_resource(MemoryCategory::kBuffers)));
+}
+
+cs_display_t register_display(DisplayRegionPtr region) {
+  std::lock_guard<std::mutex> lock(g_display_registry_mutex);
+  display_registry().push_back(region);
+  return region.get();
+}
+
+DisplayRegionPtr resolve_display(cs_display_t handle) {
+  if (!handle) {
+    return nullptr;
+  }
+  std::lock_guard<std::mutex> lock(g_display_registry_mutex);
+  for (const auto& display : display_registry()) {
+    if (display.get() == handle) {
+      return display;
+    }
+  }
+  return nullptr;
+}
+
+}  // namespace cashsloth
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "cashsloth_core.h"
+#include "memory.h"
+#include "platform.h"
+
+namespace cashsloth {
+
+class Cart;
+
+// A seqlock-protected copy of a published cart's lines JSON (cs_cart_publish), in private memory
+// or in named shared memory. The cart's calls write it and never wait: the sequence turns odd,
+// the text is stored in 8-byte words and the sequence turns even again. Readers copy the words
+// and retry until the sequence was even and unchanged around their copy. Half the sequence is
+// the version that lets readers skip unchanged frames.
+class DisplayRegion {
+ public:
+  static constexpr size_t kHeader = 64;
+  static constexpr size_t kDefaultCapacity = 64 * 1024;
+  static constexpr size_t kMaxCapacity = 16 * 1024 * 1024;
+
+  DisplayRegion() : name_(core_resource(MemoryCategory::kBuffers)) {}
+  DisplayRegion(const DisplayRegion&) = delete;
+  DisplayRegion& operator=(const DisplayRegion&) = delete;
+  ~DisplayRegion();
+
+  // Both return a CS_ERRC_* code and set the last error on failure. A null or empty name makes a
+  // private region.
+  int create(const char* shared_name, size_t capacity);
+  int open(const char* shared_name);
+
+  // Only the cart's own calls write, one at a time.
+  void write(std::string_view text, uint64_t flags);
+
+  uint64_t version() const {
+    return word(kSequenceWord).load(std::memory_order_acquire) >> 1;
+  }
+
+  // Copies the latest frame and a terminating null into `buffer`. Sets *out_size to the text's
+  // size also when `buffer` is too small.
+  int read(char* buffer, size_t buffer_size, size_t* out_size, uint64_t* out_version) const;
+
+  // Drops the shared name and tells readers the cart is gone; open mappings stay readable. The
+  // name goes first, so a closed region is never left under a name another cart could claim.
+  void close_for_writer();
+
+ private:
+  static constexpr char kMagic[8] = {'C', 'S', 'D', 'I', 'S', 'P', '0', '1'};
+  static constexpr size_t kSequenceWord = 1;
+  static constexpr size_t kMetaWord = 2;
+  static constexpr size_t kCapacityWord = 3;
+  static constexpr uint64_t kSizeMask = 0xFFFFFFFFu;
+  static constexpr uint64_t kClosed = uint64_t(1) << 32;
+  static constexpr uint64_t kOverflow = uint64_t(1) << 33;
+  static constexpr int kReadAttempts = 10000;
+
+  std::atomic<uint64_t>& word(size_t index) const {
+    return *reinterpret_cast<std::atomic<uint64_t>*>(base_ + index * 8);
+  }
+
+  std::atomic<uint64_t>* payload_words() const {
+    return reinterpret_cast<std::atomic<uint64_t>*>(base_ + kHeader);
+  }
+
+  // Creates (size > 0) or opens the named region. POSIX names get a leading '/'; Windows names
+  // live in the session's Local\ namespace. Creating never touches an existing region: the name
+  // must be free, or hold a region whose writer closed it.
+  int map_shared(const char* shared_name, size_t size, bool create);
+  int name_in_use(const char* shared_name);
+
+#if !defined(_WIN32)
+  // Removes the region under name_ if its header says its writer closed it. Live regions and
+  // ones still being set up are left alone.
+  bool unlink_if_closed() const;
+  void drop_name();
+
+  // Whether name_ still refers to the region this object created.
+  bool names_this_region() const;
+#else
+  void drop_name() { name_.clear(); }
+#endif
+
+  void unmap();
+
+  char* base_ = nullptr;
+  size_t mapped_size_ = 0;
+  size_t capacity_ = 0;
+  // Set for private regions, which come from the core's allocator.
+  std::pmr::memory_resource* resource_ = nullptr;
+  // The system name of a region this process created; empty otherwise.
+  std::pmr::string name_;
+#if defined(_WIN32)
+  HANDLE mapping_ = nullptr;
+#else
+  // Identify the created region, so a name someone else reclaimed is never unlinked.
+  dev_t device_ = 0;
+  ino_t inode_ = 0;
+#endif
+};
+
+using DisplayRegionPtr = std::shared_ptr<DisplayRegion>;
+
+// The writer side of a published cart. publish() re-renders the lines JSON into a scratch string
+// that keeps its capacity and copies it into the region.
+class CartDisplay {
+ public:
+  CartDisplay() : text_(core_resource(MemoryCategory::kBuffers)) {}
+
+  bool attached() const { return region_ != nullptr; }
+
+  void attach(DisplayRegionPtr region, const Cart& cart) {
+    region_ = std::move(region);
+    publish(cart);
+  }
+
+  // Called after the cart changed. A no-op unless the cart is published.
+  void publish(const Cart& cart) {
+    if (region_) {
+      render(cart);
+    }
+  }
+
+  void close() {
+    if (region_) {
+      region_->close_for_writer();
+      region_.reset();
+    }
+  }
+
+ private:
+  void render(const Cart& cart);
+
+  DisplayRegionPtr region_;
+  std::pmr::string text_;
+};
+
+// Reader handles from cs_cart_publish and cs_display_open. A region outlives its handle while a
+// read or the publishing cart still holds it.
+extern std::mutex g_display_registry_mutex;
+std::pmr::vector<DisplayRegionPtr>& display_registry();
+
+DisplayRegionPtr make_display_region();
+cs_display_t register_display(DisplayRegionPtr region);
+// Null for handles that are not a live display.
+DisplayRegionPtr resolve_display(cs_display_t handle);
+
+}  // namespace cashsloth
@@ -0,0 +1,71 @@
+#include "encoding.h"
+
+#include <cstdio>
+
+namespace cashsloth {
+
+void append_json_escaped(std::pmr::string& output, std::string_view input) {
+  for (unsigned char ch : input) {
+    switch (ch) {
+      case '\"':
+        output += "\\\"";
+        break;
+      case '\\':
+        output += "\\\\";
+        break;
+      case '\b':
+        output += "\\b";
+        break;
+      case '\f':
+        output += "\\f";
+        break;
+      case '\n':
+        output += "\\n";
+        break;
+      case '\r':
+        output += "\\r";
+        break;
+      case '\t':
+        output += "\\t";
+        break;
+      default:
+        if (ch < 0x20) {
+          char buffer[7];
+          std::snprintf(buffer, sizeof(buffer), "\\u%04x", ch);
+          output += buffer;
+        } else {
+          output += static_cast<char>(ch);
+        }
+        break;
+    }
+  }
+}
+
+void append_integer(std::pmr::string& output, long long value) {
+  char buffer[24];
+  const int length = std::snprintf(buffer, sizeof(buffer), "%lld", value);
+  output.append(buffer, static_cast<size_t>(length));
+}
+
+uint32_t crc32(uint32_t crc, const char* data, size_t size) {
+  struct Table {
+    Table() {
+      for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t value = i;
+        for (int bit = 0; bit < 8; ++bit) {
+          value = (value >> 1) ^ (0xEDB88320u & (0u - (value & 1u)));
+        }
+        entries[i] = value;
+      }
+    }
+    uint32_t entries[256];
+  };
+  static const Table table;
+  crc = ~crc;
+  for (size_t i = 0; i < size; ++i) {
+    crc = table.entries[(crc ^ static_cast<unsigned char>(data[i])) & 0xFFu] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+}  // namespace cashsloth
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+
+namespace cashsloth {
+
+// Offset/length pair into a snapshot's string pool.
+struct StringRef {
+  uint32_t offset = 0;
+  uint32_t length = 0;
+};
+
+// Appends `input` with JSON string escapes, without the quotes.
+void append_json_escaped(std::pmr::string& output, std::string_view input);
+
+// Formats into a stack buffer instead of a std::to_string temporary.
+void append_integer(std::pmr::string& output, long long value);
+
+// CRC-32 (IEEE 802.3, reflected), the checksum of zip and PNG. Pass the previous result to
+// continue a checksum across buffers.
+uint32_t crc32(uint32_t crc, const char* data, size_t size);
+
+// Little-endian, varint-based encoding of journal records.
+inline void append_fixed32(std::pmr::string& out, uint32_t value) {
+  for (int i = 0; i < 4; ++i) {
+    out += static_cast<char>((value >> (8 * i)) & 0xFFu);
+  }
+}
+
+inline void append_fixed64(std::pmr::string& out, uint64_t value) {
+  for (int i = 0; i < 8; ++i) {
+    out += static_cast<char>((value >> (8 * i)) & 0xFFu);
+  }
+}
+
+inline void append_varint(std::pmr::string& out, uint64_t value) {
+  while (value >= 0x80) {
+    out += static_cast<char>((value & 0x7Fu) | 0x80u);
+    value >>= 7;
+  }
+  out += static_cast<char>(value);
+}
+
+inline void append_zigzag(std::pmr::string& out, long long value) {
+  const uint64_t bits = static_cast<uint64_t>(value);
+  append_varint(out, (bits << 1) ^ (value < 0 ? ~uint64_t{0} : 0));
+}
+
+inline void append_text(std::pmr::string& out, std::string_view text) {
+  append_varint(out, text.size());
+  out.append(text.data(), text.size());
+}
+
+inline uint64_t load_fixed(const char* data, int bytes) {
+  uint64_t value = 0;
+  for (int i = 0; i < bytes; ++i) {
+    value |= static_cast<uint64_t>(static_cast<unsigned char>(data[i])) << (8 * i);
+  }
+  return value;
+}
+
+inline void store_fixed(char* out, uint64_t value, int bytes) {
+  for (int i = 0; i < bytes; ++i) {
+    out[i] = static_cast<char>((value >> (8 * i)) & 0xFFu);
+  }
+}
+
+}  // namespace cashsloth
@@ -0,0 +1,63 @@
+#include "errors.h"
+
+#include <exception>
+#include <new>
+#include <string>
+
+namespace cashsloth {
+namespace {
+
+// Formatted text of the last error, built on demand by cs_last_error.
+thread_local std::string g_last_error;
+
+// Each thread reserves its error buffer once, so messages up to this size are formatted without
+// touching the heap on a warm thread.
+constexpr size_t kLastErrorReserve = 256;
+
+void reserve_last_error() {
+  if (g_last_error.capacity() < kLastErrorReserve) {
+    g_last_error.reserve(kLastErrorReserve);
+  }
+}
+
+}  // namespace
+
+void set_last_error_text(int code, std::string_view message, std::string_view detail) {
+  note_call_failed(true);
+  reserve_last_error();
+  g_last_error.assign(message.data(), message.size());
+  g_last_error.append(detail.data(), detail.size());
+  g_error.code = code;
+  g_error.message = nullptr;
+}
+
+const char* formatted_last_error() {
+  if (g_error.message) {
+    reserve_last_error();
+    g_last_error.assign(g_error.message);
+    g_last_error.append(g_error.detail, g_error.detail_size);
+    g_error.message = nullptr;
+  }
+  return g_last_error.c_str();
+}
+
+int exception_error_code() {
+  try {
+    throw;
+  } catch (const std::bad_alloc&) {
+    set_last_error(CS_ERRC_OUT_OF_MEMORY, "Out of memory.");
+    return CS_ERRC_OUT_OF_MEMORY;
+  } catch (const std::exception& e) {
+    set_last_error(CS_ERRC_INTERNAL, "Internal error: ", e.what());
+    return CS_ERRC_INTERNAL;
+  } catch (...) {
+    set_last_error(CS_ERRC_INTERNAL, "Internal error.");
+    return CS_ERRC_INTERNAL;
+  }
+}
+
+int translate_exception() {
+  return error_result(exception_error_code());
+}
+
+}  // namespace cashsloth
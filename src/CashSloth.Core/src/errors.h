@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+#include "cashsloth_core.h"
+#include "platform.h"
+
+namespace cashsloth {
+
+// Set while the current entry point has reported an error; statistics and the call recorder read
+// it to tell failed calls apart.
+inline CS_FAST_TLS thread_local bool g_call_failed = false;
+
+inline void note_call_failed(bool failed) {
+  g_call_failed = failed;
+}
+
+// Longest detail (an item id, a catalog name) kept without formatting; longer ones are formatted
+// right away.
+constexpr size_t kErrorDetailCapacity = 128;
+
+// The calling thread's last error. Trivially constructible so it lives in initial-exec TLS:
+// reporting an error stores a code, a static message and a bounded copy of the detail, and
+// "<message><detail>" is only assembled into the formatted text when cs_last_error asks for it.
+struct LastError {
+  int code;
+  // Static text; nullptr when the formatted text already holds the message.
+  const char* message;
+  uint32_t detail_size;
+  char detail[kErrorDetailCapacity];
+};
+
+inline CS_FAST_TLS thread_local LastError g_error = {CS_ERRC_NONE, "", 0, {}};
+
+// Success of a regular entry point: cs_last_error() reads "" and cs_last_error_code() 0.
+inline void clear_last_error() {
+  note_call_failed(false);
+  g_error.code = CS_ERRC_NONE;
+  g_error.message = "";
+  g_error.detail_size = 0;
+}
+
+inline void set_last_error(int code, const char* message) {
+  note_call_failed(true);
+  g_error.code = code;
+  g_error.message = message;
+  g_error.detail_size = 0;
+}
+
+// Formats "<message><detail>" now. For messages that are not static, or details too long to keep.
+void set_last_error_text(int code, std::string_view message, std::string_view detail = {});
+
+// Reports "<message><detail>" with a static `message`.
+inline void set_last_error(int code, const char* message, std::string_view detail) {
+  if (detail.size() > kErrorDetailCapacity) {
+    set_last_error_text(code, message, detail);
+    return;
+  }
+  note_call_failed(true);
+  g_error.code = code;
+  g_error.message = message;
+  g_error.detail_size = static_cast<uint32_t>(detail.size());
+  std::memcpy(g_error.detail, detail.data(), detail.size());
+}
+
+// The calling thread's last error as text, formatted on demand.
+const char* formatted_last_error();
+
+// The CS_ERROR_* return code of the regular entry points for a CS_ERRC_* code.
+inline int error_result(int code) {
+  switch (code) {
+    case CS_ERRC_NONE:
+      return CS_SUCCESS;
+    case CS_ERRC_OUT_OF_MEMORY:
+      return CS_ERROR_OUT_OF_MEMORY;
+    case CS_ERRC_NOT_SUPPORTED:
+      return CS_ERROR_NOT_SUPPORTED;
+    case CS_ERRC_INTERNAL:
+      return CS_ERROR_INTERNAL;
+    default:
+      return CS_ERROR_INVALID_ARGUMENT;
+  }
+}
+
+// Finishes a regular entry point around a helper that returns a CS_ERRC_* code and reports its
+// own failures.
+inline int regular_result(int code) {
+  if (code == CS_ERRC_NONE) {
+    clear_last_error();
+    return CS_SUCCESS;
+  }
+  return error_result(code);
+}
+
+// Reports an exception escaping an entry point and returns its CS_ERRC_* code.
+int exception_error_code();
+
+// Maps an exception escaping an entry point to its error code.
+int translate_exception();
+
+}  // namespace cashsloth
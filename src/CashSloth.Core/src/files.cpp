@@ -0,0 +1,156 @@
+#include "files.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#if defined(_WIN32)
+#include <fcntl.h>
+#include <io.h>
+#include <share.h>
+#include <sys/stat.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace cashsloth {
+
+bool read_file(const std::pmr::string& path, std::pmr::string* out_contents) {
+  std::FILE* file = std::fopen(path.c_str(), "rb");
+  if (!file) {
+    return false;
+  }
+  char buffer[64 * 1024];
+  size_t read = 0;
+  bool ok = true;
+  try {
+    while ((read = std::fread(buffer, 1, sizeof(buffer), file)) > 0) {
+      out_contents->append(buffer, read);
+    }
+    ok = std::ferror(file) == 0;
+  } catch (...) {
+    std::fclose(file);
+    throw;
+  }
+  std::fclose(file);
+  return ok;
+}
+
+bool DurableFile::open(const char* path) {
+#if defined(_WIN32)
+  return _sopen_s(&fd_, path, _O_RDWR | _O_CREAT | _O_APPEND | _O_BINARY, _SH_DENYWR,
+                  _S_IREAD | _S_IWRITE) == 0;
+#else
+  fd_ = ::open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  return fd_ >= 0;
+#endif
+}
+
+bool DurableFile::size(uint64_t* out_size) {
+#if defined(_WIN32)
+  const long long end = _lseeki64(fd_, 0, SEEK_END);
+#else
+  const off_t end = ::lseek(fd_, 0, SEEK_END);
+#endif
+  if (end < 0) {
+    return false;
+  }
+  *out_size = static_cast<uint64_t>(end);
+  return true;
+}
+
+bool DurableFile::read_at(uint64_t offset, char* data, size_t size) {
+#if defined(_WIN32)
+  if (_lseeki64(fd_, static_cast<long long>(offset), SEEK_SET) < 0) {
+    return false;
+  }
+#else
+  if (::lseek(fd_, static_cast<off_t>(offset), SEEK_SET) < 0) {
+    return false;
+  }
+#endif
+  while (size > 0) {
+    const unsigned chunk = static_cast<unsigned>(std::min<size_t>(size, 1u << 30));
+#if defined(_WIN32)
+    const int read = _read(fd_, data, chunk);
+#else
+    const ssize_t read = ::read(fd_, data, chunk);
+    if (read < 0 && errno == EINTR) {
+      continue;
+    }
+#endif
+    if (read <= 0) {
+      return false;
+    }
+    data += read;
+    size -= static_cast<size_t>(read);
+  }
+  return true;
+}
+
+bool DurableFile::append(const char* data, size_t size) {
+  while (size > 0) {
+    const unsigned chunk = static_cast<unsigned>(std::min<size_t>(size, 1u << 30));
+#if defined(_WIN32)
+    const int written = _write(fd_, data, chunk);
+#else
+    const ssize_t written = ::write(fd_, data, chunk);
+    if (written < 0 && errno == EINTR) {
+      continue;
+    }
+#endif
+    if (written <= 0) {
+      return false;
+    }
+    data += written;
+    size -= static_cast<size_t>(written);
+  }
+  return true;
+}
+
+bool DurableFile::sync() {
+#if defined(_WIN32)
+  return _commit(fd_) == 0;
+#else
+  return ::fsync(fd_) == 0;
+#endif
+}
+
+bool DurableFile::truncate(uint64_t size) {
+#if defined(_WIN32)
+  return _chsize_s(fd_, static_cast<long long>(size)) == 0;
+#else
+  return ::ftruncate(fd_, static_cast<off_t>(size)) == 0;
+#endif
+}
+
+void DurableFile::close() {
+  if (fd_ < 0) {
+    return;
+  }
+#if defined(_WIN32)
+  _close(fd_);
+#else
+  ::close(fd_);
+#endif
+  fd_ = -1;
+}
+
+void sync_parent_directory(const char* path) {
+#if !defined(_WIN32)
+  const char* slash = std::strrchr(path, '/');
+  const std::string directory = slash ? std::string(path, slash == path ? 1 : slash - path) : ".";
+  const int fd = ::open(directory.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd >= 0) {
+    ::fsync(fd);
+    ::close(fd);
+  }
+#else
+  (void)path;
+#endif
+}
+
+}  // namespace cashsloth
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <string>
+
+namespace cashsloth {
+
+// Reads the whole file into `out_contents`. False when it cannot be opened or read.
+bool read_file(const std::pmr::string& path, std::pmr::string* out_contents);
+
+// Append-only file with explicit durability for the sale journal. stdio can neither fsync nor
+// truncate, so this sits on the CRT's low-level io on Windows and on file descriptors elsewhere.
+class DurableFile {
+ public:
+  DurableFile() = default;
+  DurableFile(const DurableFile&) = delete;
+  DurableFile& operator=(const DurableFile&) = delete;
+  ~DurableFile() { close(); }
+
+  // Opens or creates `path` for reading and appending. Windows denies other writers.
+  bool open(const char* path);
+  bool size(uint64_t* out_size);
+  bool read_at(uint64_t offset, char* data, size_t size);
+  bool append(const char* data, size_t size);
+  bool sync();
+  bool truncate(uint64_t size);
+  void close();
+
+ private:
+  int fd_ = -1;
+};
+
+// Makes a newly created file's directory entry durable. NTFS journals it with the file itself.
+void sync_parent_directory(const char* path);
+
+}  // namespace cashsloth
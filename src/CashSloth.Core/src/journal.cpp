@@ -0,0 +1,281 @@
+#include "journal.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "diagnostics.h"
+#include "errors.h"
+
+namespace cashsloth {
+namespace {
+
+// A batch is written as soon as it holds this much, whatever the commit delay.
+constexpr size_t kGroupCommitBytes = 256 * 1024;
+
+}  // namespace
+
+void SalesStore::replace(std::unique_ptr<JournalViews> views) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    views_.swap(views);
+  }
+  // The previous views are freed outside the lock.
+}
+
+void SalesStore::add(const SaleView& sale) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!views_) {
+    return;
+  }
+  try {
+    views_->add(sale);
+  } catch (...) {
+    // The sale is durable in the journal; reports refuse to run until it is reopened.
+    views_->index.mark_incomplete();
+    views_->live.mark_incomplete();
+  }
+}
+
+int SalesStore::query(const SalesFilter& filter, size_t group_by, std::pmr::string* out) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!views_) {
+    set_last_error(CS_ERRC_INVALID_STATE, "No sale journal is open.");
+    return CS_ERRC_INVALID_STATE;
+  }
+  return views_->index.query(filter, group_by, out);
+}
+
+int SalesStore::live_metrics(long long now_unix_ms, size_t top_n, std::pmr::string* out) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!views_) {
+    set_last_error(CS_ERRC_INVALID_STATE, "No sale journal is open.");
+    return CS_ERRC_INVALID_STATE;
+  }
+  return views_->live.write_json(now_unix_ms, top_n, out);
+}
+
+SalesStore& sales_store() {
+  static SalesStore store;
+  return store;
+}
+
+int SaleJournal::open(const char* path, int max_commit_delay_ms, std::pmr::string* out_report) {
+  std::lock_guard<std::mutex> admin(admin_mutex_);
+  if (open_) {
+    set_last_error(CS_ERRC_INVALID_STATE, "A sale journal is already open.");
+    return CS_ERROR_INVALID_ARGUMENT;
+  }
+  if (!file_.open(path)) {
+    set_last_error(CS_ERRC_IO, "Unable to open sale journal: ", path);
+    return CS_ERROR_INVALID_ARGUMENT;
+  }
+  auto views = std::make_unique<JournalViews>(core_resource(MemoryCategory::kSales));
+  int result = CS_ERROR_INTERNAL;
+  try {
+    result = recover(path, views.get(), out_report);
+  } catch (...) {
+    file_.close();
+    throw;
+  }
+  if (result != CS_SUCCESS) {
+    file_.close();
+    return result;
+  }
+  sales_store().replace(std::move(views));
+  std::lock_guard<std::mutex> lock(mutex_);
+  max_delay_ = std::chrono::milliseconds(max_commit_delay_ms);
+  failed_ = false;
+  stopping_ = false;
+  flusher_ = std::thread([this] { run(); });
+  open_ = true;
+  clear_last_error();
+  return CS_SUCCESS;
+}
+
+void SaleJournal::close() {
+  std::lock_guard<std::mutex> admin(admin_mutex_);
+  std::thread flusher;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!open_) {
+      return;
+    }
+    stopping_ = true;
+    flusher = std::move(flusher_);
+    work_cv_.notify_all();
+  }
+  flusher.join();
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    durable_cv_.wait(lock, [this] { return waiters_ == 0; });
+    open_ = false;
+  }
+  file_.close();
+  sales_store().replace(nullptr);
+}
+
+int SaleJournal::commit(std::pmr::string& payload, uint64_t* out_sequence) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (!open_ || stopping_) {
+    set_last_error(CS_ERRC_INVALID_STATE, "No sale journal is open.");
+    return CS_ERROR_INVALID_ARGUMENT;
+  }
+  if (failed_) {
+    set_last_error(CS_ERRC_IO, "The sale journal failed to write; reopen it.");
+    return CS_ERROR_INTERNAL;
+  }
+  if (payload.size() > kMaxJournalRecord) {
+    set_last_error(CS_ERRC_INVALID_VALUE, "Sale record is too large for the journal.");
+    return CS_ERROR_INVALID_ARGUMENT;
+  }
+
+  const uint64_t sequence = next_sequence_;
+  for (int i = 0; i < 8; ++i) {
+    payload[i] = static_cast<char>((sequence >> (8 * i)) & 0xFFu);
+  }
+  const bool was_empty = pending_.empty();
+  const size_t mark = pending_.size();
+  try {
+    append_fixed32(pending_, static_cast<uint32_t>(payload.size()));
+    append_fixed32(pending_, crc32(crc32(0, pending_.data() + mark, 4), payload.data(),
+                                   payload.size()));
+    pending_ += payload;
+  } catch (...) {
+    pending_.resize(mark);
+    throw;
+  }
+  ++next_sequence_;
+  if (was_empty) {
+    oldest_pending_ = std::chrono::steady_clock::now();
+  }
+  pending_last_ = sequence;
+  if (was_empty || pending_.size() >= kGroupCommitBytes) {
+    work_cv_.notify_one();
+  }
+
+  ++waiters_;
+  durable_cv_.wait(lock, [&] { return durable_sequence_ >= sequence || failed_; });
+  const bool durable = durable_sequence_ >= sequence;
+  if (durable) {
+    // Still counted as a waiter, so close cannot swap the index before the sale is in it.
+    SaleView sale;
+    if (decode_sale(payload, &sale)) {
+      sales_store().add(sale);
+    }
+  }
+  if (--waiters_ == 0 && stopping_) {
+    durable_cv_.notify_all();
+  }
+  if (!durable) {
+    set_last_error(CS_ERRC_IO, "Writing the sale journal failed.");
+    return CS_ERROR_INTERNAL;
+  }
+  *out_sequence = sequence;
+  return CS_SUCCESS;
+}
+
+int SaleJournal::recover(const char* path, JournalViews* views, std::pmr::string* out_report) {
+  uint64_t size = 0;
+  if (!file_.size(&size)) {
+    set_last_error(CS_ERRC_IO, "Unable to read sale journal: ", path);
+    return CS_ERROR_INVALID_ARGUMENT;
+  }
+  std::pmr::string image(core_resource(MemoryCategory::kJournal));
+  image.resize(static_cast<size_t>(size));
+  if (!file_.read_at(0, image.data(), image.size())) {
+    set_last_error(CS_ERRC_IO, "Unable to read sale journal: ", path);
+    return CS_ERROR_INVALID_ARGUMENT;
+  }
+
+  // A crash while the magic was being written leaves a prefix of it; start over.
+  const size_t magic_bytes = std::min(image.size(), sizeof(kJournalMagic));
+  const bool fresh = image.size() < sizeof(kJournalMagic) &&
+                     std::memcmp(image.data(), kJournalMagic, magic_bytes) == 0;
+  if (!fresh && std::memcmp(image.data(), kJournalMagic, magic_bytes) != 0) {
+    set_last_error(CS_ERRC_INVALID_VALUE, "Not a sale journal: ", path);
+    return CS_ERROR_INVALID_ARGUMENT;
+  }
+  if (fresh) {
+    if (!file_.truncate(0) || !file_.append(kJournalMagic, sizeof(kJournalMagic)) ||
+        !file_.sync()) {
+      set_last_error(CS_ERRC_IO, "Unable to write sale journal: ", path);
+      return CS_ERROR_INTERNAL;
+    }
+    sync_parent_directory(path);
+    image.assign(kJournalMagic, sizeof(kJournalMagic));
+  }
+
+  uint64_t records = 0;
+  uint64_t last_sequence = 0;
+  const size_t end = scan_journal(image, [&](std::string_view payload) {
+    ++records;
+    last_sequence = load_fixed(payload.data(), 8);
+    SaleView sale;
+    if (decode_sale(payload, &sale)) {
+      views->add(sale);
+    }
+    return true;
+  });
+  const size_t truncated = image.size() - end;
+  if (truncated > 0 && (!file_.truncate(end) || !file_.sync())) {
+    set_last_error(CS_ERRC_IO, "Unable to truncate sale journal: ", path);
+    return CS_ERROR_INTERNAL;
+  }
+
+  next_sequence_ = last_sequence + 1;
+  durable_sequence_ = last_sequence;
+  *out_report += "{\"records\":";
+  append_integer(*out_report, static_cast<long long>(records));
+  *out_report += ",\"truncated_bytes\":";
+  append_integer(*out_report, static_cast<long long>(truncated));
+  *out_report += ",\"next_sequence\":";
+  append_integer(*out_report, static_cast<long long>(next_sequence_));
+  *out_report += "}";
+  return CS_SUCCESS;
+}
+
+void SaleJournal::run() {
+  trace_name_thread("sale journal");
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (;;) {
+    if (pending_.empty()) {
+      if (stopping_) {
+        return;
+      }
+      work_cv_.wait(lock);
+      continue;
+    }
+    const auto deadline = oldest_pending_ + max_delay_;
+    if (!stopping_ && pending_.size() < kGroupCommitBytes &&
+        std::chrono::steady_clock::now() < deadline) {
+      work_cv_.wait_until(lock, deadline);
+      continue;
+    }
+
+    writing_.swap(pending_);
+    const uint64_t last = pending_last_;
+    lock.unlock();
+    bool ok = false;
+    {
+      TraceSpan span("journal_sync");
+      ok = file_.append(writing_.data(), writing_.size()) && file_.sync();
+    }
+    writing_.clear();
+    lock.lock();
+    if (ok) {
+      durable_sequence_ = last;
+    } else {
+      // Later records must not land behind a gap; everything queued fails with this batch.
+      failed_ = true;
+      pending_.clear();
+    }
+    durable_cv_.notify_all();
+  }
+}
+
+SaleJournal& sale_journal() {
+  static SaleJournal journal;
+  return journal;
+}
+
+}  // namespace cashsloth
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#include "encoding.h"
+#include "files.h"
+#include "live_metrics.h"
+#include "memory.h"
+#include "sale_record.h"
+#include "sales_index.h"
+
+namespace cashsloth {
+
+inline constexpr char kJournalMagic[8] = {'C', 'S', 'J', 'R', 'N', 'L', '0', '1'};
+// Payload size and CRC-32 of the size bytes plus the payload.
+constexpr size_t kJournalFrameHeader = 8;
+constexpr int kMaxCommitDelayMs = 10000;
+// Larger sizes in a frame header are treated as corruption.
+constexpr size_t kMaxJournalRecord = 64 * 1024 * 1024;
+
+// Walks the records after the magic, calling `visit(std::string_view payload)` until it returns
+// false. Stops at the first record that is cut short or fails its checksum and returns the
+// offset where the intact prefix ends.
+template <typename Visit>
+size_t scan_journal(std::string_view image, Visit&& visit) {
+  size_t offset = sizeof(kJournalMagic);
+  while (image.size() - offset >= kJournalFrameHeader) {
+    const uint64_t size = load_fixed(image.data() + offset, 4);
+    const uint32_t checksum = static_cast<uint32_t>(load_fixed(image.data() + offset + 4, 4));
+    if (size < 8 || size > kMaxJournalRecord ||
+        size > image.size() - offset - kJournalFrameHeader) {
+      break;
+    }
+    std::string_view payload = image.substr(offset + kJournalFrameHeader, static_cast<size_t>(size));
+    if (crc32(crc32(0, image.data() + offset, 4), payload.data(), payload.size()) != checksum) {
+      break;
+    }
+    offset += kJournalFrameHeader + payload.size();
+    if (!visit(payload)) {
+      break;
+    }
+  }
+  return offset;
+}
+
+// Everything derived from the open journal's sales.
+struct JournalViews {
+  explicit JournalViews(std::pmr::memory_resource* resource) : index(resource), live(resource) {}
+
+  void add(const SaleView& sale) {
+    index.add(sale);
+    live.add(sale);
+  }
+
+  SalesIndex index;
+  LiveMetrics live;
+};
+
+// The views of the open journal, rebuilt by cs_journal_open and extended by every commit.
+class SalesStore {
+ public:
+  void replace(std::unique_ptr<JournalViews> views);
+  void add(const SaleView& sale);
+  int query(const SalesFilter& filter, size_t group_by, std::pmr::string* out);
+  int live_metrics(long long now_unix_ms, size_t top_n, std::pmr::string* out);
+
+ private:
+  std::mutex mutex_;
+  std::unique_ptr<JournalViews> views_;
+};
+
+SalesStore& sales_store();
+
+// Process-wide sale journal. Committing threads queue framed records in memory and wait; one
+// flusher thread appends whatever has queued and syncs it with a single fsync, so a rush of
+// commits costs one disk flush per batch instead of one per sale. A batch is written once its
+// oldest record has waited max_commit_delay_ms or it reaches kGroupCommitBytes.
+class SaleJournal {
+ public:
+  SaleJournal()
+      : pending_(core_resource(MemoryCategory::kJournal)),
+        writing_(core_resource(MemoryCategory::kJournal)) {}
+  ~SaleJournal() { close(); }
+
+  int open(const char* path, int max_commit_delay_ms, std::pmr::string* out_report);
+
+  // Writes out every queued commit and stops the flusher. Commits still waiting get their result
+  // before close returns.
+  void close();
+
+  // Queues `payload`, whose first eight bytes are reserved for the sequence, and blocks until it
+  // is durable.
+  int commit(std::pmr::string& payload, uint64_t* out_sequence);
+
+ private:
+  // Validates the file, cuts off a torn tail left by a crash, finds the next sequence and loads
+  // the intact sales into `views`.
+  int recover(const char* path, JournalViews* views, std::pmr::string* out_report);
+  void run();
+
+  // Serializes open and close; commits only take mutex_.
+  std::mutex admin_mutex_;
+  std::mutex mutex_;
+  std::condition_variable work_cv_;
+  std::condition_variable durable_cv_;
+  DurableFile file_;
+  std::thread flusher_;
+  std::pmr::string pending_;
+  // Owned by the flusher while it writes.
+  std::pmr::string writing_;
+  std::chrono::steady_clock::time_point oldest_pending_;
+  std::chrono::milliseconds max_delay_{0};
+  uint64_t next_sequence_ = 1;
+  uint64_t pending_last_ = 0;
+  uint64_t durable_sequence_ = 0;
+  size_t waiters_ = 0;
+  bool open_ = false;
+  bool stopping_ = false;
+  // Sticky until the journal is reopened.
+  bool failed_ = false;
+};
+
+SaleJournal& sale_journal();
+
+}  // namespace cashsloth
@@ -0,0 +1,155 @@
+#include "live_metrics.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+
+#include "errors.h"
+#include "money.h"
+
+namespace cashsloth {
+namespace {
+
+// Appends numerator / denominator with two decimals, truncated; 0 when denominator is 0.
+void append_ratio(std::pmr::string& json, long long numerator, long long denominator) {
+  const long long whole = denominator > 0 ? numerator / denominator : 0;
+  const long long hundredths =
+      denominator > 0 ? static_cast<long long>(static_cast<long double>(numerator % denominator) *
+                                               100 / denominator)
+                      : 0;
+  append_integer(json, whole);
+  json += hundredths < 10 ? ".0" : ".";
+  append_integer(json, hundredths);
+}
+
+}  // namespace
+
+void HeavyHitters::add(std::string_view id, std::string_view name, long long weight) {
+  key_.assign(id.data(), id.size());
+  auto it = slots_.find(key_);
+  if (it != slots_.end()) {
+    Counter& counter = counters_[it->second];
+    counter.count += weight;
+    if (counter.name != name) {
+      counter.name.assign(name.data(), name.size());
+    }
+    return;
+  }
+  if (counters_.size() < kHeavyHitterCounters) {
+    slots_.emplace(key_, counters_.size());
+    counters_.push_back(Counter{std::pmr::string(id, resource_),
+                                std::pmr::string(name, resource_), weight, 0});
+    return;
+  }
+  size_t smallest = 0;
+  for (size_t i = 1; i < counters_.size(); ++i) {
+    if (counters_[i].count < counters_[smallest].count) {
+      smallest = i;
+    }
+  }
+  Counter& counter = counters_[smallest];
+  slots_.erase(counter.id);
+  slots_.emplace(key_, smallest);
+  counter.id.assign(id.data(), id.size());
+  counter.name.assign(name.data(), name.size());
+  counter.error = counter.count;
+  counter.count += weight;
+}
+
+void HeavyHitters::append_json(std::pmr::string& json, size_t top_n, const char* count_key) const {
+  std::pmr::vector<const Counter*> order(resource_);
+  for (const Counter& counter : counters_) {
+    order.push_back(&counter);
+  }
+  top_n = std::min(top_n, order.size());
+  std::partial_sort(order.begin(), order.begin() + static_cast<ptrdiff_t>(top_n), order.end(),
+                    [](const Counter* a, const Counter* b) {
+                      return a->count != b->count ? a->count > b->count : a->id < b->id;
+                    });
+  for (size_t i = 0; i < top_n; ++i) {
+    json += i == 0 ? "{\"id\":\"" : ",{\"id\":\"";
+    append_json_escaped(json, order[i]->id);
+    json += "\",\"name\":\"";
+    append_json_escaped(json, order[i]->name);
+    json += "\",\"";
+    json += count_key;
+    json += "\":";
+    append_integer(json, order[i]->count);
+    json += ",\"error\":";
+    append_integer(json, order[i]->error);
+    json += "}";
+  }
+}
+
+void LiveMetrics::add(const SaleView& sale) {
+  if (sale.is_showcase || overflowed_ || sale.subtotal_cents < 0 || sale.tip_cents < 0 ||
+      sale.completed_unix_ms > static_cast<uint64_t>(kMaxCents)) {
+    return;
+  }
+  long long qty = 0;
+  bool valid_lines = true;
+  bool valid = for_each_sale_line(sale, [&](const SaleLineView& line) {
+    qty += static_cast<long long>(std::min<uint64_t>(line.qty, std::numeric_limits<int>::max()));
+    valid_lines = valid_lines && line.line_total_cents >= 0;
+  });
+  if (!valid || !valid_lines) {
+    return;
+  }
+  // Bucket and counter sums are bounded by these totals.
+  if (tickets_ == kMaxCents || revenue_cents_ > kMaxCents - sale.subtotal_cents ||
+      tip_cents_ > kMaxCents - sale.tip_cents || items_ > kMaxCents - qty) {
+    overflowed_ = true;
+    return;
+  }
+  const long long unix_ms = static_cast<long long>(sale.completed_unix_ms);
+  minutes_.add(unix_ms, sale.subtotal_cents, sale.tip_cents);
+  hours_.add(unix_ms, sale.subtotal_cents, sale.tip_cents);
+  tickets_ += 1;
+  revenue_cents_ += sale.subtotal_cents;
+  tip_cents_ += sale.tip_cents;
+  items_ += qty;
+  latest_unix_ms_ = std::max(latest_unix_ms_, unix_ms);
+  for_each_sale_line(sale, [&](const SaleLineView& line) {
+    by_qty_.add(line.id, line.name, static_cast<long long>(line.qty));
+    by_revenue_.add(line.id, line.name, line.line_total_cents);
+  });
+}
+
+int LiveMetrics::write_json(long long now_unix_ms, size_t top_n, std::pmr::string* out) const {
+  if (incomplete_) {
+    set_last_error(CS_ERRC_INVALID_STATE, "Live metrics are incomplete; reopen the journal.");
+    return CS_ERRC_INVALID_STATE;
+  }
+  if (overflowed_) {
+    set_last_error(CS_ERRC_OVERFLOW, "Live metric totals overflow.");
+    return CS_ERRC_OVERFLOW;
+  }
+  *out += "{\"now_unix_ms\":";
+  append_integer(*out, now_unix_ms);
+  *out += ",\"latest_sale_unix_ms\":";
+  append_integer(*out, latest_unix_ms_);
+  *out += ",\"tickets\":";
+  append_integer(*out, tickets_);
+  *out += ",\"revenue_cents\":";
+  append_integer(*out, revenue_cents_);
+  *out += ",\"tip_cents\":";
+  append_integer(*out, tip_cents_);
+  *out += ",\"items\":";
+  append_integer(*out, items_);
+  *out += ",\"avg_basket_cents\":";
+  append_integer(*out, tickets_ > 0 ? revenue_cents_ / tickets_ : 0);
+  *out += ",\"avg_basket_items\":";
+  append_ratio(*out, items_, tickets_);
+  *out += ",\"minutes\":[";
+  minutes_.append_json(*out, now_unix_ms);
+  *out += "],\"hours\":[";
+  hours_.append_json(*out, now_unix_ms);
+  *out += "],\"top_by_qty\":[";
+  by_qty_.append_json(*out, top_n, "qty");
+  *out += "],\"top_by_revenue\":[";
+  by_revenue_.append_json(*out, top_n, "revenue_cents");
+  *out += "]}";
+  return CS_ERRC_NONE;
+}
+
+}  // namespace cashsloth
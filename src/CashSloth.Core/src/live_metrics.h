@@ -0,0 +1,132 @@
+#pragma once
+
+#include <cstddef>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "encoding.h"
+#include "sale_record.h"
+
+namespace cashsloth {
+
+// Live metrics of the open journal's regular sales, kept up to date per commit in constant
+// memory: revenue per minute and hour in rings, basket averages, and the best sellers by
+// quantity and revenue. Showcase sales are left out, as in the app's default statistics.
+constexpr size_t kLiveMinuteBuckets = 60;
+constexpr size_t kLiveHourBuckets = 24;
+constexpr size_t kHeavyHitterCounters = 64;
+
+struct LiveBucket {
+  long long index = -1;
+  long long tickets = 0;
+  long long revenue_cents = 0;
+  long long tip_cents = 0;
+};
+
+// Buckets of `width_ms` addressed by time / width_ms modulo N. A bucket is reused by the first
+// sale of a newer period; sales older than the ring reaches are not bucketed.
+template <size_t N>
+class BucketRing {
+ public:
+  explicit BucketRing(long long width_ms) : width_ms_(width_ms) {}
+
+  void add(long long unix_ms, long long revenue_cents, long long tip_cents) {
+    const long long index = unix_ms / width_ms_;
+    LiveBucket& bucket = buckets_[static_cast<size_t>(index) % N];
+    if (bucket.index > index) {
+      return;
+    }
+    if (bucket.index < index) {
+      bucket = LiveBucket{index, 0, 0, 0};
+    }
+    bucket.tickets += 1;
+    bucket.revenue_cents += revenue_cents;
+    bucket.tip_cents += tip_cents;
+  }
+
+  // The N buckets ending with the one holding `now_unix_ms`, oldest first.
+  void append_json(std::pmr::string& json, long long now_unix_ms) const {
+    const long long last = now_unix_ms / width_ms_;
+    for (long long index = last - static_cast<long long>(N) + 1; index <= last; ++index) {
+      LiveBucket bucket;
+      if (index >= 0 && buckets_[static_cast<size_t>(index) % N].index == index) {
+        bucket = buckets_[static_cast<size_t>(index) % N];
+      }
+      json += index == last - static_cast<long long>(N) + 1 ? "{\"start_unix_ms\":"
+                                                             : ",{\"start_unix_ms\":";
+      append_integer(json, index * width_ms_);
+      json += ",\"tickets\":";
+      append_integer(json, bucket.tickets);
+      json += ",\"revenue_cents\":";
+      append_integer(json, bucket.revenue_cents);
+      json += ",\"tip_cents\":";
+      append_integer(json, bucket.tip_cents);
+      json += "}";
+    }
+  }
+
+ private:
+  long long width_ms_;
+  LiveBucket buckets_[N];
+};
+
+// Space-Saving heavy hitters (Metwally, Agrawal, El Abbadi): a fixed set of counters where a new
+// item takes over the smallest one. Every item whose true weight exceeds 1/kHeavyHitterCounters
+// of the total is kept; a count overstates the truth by at most its `error`.
+class HeavyHitters {
+ public:
+  struct Counter {
+    std::pmr::string id;
+    std::pmr::string name;
+    long long count = 0;
+    long long error = 0;
+  };
+
+  explicit HeavyHitters(std::pmr::memory_resource* resource)
+      : resource_(resource), counters_(resource), slots_(resource), key_(resource) {
+    counters_.reserve(kHeavyHitterCounters);
+  }
+
+  void add(std::string_view id, std::string_view name, long long weight);
+
+  // The `top_n` largest counters, largest first.
+  void append_json(std::pmr::string& json, size_t top_n, const char* count_key) const;
+
+ private:
+  std::pmr::memory_resource* resource_;
+  std::pmr::vector<Counter> counters_;
+  std::pmr::unordered_map<std::pmr::string, size_t> slots_;
+  std::pmr::string key_;
+};
+
+class LiveMetrics {
+ public:
+  explicit LiveMetrics(std::pmr::memory_resource* resource)
+      : minutes_(60 * 1000), hours_(60 * 60 * 1000), by_qty_(resource), by_revenue_(resource) {}
+
+  // Throws only on allocation failure.
+  void add(const SaleView& sale);
+
+  void mark_incomplete() { incomplete_ = true; }
+
+  // Returns a CS_ERRC_* code.
+  int write_json(long long now_unix_ms, size_t top_n, std::pmr::string* out) const;
+
+ private:
+  BucketRing<kLiveMinuteBuckets> minutes_;
+  BucketRing<kLiveHourBuckets> hours_;
+  HeavyHitters by_qty_;
+  HeavyHitters by_revenue_;
+  long long tickets_ = 0;
+  long long revenue_cents_ = 0;
+  long long tip_cents_ = 0;
+  long long items_ = 0;
+  long long latest_unix_ms_ = 0;
+  bool incomplete_ = false;
+  bool overflowed_ = false;
+};
+
+}  // namespace cashsloth
@@ -0,0 +1,131 @@
+#include "memory.h"
+
+#include <cstring>
+#include <string>
+
+#include "cart.h"
+#include "diagnostics.h"
+#include "encoding.h"
+#include "errors.h"
+
+namespace cashsloth {
+namespace {
+
+// Default resource: plain operator new/delete. std::pmr::new_delete_resource() always takes the
+// over-aligned path on some standard libraries, which is measurably slower for node allocations.
+class HeapResource : public std::pmr::memory_resource {
+ private:
+  void* do_allocate(std::size_t bytes, std::size_t alignment) override {
+    if (alignment > __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+      return ::operator new(bytes, std::align_val_t(alignment));
+    }
+    return ::operator new(bytes);
+  }
+
+  void do_deallocate(void* p, std::size_t, std::size_t alignment) override {
+    if (alignment > __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+      ::operator delete(p, std::align_val_t(alignment));
+    } else {
+      ::operator delete(p);
+    }
+  }
+
+  bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+    return this == &other;
+  }
+};
+
+constexpr const char* kMemoryCategoryNames[kMemoryCategoryCount] = {
+    "catalog_items", "strings", "index", "carts", "lines", "buffers", "parser", "journal",
+    "sales", "pricing",
+};
+
+MemoryCounter g_memory_counters[kMemoryCategoryCount];
+
+HeapResource g_heap_resource;
+
+struct BufferHeader {
+  std::pmr::memory_resource* resource;
+  size_t size;
+};
+
+constexpr size_t kBufferHeaderSize =
+    (sizeof(BufferHeader) + alignof(std::max_align_t) - 1) / alignof(std::max_align_t) *
+    alignof(std::max_align_t);
+
+}  // namespace
+
+CoreResources g_heap_resources(&g_heap_resource);
+std::atomic<const CoreResources*> g_core_resources{&g_heap_resources};
+
+MemoryCounter& memory_counter(MemoryCategory category) {
+  return g_memory_counters[static_cast<size_t>(category)];
+}
+
+CoreResources::CoreResources(std::pmr::memory_resource* upstream) : base(upstream) {
+  for (size_t i = 0; i < kMemoryCategoryCount; ++i) {
+    categories_[i].bind(upstream, &g_memory_counters[i]);
+  }
+}
+
+char* copy_to_buffer(std::string_view text) {
+  std::pmr::memory_resource* resource = core_resource(MemoryCategory::kBuffers);
+  const size_t size = kBufferHeaderSize + text.size() + 1;
+  void* block = resource->allocate(size, alignof(std::max_align_t));
+  new (block) BufferHeader{resource, size};
+  char* buffer = static_cast<char*>(block) + kBufferHeaderSize;
+  std::memcpy(buffer, text.data(), text.size());
+  buffer[text.size()] = '\0';
+  count_serialized_bytes(text.size());
+  return buffer;
+}
+
+void free_buffer(void* p) {
+  if (!p) {
+    return;
+  }
+  char* block = static_cast<char*>(p) - kBufferHeaderSize;
+  const BufferHeader header = *reinterpret_cast<BufferHeader*>(block);
+  header.resource->deallocate(block, header.size, alignof(std::max_align_t));
+}
+
+// Counters are read one by one without stopping other threads, so categories may be off by
+// whatever was allocated while the report was built. The returned buffer is not included.
+int write_memory_usage_json(char** out_json) {
+  auto append_count = [](std::pmr::string& json, uint64_t value) {
+    append_integer(json, static_cast<long long>(value));
+  };
+
+  TraceSpan span("serialize");
+  std::pmr::string json(core_resource());
+  json.reserve(512);
+  uint64_t total_live = 0;
+  json += "{\"categories\":{";
+  for (size_t i = 0; i < kMemoryCategoryCount; ++i) {
+    const MemoryCounter& counter = g_memory_counters[i];
+    const uint64_t live = counter.live_bytes.load(std::memory_order_relaxed);
+    total_live += live;
+    json += i == 0 ? "\"" : ",\"";
+    json += kMemoryCategoryNames[i];
+    json += "\":{\"live_bytes\":";
+    append_count(json, live);
+    json += ",\"peak_bytes\":";
+    append_count(json, counter.peak_bytes.load(std::memory_order_relaxed));
+    json += ",\"live_blocks\":";
+    append_count(json, counter.live_blocks.load(std::memory_order_relaxed));
+    json += "}";
+  }
+  json += "},\"total_live_bytes\":";
+  append_count(json, total_live);
+  json += ",\"open_carts\":";
+  append_count(json, cart_pool().open_carts());
+  json += "}";
+
+  *out_json = copy_to_buffer(json);
+  clear_last_error();
+  return CS_SUCCESS;
+}
+
+// Append-only file with explicit durability for the sale journal. stdio can neither fsync nor
+
+}  // namespace cashsloth
@@ -0,0 +1,164 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <string_view>
+
+#include "cashsloth_core.h"
+
+namespace cashsloth {
+
+// Core-owned memory. Every container, snapshot, cart slab and returned buffer allocates from the
+// resource that was current when it was created and remembers it, so memory always goes back to
+// the allocator it came from. Allocation failures surface as std::bad_alloc and are mapped to
+// CS_ERROR_OUT_OF_MEMORY at the entry points.
+class HookResource : public std::pmr::memory_resource {
+ public:
+  explicit HookResource(const cs_allocator& hooks) : hooks_(hooks) {}
+
+ private:
+  void* do_allocate(std::size_t bytes, std::size_t alignment) override {
+    void* p = hooks_.allocate(hooks_.user_data, bytes, alignment);
+    if (!p) {
+      throw std::bad_alloc();
+    }
+    return p;
+  }
+
+  void do_deallocate(void* p, std::size_t bytes, std::size_t alignment) override {
+    hooks_.deallocate(hooks_.user_data, p, bytes, alignment);
+  }
+
+  bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+    return this == &other;
+  }
+
+  const cs_allocator hooks_;
+};
+
+// Memory accounting. Long-lived core memory is allocated through a per-category resource that
+// keeps live and peak byte counts. One relaxed add per allocation and free is all it costs, and
+// the hot paths it sits on are allocation-free in the steady state, so it is always on.
+enum class MemoryCategory : size_t {
+  kCatalogItems,
+  kStrings,
+  kIndex,
+  kCarts,
+  kLines,
+  kBuffers,
+  kParser,
+  kJournal,
+  kSales,
+  kPricing,
+};
+
+constexpr size_t kMemoryCategoryCount = static_cast<size_t>(MemoryCategory::kPricing) + 1;
+
+// One cache line per category so threads loading catalogs do not slow down cart allocations.
+struct alignas(64) MemoryCounter {
+  std::atomic<uint64_t> live_bytes{0};
+  std::atomic<uint64_t> peak_bytes{0};
+  std::atomic<uint64_t> live_blocks{0};
+
+  void allocated(size_t bytes) {
+    const uint64_t live = live_bytes.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+    live_blocks.fetch_add(1, std::memory_order_relaxed);
+    uint64_t peak = peak_bytes.load(std::memory_order_relaxed);
+    while (live > peak &&
+           !peak_bytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+    }
+  }
+
+  void deallocated(size_t bytes) {
+    live_bytes.fetch_sub(bytes, std::memory_order_relaxed);
+    live_blocks.fetch_sub(1, std::memory_order_relaxed);
+  }
+
+  // Restarts peak tracking from the current live size.
+  void reset_peak() {
+    peak_bytes.store(live_bytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+  }
+};
+
+MemoryCounter& memory_counter(MemoryCategory category);
+
+class AccountedResource : public std::pmr::memory_resource {
+ public:
+  void bind(std::pmr::memory_resource* upstream, MemoryCounter* counter) {
+    upstream_ = upstream;
+    counter_ = counter;
+  }
+
+ private:
+  void* do_allocate(std::size_t bytes, std::size_t alignment) override {
+    void* p = upstream_->allocate(bytes, alignment);
+    counter_->allocated(bytes);
+    return p;
+  }
+
+  void do_deallocate(void* p, std::size_t bytes, std::size_t alignment) override {
+    upstream_->deallocate(p, bytes, alignment);
+    counter_->deallocated(bytes);
+  }
+
+  bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+    return this == &other;
+  }
+
+  std::pmr::memory_resource* upstream_ = nullptr;
+  MemoryCounter* counter_ = nullptr;
+};
+
+// The base resource plus one accounting resource per category on top of it. Containers keep the
+// resource they were created with, so a set is never destroyed once installed.
+struct CoreResources {
+  explicit CoreResources(std::pmr::memory_resource* upstream);
+  CoreResources(const CoreResources&) = delete;
+  CoreResources& operator=(const CoreResources&) = delete;
+
+  std::pmr::memory_resource* resource(MemoryCategory category) const {
+    return &categories_[static_cast<size_t>(category)];
+  }
+
+  std::pmr::memory_resource* const base;
+
+ private:
+  mutable AccountedResource categories_[kMemoryCategoryCount];
+};
+
+// The default set over operator new/delete, and the set new allocations come from.
+extern CoreResources g_heap_resources;
+extern std::atomic<const CoreResources*> g_core_resources;
+
+inline const CoreResources& core_resources() {
+  return *g_core_resources.load(std::memory_order_acquire);
+}
+
+// Short-lived and bookkeeping memory that belongs to no reported category.
+inline std::pmr::memory_resource* core_resource() {
+  return core_resources().base;
+}
+
+inline std::pmr::memory_resource* core_resource(MemoryCategory category) {
+  return core_resources().resource(category);
+}
+
+// Buffers handed to callers carry their resource and size in front, so cs_free can return them
+// to the right allocator.
+char* copy_to_buffer(std::string_view text);
+void free_buffer(void* p);
+
+// Owns a buffer from copy_to_buffer until it is released to the caller.
+struct BufferDeleter {
+  void operator()(char* p) const { free_buffer(p); }
+};
+using BufferPtr = std::unique_ptr<char, BufferDeleter>;
+
+// Live and peak bytes per category as JSON (cs_memory_usage_json). Returns a CS_ERROR_* result.
+int write_memory_usage_json(char** out_json);
+
+}  // namespace cashsloth
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <limits>
+
+namespace cashsloth {
+
+constexpr long long kMaxCents = std::numeric_limits<long long>::max();
+
+// Whether unit_cents * qty fits in a long long. Prices are non-negative and quantities positive.
+inline bool line_total_fits(long long unit_cents, int qty) {
+  return unit_cents <= kMaxCents / qty;
+}
+
+inline long long add_capped(long long a, long long b) {
+  return a > kMaxCents - b ? kMaxCents : a + b;
+}
+
+}  // namespace cashsloth
@@ -0,0 +1,30 @@
+#pragma once
+
+// Compiler and platform glue shared by the core's translation units.
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <sys/types.h>
+#endif
+
+#if defined(_MSC_VER)
+#define CS_NOINLINE __declspec(noinline)
+#else
+#define CS_NOINLINE __attribute__((noinline))
+#endif
+
+// Initial-exec TLS turns a per-call thread_local access in the shared library into one
+// thread-pointer-relative load instead of a __tls_get_addr call. Only the few bytes touched on
+// every call use it, well within the static TLS glibc reserves for libraries loaded by dlopen.
+#if defined(__GNUC__) && !defined(_WIN32)
+#define CS_FAST_TLS __attribute__((tls_model("initial-exec")))
+#else
+#define CS_FAST_TLS
+#endif
@@ -0,0 +1,558 @@
+#include "pricing.h"
+
+#include <ctime>
+#include <string>
+#include <unordered_set>
+
+#include "cart.h"
+#include "errors.h"
+#include "mini_json.hpp"
+#include "money.h"
+
+namespace cashsloth {
+namespace {
+
+// Bundles compare their component counts on the stack.
+constexpr size_t kMaxBundleComponents = 16;
+
+constexpr size_t kMaxPricingRules = 1 << 20;
+
+bool integer_between(const mini_json::Value& value, long long low, long long high,
+                     long long* out) {
+  if (!value.is_number() || !value.number_is_integer() ||
+      value.as_number() < static_cast<long double>(low) ||
+      value.as_number() > static_cast<long double>(high)) {
+    return false;
+  }
+  *out = static_cast<long long>(value.as_number());
+  return true;
+}
+
+// "HH:MM" -> minute of the day.
+bool parse_minute_of_day(const mini_json::Value& value, int* out) {
+  if (!value.is_string() || value.as_string().size() != 5 || value.as_string()[2] != ':') {
+    return false;
+  }
+  const mini_json::String& text = value.as_string();
+  for (size_t i : {0, 1, 3, 4}) {
+    if (text[i] < '0' || text[i] > '9') {
+      return false;
+    }
+  }
+  const int hours = (text[0] - '0') * 10 + (text[1] - '0');
+  const int minutes = (text[3] - '0') * 10 + (text[4] - '0');
+  if (hours > 23 || minutes > 59) {
+    return false;
+  }
+  *out = hours * 60 + minutes;
+  return true;
+}
+
+}  // namespace
+
+int CartPricing::minute_of_week() const {
+  constexpr long long kDayMs = 24LL * 60 * 60 * 1000;
+  if (local_time_ms_ > 0) {
+    // 1970-01-01 was a Thursday, day 3 of an ISO week counted from 0.
+    const long long weekday = (local_time_ms_ / kDayMs + 3) % 7;
+    return static_cast<int>(weekday * 1440 + local_time_ms_ % kDayMs / 60000);
+  }
+  const std::time_t now = std::time(nullptr);
+  std::tm local{};
+#if defined(_WIN32)
+  localtime_s(&local, &now);
+#else
+  localtime_r(&now, &local);
+#endif
+  return ((local.tm_wday + 6) % 7) * 1440 + local.tm_hour * 60 + local.tm_min;
+}
+
+bool CartPricing::rule_active(const PricingRule& rule, int* minute_of_week) const {
+  if (rule.code.length > 0) {
+    const std::string_view code = rules_->view(rule.code);
+    std::string_view codes(codes_);
+    bool listed = false;
+    while (!listed && !codes.empty()) {
+      const size_t comma = codes.find(',');
+      listed = codes.substr(0, comma) == code;
+      codes = comma == std::string_view::npos ? std::string_view() : codes.substr(comma + 1);
+    }
+    if (!listed) {
+      return false;
+    }
+  }
+  if (!rule.timed()) {
+    return true;
+  }
+  if (*minute_of_week < 0) {
+    *minute_of_week = this->minute_of_week();
+  }
+  const int day = *minute_of_week / 1440;
+  const int minute = *minute_of_week % 1440;
+  if (rule.days != 0 && (rule.days & (1u << (day + 1))) == 0) {
+    return false;
+  }
+  if (rule.from_minute < rule.to_minute) {
+    return minute >= rule.from_minute && minute < rule.to_minute;
+  }
+  return rule.from_minute == rule.to_minute || minute >= rule.from_minute ||
+         minute < rule.to_minute;
+}
+
+long long CartPricing::evaluate(const Cart& cart, uint32_t rule_index, bool check_active,
+                                int* minute_of_week, std::pmr::vector<LineDiscount>* out) const {
+  const PricingRule& rule = rules_->rules[rule_index];
+  if (check_active && !rule_active(rule, minute_of_week)) {
+    return 0;
+  }
+  units_.clear();
+  for (size_t i = 0; i < cart.lines.size(); ++i) {
+    const CartLine& line = cart.lines[i];
+    if (!line_total_fits(line.unit_cents, line.qty)) {
+      // The cart's total is reported as an overflow anyway.
+      return 0;
+    }
+    const std::string_view item_id = cart.id_of(line);
+    const std::string_view category = line.item_index == kNoItem
+                                          ? std::string_view()
+                                          : cart.snapshot->category_of(line.item_index);
+    for (uint32_t c = 0; c < rule.components_count; ++c) {
+      if (rules_->matches(rules_->components[rule.components_begin + c].match, item_id, category)) {
+        units_.push_back(Unit{static_cast<uint32_t>(i), c, line.qty, line.unit_cents, 0});
+        break;
+      }
+    }
+  }
+
+  long long total = 0;
+  auto give = [&](const Unit& unit, long long cents) {
+    if (cents <= 0) {
+      return;
+    }
+    total = add_capped(total, cents);
+    if (out) {
+      out->push_back(LineDiscount{unit.line, rule_index, cents});
+    }
+  };
+  switch (rule.type) {
+    case PricingRule::kPercent:
+      for (const Unit& unit : units_) {
+        const long long line_total = unit.unit_cents * unit.qty;
+        give(unit, line_total / 100 * rule.amount + line_total % 100 * rule.amount / 100);
+      }
+      break;
+    case PricingRule::kUnitPrice:
+      for (const Unit& unit : units_) {
+        if (unit.unit_cents > rule.amount) {
+          give(unit, (unit.unit_cents - rule.amount) * unit.qty);
+        }
+      }
+      break;
+    case PricingRule::kMultiBuy: {
+      // The cheapest units are the free ones.
+      long long count = 0;
+      for (const Unit& unit : units_) {
+        count += unit.qty;
+      }
+      long long free_units = count / rule.buy * (rule.buy - rule.pay);
+      std::sort(units_.begin(), units_.end(), [](const Unit& a, const Unit& b) {
+        return a.unit_cents != b.unit_cents ? a.unit_cents < b.unit_cents : a.line < b.line;
+      });
+      for (const Unit& unit : units_) {
+        const long long taken = std::min(unit.qty, free_units);
+        free_units -= taken;
+        give(unit, taken * unit.unit_cents);
+      }
+      break;
+    }
+    case PricingRule::kBundle: {
+      // Each complete set of components costs the bundle price, made of the priciest units.
+      long long have[kMaxBundleComponents] = {};
+      for (const Unit& unit : units_) {
+        have[unit.component] += unit.qty;
+      }
+      long long sets = kMaxCents;
+      for (uint32_t c = 0; c < rule.components_count; ++c) {
+        sets = std::min(sets, have[c] / rules_->components[rule.components_begin + c].qty);
+      }
+      if (sets == 0) {
+        break;
+      }
+      std::sort(units_.begin(), units_.end(), [](const Unit& a, const Unit& b) {
+        if (a.component != b.component) {
+          return a.component < b.component;
+        }
+        return a.unit_cents != b.unit_cents ? a.unit_cents > b.unit_cents : a.line < b.line;
+      });
+      long long need[kMaxBundleComponents] = {};
+      for (uint32_t c = 0; c < rule.components_count; ++c) {
+        need[c] = sets * rules_->components[rule.components_begin + c].qty;
+      }
+      long long value = 0;
+      for (Unit& unit : units_) {
+        const long long taken = std::min(unit.qty, need[unit.component]);
+        need[unit.component] -= taken;
+        unit.used = taken * unit.unit_cents;
+        value = add_capped(value, unit.used);
+      }
+      const long long price =
+          rule.amount > 0 && sets > kMaxCents / rule.amount ? kMaxCents : sets * rule.amount;
+      if (value <= price) {
+        break;
+      }
+      // Shared in proportion to each line's part of the bundle; the last line takes the rest.
+      const long long discount = value - price;
+      long long remaining = discount;
+      size_t last = units_.size();
+      while (last > 0 && units_[last - 1].used == 0) {
+        --last;
+      }
+      for (size_t i = 0; i < last; ++i) {
+        const long long share =
+            i + 1 == last ? remaining
+                          : static_cast<long long>(static_cast<long double>(discount) *
+                                                   units_[i].used / value);
+        remaining -= share;
+        give(units_[i], share);
+      }
+      break;
+    }
+  }
+  return total;
+}
+
+void CartPricing::store(uint32_t rule, long long cents) const {
+  auto it = std::lower_bound(applied_.begin(), applied_.end(), rule,
+                             [](const Applied& a, uint32_t r) { return a.rule < r; });
+  const bool found = it != applied_.end() && it->rule == rule;
+  if (cents == 0) {
+    if (found) {
+      applied_.erase(it);
+    }
+  } else if (found) {
+    it->cents = cents;
+  } else {
+    applied_.insert(it, Applied{rule, cents});
+  }
+}
+
+void CartPricing::evaluate_list(const Cart& cart, const PricingRules::RuleList* list,
+                                int* minute_of_week) const {
+  if (!list) {
+    return;
+  }
+  for (uint32_t rule : *list) {
+    store(rule, evaluate(cart, rule, true, minute_of_week, nullptr));
+  }
+}
+
+void CartPricing::item_changed(const Cart& cart, std::string_view item_id, uint32_t item_index) {
+  if (!rules_) {
+    return;
+  }
+  if (stale_) {
+    recompute(cart);
+    return;
+  }
+  stale_ = true;
+  const std::string_view category =
+      item_index == kNoItem ? std::string_view() : cart.snapshot->category_of(item_index);
+  int minute = -1;
+  evaluate_list(cart, &rules_->every_item, &minute);
+  evaluate_list(cart, rules_->rules_for_item(item_id), &minute);
+  evaluate_list(cart, rules_->rules_for_category(category), &minute);
+  stale_ = false;
+}
+
+void CartPricing::recompute(const Cart& cart) const {
+  applied_.clear();
+  stale_ = false;
+  if (!rules_ || cart.lines.empty()) {
+    return;
+  }
+  stale_ = true;
+  pending_.assign(rules_->every_item.begin(), rules_->every_item.end());
+  for (const CartLine& line : cart.lines) {
+    for (const PricingRules::RuleList* list :
+         {rules_->rules_for_item(cart.id_of(line)),
+          line.item_index == kNoItem
+              ? nullptr
+              : rules_->rules_for_category(cart.snapshot->category_of(line.item_index))}) {
+      if (list) {
+        pending_.insert(pending_.end(), list->begin(), list->end());
+      }
+    }
+  }
+  std::sort(pending_.begin(), pending_.end());
+  pending_.erase(std::unique(pending_.begin(), pending_.end()), pending_.end());
+  int minute = -1;
+  for (uint32_t rule : pending_) {
+    store(rule, evaluate(cart, rule, true, &minute, nullptr));
+  }
+  stale_ = false;
+}
+
+long long CartPricing::discount_cents(const Cart& cart) const {
+  if (stale_) {
+    recompute(cart);
+  }
+  long long total = 0;
+  for (const Applied& applied : applied_) {
+    total = add_capped(total, applied.cents);
+  }
+  return total;
+}
+
+void CartPricing::line_discounts(const Cart& cart, std::pmr::vector<LineDiscount>* out) const {
+  if (stale_) {
+    recompute(cart);
+  }
+  for (const Applied& applied : applied_) {
+    evaluate(cart, applied.rule, false, nullptr, out);
+  }
+  std::sort(out->begin(), out->end(), [](const LineDiscount& a, const LineDiscount& b) {
+    return a.line != b.line ? a.line < b.line : a.rule < b.rule;
+  });
+}
+
+int compile_pricing_json(const char* json, PricingRules* out) {
+  mini_json::Value root(core_resource(MemoryCategory::kParser));
+  std::string parse_error;
+  if (!mini_json::parse(json, &root, &parse_error)) {
+    set_last_error_text(CS_ERRC_INVALID_VALUE, "Invalid pricing JSON: ", parse_error);
+    return CS_ERRC_INVALID_VALUE;
+  }
+  auto rules_it = root.is_object() ? root.as_object().find("rules") : root.as_object().end();
+  if (!root.is_object() || rules_it == root.as_object().end() || !rules_it->second.is_array()) {
+    set_last_error(CS_ERRC_INVALID_VALUE, "Pricing JSON must be an object with a rules array.");
+    return CS_ERRC_INVALID_VALUE;
+  }
+  const auto& rules = rules_it->second.as_array();
+  if (rules.size() > kMaxPricingRules) {
+    set_last_error(CS_ERRC_INVALID_VALUE, "Pricing JSON must not hold more than 2^20 rules.");
+    return CS_ERRC_INVALID_VALUE;
+  }
+
+  std::pmr::memory_resource* scratch = core_resource(MemoryCategory::kParser);
+  // Keys are collected as pool offsets first, since the pool grows while rules are read.
+  std::pmr::vector<StringRef> key_refs(scratch);
+  std::pmr::unordered_set<std::string_view> ids(scratch);
+  size_t index = 0;
+  auto fail = [&index](const char* problem) {
+    char prefix[48];
+    std::snprintf(prefix, sizeof(prefix), "Invalid pricing rule %zu: ", index);
+    set_last_error_text(CS_ERRC_INVALID_VALUE, prefix, problem);
+    return CS_ERRC_INVALID_VALUE;
+  };
+  auto store = [out](const mini_json::String& text) {
+    StringRef ref{static_cast<uint32_t>(out->strings.size()), static_cast<uint32_t>(text.size())};
+    out->strings.append(text.data(), text.size());
+    return ref;
+  };
+  // Reads "items" and "categories"; both missing means every item.
+  auto read_match = [&](const mini_json::Value::Object& object, PricingMatch* match) {
+    for (const char* field : {"items", "categories"}) {
+      auto it = object.find(field);
+      const bool items = field[0] == 'i';
+      (items ? match->items_begin : match->categories_begin) =
+          static_cast<uint32_t>(key_refs.size());
+      if (it == object.end()) {
+        continue;
+      }
+      if (!it->second.is_array() || it->second.as_array().empty()) {
+        return false;
+      }
+      for (const auto& key : it->second.as_array()) {
+        if (!key.is_string() || key.as_string().empty()) {
+          return false;
+        }
+        key_refs.push_back(store(key.as_string()));
+      }
+      (items ? match->items_count : match->categories_count) =
+          static_cast<uint32_t>(it->second.as_array().size());
+    }
+    return true;
+  };
+  auto only_fields = [](const mini_json::Value::Object& object,
+                        std::initializer_list<std::string_view> allowed) {
+    for (const auto& entry : object) {
+      if (std::find(allowed.begin(), allowed.end(), std::string_view(entry.first)) ==
+          allowed.end()) {
+        return false;
+      }
+    }
+    return true;
+  };
+
+  out->rules.reserve(rules.size());
+  for (; index < rules.size(); ++index) {
+    if (!rules[index].is_object()) {
+      return fail("rules must be JSON objects.");
+    }
+    const auto& object = rules[index].as_object();
+    PricingRule rule;
+    auto id_it = object.find("id");
+    if (id_it == object.end() || !id_it->second.is_string() || id_it->second.as_string().empty()) {
+      return fail("id must be a non-empty string.");
+    }
+    if (!ids.insert(id_it->second.as_string()).second) {
+      return fail("id is used by an earlier rule.");
+    }
+    rule.id = store(id_it->second.as_string());
+
+    auto type_it = object.find("type");
+    const std::string_view type = type_it != object.end() && type_it->second.is_string()
+                                      ? std::string_view(type_it->second.as_string())
+                                      : std::string_view();
+    std::string_view amount_field;
+    long long amount_max = kMaxCents;
+    bool fields_ok = false;
+    if (type == "percent") {
+      rule.type = PricingRule::kPercent;
+      amount_field = "percent";
+      amount_max = 100;
+      fields_ok = only_fields(object, {"id", "type", "code", "days", "from", "to", "items",
+                                       "categories", "percent"});
+    } else if (type == "unit_price") {
+      rule.type = PricingRule::kUnitPrice;
+      amount_field = "unit_cents";
+      fields_ok = only_fields(object, {"id", "type", "code", "days", "from", "to", "items",
+                                       "categories", "unit_cents"});
+    } else if (type == "multibuy") {
+      rule.type = PricingRule::kMultiBuy;
+      fields_ok = only_fields(object, {"id", "type", "code", "days", "from", "to", "items",
+                                       "categories", "buy", "pay"});
+    } else if (type == "bundle") {
+      rule.type = PricingRule::kBundle;
+      amount_field = "price_cents";
+      fields_ok = only_fields(object, {"id", "type", "code", "days", "from", "to", "components",
+                                       "price_cents"});
+    } else {
+      return fail("type must be percent, unit_price, multibuy or bundle.");
+    }
+    if (!fields_ok) {
+      return fail("unknown field for its type.");
+    }
+
+    auto code_it = object.find("code");
+    if (code_it != object.end()) {
+      if (!code_it->second.is_string() || code_it->second.as_string().empty() ||
+          code_it->second.as_string().find(',') != mini_json::String::npos) {
+        return fail("code must be a non-empty string without commas.");
+      }
+      rule.code = store(code_it->second.as_string());
+    }
+    auto days_it = object.find("days");
+    if (days_it != object.end()) {
+      if (!days_it->second.is_array() || days_it->second.as_array().empty()) {
+        return fail("days must be a non-empty array of ISO weekdays (1 = Monday .. 7 = Sunday).");
+      }
+      for (const auto& day : days_it->second.as_array()) {
+        long long value = 0;
+        if (!integer_between(day, 1, 7, &value)) {
+          return fail("days must be a non-empty array of ISO weekdays (1 = Monday .. 7 = Sunday).");
+        }
+        rule.days = static_cast<unsigned char>(rule.days | (1u << value));
+      }
+    }
+    auto from_it = object.find("from");
+    auto to_it = object.find("to");
+    if ((from_it == object.end()) != (to_it == object.end()) ||
+        (from_it != object.end() && (!parse_minute_of_day(from_it->second, &rule.from_minute) ||
+                                     !parse_minute_of_day(to_it->second, &rule.to_minute)))) {
+      return fail("from and to must both be \"HH:MM\" times.");
+    }
+
+    if (!amount_field.empty()) {
+      auto amount_it = object.find(mini_json::String(amount_field, scratch));
+      if (amount_it == object.end() ||
+          !integer_between(amount_it->second, rule.type == PricingRule::kPercent ? 1 : 0,
+                           amount_max, &rule.amount)) {
+        return fail(rule.type == PricingRule::kPercent
+                        ? "percent must be an integer from 1 to 100."
+                        : "unit_cents and price_cents must be non-negative integers.");
+      }
+    }
+    if (rule.type == PricingRule::kMultiBuy) {
+      auto buy_it = object.find("buy");
+      auto pay_it = object.find("pay");
+      if (buy_it == object.end() || pay_it == object.end() ||
+          !integer_between(buy_it->second, 2, std::numeric_limits<int>::max(), &rule.buy) ||
+          !integer_between(pay_it->second, 0, rule.buy - 1, &rule.pay)) {
+        return fail("buy must be an integer of at least 2 and pay one from 0 to buy - 1.");
+      }
+    }
+
+    rule.components_begin = static_cast<uint32_t>(out->components.size());
+    if (rule.type == PricingRule::kBundle) {
+      auto components_it = object.find("components");
+      if (components_it == object.end() || !components_it->second.is_array() ||
+          components_it->second.as_array().empty() ||
+          components_it->second.as_array().size() > kMaxBundleComponents) {
+        return fail("components must be an array of 1 to 16 objects.");
+      }
+      for (const auto& value : components_it->second.as_array()) {
+        PricingComponent component;
+        if (!value.is_object() || !only_fields(value.as_object(), {"items", "categories", "qty"}) ||
+            !read_match(value.as_object(), &component.match)) {
+          return fail("components must list non-empty items or categories arrays of strings.");
+        }
+        auto qty_it = value.as_object().find("qty");
+        if (qty_it != value.as_object().end() &&
+            !integer_between(qty_it->second, 1, std::numeric_limits<int>::max(), &component.qty)) {
+          return fail("component qty must be a positive integer.");
+        }
+        out->components.push_back(component);
+      }
+    } else {
+      PricingComponent component;
+      if (!read_match(object, &component.match)) {
+        return fail("items and categories must be non-empty arrays of non-empty strings.");
+      }
+      out->components.push_back(component);
+    }
+    rule.components_count = static_cast<uint32_t>(out->components.size()) - rule.components_begin;
+    out->any_timed = out->any_timed || rule.timed();
+    out->rules.push_back(rule);
+  }
+  if (out->strings.size() > std::numeric_limits<uint32_t>::max()) {
+    set_last_error(CS_ERRC_INVALID_VALUE, "Pricing rule strings must not exceed 4 GiB.");
+    return CS_ERRC_INVALID_VALUE;
+  }
+
+  out->keys.reserve(key_refs.size());
+  for (const StringRef& ref : key_refs) {
+    out->keys.push_back(out->view(ref));
+  }
+  for (const PricingComponent& component : out->components) {
+    const PricingMatch& match = component.match;
+    std::sort(out->keys.begin() + match.items_begin,
+              out->keys.begin() + match.items_begin + match.items_count);
+    std::sort(out->keys.begin() + match.categories_begin,
+              out->keys.begin() + match.categories_begin + match.categories_count);
+  }
+  // A rule is listed once per key even if several components name it.
+  auto add = [](PricingRules::RuleList& list, uint32_t rule) {
+    if (list.empty() || list.back() != rule) {
+      list.push_back(rule);
+    }
+  };
+  for (uint32_t r = 0; r < out->rules.size(); ++r) {
+    const PricingRule& rule = out->rules[r];
+    for (uint32_t c = 0; c < rule.components_count; ++c) {
+      const PricingMatch& match = out->components[rule.components_begin + c].match;
+      if (match.items_count == 0 && match.categories_count == 0) {
+        add(out->every_item, r);
+      }
+      for (uint32_t k = 0; k < match.items_count; ++k) {
+        add(out->by_item[out->keys[match.items_begin + k]], r);
+      }
+      for (uint32_t k = 0; k < match.categories_count; ++k) {
+        add(out->by_category[out->keys[match.categories_begin + k]], r);
+      }
+    }
+  }
+  return CS_ERRC_NONE;
+}
+
+}  // namespace cashsloth
@@ -0,0 +1,219 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "encoding.h"
+#include "memory.h"
+
+namespace cashsloth {
+
+class Cart;
+
+// Which items a rule, or one bundle component, applies to: the item ids in keys[items_begin..)
+// and the categories in keys[categories_begin..), each range sorted. Both empty match every item.
+struct PricingMatch {
+  uint32_t items_begin = 0;
+  uint32_t items_count = 0;
+  uint32_t categories_begin = 0;
+  uint32_t categories_count = 0;
+};
+
+struct PricingComponent {
+  PricingMatch match;
+  long long qty = 1;
+};
+
+struct PricingRule {
+  enum Type : unsigned char { kPercent, kUnitPrice, kMultiBuy, kBundle };
+
+  Type type = kPercent;
+  StringRef id;
+  // Empty, or a code the cart's pricing context must list (cs_cart_set_pricing_context).
+  StringRef code;
+  // ISO weekdays (bit 1 = Monday .. bit 7 = Sunday) and a [from, to) minute-of-day window that
+  // wraps past midnight when from > to. No days and from == to means always.
+  unsigned char days = 0;
+  int from_minute = 0;
+  int to_minute = 0;
+  // Percent off, the fixed unit price, or the bundle price.
+  long long amount = 0;
+  long long buy = 0;
+  long long pay = 0;
+  // Every rule has at least one component; only bundles have more.
+  uint32_t components_begin = 0;
+  uint32_t components_count = 0;
+
+  bool timed() const { return days != 0 || from_minute != to_minute; }
+};
+
+// Compiled pricing rules of one catalog (cs_catalog_set_pricing_json). Immutable once built and
+// shared by the carts pinned to it. A cart change only re-evaluates the rules indexed under the
+// changed item's id and category plus the rules that match every item, so its cost follows the
+// rules that can apply rather than how many are loaded.
+struct PricingRules {
+  explicit PricingRules(std::pmr::memory_resource* resource)
+      : strings(resource),
+        rules(resource),
+        components(resource),
+        keys(resource),
+        by_item(resource),
+        by_category(resource),
+        every_item(resource) {}
+  PricingRules(const PricingRules&) = delete;
+  PricingRules& operator=(const PricingRules&) = delete;
+
+  using RuleList = std::pmr::vector<uint32_t>;
+
+  std::string_view view(StringRef ref) const {
+    return std::string_view(strings.data() + ref.offset, ref.length);
+  }
+
+  bool matches(const PricingMatch& match, std::string_view item_id,
+               std::string_view category) const {
+    if (match.items_count == 0 && match.categories_count == 0) {
+      return true;
+    }
+    auto contains = [this](uint32_t begin, uint32_t count, std::string_view key) {
+      return std::binary_search(keys.begin() + begin, keys.begin() + begin + count, key);
+    };
+    return contains(match.items_begin, match.items_count, item_id) ||
+           (!category.empty() &&
+            contains(match.categories_begin, match.categories_count, category));
+  }
+
+  const RuleList* rules_for_item(std::string_view item_id) const {
+    auto it = by_item.find(item_id);
+    return it == by_item.end() ? nullptr : &it->second;
+  }
+
+  const RuleList* rules_for_category(std::string_view category) const {
+    auto it = category.empty() ? by_category.end() : by_category.find(category);
+    return it == by_category.end() ? nullptr : &it->second;
+  }
+
+  // Every id, code, item id and category of the rules, back to back. Keys view it, so it is
+  // filled completely before they are built.
+  std::pmr::string strings;
+  std::pmr::vector<PricingRule> rules;
+  std::pmr::vector<PricingComponent> components;
+  std::pmr::vector<std::string_view> keys;
+  std::pmr::unordered_map<std::string_view, RuleList> by_item;
+  std::pmr::unordered_map<std::string_view, RuleList> by_category;
+  RuleList every_item;
+  bool any_timed = false;
+};
+
+using PricingPtr = std::shared_ptr<const PricingRules>;
+
+// Builds `out` from a pricing rules document (docs/ABI.md "Pricing rules"). Returns a CS_ERRC_*
+// code and sets the last error on failure, when `out` must be discarded.
+int compile_pricing_json(const char* json, PricingRules* out);
+
+// One line's share of a rule's discount.
+struct LineDiscount {
+  uint32_t line = 0;
+  uint32_t rule = 0;
+  long long cents = 0;
+};
+
+// A cart's pinned pricing rules and the discount each one currently gives. Only rules with a
+// discount are kept, ordered by rule. If an evaluation throws, the cart has already changed, so
+// the discounts are marked stale and recomputed on the next read.
+class CartPricing {
+ public:
+  CartPricing()
+      : applied_(core_resource(MemoryCategory::kLines)),
+        units_(applied_.get_allocator().resource()),
+        pending_(applied_.get_allocator().resource()),
+        codes_(applied_.get_allocator().resource()) {}
+
+  void pin(PricingPtr rules) {
+    rules_ = std::move(rules);
+    applied_.clear();
+    stale_ = false;
+  }
+
+  void release() {
+    pin(nullptr);
+    codes_.clear();
+    local_time_ms_ = 0;
+  }
+
+  void copy_context(const CartPricing& other) {
+    rules_ = other.rules_;
+    codes_ = other.codes_;
+    local_time_ms_ = other.local_time_ms_;
+  }
+
+  void set_context(std::string_view codes, long long local_time_ms) {
+    codes_.assign(codes.data(), codes.size());
+    local_time_ms_ = local_time_ms;
+  }
+
+  // The cart lost every line.
+  void cleared() {
+    applied_.clear();
+    stale_ = false;
+  }
+
+  // Re-evaluates the rules that can apply to the item of a line that was added, changed or
+  // removed.
+  void item_changed(const Cart& cart, std::string_view item_id, uint32_t item_index);
+
+  // Re-evaluates every rule that can apply to the cart's lines.
+  void refresh(const Cart& cart) { recompute(cart); }
+
+  // The sum of the rules' discounts, at most kMaxCents.
+  long long discount_cents(const Cart& cart) const;
+
+  // Splits each applied rule's discount over the lines, ordered by line and then rule.
+  void line_discounts(const Cart& cart, std::pmr::vector<LineDiscount>* out) const;
+
+  std::string_view rule_id(uint32_t rule) const { return rules_->view(rules_->rules[rule].id); }
+
+ private:
+  struct Applied {
+    uint32_t rule = 0;
+    long long cents = 0;
+  };
+
+  // One matching line while a rule is evaluated.
+  struct Unit {
+    uint32_t line = 0;
+    uint32_t component = 0;
+    long long qty = 0;
+    long long unit_cents = 0;
+    long long used = 0;
+  };
+
+  // Minute of the ISO week (Monday 00:00 = 0), computed once per evaluation pass.
+  int minute_of_week() const;
+  bool rule_active(const PricingRule& rule, int* minute_of_week) const;
+  // `rule`'s discount on the cart, split over its lines into `out` if given. Applied rules were
+  // active when last evaluated and the lines have not changed since, so reads skip the check.
+  long long evaluate(const Cart& cart, uint32_t rule, bool check_active, int* minute_of_week,
+                     std::pmr::vector<LineDiscount>* out) const;
+  void evaluate_list(const Cart& cart, const PricingRules::RuleList* list,
+                     int* minute_of_week) const;
+  void store(uint32_t rule, long long cents) const;
+  void recompute(const Cart& cart) const;
+
+  PricingPtr rules_;
+  // A cache of the lines' discounts, so reads may bring a stale one up to date.
+  mutable std::pmr::vector<Applied> applied_;
+  // Evaluation scratch; keeps its capacity across changes.
+  mutable std::pmr::vector<Unit> units_;
+  mutable std::pmr::vector<uint32_t> pending_;
+  std::pmr::string codes_;
+  long long local_time_ms_ = 0;
+  mutable bool stale_ = false;
+};
+
+}  // namespace cashsloth
@@ -0,0 +1,144 @@
+#include "recorder.h"
+
+#include <algorithm>
+
+namespace cashsloth {
+namespace {
+
+constexpr char kRecordMagic[8] = {'C', 'S', 'R', 'E', 'C', '0', '0', '1'};
+
+uint64_t fnv1a(const char* data, size_t size) {
+  uint64_t hash = 14695981039346656037ull;
+  for (size_t i = 0; i < size; ++i) {
+    hash = (hash ^ static_cast<unsigned char>(data[i])) * 1099511628211ull;
+  }
+  return hash;
+}
+
+}  // namespace
+
+int RecordWriter::start(const char* path) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (file_) {
+    set_last_error(CS_ERRC_INVALID_STATE, "A recording is already active.");
+    return CS_ERROR_INVALID_ARGUMENT;
+  }
+  file_ = std::fopen(path, "wb");
+  if (!file_) {
+    set_last_error(CS_ERRC_IO, "Unable to open record file: ", path);
+    return CS_ERROR_INVALID_ARGUMENT;
+  }
+  used_ = 0;
+  write_failed_ = false;
+  epoch_ = std::chrono::steady_clock::now();
+  put_bytes(kRecordMagic, sizeof(kRecordMagic));
+  put_varint(kApiCount);
+  for (const char* name : kApiNames) {
+    put_string(name, std::strlen(name));
+  }
+  g_recording.store(true, std::memory_order_relaxed);
+  clear_last_error();
+  return CS_SUCCESS;
+}
+
+int RecordWriter::stop() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  g_recording.store(false, std::memory_order_relaxed);
+  if (!file_) {
+    clear_last_error();
+    return CS_SUCCESS;
+  }
+  flush();
+  const bool failed = std::fclose(file_) != 0 || write_failed_;
+  file_ = nullptr;
+  if (failed) {
+    set_last_error(CS_ERRC_IO, "Writing the record file failed.");
+    return CS_ERROR_INTERNAL;
+  }
+  clear_last_error();
+  return CS_SUCCESS;
+}
+
+uint64_t RecordWriter::record_thread_id() {
+  static std::atomic<uint32_t> next{1};
+  static thread_local uint32_t id = next.fetch_add(1, std::memory_order_relaxed);
+  return id;
+}
+
+void RecordWriter::put_arg(const cs_sale_meta* meta) {
+  put_arg(meta ? static_cast<long long>(meta->struct_size) : -1LL);
+  const bool readable = meta && meta->struct_size >= sizeof(cs_sale_meta);
+  put_arg(readable ? meta->event_name : nullptr);
+  put_arg(readable ? meta->register_name : nullptr);
+  put_arg(readable ? meta->operator_username : nullptr);
+  put_arg(readable ? meta->payment_method : nullptr);
+  put_arg(readable ? meta->tip_cents : 0LL);
+  put_arg(readable ? meta->completed_unix_ms : 0LL);
+  put_arg(readable ? meta->is_showcase : 0);
+}
+
+void RecordWriter::put_arg(RecordedFile file) {
+  std::FILE* in = file.path && file.path[0] != '\0' ? std::fopen(file.path, "rb") : nullptr;
+  long size = -1;
+  if (in && std::fseek(in, 0, SEEK_END) == 0) {
+    size = std::ftell(in);
+  }
+  if (size < 0 || std::fseek(in, 0, SEEK_SET) != 0) {
+    if (in) {
+      std::fclose(in);
+    }
+    put_byte(kRecordNullString);
+    return;
+  }
+  put_byte(kRecordString);
+  put_varint(static_cast<uint64_t>(size));
+  for (size_t left = static_cast<size_t>(size); left > 0;) {
+    if (used_ == sizeof(buffer_)) {
+      flush();
+    }
+    const size_t chunk = std::min(left, sizeof(buffer_) - used_);
+    const size_t read = std::fread(buffer_ + used_, 1, chunk, in);
+    std::memset(buffer_ + used_ + read, 0, chunk - read);
+    used_ += chunk;
+    left -= chunk;
+  }
+  std::fclose(in);
+}
+
+void RecordWriter::put_arg(char** out_text) {
+  if (!out_text) {
+    put_byte(kRecordOutNull);
+    return;
+  }
+  put_byte(kRecordOutText);
+  const size_t size = *out_text ? std::strlen(*out_text) : 0;
+  put_varint(size);
+  const uint64_t hash = *out_text ? fnv1a(*out_text, size) : 0;
+  for (int shift = 0; shift < 64; shift += 8) {
+    put_byte(static_cast<unsigned char>(hash >> shift));
+  }
+}
+
+void RecordWriter::put_bytes(const char* data, size_t size) {
+  if (used_ + size > sizeof(buffer_)) {
+    flush();
+    if (size > sizeof(buffer_)) {
+      write_failed_ |= std::fwrite(data, 1, size, file_) != size;
+      return;
+    }
+  }
+  std::memcpy(buffer_ + used_, data, size);
+  used_ += size;
+}
+
+void RecordWriter::flush() {
+  write_failed_ |= std::fwrite(buffer_, 1, used_, file_) != used_;
+  used_ = 0;
+}
+
+RecordWriter& record_writer() {
+  static RecordWriter* writer = new RecordWriter();
+  return *writer;
+}
+
+}  // namespace cashsloth
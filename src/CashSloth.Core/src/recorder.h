@@ -0,0 +1,222 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <tuple>
+#include <type_traits>
+
+#include "cashsloth_core.h"
+#include "diagnostics.h"
+#include "errors.h"
+#include "platform.h"
+
+namespace cashsloth {
+
+// Call recorder. While a recording is active, every replayable entry point appends one record
+// with its arguments, outputs, timing, thread and outcome to the record file (see docs/ABI.md
+// for the format). Records are written when a call returns, so a handle always appears as an
+// output before any call on another thread can use it. While no recording is active a call
+// pays one relaxed load. Lifecycle, allocator, diagnostics and cs_free calls are not recorded;
+// they configure or observe the process rather than serve the register.
+inline std::atomic<bool> g_recording{false};
+
+constexpr unsigned char kRecordCall = 1;
+
+enum RecordTag : unsigned char {
+  kRecordInt = 1,
+  kRecordHandle = 2,
+  kRecordString = 3,
+  kRecordNullString = 4,
+  kRecordOutInt = 5,
+  kRecordOutHandle = 6,
+  kRecordOutText = 7,
+  kRecordOutNull = 8,
+};
+
+// A file whose contents are recorded as a string when the call returns: cs_cart_recover's state
+// file, so a replay can recover the same cart. Null when the file cannot be read.
+struct RecordedFile {
+  const char* path;
+};
+
+// A recorded argument is one tagged value, except sale details, which are recorded field by field.
+template <typename T>
+inline constexpr size_t kRecordArity = 1;
+template <>
+inline constexpr size_t kRecordArity<const cs_sale_meta*> = 8;
+
+// Records are encoded into a fixed buffer under one mutex, so recording never touches the core
+// allocator and the file holds calls in completion order.
+class RecordWriter {
+ public:
+  // Both return a CS_ERROR_* result.
+  int start(const char* path);
+  int stop();
+
+  uint64_t now_ns() const {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                     std::chrono::steady_clock::now() - epoch_)
+                                     .count());
+  }
+
+  template <typename... Args>
+  void record(ApiId api, uint64_t start_ns, bool failed, const Args&... args) {
+    const uint64_t end_ns = now_ns();
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!file_) {
+      return;
+    }
+    put_byte(kRecordCall);
+    put_varint(static_cast<uint64_t>(api));
+    put_varint(record_thread_id());
+    put_varint(start_ns);
+    put_varint(end_ns > start_ns ? end_ns - start_ns : 0);
+    put_byte(failed ? 1 : 0);
+    put_byte(static_cast<unsigned char>((kRecordArity<Args> + ... + 0)));
+    (put_arg(args), ...);
+  }
+
+ private:
+  static uint64_t record_thread_id();
+
+  void put_arg(int value) { put_signed(kRecordInt, value); }
+  void put_arg(long long value) { put_signed(kRecordInt, value); }
+
+  void put_arg(void* handle) {
+    put_byte(kRecordHandle);
+    put_varint(reinterpret_cast<uintptr_t>(handle));
+  }
+
+  void put_arg(const char* text) {
+    if (!text) {
+      put_byte(kRecordNullString);
+      return;
+    }
+    put_byte(kRecordString);
+    put_string(text, std::strlen(text));
+  }
+
+  void put_arg(void** out_handle) {
+    if (!out_handle) {
+      put_byte(kRecordOutNull);
+      return;
+    }
+    put_byte(kRecordOutHandle);
+    put_varint(reinterpret_cast<uintptr_t>(*out_handle));
+  }
+
+  // struct_size (-1 for a null meta), the four strings, tip_cents, completed_unix_ms and
+  // is_showcase. The fields of a meta whose struct_size is too small are not read.
+  void put_arg(const cs_sale_meta* meta);
+
+  // Streamed through the buffer, so even a large state file is recorded without allocating. A
+  // file that shrinks while it is read is padded with zeros to the length already written.
+  void put_arg(RecordedFile file);
+
+  template <typename T>
+  void put_arg(T* out_value) {
+    static_assert(std::is_integral<T>::value, "Only integer outputs are recorded.");
+    if (!out_value) {
+      put_byte(kRecordOutNull);
+      return;
+    }
+    put_signed(kRecordOutInt, static_cast<long long>(*out_value));
+  }
+
+  // Returned text is recorded as its length and FNV-1a hash, which is enough to verify a replay.
+  void put_arg(char** out_text);
+
+  void put_signed(unsigned char tag, long long value) {
+    put_byte(tag);
+    const uint64_t bits = static_cast<uint64_t>(value);
+    put_varint((bits << 1) ^ (value < 0 ? ~uint64_t{0} : 0));
+  }
+
+  void put_varint(uint64_t value) {
+    while (value >= 0x80) {
+      put_byte(static_cast<unsigned char>(value | 0x80));
+      value >>= 7;
+    }
+    put_byte(static_cast<unsigned char>(value));
+  }
+
+  void put_string(const char* text, size_t size) {
+    put_varint(size);
+    put_bytes(text, size);
+  }
+
+  void put_byte(unsigned char byte) {
+    if (used_ == sizeof(buffer_)) {
+      flush();
+    }
+    buffer_[used_++] = byte;
+  }
+
+  // Payloads larger than the buffer, such as catalog JSON, bypass it.
+  void put_bytes(const char* data, size_t size);
+  void flush();
+
+  std::mutex mutex_;
+  std::FILE* file_ = nullptr;
+  bool write_failed_ = false;
+  std::chrono::steady_clock::time_point epoch_;
+  size_t used_ = 0;
+  unsigned char buffer_[64 * 1024];
+};
+
+// Leaked: calls may be recorded up to process exit.
+RecordWriter& record_writer();
+
+// Captures an entry point's arguments by value; output pointers are read when the call returns.
+// Declared after CS_ENTRY, so it is destroyed first and the record excludes no part of the call
+// but the statistics bookkeeping.
+template <typename... Args>
+class CallRecorder {
+ public:
+  explicit CallRecorder(ApiId api, Args... args)
+      : api_(api), args_(args...), active_(g_recording.load(std::memory_order_relaxed)) {
+    if (active_) {
+      begin();
+    }
+  }
+
+  ~CallRecorder() {
+    if (active_) {
+      finish();
+    }
+  }
+
+  CallRecorder(const CallRecorder&) = delete;
+  CallRecorder& operator=(const CallRecorder&) = delete;
+
+ private:
+  CS_NOINLINE void begin() {
+    g_call_failed = false;
+    exceptions_ = std::uncaught_exceptions();
+    start_ns_ = record_writer().now_ns();
+  }
+
+  // A call left by an exception has not reported its error yet; translate_exception runs later.
+  CS_NOINLINE void finish() {
+    const bool failed = g_call_failed || std::uncaught_exceptions() > exceptions_;
+    std::apply(
+        [&](const Args&... args) { record_writer().record(api_, start_ns_, failed, args...); },
+        args_);
+  }
+
+  ApiId api_;
+  std::tuple<Args...> args_;
+  bool active_;
+  int exceptions_ = 0;
+  uint64_t start_ns_ = 0;
+};
+
+#define CS_RECORD(api, ...) CallRecorder cs_call_recorder(ApiId::api, __VA_ARGS__)
+#define CS_RECORD_NO_ARGS(api) CallRecorder<> cs_call_recorder(ApiId::api)
+
+}  // namespace cashsloth
@@ -0,0 +1,150 @@
+#include "sale_record.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "cart.h"
+#include "money.h"
+
+namespace cashsloth {
+
+bool decode_sale(std::string_view payload, SaleView* sale) {
+  JournalDecoder decoder(payload);
+  unsigned char flags = 0;
+  if (!decoder.fixed64(&sale->sequence) || !decoder.varint(&sale->completed_unix_ms) ||
+      !decoder.zigzag(&sale->subtotal_cents) || !decoder.zigzag(&sale->tip_cents) ||
+      !decoder.zigzag(&sale->total_cents) || !decoder.zigzag(&sale->given_cents) ||
+      !decoder.zigzag(&sale->change_cents) || !decoder.byte(&flags) ||
+      !decoder.text(&sale->event_name) || !decoder.text(&sale->register_name) ||
+      !decoder.text(&sale->operator_username) || !decoder.text(&sale->payment_method) ||
+      !decoder.varint(&sale->line_count)) {
+    return false;
+  }
+  sale->is_showcase = (flags & kSaleShowcase) != 0;
+  sale->line_discounts = (flags & kSaleLineDiscounts) != 0;
+  sale->lines = decoder.rest();
+  return true;
+}
+
+void encode_sale(const Cart& cart, const cs_sale_meta& meta, long long subtotal_cents,
+                 uint64_t completed_unix_ms, std::pmr::string& out) {
+  auto text = [](const char* value) { return std::string_view(value ? value : ""); };
+  const long long total_cents = subtotal_cents + meta.tip_cents;
+  std::pmr::vector<LineDiscount> discounts(out.get_allocator().resource());
+  if (cart.pricing.discount_cents(cart) > 0) {
+    cart.pricing.line_discounts(cart, &discounts);
+  }
+  unsigned char flags = meta.is_showcase ? kSaleShowcase : 0;
+  flags |= discounts.empty() ? 0 : kSaleLineDiscounts;
+  append_fixed64(out, 0);
+  append_varint(out, completed_unix_ms);
+  append_zigzag(out, subtotal_cents);
+  append_zigzag(out, meta.tip_cents);
+  append_zigzag(out, total_cents);
+  append_zigzag(out, cart.given_cents);
+  // Non-cash sales may be committed with less than the total given; they record no change.
+  append_zigzag(out, cart.given_cents > total_cents ? cart.given_cents - total_cents : 0);
+  out += static_cast<char>(flags);
+  append_text(out, text(meta.event_name));
+  append_text(out, text(meta.register_name));
+  append_text(out, text(meta.operator_username));
+  append_text(out, text(meta.payment_method));
+  append_varint(out, cart.lines.size());
+  const size_t column = cart.name_column();
+  size_t next_discount = 0;
+  for (size_t i = 0; i < cart.lines.size(); ++i) {
+    const CartLine& line = cart.lines[i];
+    const long long line_total_cents = line.unit_cents * static_cast<long long>(line.qty);
+    // Stacked rules never take a line below zero, as in CartTax::for_each_class.
+    long long discount = 0;
+    for (; next_discount < discounts.size() && discounts[next_discount].line == i;
+         ++next_discount) {
+      discount = add_capped(discount, discounts[next_discount].cents);
+    }
+    discount = std::min(discount, line_total_cents);
+    append_text(out, cart.id_of(line));
+    append_text(out, cart.item_of(line) ? cart.snapshot->name_of(line.item_index, column)
+                                        : std::string_view());
+    append_zigzag(out, line.unit_cents);
+    append_varint(out, static_cast<uint64_t>(line.qty));
+    append_zigzag(out, line_total_cents - discount);
+    if (!discounts.empty()) {
+      append_zigzag(out, discount);
+    }
+  }
+  if (!cart.tax.enabled()) {
+    return;
+  }
+  // Trailing per-class totals; records without them are sales from catalogs without classes.
+  uint64_t classes = 0;
+  cart.tax.for_each_class(cart, [&classes](const TaxTotal&) { ++classes; });
+  append_varint(out, classes);
+  cart.tax.for_each_class(cart, [&](const TaxTotal& tax) {
+    const bool classed = tax.tax_class != kNoTaxClass;
+    append_text(out, classed ? std::string_view(cart.snapshot->tax_class_ids[tax.tax_class])
+                             : std::string_view());
+    append_varint(out, classed ? static_cast<uint64_t>(cart.snapshot->tax_rates[tax.tax_class])
+                               : 0);
+    append_zigzag(out, tax.net_cents);
+    append_zigzag(out, tax.tax_cents);
+    append_zigzag(out, tax.gross_cents);
+  });
+}
+
+bool append_sale_json(std::pmr::string& json, const SaleView& sale) {
+  json += "{\"sequence\":";
+  append_integer(json, static_cast<long long>(sale.sequence));
+  json += ",\"completed_unix_ms\":";
+  append_integer(json, static_cast<long long>(sale.completed_unix_ms));
+  json += ",\"event\":\"";
+  append_json_escaped(json, sale.event_name);
+  json += "\",\"register\":\"";
+  append_json_escaped(json, sale.register_name);
+  json += "\",\"operator\":\"";
+  append_json_escaped(json, sale.operator_username);
+  json += "\",\"payment_method\":\"";
+  append_json_escaped(json, sale.payment_method);
+  json += sale.is_showcase ? "\",\"showcase\":true" : "\",\"showcase\":false";
+  json += ",\"subtotal_cents\":";
+  append_integer(json, sale.subtotal_cents);
+  json += ",\"tip_cents\":";
+  append_integer(json, sale.tip_cents);
+  json += ",\"total_cents\":";
+  append_integer(json, sale.total_cents);
+  json += ",\"given_cents\":";
+  append_integer(json, sale.given_cents);
+  json += ",\"change_cents\":";
+  append_integer(json, sale.change_cents);
+  json += ",\"lines\":[";
+  bool first = true;
+  const bool lines_ok = for_each_sale_line(sale, [&](const SaleLineView& line) {
+    json += first ? "{\"id\":\"" : ",{\"id\":\"";
+    first = false;
+    append_json_escaped(json, line.id);
+    json += "\",\"name\":\"";
+    append_json_escaped(json, line.name);
+    json += "\",\"unit_cents\":";
+    append_integer(json, line.unit_cents);
+    json += ",\"qty\":";
+    append_integer(json, static_cast<long long>(line.qty));
+    json += ",\"line_total_cents\":";
+    append_integer(json, line.line_total_cents);
+    if (line.discount_cents != 0) {
+      json += ",\"discount_cents\":";
+      append_integer(json, line.discount_cents);
+    }
+    json += "}";
+  });
+  json += "]";
+  bool has_taxes = false;
+  const bool taxes_ok = lines_ok && for_each_sale_tax(sale, [&](const SaleTaxView& tax) {
+    json += has_taxes ? "," : ",\"taxes\":[";
+    append_tax_total_json(json, tax.tax_class, static_cast<long long>(tax.rate_basis_points),
+                          tax.total, true);
+    has_taxes = true;
+  });
+  json += has_taxes ? "]}" : "}";
+  return taxes_ok;
+}
+
+}  // namespace cashsloth
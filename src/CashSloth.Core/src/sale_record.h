@@ -0,0 +1,181 @@
+#pragma once
+
+#include <cstdint>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+
+#include "cashsloth_core.h"
+#include "encoding.h"
+#include "tax.h"
+
+namespace cashsloth {
+
+class Cart;
+
+// Reads the fields of a journal record in the order encode_sale wrote them.
+class JournalDecoder {
+ public:
+  explicit JournalDecoder(std::string_view data) : p_(data.data()), end_(data.data() + data.size()) {}
+
+  bool fixed64(uint64_t* out) {
+    if (end_ - p_ < 8) {
+      return false;
+    }
+    *out = load_fixed(p_, 8);
+    p_ += 8;
+    return true;
+  }
+
+  bool varint(uint64_t* out) {
+    uint64_t value = 0;
+    for (int shift = 0; shift < 64 && p_ < end_; shift += 7) {
+      const unsigned char byte = static_cast<unsigned char>(*p_++);
+      value |= static_cast<uint64_t>(byte & 0x7Fu) << shift;
+      if ((byte & 0x80u) == 0) {
+        *out = value;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool zigzag(long long* out) {
+    uint64_t bits = 0;
+    if (!varint(&bits)) {
+      return false;
+    }
+    *out = static_cast<long long>((bits >> 1) ^ (~(bits & 1) + 1));
+    return true;
+  }
+
+  bool byte(unsigned char* out) {
+    if (p_ == end_) {
+      return false;
+    }
+    *out = static_cast<unsigned char>(*p_++);
+    return true;
+  }
+
+  bool text(std::string_view* out) {
+    uint64_t size = 0;
+    if (!varint(&size) || size > static_cast<uint64_t>(end_ - p_)) {
+      return false;
+    }
+    *out = std::string_view(p_, static_cast<size_t>(size));
+    p_ += size;
+    return true;
+  }
+
+  std::string_view rest() const { return std::string_view(p_, static_cast<size_t>(end_ - p_)); }
+
+ private:
+  const char* p_;
+  const char* end_;
+};
+
+// Sale record flag bits.
+constexpr unsigned char kSaleShowcase = 1;
+// Each line stores its pricing rule discount after its (discounted) total.
+constexpr unsigned char kSaleLineDiscounts = 2;
+
+// A committed sale as stored in the journal. Views point into the record payload.
+struct SaleView {
+  uint64_t sequence = 0;
+  uint64_t completed_unix_ms = 0;
+  long long subtotal_cents = 0;
+  long long tip_cents = 0;
+  long long total_cents = 0;
+  long long given_cents = 0;
+  long long change_cents = 0;
+  bool is_showcase = false;
+  bool line_discounts = false;
+  std::string_view event_name;
+  std::string_view register_name;
+  std::string_view operator_username;
+  std::string_view payment_method;
+  uint64_t line_count = 0;
+  // Encoded lines, followed by fields added by later versions.
+  std::string_view lines;
+};
+
+struct SaleLineView {
+  std::string_view id;
+  std::string_view name;
+  long long unit_cents = 0;
+  uint64_t qty = 0;
+  // After pricing rule discounts, which `discount_cents` holds.
+  long long line_total_cents = 0;
+  long long discount_cents = 0;
+};
+
+// False when the fixed fields of `payload` do not decode.
+bool decode_sale(std::string_view payload, SaleView* sale);
+
+inline bool decode_sale_line(const SaleView& sale, JournalDecoder& decoder, SaleLineView* line) {
+  line->discount_cents = 0;
+  return decoder.text(&line->id) && decoder.text(&line->name) &&
+         decoder.zigzag(&line->unit_cents) && decoder.varint(&line->qty) &&
+         decoder.zigzag(&line->line_total_cents) &&
+         (!sale.line_discounts || decoder.zigzag(&line->discount_cents));
+}
+
+// Calls `visit(const SaleLineView&)` for each line. Bytes after the last line are ignored.
+template <typename Visit>
+bool for_each_sale_line(const SaleView& sale, Visit&& visit) {
+  JournalDecoder decoder(sale.lines);
+  SaleLineView line;
+  for (uint64_t i = 0; i < sale.line_count; ++i) {
+    if (!decode_sale_line(sale, decoder, &line)) {
+      return false;
+    }
+    visit(line);
+  }
+  return true;
+}
+
+struct SaleTaxView {
+  std::string_view tax_class;
+  uint64_t rate_basis_points = 0;
+  TaxTotal total;
+};
+
+// Calls `visit(const SaleTaxView&)` for each tax class total stored after the lines; sales
+// without them visit nothing. False when the lines or the totals do not decode.
+template <typename Visit>
+bool for_each_sale_tax(const SaleView& sale, Visit&& visit) {
+  JournalDecoder decoder(sale.lines);
+  SaleLineView line;
+  for (uint64_t i = 0; i < sale.line_count; ++i) {
+    if (!decode_sale_line(sale, decoder, &line)) {
+      return false;
+    }
+  }
+  if (decoder.rest().empty()) {
+    return true;
+  }
+  uint64_t classes = 0;
+  if (!decoder.varint(&classes)) {
+    return false;
+  }
+  SaleTaxView tax;
+  for (uint64_t i = 0; i < classes; ++i) {
+    if (!decoder.text(&tax.tax_class) || !decoder.varint(&tax.rate_basis_points) ||
+        !decoder.zigzag(&tax.total.net_cents) || !decoder.zigzag(&tax.total.tax_cents) ||
+        !decoder.zigzag(&tax.total.gross_cents)) {
+      return false;
+    }
+    visit(tax);
+  }
+  return true;
+}
+
+// Encodes the sale payload with a zero sequence for SaleJournal::commit to fill in. Line totals
+// are stored after pricing rule discounts, so sales reports see what the lines earned.
+void encode_sale(const Cart& cart, const cs_sale_meta& meta, long long subtotal_cents,
+                 uint64_t completed_unix_ms, std::pmr::string& out);
+
+// False when the lines do not decode.
+bool append_sale_json(std::pmr::string& json, const SaleView& sale);
+
+}  // namespace cashsloth
@@ -0,0 +1,422 @@
+#include "sales_index.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "encoding.h"
+#include "errors.h"
+
+namespace cashsloth {
+namespace {
+
+void append_sales_totals(std::pmr::string& json, const SalesTotals& totals) {
+  json += "\"sale_count\":";
+  append_integer(json, totals.sale_count);
+  json += ",\"subtotal_cents\":";
+  append_integer(json, totals.subtotal_cents);
+  json += ",\"tip_cents\":";
+  append_integer(json, totals.tip_cents);
+  json += ",\"total_cents\":";
+  append_integer(json, totals.total_cents);
+  json += ",\"given_cents\":";
+  append_integer(json, totals.given_cents);
+  json += ",\"change_cents\":";
+  append_integer(json, totals.change_cents);
+  json += ",\"line_count\":";
+  append_integer(json, totals.line_count);
+}
+
+}  // namespace
+
+void SalesIndex::add(const SaleView& sale) {
+  if (incomplete_ || overflowed_) {
+    return;
+  }
+  SalesTotals row;
+  row.sale_count = 1;
+  row.subtotal_cents = sale.subtotal_cents;
+  row.tip_cents = sale.tip_cents;
+  row.total_cents = sale.total_cents;
+  row.given_cents = sale.given_cents;
+  row.change_cents = sale.change_cents;
+  row.line_count = static_cast<long long>(std::min<uint64_t>(sale.line_count, kMaxCents));
+  if (row.subtotal_cents < 0 || row.tip_cents < 0 || row.total_cents < 0 ||
+      row.given_cents < 0 || row.change_cents < 0 ||
+      sale.completed_unix_ms > static_cast<uint64_t>(kMaxCents)) {
+    return;
+  }
+  // Every filtered sum is bounded by the sum over all sales, so checking that one is enough.
+  if (!all_.fits(row)) {
+    overflowed_ = true;
+    return;
+  }
+
+  if (blocks_.empty() || blocks_.back().rows() == kSalesBlockRows) {
+    if (!blocks_.empty()) {
+      seal(blocks_.back());
+    }
+    blocks_.emplace_back(resource_);
+  }
+  SalesBlock& block = blocks_.back();
+  const size_t lines_before = block.line_item.size();
+  bool lines_ok = for_each_sale_line(sale, [&](const SaleLineView& line) {
+    block.line_item.push_back(intern_item(line.id, line.name));
+    block.line_qty.push_back(static_cast<long long>(line.qty));
+    block.line_revenue_cents.push_back(line.line_total_cents);
+  });
+  for (size_t i = lines_before; lines_ok && i < block.line_item.size(); ++i) {
+    lines_ok = block.line_revenue_cents[i] >= 0;
+  }
+  // Net and tax never exceed gross, so bounding the gross sum over all sales bounds them all.
+  const size_t taxes_before = block.tax_class.size();
+  long long gross_cents = 0;
+  bool taxes_ok = lines_ok && for_each_sale_tax(sale, [&](const SaleTaxView& tax) {
+    const TaxTotal& total = tax.total;
+    if (total.net_cents < 0 || total.tax_cents < 0 ||
+        total.gross_cents != total.net_cents + total.tax_cents ||
+        total.gross_cents > kMaxCents - gross_cents || tax.rate_basis_points > kMaxTaxRate) {
+      lines_ok = false;
+      return;
+    }
+    gross_cents += total.gross_cents;
+    block.tax_class.push_back(intern_tax_class(tax.tax_class, tax.rate_basis_points));
+    block.tax_net_cents.push_back(total.net_cents);
+    block.tax_tax_cents.push_back(total.tax_cents);
+    block.tax_gross_cents.push_back(total.gross_cents);
+  });
+  if (!lines_ok || !taxes_ok) {
+    block.line_item.resize(lines_before);
+    block.line_qty.resize(lines_before);
+    block.line_revenue_cents.resize(lines_before);
+    block.tax_class.resize(taxes_before);
+    block.tax_net_cents.resize(taxes_before);
+    block.tax_tax_cents.resize(taxes_before);
+    block.tax_gross_cents.resize(taxes_before);
+    return;
+  }
+  if (gross_cents > kMaxCents - all_gross_cents_) {
+    overflowed_ = true;
+    return;
+  }
+  all_gross_cents_ += gross_cents;
+
+  const long long completed_unix_ms = static_cast<long long>(sale.completed_unix_ms);
+  const std::string_view labels[kSalesDimensionCount] = {
+      sale.event_name, sale.register_name, sale.operator_username, sale.payment_method};
+  for (size_t d = 0; d < kSalesDimensionCount; ++d) {
+    const uint32_t code = dictionaries_[d].intern(labels[d]);
+    block.codes[d].push_back(code);
+    block.min_code[d] = std::min(block.min_code[d], code);
+    block.max_code[d] = std::max(block.max_code[d], code);
+  }
+  block.completed_unix_ms.push_back(completed_unix_ms);
+  block.subtotal_cents.push_back(row.subtotal_cents);
+  block.tip_cents.push_back(row.tip_cents);
+  block.total_cents.push_back(row.total_cents);
+  block.given_cents.push_back(row.given_cents);
+  block.change_cents.push_back(row.change_cents);
+  block.line_count.push_back(row.line_count);
+  block.showcase.push_back(sale.is_showcase ? 1 : 0);
+  block.line_end.push_back(static_cast<uint32_t>(block.line_item.size()));
+  block.tax_end.push_back(static_cast<uint32_t>(block.tax_class.size()));
+  block.min_unix_ms = std::min(block.min_unix_ms, completed_unix_ms);
+  block.max_unix_ms = std::max(block.max_unix_ms, completed_unix_ms);
+  block.totals[sale.is_showcase ? 1 : 0].add(row);
+  all_.add(row);
+}
+
+int SalesIndex::query(const SalesFilter& filter, size_t group_by, std::pmr::string* out) const {
+  if (incomplete_) {
+    set_last_error(CS_ERRC_INVALID_STATE, "The sales index is incomplete; reopen the journal.");
+    return CS_ERRC_INVALID_STATE;
+  }
+  if (overflowed_) {
+    set_last_error(CS_ERRC_OVERFLOW, "Sales totals overflow.");
+    return CS_ERRC_OVERFLOW;
+  }
+
+  Query query(resource_);
+  query.filter = &filter;
+  query.group_by = group_by;
+  bool matches_any = true;
+  std::pmr::string scratch(resource_);
+  for (size_t d = 0; d < kSalesDimensionCount; ++d) {
+    if (filter.has[d]) {
+      query.code[d] = dictionaries_[d].find(filter.text[d], &scratch);
+      matches_any = matches_any && query.code[d] != kNoItem;
+    }
+  }
+  if (group_by != kNoSalesGroup) {
+    query.groups.resize(dictionaries_[group_by].size());
+  }
+  query.item_qty.resize(item_ids_.size());
+  query.item_revenue_cents.resize(item_ids_.size());
+  query.taxes.resize(tax_ids_.size());
+
+  if (matches_any) {
+    for (const SalesBlock& block : blocks_) {
+      aggregate_block(block, &query);
+    }
+  }
+
+  // Codes follow the order sales reached the index, which differs between a live index and
+  // one rebuilt from the journal; reports are sorted by key instead.
+  std::pmr::vector<uint32_t> order(resource_);
+  auto sorted = [&order](size_t count, auto&& keep, auto&& key) -> const auto& {
+    order.clear();
+    for (uint32_t code = 0; code < count; ++code) {
+      if (keep(code)) {
+        order.push_back(code);
+      }
+    }
+    std::sort(order.begin(), order.end(),
+              [&key](uint32_t a, uint32_t b) { return key(a) < key(b); });
+    return order;
+  };
+
+  *out += "{";
+  append_sales_totals(*out, query.totals);
+  *out += ",\"groups\":[";
+  bool first = true;
+  if (group_by != kNoSalesGroup) {
+    const SalesDictionary& dictionary = dictionaries_[group_by];
+    for (uint32_t code : sorted(
+             query.groups.size(), [&](uint32_t c) { return query.groups[c].sale_count != 0; },
+             [&](uint32_t c) { return dictionary.label(c); })) {
+      *out += first ? "{\"key\":\"" : ",{\"key\":\"";
+      first = false;
+      append_json_escaped(*out, dictionary.label(code));
+      *out += "\",";
+      append_sales_totals(*out, query.groups[code]);
+      *out += "}";
+    }
+  }
+  *out += "],\"items\":[";
+  first = true;
+  for (uint32_t item : sorted(
+           item_ids_.size(), [&](uint32_t c) { return query.item_qty[c] != 0; },
+           [&](uint32_t c) { return std::string_view(item_ids_[c]); })) {
+    *out += first ? "{\"id\":\"" : ",{\"id\":\"";
+    first = false;
+    append_json_escaped(*out, item_ids_[item]);
+    *out += "\",\"name\":\"";
+    append_json_escaped(*out, item_names_[item]);
+    *out += "\",\"qty\":";
+    append_integer(*out, query.item_qty[item]);
+    *out += ",\"revenue_cents\":";
+    append_integer(*out, query.item_revenue_cents[item]);
+    *out += "}";
+  }
+  *out += "]";
+  first = true;
+  for (uint32_t tax : sorted(
+           tax_ids_.size(), [&](uint32_t c) { return query.taxes[c].sale_count != 0; },
+           [&](uint32_t c) {
+             return std::make_pair(std::string_view(tax_ids_[c]), tax_rates_[c]);
+           })) {
+    const SalesTaxTotal& total = query.taxes[tax];
+    *out += first ? ",\"taxes\":[" : ",";
+    first = false;
+    append_tax_total_json(*out, tax_ids_[tax], tax_rates_[tax],
+                          TaxTotal{tax, total.net_cents, total.tax_cents, total.gross_cents},
+                          true);
+  }
+  *out += first ? "}" : "]}";
+  return CS_ERRC_NONE;
+}
+
+uint32_t SalesIndex::intern_item(std::string_view id, std::string_view name) {
+  key_.assign(id.data(), id.size());
+  auto it = items_.find(key_);
+  if (it != items_.end()) {
+    // Reports show the name of the item's latest sale.
+    if (item_names_[it->second] != name) {
+      item_names_[it->second].assign(name.data(), name.size());
+    }
+    return it->second;
+  }
+  const uint32_t code = static_cast<uint32_t>(item_ids_.size());
+  item_ids_.emplace_back(id);
+  item_names_.emplace_back(name);
+  items_.emplace(key_, code);
+  return code;
+}
+
+uint32_t SalesIndex::intern_tax_class(std::string_view id, uint64_t rate) {
+  key_.clear();
+  append_fixed64(key_, rate);
+  key_.append(id.data(), id.size());
+  auto it = tax_classes_.find(key_);
+  if (it != tax_classes_.end()) {
+    return it->second;
+  }
+  const uint32_t code = static_cast<uint32_t>(tax_ids_.size());
+  tax_ids_.emplace_back(id);
+  tax_rates_.push_back(static_cast<long long>(rate));
+  tax_classes_.emplace(key_, code);
+  return code;
+}
+
+void SalesIndex::add_tax(SalesTaxTotal& total, const SalesBlock& block, uint32_t row) {
+  total.sale_count += 1;
+  total.net_cents += block.tax_net_cents[row];
+  total.tax_cents += block.tax_tax_cents[row];
+  total.gross_cents += block.tax_gross_cents[row];
+}
+
+void SalesIndex::seal(SalesBlock& block) {
+  std::pmr::unordered_map<uint32_t, size_t> slots[2] = {
+      std::pmr::unordered_map<uint32_t, size_t>(resource_),
+      std::pmr::unordered_map<uint32_t, size_t>(resource_)};
+  uint32_t line = 0;
+  for (size_t row = 0; row < block.rows(); ++row) {
+    const size_t flag = static_cast<size_t>(block.showcase[row]);
+    for (; line < block.line_end[row]; ++line) {
+      auto inserted = slots[flag].emplace(block.line_item[line], block.item_totals[flag].size());
+      if (inserted.second) {
+        block.item_totals[flag].push_back(SalesItemTotal{block.line_item[line], 0, 0});
+      }
+      SalesItemTotal& total = block.item_totals[flag][inserted.first->second];
+      total.qty += block.line_qty[line];
+      total.revenue_cents += block.line_revenue_cents[line];
+    }
+  }
+  slots[0].clear();
+  slots[1].clear();
+  uint32_t tax = 0;
+  for (size_t row = 0; row < block.rows(); ++row) {
+    const size_t flag = static_cast<size_t>(block.showcase[row]);
+    for (; tax < block.tax_end[row]; ++tax) {
+      auto inserted = slots[flag].emplace(block.tax_class[tax], block.tax_totals[flag].size());
+      if (inserted.second) {
+        block.tax_totals[flag].push_back(SalesTaxTotal{block.tax_class[tax], 0, 0, 0, 0});
+      }
+      add_tax(block.tax_totals[flag][inserted.first->second], block, tax);
+    }
+  }
+  block.sealed = true;
+}
+
+void SalesIndex::aggregate_block(const SalesBlock& block, Query* query) const {
+  const SalesFilter& filter = *query->filter;
+  if (block.rows() == 0 || block.max_unix_ms < filter.from_unix_ms ||
+      block.min_unix_ms >= filter.to_unix_ms ||
+      (!filter.include_showcase && block.totals[0].sale_count == 0)) {
+    return;
+  }
+  bool whole = block.sealed && block.min_unix_ms >= filter.from_unix_ms &&
+               block.max_unix_ms < filter.to_unix_ms;
+  for (size_t d = 0; d < kSalesDimensionCount; ++d) {
+    if (!filter.has[d]) {
+      continue;
+    }
+    if (query->code[d] < block.min_code[d] || query->code[d] > block.max_code[d]) {
+      return;
+    }
+    whole = whole && block.min_code[d] == block.max_code[d];
+  }
+  const size_t group_by = query->group_by;
+  if (group_by != kNoSalesGroup) {
+    whole = whole && block.min_code[group_by] == block.max_code[group_by];
+  }
+
+  if (whole) {
+    const int flags = filter.include_showcase ? 2 : 1;
+    for (int flag = 0; flag < flags; ++flag) {
+      query->totals.add(block.totals[flag]);
+      if (group_by != kNoSalesGroup) {
+        query->groups[block.min_code[group_by]].add(block.totals[flag]);
+      }
+      for (const SalesItemTotal& item : block.item_totals[flag]) {
+        query->item_qty[item.item] += item.qty;
+        query->item_revenue_cents[item.item] += item.revenue_cents;
+      }
+      for (const SalesTaxTotal& tax : block.tax_totals[flag]) {
+        SalesTaxTotal& total = query->taxes[tax.tax_class];
+        total.sale_count += tax.sale_count;
+        total.net_cents += tax.net_cents;
+        total.tax_cents += tax.tax_cents;
+        total.gross_cents += tax.gross_cents;
+      }
+    }
+    return;
+  }
+  scan_block(block, query);
+}
+
+void SalesIndex::scan_block(const SalesBlock& block, Query* query) {
+  const SalesFilter& filter = *query->filter;
+  const size_t rows = block.rows();
+  std::pmr::vector<long long>& mask = query->mask;
+  mask.resize(rows);
+  const long long keep_showcase = filter.include_showcase ? 1 : 0;
+  const long long* unix_ms = block.completed_unix_ms.data();
+  const long long* showcase = block.showcase.data();
+  for (size_t i = 0; i < rows; ++i) {
+    mask[i] = static_cast<long long>(unix_ms[i] >= filter.from_unix_ms) &
+              static_cast<long long>(unix_ms[i] < filter.to_unix_ms) &
+              (keep_showcase | (showcase[i] ^ 1));
+  }
+  for (size_t d = 0; d < kSalesDimensionCount; ++d) {
+    if (!filter.has[d]) {
+      continue;
+    }
+    const uint32_t code = query->code[d];
+    const uint32_t* codes = block.codes[d].data();
+    for (size_t i = 0; i < rows; ++i) {
+      mask[i] &= static_cast<long long>(codes[i] == code);
+    }
+  }
+
+  auto masked_sum = [&](const SalesBlock::Cents& column) {
+    long long sum = 0;
+    for (size_t i = 0; i < rows; ++i) {
+      sum += column[i] * mask[i];
+    }
+    return sum;
+  };
+  SalesTotals totals;
+  for (size_t i = 0; i < rows; ++i) {
+    totals.sale_count += mask[i];
+  }
+  if (totals.sale_count == 0) {
+    return;
+  }
+  totals.subtotal_cents = masked_sum(block.subtotal_cents);
+  totals.tip_cents = masked_sum(block.tip_cents);
+  totals.total_cents = masked_sum(block.total_cents);
+  totals.given_cents = masked_sum(block.given_cents);
+  totals.change_cents = masked_sum(block.change_cents);
+  totals.line_count = masked_sum(block.line_count);
+  query->totals.add(totals);
+
+  const uint32_t* groups =
+      query->group_by == kNoSalesGroup ? nullptr : block.codes[query->group_by].data();
+  uint32_t line = 0;
+  for (size_t i = 0; i < rows; ++i) {
+    const uint32_t end = block.line_end[i];
+    if (mask[i] == 0) {
+      line = end;
+      continue;
+    }
+    for (uint32_t tax = i == 0 ? 0 : block.tax_end[i - 1]; tax < block.tax_end[i]; ++tax) {
+      add_tax(query->taxes[block.tax_class[tax]], block, tax);
+    }
+    if (groups) {
+      SalesTotals& group = query->groups[groups[i]];
+      group.sale_count += 1;
+      group.subtotal_cents += block.subtotal_cents[i];
+      group.tip_cents += block.tip_cents[i];
+      group.total_cents += block.total_cents[i];
+      group.given_cents += block.given_cents[i];
+      group.change_cents += block.change_cents[i];
+      group.line_count += block.line_count[i];
+    }
+    for (; line < end; ++line) {
+      query->item_qty[block.line_item[line]] += block.line_qty[line];
+      query->item_revenue_cents[block.line_item[line]] += block.line_revenue_cents[line];
+    }
+  }
+}
+
+}  // namespace cashsloth
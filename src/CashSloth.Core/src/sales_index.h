@@ -0,0 +1,294 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "catalog.h"
+#include "money.h"
+#include "sale_record.h"
+
+namespace cashsloth {
+
+// Sale analytics. Committed sales of the open journal are kept in memory as columns in
+// fixed-size blocks, so a report sums a few contiguous arrays instead of re-reading history.
+// Event, register, operator and payment method are dictionary-encoded. Each block keeps the
+// min/max of its codes and times as a zone map, which lets a filtered query skip blocks, and a
+// full block keeps its own totals so one that matches entirely is added without a row scan.
+constexpr size_t kSalesBlockRows = 2048;
+
+enum SalesDimension : size_t {
+  kSalesEvent,
+  kSalesRegister,
+  kSalesOperator,
+  kSalesPaymentMethod,
+  kSalesDimensionCount,
+};
+
+inline constexpr const char* kSalesDimensionNames[kSalesDimensionCount] = {
+    "event", "register", "operator", "payment_method",
+};
+
+struct SalesTotals {
+  long long sale_count = 0;
+  long long subtotal_cents = 0;
+  long long tip_cents = 0;
+  long long total_cents = 0;
+  long long given_cents = 0;
+  long long change_cents = 0;
+  long long line_count = 0;
+
+  void add(const SalesTotals& other) {
+    sale_count += other.sale_count;
+    subtotal_cents += other.subtotal_cents;
+    tip_cents += other.tip_cents;
+    total_cents += other.total_cents;
+    given_cents += other.given_cents;
+    change_cents += other.change_cents;
+    line_count += other.line_count;
+  }
+
+  // Whether adding `other` keeps every sum within a long long.
+  bool fits(const SalesTotals& other) const {
+    return sale_count <= kMaxCents - other.sale_count &&
+           subtotal_cents <= kMaxCents - other.subtotal_cents &&
+           tip_cents <= kMaxCents - other.tip_cents &&
+           total_cents <= kMaxCents - other.total_cents &&
+           given_cents <= kMaxCents - other.given_cents &&
+           change_cents <= kMaxCents - other.change_cents &&
+           line_count <= kMaxCents - other.line_count;
+  }
+};
+
+struct SalesItemTotal {
+  uint32_t item = 0;
+  long long qty = 0;
+  long long revenue_cents = 0;
+};
+
+struct SalesTaxTotal {
+  uint32_t tax_class = 0;
+  long long sale_count = 0;
+  long long net_cents = 0;
+  long long tax_cents = 0;
+  long long gross_cents = 0;
+};
+
+// Interns labels by their ASCII case-folded form, which is how the app's history filters
+// compare them. A code's label is the first spelling seen.
+class SalesDictionary {
+ public:
+  explicit SalesDictionary(std::pmr::memory_resource* resource)
+      : codes_(resource), labels_(resource), key_(resource) {}
+
+  uint32_t intern(std::string_view label) {
+    fold(label);
+    auto it = codes_.find(key_);
+    if (it != codes_.end()) {
+      return it->second;
+    }
+    const uint32_t code = static_cast<uint32_t>(labels_.size());
+    labels_.emplace_back(label);
+    codes_.emplace(key_, code);
+    return code;
+  }
+
+  // kNoItem when no sale used `label`.
+  uint32_t find(std::string_view label, std::pmr::string* scratch) const {
+    fold_into(label, scratch);
+    auto it = codes_.find(*scratch);
+    return it == codes_.end() ? kNoItem : it->second;
+  }
+
+  size_t size() const { return labels_.size(); }
+  std::string_view label(uint32_t code) const { return labels_[code]; }
+
+ private:
+  static void fold_into(std::string_view text, std::pmr::string* out) {
+    out->assign(text.data(), text.size());
+    for (char& c : *out) {
+      if (c >= 'A' && c <= 'Z') {
+        c = static_cast<char>(c - 'A' + 'a');
+      }
+    }
+  }
+
+  void fold(std::string_view text) { fold_into(text, &key_); }
+
+  std::pmr::unordered_map<std::pmr::string, uint32_t> codes_;
+  std::pmr::vector<std::pmr::string> labels_;
+  std::pmr::string key_;
+};
+
+struct SalesBlock {
+  using Codes = std::pmr::vector<uint32_t>;
+  using Cents = std::pmr::vector<long long>;
+  using ItemTotals = std::pmr::vector<SalesItemTotal>;
+  using TaxTotals = std::pmr::vector<SalesTaxTotal>;
+
+  explicit SalesBlock(std::pmr::memory_resource* resource)
+      : completed_unix_ms(resource),
+        subtotal_cents(resource),
+        tip_cents(resource),
+        total_cents(resource),
+        given_cents(resource),
+        change_cents(resource),
+        line_count(resource),
+        codes{{Codes(resource), Codes(resource), Codes(resource), Codes(resource)}},
+        showcase(resource),
+        line_end(resource),
+        line_item(resource),
+        line_qty(resource),
+        line_revenue_cents(resource),
+        tax_end(resource),
+        tax_class(resource),
+        tax_net_cents(resource),
+        tax_tax_cents(resource),
+        tax_gross_cents(resource),
+        item_totals{{ItemTotals(resource), ItemTotals(resource)}},
+        tax_totals{{TaxTotals(resource), TaxTotals(resource)}} {
+    static_assert(kSalesDimensionCount == 4, "codes lists one column per dimension.");
+    for (size_t d = 0; d < kSalesDimensionCount; ++d) {
+      min_code[d] = kNoItem;
+      max_code[d] = 0;
+    }
+  }
+
+  size_t rows() const { return subtotal_cents.size(); }
+
+  // One entry per sale.
+  Cents completed_unix_ms;
+  Cents subtotal_cents;
+  Cents tip_cents;
+  Cents total_cents;
+  Cents given_cents;
+  Cents change_cents;
+  Cents line_count;
+  std::array<Codes, kSalesDimensionCount> codes;
+  // 1 for showcase sales; the long long width lets the mask loops run without conversions.
+  Cents showcase;
+  // End of each sale's lines in the line columns.
+  std::pmr::vector<uint32_t> line_end;
+
+  // One entry per line.
+  Codes line_item;
+  Cents line_qty;
+  Cents line_revenue_cents;
+
+  // One entry per tax class total; each sale's end is in tax_end. Empty for sales from catalogs
+  // without tax classes.
+  std::pmr::vector<uint32_t> tax_end;
+  Codes tax_class;
+  Cents tax_net_cents;
+  Cents tax_tax_cents;
+  Cents tax_gross_cents;
+
+  // Zone map.
+  long long min_unix_ms = std::numeric_limits<long long>::max();
+  long long max_unix_ms = std::numeric_limits<long long>::min();
+  uint32_t min_code[kSalesDimensionCount];
+  uint32_t max_code[kSalesDimensionCount];
+
+  // Totals of regular ([0]) and showcase ([1]) sales; item and tax totals are filled when the
+  // block is full.
+  SalesTotals totals[2];
+  std::array<ItemTotals, 2> item_totals;
+  std::array<TaxTotals, 2> tax_totals;
+  bool sealed = false;
+};
+
+struct SalesFilter {
+  bool has[kSalesDimensionCount] = {};
+  std::pmr::string text[kSalesDimensionCount];
+  bool include_showcase = false;
+  long long from_unix_ms = std::numeric_limits<long long>::min();
+  long long to_unix_ms = std::numeric_limits<long long>::max();
+};
+
+constexpr size_t kNoSalesGroup = kSalesDimensionCount;
+
+class SalesIndex {
+ public:
+  explicit SalesIndex(std::pmr::memory_resource* resource)
+      : resource_(resource),
+        blocks_(resource),
+        dictionaries_{{SalesDictionary(resource), SalesDictionary(resource),
+                       SalesDictionary(resource), SalesDictionary(resource)}},
+        items_(resource),
+        item_ids_(resource),
+        item_names_(resource),
+        tax_classes_(resource),
+        tax_ids_(resource),
+        tax_rates_(resource),
+        key_(resource) {}
+
+  // Sales with negative amounts are never committed and are left out. Allocation failures
+  // propagate; the caller marks the index incomplete.
+  void add(const SaleView& sale);
+
+  void mark_incomplete() { incomplete_ = true; }
+
+  // Appends the report for `filter` to `out`; returns a CS_ERRC_* code.
+  int query(const SalesFilter& filter, size_t group_by, std::pmr::string* out) const;
+
+ private:
+  struct Query {
+    explicit Query(std::pmr::memory_resource* resource)
+        : groups(resource),
+          item_qty(resource),
+          item_revenue_cents(resource),
+          taxes(resource),
+          mask(resource) {
+      for (uint32_t& c : code) {
+        c = kNoItem;
+      }
+    }
+
+    const SalesFilter* filter = nullptr;
+    size_t group_by = kNoSalesGroup;
+    uint32_t code[kSalesDimensionCount];
+    SalesTotals totals;
+    std::pmr::vector<SalesTotals> groups;
+    std::pmr::vector<long long> item_qty;
+    std::pmr::vector<long long> item_revenue_cents;
+    std::pmr::vector<SalesTaxTotal> taxes;
+    // 1 for rows of the current block that pass the filter.
+    std::pmr::vector<long long> mask;
+  };
+
+  uint32_t intern_item(std::string_view id, std::string_view name);
+
+  // A class is its id and rate, so a rate change starts a new row in reports.
+  uint32_t intern_tax_class(std::string_view id, uint64_t rate);
+  static void add_tax(SalesTaxTotal& total, const SalesBlock& block, uint32_t row);
+  void seal(SalesBlock& block);
+  void aggregate_block(const SalesBlock& block, Query* query) const;
+
+  // Row scan for blocks that match only in part. The filter becomes a 0/1 mask and every sum is
+  // a multiply-add over a column, which compilers vectorize.
+  static void scan_block(const SalesBlock& block, Query* query);
+
+  std::pmr::memory_resource* resource_;
+  std::pmr::deque<SalesBlock> blocks_;
+  std::array<SalesDictionary, kSalesDimensionCount> dictionaries_;
+  std::pmr::unordered_map<std::pmr::string, uint32_t> items_;
+  std::pmr::vector<std::pmr::string> item_ids_;
+  std::pmr::vector<std::pmr::string> item_names_;
+  std::pmr::unordered_map<std::pmr::string, uint32_t> tax_classes_;
+  std::pmr::vector<std::pmr::string> tax_ids_;
+  std::pmr::vector<long long> tax_rates_;
+  std::pmr::string key_;
+  SalesTotals all_;
+  long long all_gross_cents_ = 0;
+  bool incomplete_ = false;
+  bool overflowed_ = false;
+};
+
+}  // namespace cashsloth
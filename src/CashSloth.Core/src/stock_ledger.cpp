@@ -0,0 +1,153 @@
+#include "stock_ledger.h"
+
+#include <cstdio>
+
+#include "cart.h"
+#include "catalog.h"
+#include "mini_json.hpp"
+
+namespace cashsloth {
+namespace {
+
+constexpr size_t kMaxStockItems = 1 << 20;
+constexpr long long kMaxStockUnits = 1000000000000LL;
+
+}  // namespace
+
+int compile_stock_json(const char* json, StockPtr* out) {
+  mini_json::Value root(core_resource(MemoryCategory::kParser));
+  std::string parse_error;
+  if (!mini_json::parse(json, &root, &parse_error)) {
+    set_last_error_text(CS_ERRC_INVALID_VALUE, "Invalid stock JSON: ", parse_error);
+    return CS_ERRC_INVALID_VALUE;
+  }
+  auto items_it = root.is_object() ? root.as_object().find("items") : root.as_object().end();
+  if (!root.is_object() || root.as_object().size() != 1 || items_it == root.as_object().end() ||
+      !items_it->second.is_array()) {
+    set_last_error(CS_ERRC_INVALID_VALUE, "Stock JSON must be an object with an items array.");
+    return CS_ERRC_INVALID_VALUE;
+  }
+  const auto& items = items_it->second.as_array();
+  if (items.size() > kMaxStockItems) {
+    set_last_error(CS_ERRC_INVALID_VALUE, "Stock JSON must not hold more than 2^20 items.");
+    return CS_ERRC_INVALID_VALUE;
+  }
+
+  std::pmr::memory_resource* resource = core_resource(MemoryCategory::kCatalogItems);
+  auto ledger = std::allocate_shared<StockLedger>(
+      std::pmr::polymorphic_allocator<StockLedger>(resource), resource, items.size());
+  ledger->ids.reserve(items.size());
+  for (size_t index = 0; index < items.size(); ++index) {
+    const mini_json::Value& item = items[index];
+    const auto* object = item.is_object() ? &item.as_object() : nullptr;
+    auto id_it = object ? object->find("id") : mini_json::Value::Object::const_iterator();
+    auto available_it =
+        object ? object->find("available") : mini_json::Value::Object::const_iterator();
+    if (!object || object->size() != 2 || id_it == object->end() ||
+        available_it == object->end() || !id_it->second.is_string() ||
+        id_it->second.as_string().empty() || !available_it->second.is_number() ||
+        !available_it->second.number_is_integer() || available_it->second.as_number() < 0 ||
+        available_it->second.as_number() > static_cast<long double>(kMaxStockUnits)) {
+      char prefix[48];
+      std::snprintf(prefix, sizeof(prefix), "Invalid stock item %zu: ", index);
+      set_last_error_text(CS_ERRC_INVALID_VALUE, prefix,
+                          "needs an id and an available count from 0 to 10^12.");
+      return CS_ERRC_INVALID_VALUE;
+    }
+    const mini_json::String& id = id_it->second.as_string();
+    ledger->ids.push_back(
+        StringRef{static_cast<uint32_t>(ledger->strings.size()), static_cast<uint32_t>(id.size())});
+    ledger->strings.append(id.data(), id.size());
+    ledger->counts[index] = static_cast<long long>(available_it->second.as_number());
+  }
+  // Ids view the string pool, so they are indexed once it is complete.
+  ledger->by_id.reserve(items.size());
+  for (uint32_t index = 0; index < ledger->ids.size(); ++index) {
+    if (!ledger->by_id.emplace(ledger->id(index), index).second) {
+      set_last_error(CS_ERRC_INVALID_VALUE, "Duplicate stock item id: ", ledger->id(index));
+      return CS_ERRC_INVALID_VALUE;
+    }
+  }
+  *out = std::move(ledger);
+  return CS_ERRC_NONE;
+}
+
+void append_stock_json(const StockLedger* ledger, std::pmr::string& json) {
+  json += "{\"items\":[";
+  for (uint32_t index = 0; ledger && index < ledger->ids.size(); ++index) {
+    const StockSlot& counts = *ledger->slots[index];
+    json += index == 0 ? "{\"id\":\"" : ",{\"id\":\"";
+    append_json_escaped(json, ledger->id(index));
+    json += "\",\"available\":";
+    append_integer(json, counts.available.load(std::memory_order_relaxed));
+    json += ",\"reserved\":";
+    append_integer(json, counts.reserved.load(std::memory_order_relaxed));
+    json += ",\"sold\":";
+    append_integer(json, counts.sold());
+    json += "}";
+  }
+  json += "]}";
+}
+
+void CartStock::follow(const Cart& cart) {
+  const unsigned long long version = cart.catalog->stock_version.load(std::memory_order_acquire);
+  if (version != version_) {
+    rebase(cart, cart.catalog->acquire_stock(), true);
+    version_ = version;
+  }
+}
+
+int CartStock::sync(const Cart& cart) { return rebind(cart, *cart.catalog); }
+
+int CartStock::rebind(const Cart& cart, const Catalog& catalog) {
+  const unsigned long long version = catalog.stock_version.load(std::memory_order_acquire);
+  const int code = rebase(cart, catalog.acquire_stock(), false);
+  version_ = code == CS_ERRC_NONE ? version : version_;
+  return code;
+}
+
+int CartStock::rebase(const Cart& cart, StockPtr ledger, bool claim) {
+  wanted_.clear();
+  for (const CartLine& line : cart.lines) {
+    StockSlot* slot = ledger ? ledger->slot_of(cart.id_of(line)) : nullptr;
+    if (!slot) {
+      continue;
+    }
+    auto wanted = std::find_if(wanted_.begin(), wanted_.end(),
+                               [slot](const Held& entry) { return entry.slot == slot; });
+    if (wanted == wanted_.end()) {
+      wanted_.push_back(Held{slot, line.qty});
+    } else {
+      wanted->qty += line.qty;
+    }
+  }
+  auto missing = [this](const Held& wanted) { return wanted.qty - qty_of(held_, wanted.slot); };
+  for (size_t i = 0; i < wanted_.size(); ++i) {
+    const long long units = missing(wanted_[i]);
+    if (units <= 0) {
+      continue;
+    }
+    if (claim) {
+      wanted_[i].slot->claim(units);
+    } else if (!wanted_[i].slot->reserve(units)) {
+      for (size_t j = 0; j < i; ++j) {
+        if (missing(wanted_[j]) > 0) {
+          wanted_[j].slot->release(missing(wanted_[j]));
+        }
+      }
+      set_last_error(CS_ERRC_OUT_OF_STOCK, "Out of stock: ", wanted_[i].slot->id);
+      return CS_ERRC_OUT_OF_STOCK;
+    }
+  }
+  for (const Held& held : held_) {
+    const long long extra = held.qty - qty_of(wanted_, held.slot);
+    if (extra > 0) {
+      held.slot->release(extra);
+    }
+  }
+  held_.swap(wanted_);
+  ledger_ = std::move(ledger);
+  return CS_ERRC_NONE;
+}
+
+}  // namespace cashsloth
@@ -0,0 +1,260 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <memory>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "encoding.h"
+#include "errors.h"
+#include "memory.h"
+
+namespace cashsloth {
+
+class Cart;
+class Catalog;
+
+// One item's counts, alone on its cache line so registers selling different items never write
+// to the same line. A unit moves from available to reserved while it is in a cart and leaves
+// reserved when the sale commits. Every count changes on its own, so carts on any thread
+// reserve, release and sell units without a lock.
+struct alignas(64) StockSlot {
+  // Moves `qty` units from available to reserved, or nothing when fewer are available. The
+  // compare-exchange on available alone decides who gets the last unit, so the counts need no
+  // ordering beyond their own.
+  bool reserve(long long qty) {
+    long long units = available.load(std::memory_order_relaxed);
+    do {
+      if (units < qty) {
+        return false;
+      }
+    } while (!available.compare_exchange_weak(units, units - qty, std::memory_order_relaxed));
+    reserved.fetch_add(qty, std::memory_order_relaxed);
+    return true;
+  }
+
+  // Reserves units a cart already had before the item was limited, even past zero.
+  void claim(long long qty) {
+    available.fetch_sub(qty, std::memory_order_relaxed);
+    reserved.fetch_add(qty, std::memory_order_relaxed);
+  }
+
+  void release(long long qty) {
+    reserved.fetch_sub(qty, std::memory_order_relaxed);
+    available.fetch_add(qty, std::memory_order_relaxed);
+  }
+
+  void sell(long long qty) {
+    reserved.fetch_sub(qty, std::memory_order_relaxed);
+    unsold.fetch_sub(qty, std::memory_order_relaxed);
+  }
+
+  // Sets a new count of the item's unsold units, including those in carts: available becomes
+  // `count` minus the reserved units. unsold moves by the same amount as available, so a sale
+  // racing with this lands wholly before or wholly after it.
+  void restock(long long count) {
+    const long long delta = count - unsold.load(std::memory_order_relaxed);
+    unsold.fetch_add(delta, std::memory_order_relaxed);
+    counted.store(count, std::memory_order_relaxed);
+    available.fetch_add(delta, std::memory_order_relaxed);
+  }
+
+  // Units sold since the last restock.
+  long long sold() const {
+    return std::max(0LL, counted.load(std::memory_order_relaxed) -
+                             unsold.load(std::memory_order_relaxed));
+  }
+
+  std::atomic<long long> available{0};
+  std::atomic<long long> reserved{0};
+  // available + reserved; only sales and restocks change it.
+  std::atomic<long long> unsold{0};
+  std::atomic<long long> counted{0};
+  std::string_view id;
+};
+
+// The stock slots of every item a catalog has limited. Slots never move and live as long as
+// the catalog, so a ledger that replaces another takes over the slot of each item it lists
+// again, together with the units carts hold in it.
+class StockSlots {
+ public:
+  explicit StockSlots(std::pmr::memory_resource* resource)
+      : ids_(resource), slots_(resource), by_id_(resource) {}
+
+  // Callers serialize; carts only touch slots they were given.
+  StockSlot* find_or_add(std::string_view item_id) {
+    auto it = by_id_.find(item_id);
+    if (it != by_id_.end()) {
+      return it->second;
+    }
+    const std::pmr::string& id = ids_.emplace_back(item_id);
+    StockSlot& slot = slots_.emplace_back();
+    slot.id = id;
+    by_id_.emplace(slot.id, &slot);
+    return &slot;
+  }
+
+ private:
+  std::pmr::deque<std::pmr::string> ids_;
+  std::pmr::deque<StockSlot> slots_;
+  std::pmr::unordered_map<std::string_view, StockSlot*> by_id_;
+};
+
+// The limited items of one catalog and their counts as set by cs_catalog_set_stock_json. Its
+// items are fixed when it is built; Catalog::set_stock binds them to the catalog's slots. Items
+// it does not list are not limited.
+struct StockLedger {
+  StockLedger(std::pmr::memory_resource* resource, size_t item_count)
+      : strings(resource), ids(resource), counts(item_count, resource), slots(resource),
+        by_id(resource) {}
+  StockLedger(const StockLedger&) = delete;
+  StockLedger& operator=(const StockLedger&) = delete;
+
+  // Null when the item is not limited.
+  StockSlot* slot_of(std::string_view item_id) const {
+    auto it = by_id.find(item_id);
+    return it == by_id.end() ? nullptr : slots[it->second];
+  }
+
+  std::string_view id(uint32_t index) const {
+    return std::string_view(strings.data() + ids[index].offset, ids[index].length);
+  }
+
+  // Item ids back to back, in the order they were loaded; by_id views it.
+  std::pmr::string strings;
+  std::pmr::vector<StringRef> ids;
+  std::pmr::vector<long long> counts;
+  std::pmr::vector<StockSlot*> slots;
+  std::pmr::unordered_map<std::string_view, uint32_t> by_id;
+};
+
+using StockPtr = std::shared_ptr<StockLedger>;
+
+// Builds a ledger from a cs_catalog_set_stock_json document. Returns a CS_ERRC_* code and sets
+// the last error on failure.
+int compile_stock_json(const char* json, StockPtr* out);
+
+// Each count is read on its own, so while carts change an item its three counts may come from
+// slightly different moments; available never shows a unit twice.
+void append_stock_json(const StockLedger* ledger, std::pmr::string& json);
+
+// The units a cart holds, summed per stock slot over its lines. A cart holds few distinct
+// limited items, so a flat list beats a map. Without a ledger, a line change costs one null
+// check.
+class CartStock {
+ public:
+  CartStock()
+      : held_(core_resource(MemoryCategory::kLines)),
+        wanted_(held_.get_allocator().resource()) {}
+
+  // Moves to the cart's catalog's current ledger if it changed, before a change to the lines;
+  // in the steady state this is one atomic load. Items the new ledger lists again keep their
+  // units. Lines of an item it newly limits claim theirs even past zero, and units of items it
+  // no longer lists are returned.
+  void follow(const Cart& cart);
+
+  // Returns every held unit and forgets the ledger; the next follow() or sync() picks one.
+  void drop() {
+    release_all();
+    ledger_.reset();
+    version_ = kNoVersion;
+  }
+
+  // Reserves or returns units for `qty_delta` more of `item_id` in the cart. Returns a CS_ERRC_*
+  // code; CS_ERRC_OUT_OF_STOCK reserves nothing.
+  int change(std::string_view item_id, long long qty_delta) {
+    StockSlot* slot = ledger_ && qty_delta != 0 ? ledger_->slot_of(item_id) : nullptr;
+    if (!slot) {
+      return CS_ERRC_NONE;
+    }
+    auto held = std::find_if(held_.begin(), held_.end(),
+                             [slot](const Held& entry) { return entry.slot == slot; });
+    if (qty_delta < 0) {
+      if (held != held_.end()) {
+        slot->release(std::min(held->qty, -qty_delta));
+        held->qty -= std::min(held->qty, -qty_delta);
+        if (held->qty == 0) {
+          *held = held_.back();
+          held_.pop_back();
+        }
+      }
+      return CS_ERRC_NONE;
+    }
+    const bool first = held == held_.end();
+    if (first) {
+      // Grown before any unit is taken, so a failed allocation leaves the ledger alone.
+      held_.reserve(held_.size() + 1);
+    }
+    if (!slot->reserve(qty_delta)) {
+      set_last_error(CS_ERRC_OUT_OF_STOCK, "Out of stock: ", item_id);
+      return CS_ERRC_OUT_OF_STOCK;
+    }
+    if (first) {
+      held_.push_back(Held{slot, qty_delta});
+    } else {
+      held->qty += qty_delta;
+    }
+    return CS_ERRC_NONE;
+  }
+
+  // Holds exactly what the cart's lines need under `catalog`'s current ledger. Units are
+  // reserved before any are returned, so CS_ERRC_OUT_OF_STOCK changes nothing. Returns a
+  // CS_ERRC_* code.
+  int rebind(const Cart& cart, const Catalog& catalog);
+
+  // rebind() to the cart's own catalog, after its lines changed wholesale.
+  int sync(const Cart& cart);
+
+  // The cart's sale committed: every held unit is sold.
+  void sell_all() {
+    for (const Held& held : held_) {
+      held.slot->sell(held.qty);
+    }
+    held_.clear();
+  }
+
+  void release_all() {
+    for (const Held& held : held_) {
+      held.slot->release(held.qty);
+    }
+    held_.clear();
+  }
+
+ private:
+  struct Held {
+    StockSlot* slot = nullptr;
+    long long qty = 0;
+  };
+
+  static constexpr unsigned long long kNoVersion = std::numeric_limits<unsigned long long>::max();
+
+  static long long qty_of(const std::pmr::vector<Held>& list, const StockSlot* slot) {
+    for (const Held& entry : list) {
+      if (entry.slot == slot) {
+        return entry.qty;
+      }
+    }
+    return 0;
+  }
+
+  // Moves the holdings to what the lines need under `ledger`. With `claim`, missing units are
+  // claimed and this cannot fail.
+  int rebase(const Cart& cart, StockPtr ledger, bool claim);
+
+  // Keeps the slots held_ points into alive.
+  StockPtr ledger_;
+  // The catalog's stock_version when ledger_ was its current ledger.
+  unsigned long long version_ = kNoVersion;
+  std::pmr::vector<Held> held_;
+  // rebase() scratch; keeps its capacity, swapped with held_ on success.
+  std::pmr::vector<Held> wanted_;
+};
+
+}  // namespace cashsloth
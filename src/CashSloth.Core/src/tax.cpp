@@ -0,0 +1,56 @@
+#include "tax.h"
+
+#include "cart.h"
+#include "encoding.h"
+
+namespace cashsloth {
+
+size_t CartTax::slot_of(const Cart& cart, const CartLine& line) const {
+  const uint32_t tax_class =
+      line.item_index == kNoItem ? kNoTaxClass : cart.snapshot->items[line.item_index].tax_class;
+  return tax_class == kNoTaxClass ? sums_.size() - 1 : tax_class;
+}
+
+void CartTax::recount(const Cart& cart) {
+  const size_t classes = cart.snapshot->tax_class_ids.size();
+  sums_.assign(classes == 0 ? 0 : classes + 1, Sum());
+  for (const CartLine& line : cart.lines) {
+    line_changed(cart, line, line.qty, 1);
+  }
+}
+
+void CartTax::line_changed(const Cart& cart, const CartLine& line, long long qty_delta,
+                           int lines_delta) {
+  if (sums_.empty()) {
+    return;
+  }
+  Sum& sum = sums_[slot_of(cart, line)];
+  sum.cents += static_cast<unsigned long long>(line.unit_cents) *
+               static_cast<unsigned long long>(qty_delta);
+  sum.lines += static_cast<uint32_t>(lines_delta);
+}
+
+void append_tax_total_json(std::pmr::string& json, std::string_view tax_class, long long rate,
+                           const TaxTotal& total, bool first) {
+  json += first ? "{\"class\":\"" : ",{\"class\":\"";
+  append_json_escaped(json, tax_class);
+  json += "\",\"rate_basis_points\":";
+  append_integer(json, rate);
+  json += ",\"net_cents\":";
+  append_integer(json, total.net_cents);
+  json += ",\"tax_cents\":";
+  append_integer(json, total.tax_cents);
+  json += ",\"gross_cents\":";
+  append_integer(json, total.gross_cents);
+  json += "}";
+}
+
+void append_tax_total_json(std::pmr::string& json, const CatalogSnapshot& snapshot,
+                           const TaxTotal& total, bool first) {
+  const bool classed = total.tax_class != kNoTaxClass;
+  append_tax_total_json(json, classed ? std::string_view(snapshot.tax_class_ids[total.tax_class])
+                                      : std::string_view(),
+                        classed ? snapshot.tax_rates[total.tax_class] : 0, total, first);
+}
+
+}  // namespace cashsloth
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "catalog.h"
+#include "memory.h"
+#include "pricing.h"
+
+namespace cashsloth {
+
+class Cart;
+struct CartLine;
+
+// One tax class's share of a cart or sale. Inclusive prices split the gross into net and tax;
+// exclusive prices add the tax to the net.
+struct TaxTotal {
+  uint32_t tax_class = kNoTaxClass;
+  long long net_cents = 0;
+  long long tax_cents = 0;
+  long long gross_cents = 0;
+};
+
+// A cart's line totals summed per tax class of its snapshot, with one more slot for lines
+// without a class. Each line change adds its difference, so reading the breakdown costs
+// O(classes) plus the lines that pricing rules discount. Carts whose catalog has no tax classes
+// keep no slots.
+class CartTax {
+ public:
+  CartTax()
+      : sums_(core_resource(MemoryCategory::kLines)),
+        discounts_(sums_.get_allocator().resource()),
+        line_discounts_(sums_.get_allocator().resource()) {}
+
+  bool enabled() const { return !sums_.empty(); }
+
+  // Sizes the slots for the cart's snapshot and sums its lines again.
+  void recount(const Cart& cart);
+
+  void cleared() { std::fill(sums_.begin(), sums_.end(), Sum()); }
+
+  // `line` gained `qty_delta` units; `lines_delta` is +1 for a new line and -1 for a removed one.
+  void line_changed(const Cart& cart, const CartLine& line, long long qty_delta, int lines_delta);
+
+  // Calls `visit(const TaxTotal&)` for each class with lines, in catalog order, then for the
+  // lines without one. False when an amount overflows. Needs the cart's total to fit.
+  template <typename Visit>
+  bool for_each_class(const Cart& cart, Visit&& visit) const;
+
+ private:
+  // Sums wrap like unsigned integers; they are exact again once every line's total fits.
+  struct Sum {
+    unsigned long long cents = 0;
+    uint32_t lines = 0;
+  };
+
+  size_t slot_of(const Cart& cart, const CartLine& line) const;
+
+  std::pmr::vector<Sum> sums_;
+  // Read scratch; keeps its capacity across reads.
+  mutable std::pmr::vector<long long> discounts_;
+  mutable std::pmr::vector<LineDiscount> line_discounts_;
+};
+
+// amount * rate / divisor rounded half up, for amount >= 0 and rate <= divisor <=
+// 2 * kMaxTaxRate, without an intermediate product that could overflow.
+inline long long tax_share(long long amount, long long rate, long long divisor) {
+  return amount / divisor * rate + (amount % divisor * rate * 2 + divisor) / (divisor * 2);
+}
+
+// {"class":"A","rate_basis_points":1900,"net_cents":..,"tax_cents":..,"gross_cents":..}, with
+// an empty class and rate 0 for lines without a tax class.
+void append_tax_total_json(std::pmr::string& json, std::string_view tax_class, long long rate,
+                           const TaxTotal& total, bool first);
+void append_tax_total_json(std::pmr::string& json, const CatalogSnapshot& snapshot,
+                           const TaxTotal& total, bool first);
+
+}  // namespace cashsloth
@@ -4,6 +4,7 @@
 #include <cstddef>
 #include <cstdint>
 #include <cstdlib>
+#include <memory_resource>
 #include <string>
 #include <string_view>
 #include <unordered_map>
@@ -12,6 +13,10 @@
 
 namespace mini_json {
 
+// Every string, array and object of a parsed tree is allocated from the resource of the Value
+// passed to parse(), so a whole document can live in one arena.
+using String = std::pmr::string;
+
 class Value {
  public:
   enum class Type {
@@ -23,41 +28,49 @@ class Value {
     kObject
   };
 
-  Value() : type_(Type::kNull) {}
+  using Array = std::pmr::vector<Value>;
+  using Object = std::pmr::unordered_map<String, Value>;
+
+  explicit Value(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+      : type_(Type::kNull),
+        string_value_(resource),
+        array_value_(resource),
+        object_value_(resource) {}
 
-  static Value make_null() { return Value(); }
+  static Value make_null(std::pmr::memory_resource* resource) { return Value(resource); }
 
-  static Value make_bool(bool value) {
-    Value result;
+  static Value make_bool(bool value, std::pmr::memory_resource* resource) {
+    Value result(resource);
     result.type_ = Type::kBool;
     result.bool_value_ = value;
     return result;
   }
 
-  static Value make_number(long double value, bool is_integer) {
-    Value result;
+  static Value make_number(long double value, bool is_integer,
+                           std::pmr::memory_resource* resource) {
+    Value result(resource);
     result.type_ = Type::kNumber;
     result.number_value_ = value;
     result.number_is_integer_ = is_integer;
     return result;
   }
 
-  static Value make_string(std::string value) {
-    Value result;
+  static Value make_string(String value) {
+    Value result(value.get_allocator().resource());
     result.type_ = Type::kString;
     result.string_value_ = std::move(value);
     return result;
   }
 
-  static Value make_array(std::vector<Value> value) {
-    Value result;
+  static Value make_array(Array value) {
+    Value result(value.get_allocator().resource());
     result.type_ = Type::kArray;
     result.array_value_ = std::move(value);
     return result;
   }
 
-  static Value make_object(std::unordered_map<std::string, Value> value) {
-    Value result;
+  static Value make_object(Object value) {
+    Value result(value.get_allocator().resource());
     result.type_ = Type::kObject;
     result.object_value_ = std::move(value);
     return result;
@@ -73,23 +86,25 @@ class Value {
   bool as_bool() const { return bool_value_; }
   long double as_number() const { return number_value_; }
   bool number_is_integer() const { return number_is_integer_; }
-  const std::string& as_string() const { return string_value_; }
-  const std::vector<Value>& as_array() const { return array_value_; }
-  const std::unordered_map<std::string, Value>& as_object() const { return object_value_; }
+  const String& as_string() const { return string_value_; }
+  const Array& as_array() const { return array_value_; }
+  const Object& as_object() const { return object_value_; }
+  std::pmr::memory_resource* resource() const { return string_value_.get_allocator().resource(); }
 
  private:
   Type type_;
   bool bool_value_ = false;
   long double number_value_ = 0;
   bool number_is_integer_ = false;
-  std::string string_value_;
-  std::vector<Value> array_value_;
-  std::unordered_map<std::string, Value> object_value_;
+  String string_value_;
+  Array array_value_;
+  Object object_value_;
 };
 
 class Parser {
  public:
-  explicit Parser(std::string_view input) : input_(input) {}
+  Parser(std::string_view input, std::pmr::memory_resource* resource)
+      : input_(input), resource_(resource) {}
 
   bool parse(Value* out_value, std::string* out_error) {
     skip_whitespace();
@@ -115,18 +130,18 @@ class Parser {
     skip_whitespace();
     if (pos_ >= input_.size()) {
       set_error(out_error, "Unexpected end of input.");
-      return Value::make_null();
+      return Value::make_null(resource_);
     }
 
     char ch = input_[pos_];
     if (ch == 'n') {
-      return parse_literal("null", Value::make_null(), out_error);
+      return parse_literal("null", Value::make_null(resource_), out_error);
     }
     if (ch == 't') {
-      return parse_literal("true", Value::make_bool(true), out_error);
+      return parse_literal("true", Value::make_bool(true, resource_), out_error);
     }
     if (ch == 'f') {
-      return parse_literal("false", Value::make_bool(false), out_error);
+      return parse_literal("false", Value::make_bool(false, resource_), out_error);
     }
     if (ch == '"') {
       return Value::make_string(parse_string(out_error));
@@ -142,7 +157,7 @@ class Parser {
     }
 
     set_error(out_error, "Invalid JSON value.");
-    return Value::make_null();
+    return Value::make_null(resource_);
   }
 
   Value parse_literal(std::string_view literal, Value value, std::string* out_error) {
@@ -151,17 +166,17 @@ class Parser {
       return value;
     }
     set_error(out_error, "Invalid literal.");
-    return Value::make_null();
+    return Value::make_null(resource_);
   }
 
   Value parse_array(std::string* out_error) {
     if (!consume('[')) {
       set_error(out_error, "Expected '['.");
-      return Value::make_null();
+      return Value::make_null(resource_);
     }
 
     skip_whitespace();
-    std::vector<Value> values;
+    Value::Array values(resource_);
     if (consume(']')) {
       return Value::make_array(std::move(values));
     }
@@ -169,7 +184,7 @@ class Parser {
     while (pos_ < input_.size()) {
       Value value = parse_value(out_error);
       if (!out_error->empty()) {
-        return Value::make_null();
+        return Value::make_null(resource_);
       }
       values.push_back(std::move(value));
       skip_whitespace();
@@ -178,23 +193,23 @@ class Parser {
       }
       if (!consume(',')) {
         set_error(out_error, "Expected ',' in array.");
-        return Value::make_null();
+        return Value::make_null(resource_);
       }
       skip_whitespace();
     }
 
     set_error(out_error, "Unterminated array.");
-    return Value::make_null();
+    return Value::make_null(resource_);
   }
 
   Value parse_object(std::string* out_error) {
     if (!consume('{')) {
       set_error(out_error, "Expected '{'.");
-      return Value::make_null();
+      return Value::make_null(resource_);
     }
 
     skip_whitespace();
-    std::unordered_map<std::string, Value> values;
+    Value::Object values(resource_);
     if (consume('}')) {
       return Value::make_object(std::move(values));
     }
@@ -202,20 +217,20 @@ class Parser {
     while (pos_ < input_.size()) {
       if (input_[pos_] != '"') {
         set_error(out_error, "Expected object key string.");
-        return Value::make_null();
+        return Value::make_null(resource_);
       }
-      std::string key = parse_string(out_error);
+      String key = parse_string(out_error);
       if (!out_error->empty()) {
-        return Value::make_null();
+        return Value::make_null(resource_);
       }
       skip_whitespace();
       if (!consume(':')) {
         set_error(out_error, "Expected ':' after object key.");
-        return Value::make_null();
+        return Value::make_null(resource_);
       }
       Value value = parse_value(out_error);
       if (!out_error->empty()) {
-        return Value::make_null();
+        return Value::make_null(resource_);
       }
       values.emplace(std::move(key), std::move(value));
       skip_whitespace();
@@ -224,13 +239,13 @@ class Parser {
       }
       if (!consume(',')) {
         set_error(out_error, "Expected ',' in object.");
-        return Value::make_null();
+        return Value::make_null(resource_);
       }
       skip_whitespace();
     }
 
     set_error(out_error, "Unterminated object.");
-    return Value::make_null();
+    return Value::make_null(resource_);
   }
 
   Value parse_number(std::string* out_error) {
@@ -241,7 +256,7 @@ class Parser {
     if (consume('-')) {
       if (pos_ >= input_.size()) {
         set_error(out_error, "Invalid number.");
-        return Value::make_null();
+        return Value::make_null(resource_);
       }
     }
 
@@ -253,14 +268,14 @@ class Parser {
       }
     } else {
       set_error(out_error, "Invalid number.");
-      return Value::make_null();
+      return Value::make_null(resource_);
     }
 
     if (consume('.')) {
       has_fraction = true;
       if (!std::isdigit(static_cast<unsigned char>(peek()))) {
         set_error(out_error, "Invalid fractional number.");
-        return Value::make_null();
+        return Value::make_null(resource_);
       }
       while (std::isdigit(static_cast<unsigned char>(peek()))) {
         ++pos_;
@@ -275,31 +290,31 @@ class Parser {
       }
       if (!std::isdigit(static_cast<unsigned char>(peek()))) {
         set_error(out_error, "Invalid exponent.");
-        return Value::make_null();
+        return Value::make_null(resource_);
       }
       while (std::isdigit(static_cast<unsigned char>(peek()))) {
         ++pos_;
       }
     }
 
-    std::string number_text(input_.substr(start, pos_ - start));
+    String number_text(input_.substr(start, pos_ - start), resource_);
     char* end_ptr = nullptr;
     long double value = std::strtold(number_text.c_str(), &end_ptr);
     if (!end_ptr || *end_ptr != '\0') {
       set_error(out_error, "Invalid number.");
-      return Value::make_null();
+      return Value::make_null(resource_);
     }
 
-    return Value::make_number(value, !(has_fraction || has_exponent));
+    return Value::make_number(value, !(has_fraction || has_exponent), resource_);
   }
 
-  std::string parse_string(std::string* out_error) {
+  String parse_string(std::string* out_error) {
+    String result(resource_);
     if (!consume('"')) {
       set_error(out_error, "Expected string.");
-      return {};
+      return result;
     }
 
-    std::string result;
     while (pos_ < input_.size()) {
       char ch = input_[pos_++];
       if (ch == '"') {
@@ -307,12 +322,12 @@ class Parser {
       }
       if (static_cast<unsigned char>(ch) < 0x20) {
         set_error(out_error, "Control character in string.");
-        return {};
+        return result;
       }
       if (ch == '\\') {
         if (pos_ >= input_.size()) {
           set_error(out_error, "Unterminated escape sequence.");
-          return {};
+          return result;
         }
         char esc = input_[pos_++];
         switch (esc) {
@@ -338,12 +353,12 @@ class Parser {
             break;
           case 'u':
             if (!parse_unicode_escape(&result, out_error)) {
-              return {};
+              return result;
             }
             break;
           default:
             set_error(out_error, "Invalid escape sequence.");
-            return {};
+            return result;
         }
       } else {
         result.push_back(ch);
@@ -351,10 +366,10 @@ class Parser {
     }
 
     set_error(out_error, "Unterminated string.");
-    return {};
+    return result;
   }
 
-  bool parse_unicode_escape(std::string* output, std::string* out_error) {
+  bool parse_unicode_escape(String* output, std::string* out_error) {
     if (pos_ + 4 > input_.size()) {
       set_error(out_error, "Invalid unicode escape.");
       return false;
@@ -379,7 +394,7 @@ class Parser {
     return true;
   }
 
-  void append_utf8(uint32_t codepoint, std::string* output) {
+  void append_utf8(uint32_t codepoint, String* output) {
     if (codepoint <= 0x7F) {
       output->push_back(static_cast<char>(codepoint));
     } else if (codepoint <= 0x7FF) {
@@ -425,14 +440,16 @@ class Parser {
   }
 
   std::string_view input_;
+  std::pmr::memory_resource* resource_;
   size_t pos_ = 0;
 };
 
+// The parsed tree is allocated from `out_value`'s resource.
 inline bool parse(std::string_view input, Value* out_value, std::string* out_error) {
   std::string fallback_error;
   std::string* error_ptr = out_error ? out_error : &fallback_error;
   error_ptr->clear();
-  Parser parser(input);
+  Parser parser(input, out_value->resource());
   return parser.parse(out_value, error_ptr);
 }
 
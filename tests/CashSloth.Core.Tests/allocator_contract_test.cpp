@@ -0,0 +1,404 @@
+#include "cashsloth_core.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+
+bool check(bool condition, const char* message) {
+  if (!condition) {
+    std::cerr << message << "\n";
+    return false;
+  }
+  return true;
+}
+
+// Bump arena that never reuses memory, plus an allocation budget: once the budget reaches zero
+// every further allocation fails. A budget of -1 is unlimited. The budget applies to the main
+// thread only unless g_budget_all_threads is set, so the loader thread is not starved by a sweep
+// that has just ended.
+constexpr size_t kArenaSize = 64 * 1024 * 1024;
+alignas(64) unsigned char g_arena[kArenaSize];
+std::atomic<size_t> g_arena_used{0};
+std::atomic<long long> g_budget{-1};
+std::atomic<unsigned long long> g_allocations{0};
+std::atomic<unsigned long long> g_deallocations{0};
+std::atomic<bool> g_fail_background{false};
+std::atomic<bool> g_budget_all_threads{false};
+std::thread::id g_main_thread;
+
+void* arena_allocate(void*, size_t size, size_t alignment) {
+  const bool main_thread = std::this_thread::get_id() == g_main_thread;
+  if (g_fail_background.load() && !main_thread) {
+    return nullptr;
+  }
+  if (main_thread || g_budget_all_threads.load()) {
+    long long budget = g_budget.load();
+    while (budget > 0 && !g_budget.compare_exchange_weak(budget, budget - 1)) {
+    }
+    if (budget == 0) {
+      return nullptr;
+    }
+  }
+
+  size_t used = g_arena_used.load();
+  size_t offset = 0;
+  do {
+    offset = (used + alignment - 1) / alignment * alignment;
+    if (offset + size > kArenaSize) {
+      return nullptr;
+    }
+  } while (!g_arena_used.compare_exchange_weak(used, offset + size));
+  g_allocations.fetch_add(1);
+  return g_arena + offset;
+}
+
+void arena_deallocate(void*, void* ptr, size_t, size_t) {
+  if (ptr) {
+    g_deallocations.fetch_add(1);
+  }
+}
+
+bool in_arena(const void* ptr) {
+  const unsigned char* p = static_cast<const unsigned char*>(ptr);
+  return p >= g_arena && p < g_arena + kArenaSize;
+}
+
+// Runs `op` with a budget of 0, 1, 2, ... allocations until it succeeds. Every attempt before
+// that must fail cleanly with CS_ERROR_OUT_OF_MEMORY.
+template <typename Op>
+bool sweep_out_of_memory(const char* name, Op op) {
+  for (long long budget = 0; budget < 100000; ++budget) {
+    g_budget.store(budget);
+    const int result = op();
+    g_budget.store(-1);
+    if (result == CS_SUCCESS) {
+      return true;
+    }
+    if (result != CS_ERROR_OUT_OF_MEMORY) {
+      std::cerr << name << " returned " << result << " with an allocation budget of " << budget
+                << ": " << cs_last_error() << "\n";
+      return false;
+    }
+  }
+  std::cerr << name << " never succeeded.\n";
+  return false;
+}
+
+std::string catalog_json_of(cs_catalog_t catalog) {
+  char* json = nullptr;
+  if (cs_catalog_instance_get_json(catalog, &json) != CS_SUCCESS) {
+    return std::string();
+  }
+  std::string result(json);
+  cs_free(json);
+  return result;
+}
+
+std::string make_large_catalog(int items, int unit_cents) {
+  std::string json = "{\"items\":[";
+  for (int i = 0; i < items; ++i) {
+    if (i > 0) {
+      json += ",";
+    }
+    json += "{\"id\":\"SKU-" + std::to_string(i) + "\",\"name\":\"Item number " +
+            std::to_string(i) + "\",\"unit_cents\":" + std::to_string(unit_cents) +
+            ",\"names\":{\"de\":\"Artikel " + std::to_string(i) + "\"}}";
+  }
+  json += "]}";
+  return json;
+}
+
+int main() {
+  g_main_thread = std::this_thread::get_id();
+
+  cs_allocator incomplete = {arena_allocate, nullptr, nullptr};
+  if (!check(cs_set_allocator(&incomplete) == CS_ERROR_INVALID_ARGUMENT,
+             "An allocator without deallocate should be rejected.")) {
+    return 1;
+  }
+  cs_allocator arena = {arena_allocate, arena_deallocate, nullptr};
+  if (!check(cs_set_allocator(&arena) == CS_SUCCESS, "cs_set_allocator failed.")) {
+    return 1;
+  }
+  if (cs_init() != CS_SUCCESS) {
+    std::cerr << "cs_init failed: " << cs_last_error() << "\n";
+    return 1;
+  }
+  if (!check(cs_set_allocator(nullptr) == CS_ERROR_INVALID_ARGUMENT,
+             "cs_set_allocator should fail after cs_init.")) {
+    cs_shutdown();
+    return 1;
+  }
+
+  // Returned buffers come from the installed allocator and go back to it through cs_free.
+  char* version_json = nullptr;
+  if (!check(cs_get_version(&version_json) == CS_SUCCESS && in_arena(version_json),
+             "cs_get_version should allocate its buffer from the installed allocator.")) {
+    cs_shutdown();
+    return 1;
+  }
+  const unsigned long long deallocations_before_free = g_deallocations.load();
+  cs_free(version_json);
+  if (!check(g_deallocations.load() == deallocations_before_free + 1,
+             "cs_free should return the buffer to the installed allocator.")) {
+    cs_shutdown();
+    return 1;
+  }
+
+  cs_catalog_t catalog = nullptr;
+  if (!check(cs_catalog_get_default(&catalog) == CS_SUCCESS, "cs_catalog_get_default failed.")) {
+    cs_shutdown();
+    return 1;
+  }
+  const char* catalog_json =
+      "{\"items\":[{\"id\":\"COFFEE-HOUSE-BLEND-LARGE\",\"name\":\"Coffee\",\"unit_cents\":500,"
+      "\"names\":{\"de\":\"Kaffee\"}},"
+      "{\"id\":\"CROISSANT-BUTTER-CLASSIC\",\"name\":\"Croissant\",\"unit_cents\":350}]}";
+  const unsigned long long allocations_before_load = g_allocations.load();
+  if (!check(sweep_out_of_memory("cs_catalog_load_json",
+                                 [&] { return cs_catalog_load_json(catalog_json); }),
+             "Catalog load out-of-memory sweep failed.")) {
+    cs_shutdown();
+    return 1;
+  }
+  if (!check(g_allocations.load() > allocations_before_load,
+             "Catalog loads should allocate from the installed allocator.")) {
+    cs_shutdown();
+    return 1;
+  }
+
+  // A failed reload leaves the published catalog untouched.
+  const std::string loaded_json = catalog_json_of(catalog);
+  const char* repriced_json =
+      "{\"items\":[{\"id\":\"COFFEE-HOUSE-BLEND-LARGE\",\"name\":\"Coffee\",\"unit_cents\":550},"
+      "{\"id\":\"CROISSANT-BUTTER-CLASSIC\",\"name\":\"Croissant\",\"unit_cents\":375}]}";
+  g_budget.store(3);
+  const int failed_reload = cs_catalog_load_json(repriced_json);
+  g_budget.store(-1);
+  if (!check(failed_reload == CS_ERROR_OUT_OF_MEMORY && catalog_json_of(catalog) == loaded_json,
+             "A reload that runs out of memory should keep the previous catalog.")) {
+    cs_shutdown();
+    return 1;
+  }
+
+  char* json = nullptr;
+  if (!check(sweep_out_of_memory("cs_get_version", [&] { return cs_get_version(&json); }),
+             "Version out-of-memory sweep failed.")) {
+    cs_shutdown();
+    return 1;
+  }
+  cs_free(json);
+  if (!check(sweep_out_of_memory("cs_catalog_get_json", [&] { return cs_catalog_get_json(&json); }),
+             "Catalog JSON out-of-memory sweep failed.")) {
+    cs_shutdown();
+    return 1;
+  }
+  cs_free(json);
+  if (!check(sweep_out_of_memory("cs_catalog_set_display_locale",
+                                 [&] {
+                                   return cs_catalog_set_display_locale(
+                                       catalog, "de-CH-x-point-of-sale-terminal");
+                                 }),
+             "Catalog locale out-of-memory sweep failed.")) {
+    cs_shutdown();
+    return 1;
+  }
+
+  // Failed cs_catalog_new calls must not register the name, or the final call would collide.
+  cs_catalog_t festival = nullptr;
+  if (!check(sweep_out_of_memory("cs_catalog_new",
+                                 [&] { return cs_catalog_new("festival", &festival); }),
+             "Catalog creation out-of-memory sweep failed.")) {
+    cs_shutdown();
+    return 1;
+  }
+  if (!check(sweep_out_of_memory("cs_catalog_instance_load_json",
+                                 [&] { return cs_catalog_instance_load_json(festival, catalog_json); }),
+             "Catalog instance load out-of-memory sweep failed.")) {
+    cs_catalog_free(festival);
+    cs_shutdown();
+    return 1;
+  }
+  cs_catalog_free(festival);
+
+  // The first cart grows the pool by one slab.
+  cs_cart_t cart = nullptr;
+  if (!check(sweep_out_of_memory("cs_cart_new", [&] { return cs_cart_new(&cart); }),
+             "Cart creation out-of-memory sweep failed.")) {
+    cs_shutdown();
+    return 1;
+  }
+  if (!check(sweep_out_of_memory("cs_cart_add_item_by_id",
+                                 [&] {
+                                   return cs_cart_add_item_by_id(cart, "COFFEE-HOUSE-BLEND-LARGE",
+                                                                 2);
+                                 }),
+             "Cart add out-of-memory sweep failed.")) {
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+  if (!check(sweep_out_of_memory("cs_cart_set_display_locale",
+                                 [&] {
+                                   return cs_cart_set_display_locale(
+                                       cart, "de-CH-x-customer-display-locale");
+                                 }),
+             "Cart locale out-of-memory sweep failed.")) {
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+  if (!check(sweep_out_of_memory("cs_cart_get_lines_json",
+                                 [&] { return cs_cart_get_lines_json(cart, &json); }),
+             "Cart JSON out-of-memory sweep failed.")) {
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+  const bool localized = std::strstr(json, "\"name\":\"Kaffee\"") != nullptr;
+  cs_free(json);
+  if (!check(localized, "Cart JSON should use the cart's display locale.")) {
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+
+  // Reprice builds its report and reserves its undo records first, so failed attempts leave the
+  // stored price and the history alone.
+  if (!check(cs_catalog_load_json(repriced_json) == CS_SUCCESS &&
+                 cs_cart_checkpoint(cart) == CS_SUCCESS,
+             "Catalog reprice load failed.")) {
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+  long long total_cents = 0;
+  if (!check(sweep_out_of_memory("cs_cart_reprice",
+                                 [&]() -> int {
+                                   const int result =
+                                       cs_cart_reprice(cart, CS_REPRICE_KEEP_VANISHED, &json);
+                                   if (result != CS_SUCCESS &&
+                                       (cs_cart_get_total_cents(cart, &total_cents) != CS_SUCCESS ||
+                                        total_cents != 1000)) {
+                                     return CS_ERROR_INTERNAL;
+                                   }
+                                   return result;
+                                 }),
+             "Cart reprice out-of-memory sweep failed.")) {
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+  cs_free(json);
+  if (!check(cs_cart_get_total_cents(cart, &total_cents) == CS_SUCCESS && total_cents == 1100,
+             "Reprice should apply once it succeeds.")) {
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+  if (!check(cs_cart_undo(cart) == CS_SUCCESS &&
+                 cs_cart_get_total_cents(cart, &total_cents) == CS_SUCCESS &&
+                 total_cents == 1000 && cs_cart_undo(cart) == CS_ERROR_INVALID_ARGUMENT &&
+                 cs_cart_redo(cart) == CS_SUCCESS &&
+                 cs_cart_get_total_cents(cart, &total_cents) == CS_SUCCESS && total_cents == 1100,
+             "Reprice should record one undo step.")) {
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+
+  cs_load_ticket_t ticket = nullptr;
+  if (!check(sweep_out_of_memory("cs_catalog_load_json_async",
+                                 [&] {
+                                   return cs_catalog_load_json_async(catalog, catalog_json, nullptr,
+                                                                     nullptr, &ticket);
+                                 }),
+             "Async submit out-of-memory sweep failed.")) {
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+  int state = CS_LOAD_PENDING;
+  if (!check(cs_load_ticket_wait(ticket, -1, &state) == CS_SUCCESS && state == CS_LOAD_SUCCEEDED,
+             "Async load should succeed once submitted.")) {
+    cs_load_ticket_free(ticket);
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+  cs_load_ticket_free(ticket);
+
+  // Allocation failures on the loader thread fail the ticket instead of the process.
+  g_fail_background.store(true);
+  const int submitted =
+      cs_catalog_load_json_async(catalog, repriced_json, nullptr, nullptr, &ticket);
+  if (!check(submitted == CS_SUCCESS, "Async submit on the main thread should succeed.")) {
+    g_fail_background.store(false);
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+  const int waited = cs_load_ticket_wait(ticket, -1, &state);
+  g_fail_background.store(false);
+  if (!check(waited == CS_SUCCESS && state == CS_LOAD_FAILED &&
+                 std::strstr(cs_last_error(), "Out of memory") != nullptr,
+             "A background load without memory should fail its ticket.")) {
+    cs_load_ticket_free(ticket);
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+  cs_load_ticket_free(ticket);
+
+  // Parallel loads surface worker-thread allocation failures as CS_ERROR_OUT_OF_MEMORY too.
+  if (!check(cs_catalog_set_load_threads(4) == CS_SUCCESS, "cs_catalog_set_load_threads failed.")) {
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+  const std::string large_catalog = make_large_catalog(2048, 100);
+  const std::string large_reload = make_large_catalog(2048, 200);
+  if (!check(cs_catalog_load_json(large_catalog.c_str()) == CS_SUCCESS,
+             "Parallel catalog load failed.")) {
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+  const std::string large_json = catalog_json_of(catalog);
+  const unsigned long long before_large_reload = g_allocations.load();
+  if (!check(cs_catalog_load_json(large_reload.c_str()) == CS_SUCCESS,
+             "Parallel catalog reload failed.")) {
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+  const long long reload_allocations =
+      static_cast<long long>(g_allocations.load() - before_large_reload);
+  if (!check(cs_catalog_load_json(large_catalog.c_str()) == CS_SUCCESS,
+             "Parallel catalog load failed.")) {
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+  g_budget_all_threads.store(true);
+  for (int step = 0; step < 8; ++step) {
+    g_budget.store(reload_allocations * step / 8);
+    const int result = cs_catalog_load_json(large_reload.c_str());
+    g_budget.store(-1);
+    if (!check(result == CS_ERROR_OUT_OF_MEMORY && catalog_json_of(catalog) == large_json,
+               "A parallel load that runs out of memory should fail cleanly.")) {
+      g_budget_all_threads.store(false);
+      cs_cart_free(cart);
+      cs_shutdown();
+      return 1;
+    }
+  }
+  g_budget_all_threads.store(false);
+
+  cs_cart_free(cart);
+  cs_shutdown();
+  return 0;
+}
@@ -0,0 +1,240 @@
+#include "cashsloth_core.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+bool check(bool condition, const char* message) {
+  if (!condition) {
+    std::cerr << message << "\n";
+    return false;
+  }
+  return true;
+}
+
+constexpr int kItemCount = 64;
+constexpr int kCartCount = 2000;
+constexpr int kOpsPerThread = 20000;
+
+std::string make_catalog(int price_offset) {
+  std::string json = "{\"items\":[";
+  for (int i = 0; i < kItemCount; ++i) {
+    if (i > 0) {
+      json += ",";
+    }
+    json += "{\"id\":\"ITEM-" + std::to_string(i) + "\",\"name\":\"Item " + std::to_string(i) +
+            "\",\"unit_cents\":" + std::to_string(100 + i + price_offset) + "}";
+  }
+  json += "]}";
+  return json;
+}
+
+uint32_t next_random(uint32_t* state) {
+  *state = *state * 1664525u + 1013904223u;
+  return *state >> 8;
+}
+
+// Sums the numbers following every occurrence of `key`.
+long long sum_after(const std::string& json, const char* key) {
+  long long sum = 0;
+  for (size_t pos = json.find(key); pos != std::string::npos; pos = json.find(key, pos + 1)) {
+    sum += std::atoll(json.c_str() + pos + std::strlen(key));
+  }
+  return sum;
+}
+
+std::string lines_json(cs_cart_t cart) {
+  char* json = nullptr;
+  if (cs_cart_get_lines_json(cart, &json) != CS_SUCCESS) {
+    return std::string();
+  }
+  std::string result(json);
+  cs_free(json);
+  return result;
+}
+
+// One snapshot of a cart is self-consistent: its total is the sum of the line totals it shows.
+bool consistent(const std::string& json) {
+  const size_t total_pos = json.find("],\"total_cents\":");
+  return total_pos != std::string::npos &&
+         sum_after(json, "\"line_total_cents\":") ==
+             std::atoll(json.c_str() + total_pos + std::strlen("],\"total_cents\":"));
+}
+
+unsigned thread_count() {
+  const unsigned hardware = std::thread::hardware_concurrency();
+  return std::min(32u, std::max(4u, hardware));
+}
+
+// Many threads add to randomly chosen shared carts while the catalog keeps reloading.
+bool run_shared_carts(cs_catalog_t catalog) {
+  std::vector<cs_cart_t> carts(kCartCount, nullptr);
+  for (cs_cart_t& cart : carts) {
+    if (cs_cart_new_concurrent(catalog, &cart) != CS_SUCCESS) {
+      std::cerr << "cs_cart_new_concurrent failed: " << cs_last_error() << "\n";
+      return false;
+    }
+  }
+
+  std::atomic<bool> done{false};
+  std::atomic<long long> adds{0};
+  std::atomic<int> failures{0};
+  std::thread reloader([&] {
+    const std::string catalogs[] = {make_catalog(0), make_catalog(50)};
+    for (int i = 0; !done.load(); ++i) {
+      if (cs_catalog_instance_load_json(catalog, catalogs[i % 2].c_str()) != CS_SUCCESS) {
+        failures.fetch_add(1);
+      }
+    }
+  });
+
+  std::vector<std::thread> workers;
+  for (unsigned t = 0; t < thread_count(); ++t) {
+    workers.emplace_back([&, t] {
+      uint32_t random = 12345u + t;
+      long long local_adds = 0;
+      std::string id;
+      for (int op = 0; op < kOpsPerThread; ++op) {
+        const cs_cart_t cart = carts[next_random(&random) % kCartCount];
+        const uint32_t choice = next_random(&random) % 16;
+        long long cents = 0;
+        if (choice < 10) {
+          id = "ITEM-" + std::to_string(next_random(&random) % kItemCount);
+          if (cs_cart_add_item_by_id_fast(cart, id.c_str(), 1) != CS_ERRC_NONE) {
+            failures.fetch_add(1);
+          }
+          ++local_adds;
+        } else if (choice < 12) {
+          if (cs_cart_get_total_cents(cart, &cents) != CS_SUCCESS) {
+            failures.fetch_add(1);
+          }
+        } else if (choice < 14) {
+          if (cs_payment_set_given_cents(cart, 10000) != CS_SUCCESS ||
+              cs_payment_get_change_cents(cart, &cents) != CS_SUCCESS) {
+            failures.fetch_add(1);
+          }
+        } else if (choice < 15) {
+          if (cs_cart_reprice(cart, CS_REPRICE_KEEP_VANISHED, nullptr) != CS_SUCCESS) {
+            failures.fetch_add(1);
+          }
+        } else if (!consistent(lines_json(cart))) {
+          failures.fetch_add(1);
+        }
+      }
+      adds.fetch_add(local_adds);
+    });
+  }
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
+  done.store(true);
+  reloader.join();
+
+  long long quantity = 0;
+  bool ok = failures.load() == 0;
+  for (cs_cart_t cart : carts) {
+    const std::string json = lines_json(cart);
+    ok = ok && consistent(json);
+    quantity += sum_after(json, "\"qty\":");
+    cs_cart_free(cart);
+  }
+  if (!check(ok, "Concurrent cart calls failed or returned an inconsistent cart.")) {
+    return false;
+  }
+  return check(quantity == adds.load(), "Every concurrent add should be kept exactly once.");
+}
+
+// Threads keep using a few carts while another thread frees and recreates them. Calls either
+// complete on a live cart or are rejected as stale; none touches a freed cart.
+bool run_free_races(cs_catalog_t catalog) {
+  constexpr int kSlots = 8;
+  std::atomic<cs_cart_t> carts[kSlots];
+  for (auto& slot : carts) {
+    cs_cart_t cart = nullptr;
+    if (cs_cart_new_concurrent(catalog, &cart) != CS_SUCCESS) {
+      return false;
+    }
+    slot.store(cart);
+  }
+
+  std::atomic<bool> done{false};
+  std::atomic<int> failures{0};
+  std::vector<std::thread> workers;
+  for (unsigned t = 0; t < thread_count(); ++t) {
+    workers.emplace_back([&, t] {
+      uint32_t random = 777u + t;
+      while (!done.load()) {
+        const cs_cart_t cart = carts[next_random(&random) % kSlots].load();
+        const int added = cs_cart_add_item_by_id_fast(cart, "ITEM-1", 1);
+        long long cents = 0;
+        const int total = cs_cart_get_total_cents_fast(cart, &cents);
+        if ((added != CS_ERRC_NONE && added != CS_ERRC_INVALID_HANDLE) ||
+            (total != CS_ERRC_NONE && total != CS_ERRC_INVALID_HANDLE)) {
+          failures.fetch_add(1);
+        }
+      }
+    });
+  }
+
+  uint32_t random = 99u;
+  for (int i = 0; i < 20000; ++i) {
+    std::atomic<cs_cart_t>& slot = carts[next_random(&random) % kSlots];
+    cs_cart_t replacement = nullptr;
+    if (cs_cart_new_concurrent(catalog, &replacement) != CS_SUCCESS) {
+      failures.fetch_add(1);
+      break;
+    }
+    if (cs_cart_free(slot.exchange(replacement)) != CS_SUCCESS) {
+      failures.fetch_add(1);
+    }
+  }
+  done.store(true);
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
+  for (auto& slot : carts) {
+    cs_cart_free(slot.load());
+  }
+  return check(failures.load() == 0, "Calls racing cs_cart_free should fail only as stale handles.");
+}
+
+int main() {
+  if (cs_init() != CS_SUCCESS) {
+    std::cerr << "cs_init failed: " << cs_last_error() << "\n";
+    return 1;
+  }
+
+  cs_catalog_t catalog = nullptr;
+  const std::string catalog_json = make_catalog(0);
+  if (!check(cs_catalog_new("stress", &catalog) == CS_SUCCESS &&
+                 cs_catalog_instance_load_json(catalog, catalog_json.c_str()) == CS_SUCCESS,
+             "Catalog setup failed.")) {
+    cs_shutdown();
+    return 1;
+  }
+
+  cs_cart_t cart = nullptr;
+  if (!check(cs_cart_new_concurrent(nullptr, &cart) == CS_ERROR_INVALID_ARGUMENT &&
+                 cs_cart_new_concurrent(catalog, nullptr) == CS_ERROR_INVALID_ARGUMENT,
+             "cs_cart_new_concurrent should reject a null catalog or output.")) {
+    cs_catalog_free(catalog);
+    cs_shutdown();
+    return 1;
+  }
+
+  if (!run_shared_carts(catalog) || !run_free_races(catalog)) {
+    cs_catalog_free(catalog);
+    cs_shutdown();
+    return 1;
+  }
+
+  cs_catalog_free(catalog);
+  cs_shutdown();
+  return 0;
+}
@@ -0,0 +1,284 @@
+#include "cashsloth_core.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+bool check(bool condition, const char* message) {
+  if (!condition) {
+    std::cerr << message << "\n";
+    return false;
+  }
+  return true;
+}
+
+constexpr const char* kSharedName = "cashsloth_display_contract";
+constexpr int kWrites = 20000;
+
+std::string lines_json(cs_cart_t cart) {
+  char* json = nullptr;
+  if (cs_cart_get_lines_json(cart, &json) != CS_SUCCESS) {
+    return "failed";
+  }
+  std::string result(json);
+  cs_free(json);
+  return result;
+}
+
+std::string read_frame(cs_display_t display, unsigned long long* out_version = nullptr) {
+  std::vector<char> buffer(1 << 16);
+  int size = -1;
+  unsigned long long version = 0;
+  if (cs_display_read(display, buffer.data(), static_cast<int>(buffer.size()), &size, &version) !=
+          CS_SUCCESS ||
+      size < 0 || buffer[static_cast<size_t>(size)] != '\0') {
+    return "failed";
+  }
+  if (out_version) {
+    *out_version = version;
+  }
+  return std::string(buffer.data(), static_cast<size_t>(size));
+}
+
+long long number_after(const std::string& text, const char* key, size_t from = 0) {
+  const size_t pos = text.find(key, from);
+  return pos == std::string::npos ? -1 : std::atoll(text.c_str() + pos + std::strlen(key));
+}
+
+// A frame is consistent when its total is the sum of its line totals.
+bool frame_consistent(const std::string& frame) {
+  if (frame.size() < 2 || frame.front() != '{' || frame.back() != '}') {
+    return false;
+  }
+  long long sum = 0;
+  for (size_t pos = frame.find("\"line_total_cents\":"); pos != std::string::npos;
+       pos = frame.find("\"line_total_cents\":", pos + 1)) {
+    sum += number_after(frame, "\"line_total_cents\":", pos);
+  }
+  return number_after(frame, "\"total_cents\":") == sum;
+}
+
+bool run_invalid_arguments(cs_cart_t cart) {
+  cs_display_t display = nullptr;
+  int size = 0;
+  unsigned long long version = 0;
+  const bool ok = cs_cart_publish(nullptr, nullptr, 0, &display) == CS_ERROR_INVALID_ARGUMENT &&
+                  cs_last_error_code() == CS_ERRC_INVALID_HANDLE &&
+                  cs_cart_publish(cart, nullptr, -1, &display) == CS_ERROR_INVALID_ARGUMENT &&
+                  cs_last_error_code() == CS_ERRC_INVALID_VALUE &&
+                  cs_cart_publish(cart, "bad/name", 0, &display) == CS_ERROR_INVALID_ARGUMENT &&
+                  cs_last_error_code() == CS_ERRC_INVALID_VALUE &&
+                  cs_display_open("", &display) == CS_ERROR_INVALID_ARGUMENT &&
+                  cs_last_error_code() == CS_ERRC_NULL_ARGUMENT &&
+                  cs_display_open("cashsloth_display_missing", &display) ==
+                      CS_ERROR_INVALID_ARGUMENT &&
+                  cs_last_error_code() == CS_ERRC_IO &&
+                  cs_display_get_version(cart, &version) == CS_ERROR_INVALID_ARGUMENT &&
+                  cs_last_error_code() == CS_ERRC_INVALID_HANDLE &&
+                  cs_display_read(nullptr, nullptr, 0, &size, nullptr) == CS_ERROR_INVALID_ARGUMENT &&
+                  cs_display_close(nullptr) == CS_SUCCESS;
+  return check(ok && display == nullptr, "Invalid publish and display calls should be rejected.");
+}
+
+bool run_versions(cs_cart_t cart, cs_display_t display) {
+  unsigned long long first = 0;
+  unsigned long long second = 0;
+  unsigned long long read_version = 0;
+  long long total = 0;
+  bool ok = read_frame(display, &read_version) == lines_json(cart) &&
+            cs_display_get_version(display, &first) == CS_SUCCESS && first == read_version &&
+            cs_cart_publish(cart, nullptr, 0, nullptr) == CS_ERROR_INVALID_ARGUMENT &&
+            cs_last_error_code() == CS_ERRC_INVALID_STATE;
+  // Reads leave the version alone, so a display can skip frames it already drew.
+  ok = ok && cs_cart_get_total_cents(cart, &total) == CS_SUCCESS &&
+       cs_display_get_version(display, &second) == CS_SUCCESS && second == first;
+  ok = ok && cs_cart_add_item_by_id(cart, "COFFEE", 2) == CS_SUCCESS &&
+       cs_payment_set_given_cents(cart, 2000) == CS_SUCCESS &&
+       cs_cart_set_display_locale(cart, "de") == CS_SUCCESS &&
+       cs_display_get_version(display, &second) == CS_SUCCESS && second == first + 3 &&
+       read_frame(display) == lines_json(cart) &&
+       lines_json(cart).find("\"name\":\"Kaffee\"") != std::string::npos;
+  if (!check(ok, "The published frame should follow the cart and count its changes.")) {
+    return false;
+  }
+
+  // A too small buffer reports the size it needs.
+  int size = 0;
+  char small[8];
+  ok = cs_display_read(display, small, sizeof(small), &size, nullptr) ==
+           CS_ERROR_INVALID_ARGUMENT &&
+       cs_last_error_code() == CS_ERRC_INVALID_VALUE &&
+       size == static_cast<int>(lines_json(cart).size()) &&
+       cs_display_read(display, nullptr, 0, &size, nullptr) == CS_ERROR_INVALID_ARGUMENT &&
+       size == static_cast<int>(lines_json(cart).size());
+  return check(ok, "A too small buffer should report the frame size.");
+}
+
+// A reader copies frames while the cart keeps changing and never sees a torn one.
+bool run_concurrent_reader(cs_cart_t cart, cs_display_t display) {
+  std::atomic<bool> done(false);
+  std::atomic<int> frames(0);
+  std::atomic<int> torn(0);
+  std::thread reader([&] {
+    unsigned long long seen = 0;
+    while (!done.load()) {
+      unsigned long long version = 0;
+      if (cs_display_get_version(display, &version) != CS_SUCCESS || version == seen) {
+        std::this_thread::yield();
+        continue;
+      }
+      const std::string frame = read_frame(display, &seen);
+      if (frame == "failed" && cs_last_error_code() == CS_ERRC_INVALID_STATE) {
+        continue;
+      }
+      frames.fetch_add(1);
+      if (!frame_consistent(frame)) {
+        torn.fetch_add(1);
+      }
+    }
+  });
+
+  bool ok = cs_cart_clear(cart) == CS_SUCCESS;
+  for (int i = 0; i < kWrites && ok; ++i) {
+    if (i % 40 == 39) {
+      ok = cs_cart_clear(cart) == CS_SUCCESS;
+    } else {
+      ok = cs_cart_add_item_by_id(cart, i % 3 == 0 ? "TEA" : "COFFEE", 1 + i % 4) == CS_SUCCESS &&
+           cs_cart_set_line_qty(cart, 0, 1 + i % 9) == CS_SUCCESS;
+    }
+  }
+  done.store(true);
+  reader.join();
+  if (!check(ok && torn.load() == 0 && frames.load() > 0,
+             "A reader should only see whole frames.")) {
+    std::cerr << frames.load() << " frames, " << torn.load() << " torn\n";
+    return false;
+  }
+  return check(read_frame(display) == lines_json(cart), "The last frame should be the cart.");
+}
+
+bool run_shared(cs_catalog_t catalog) {
+  cs_cart_t cart = nullptr;
+  cs_display_t display = nullptr;
+  bool ok = cs_cart_new_for_catalog(catalog, &cart) == CS_SUCCESS &&
+            cs_cart_add_item_by_id(cart, "TEA", 2) == CS_SUCCESS &&
+            cs_cart_publish(cart, kSharedName, 4096, nullptr) == CS_SUCCESS &&
+            cs_display_open(kSharedName, &display) == CS_SUCCESS &&
+            read_frame(display) == lines_json(cart) &&
+            cs_cart_add_item_by_id(cart, "COFFEE", 1) == CS_SUCCESS &&
+            read_frame(display) == lines_json(cart);
+  // A frame larger than the region is reported until the cart fits again.
+  for (int i = 0; i < 200 && ok; ++i) {
+    ok = cs_cart_add_item_by_id(cart, i % 2 == 0 ? "TEA" : "COFFEE", 1) == CS_SUCCESS &&
+         cs_cart_set_line_qty(cart, 0, 1) == CS_SUCCESS;
+  }
+  ok = ok && lines_json(cart).size() <= 4096 && read_frame(display) == lines_json(cart);
+  if (!check(ok, "A named region should show the cart to other readers.")) {
+    cs_display_close(display);
+    cs_cart_free(cart);
+    return false;
+  }
+
+  // Freeing the cart closes the region and removes its name.
+  int size = 0;
+  cs_display_t again = nullptr;
+  std::vector<char> buffer(4096);
+  ok = cs_cart_free(cart) == CS_SUCCESS &&
+       cs_display_read(display, buffer.data(), 4096, &size, nullptr) ==
+           CS_ERROR_INVALID_ARGUMENT &&
+       cs_last_error_code() == CS_ERRC_INVALID_STATE &&
+       cs_display_open(kSharedName, &again) == CS_ERROR_INVALID_ARGUMENT;
+  ok = cs_display_close(display) == CS_SUCCESS && ok &&
+       cs_display_close(display) == CS_ERROR_INVALID_ARGUMENT;
+  return check(ok, "A freed cart should close its published region.");
+}
+
+// A second cart cannot take over a name in use; the first cart keeps its region intact.
+bool run_double_publish(cs_catalog_t catalog) {
+  cs_cart_t first = nullptr;
+  cs_cart_t second = nullptr;
+  cs_display_t display = nullptr;
+  bool ok = cs_cart_new_for_catalog(catalog, &first) == CS_SUCCESS &&
+            cs_cart_new_for_catalog(catalog, &second) == CS_SUCCESS &&
+            cs_cart_publish(first, kSharedName, 1 << 16, nullptr) == CS_SUCCESS &&
+            cs_cart_publish(second, kSharedName, 64, nullptr) == CS_ERROR_INVALID_ARGUMENT &&
+            cs_last_error_code() == CS_ERRC_NAME_IN_USE &&
+            cs_cart_publish(second, kSharedName, 1 << 20, nullptr) ==
+                CS_ERROR_INVALID_ARGUMENT &&
+            cs_last_error_code() == CS_ERRC_NAME_IN_USE;
+  for (int i = 0; i < 100 && ok; ++i) {
+    ok = cs_cart_add_item_by_id(first, i % 2 == 0 ? "TEA" : "COFFEE", 1) == CS_SUCCESS;
+  }
+  ok = ok && cs_display_open(kSharedName, &display) == CS_SUCCESS &&
+       read_frame(display) == lines_json(first) &&
+       cs_cart_add_item_by_id(second, "TEA", 1) == CS_SUCCESS &&
+       read_frame(display) == lines_json(first);
+  cs_display_close(display);
+  if (!check(ok, "Publishing under a name in use should fail and leave it alone.")) {
+    cs_cart_free(first);
+    cs_cart_free(second);
+    return false;
+  }
+
+  // The name is free again once its cart is gone.
+  display = nullptr;
+  ok = cs_cart_free(first) == CS_SUCCESS &&
+       cs_cart_publish(second, kSharedName, 4096, nullptr) == CS_SUCCESS &&
+       cs_display_open(kSharedName, &display) == CS_SUCCESS &&
+       read_frame(display) == lines_json(second);
+  cs_display_close(display);
+  cs_cart_free(second);
+  return check(ok, "A freed cart's name should be publishable again.");
+}
+
+bool run_overflow(cs_catalog_t catalog) {
+  cs_cart_t cart = nullptr;
+  cs_display_t display = nullptr;
+  int size = 0;
+  std::vector<char> buffer(4096);
+  bool ok = cs_cart_new_for_catalog(catalog, &cart) == CS_SUCCESS &&
+            cs_cart_publish(cart, nullptr, 64, &display) == CS_SUCCESS &&
+            cs_cart_add_item_by_id(cart, "COFFEE", 1) == CS_SUCCESS &&
+            cs_display_read(display, buffer.data(), 4096, &size, nullptr) ==
+                CS_ERROR_INVALID_ARGUMENT &&
+            cs_last_error_code() == CS_ERRC_OVERFLOW;
+  cs_cart_free(cart);
+  cs_display_close(display);
+  return check(ok, "A frame larger than the region should report an overflow.");
+}
+
+int main() {
+  if (cs_init() != CS_SUCCESS) {
+    std::cerr << "cs_init failed: " << cs_last_error() << "\n";
+    return 1;
+  }
+
+  const char* catalog_json =
+      "{\"items\":[{\"id\":\"COFFEE\",\"name\":\"Coffee\",\"names\":{\"de\":\"Kaffee\"},"
+      "\"unit_cents\":500},{\"id\":\"TEA\",\"name\":\"Tea\",\"unit_cents\":300}]}";
+  cs_catalog_t catalog = nullptr;
+  cs_cart_t cart = nullptr;
+  cs_display_t display = nullptr;
+  if (!check(cs_catalog_load_json(catalog_json) == CS_SUCCESS &&
+                 cs_catalog_get_default(&catalog) == CS_SUCCESS &&
+                 cs_cart_new_concurrent(catalog, &cart) == CS_SUCCESS,
+             "Setup failed.")) {
+    cs_shutdown();
+    return 1;
+  }
+
+  const bool ok = run_invalid_arguments(cart) &&
+                  check(cs_cart_publish(cart, nullptr, 0, &display) == CS_SUCCESS,
+                        "Publishing the cart failed.") &&
+                  run_versions(cart, display) && run_concurrent_reader(cart, display) &&
+                  run_shared(catalog) && run_double_publish(catalog) &&
+                  run_overflow(catalog);
+  cs_cart_free(cart);
+  cs_display_close(display);
+  cs_shutdown();
+  return ok ? 0 : 1;
+}
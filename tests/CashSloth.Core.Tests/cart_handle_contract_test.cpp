@@ -0,0 +1,135 @@
+#include "cashsloth_core.h"
+
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+bool check(bool condition, const char* message) {
+  if (!condition) {
+    std::cerr << message << "\n";
+    return false;
+  }
+  return true;
+}
+
+void free_all(std::vector<cs_cart_t>& carts) {
+  for (cs_cart_t cart : carts) {
+    cs_cart_free(cart);
+  }
+  carts.clear();
+}
+
+int main() {
+  if (cs_init() != CS_SUCCESS) {
+    std::cerr << "cs_init failed: " << cs_last_error() << "\n";
+    return 1;
+  }
+
+  const char* catalog_json =
+      "{\"items\":[{\"id\":\"COFFEE\",\"name\":\"Coffee\",\"unit_cents\":500}]}";
+  if (!check(cs_catalog_load_json(catalog_json) == CS_SUCCESS, "cs_catalog_load_json failed.")) {
+    cs_shutdown();
+    return 1;
+  }
+
+  cs_cart_t first = nullptr;
+  if (!check(cs_cart_new(&first) == CS_SUCCESS && first != nullptr, "cs_cart_new failed.")) {
+    cs_shutdown();
+    return 1;
+  }
+  if (!check(cs_cart_add_item_by_id(first, "COFFEE", 2) == CS_SUCCESS,
+             "cs_cart_add_item_by_id failed.")) {
+    cs_cart_free(first);
+    cs_shutdown();
+    return 1;
+  }
+  if (!check(cs_cart_free(first) == CS_SUCCESS, "cs_cart_free failed.")) {
+    cs_shutdown();
+    return 1;
+  }
+
+  // Stale handles are rejected rather than dereferenced.
+  long long total_cents = 0;
+  if (!check(cs_cart_get_total_cents(first, &total_cents) == CS_ERROR_INVALID_ARGUMENT,
+             "A freed cart handle should be rejected.")) {
+    cs_shutdown();
+    return 1;
+  }
+  if (!check(cs_cart_free(first) == CS_ERROR_INVALID_ARGUMENT,
+             "Freeing a cart twice should fail.")) {
+    cs_shutdown();
+    return 1;
+  }
+
+  // The freed slot is reused under a different handle and starts empty.
+  cs_cart_t second = nullptr;
+  if (!check(cs_cart_new(&second) == CS_SUCCESS && second != first,
+             "A reused cart slot should get a new handle value.")) {
+    cs_cart_free(second);
+    cs_shutdown();
+    return 1;
+  }
+  if (!check(cs_cart_get_total_cents(second, &total_cents) == CS_SUCCESS && total_cents == 0,
+             "A reused cart should start empty.")) {
+    cs_cart_free(second);
+    cs_shutdown();
+    return 1;
+  }
+  if (!check(cs_cart_add_item_by_id(first, "COFFEE", 1) == CS_ERROR_INVALID_ARGUMENT,
+             "A stale handle must not reach the cart that reuses its slot.")) {
+    cs_cart_free(second);
+    cs_shutdown();
+    return 1;
+  }
+  // Every generation bit of a handle counts, up to the top one.
+  const uintptr_t top_bit = uintptr_t(1) << (sizeof(uintptr_t) * 8 - 1);
+  cs_cart_t high = reinterpret_cast<cs_cart_t>(reinterpret_cast<uintptr_t>(second) ^ top_bit);
+  if (!check(cs_cart_clear(high) == CS_ERROR_INVALID_ARGUMENT,
+             "A handle differing in its top generation bit must be rejected.")) {
+    cs_cart_free(second);
+    cs_shutdown();
+    return 1;
+  }
+  if (!check(cs_cart_free(second) == CS_SUCCESS, "cs_cart_free second failed.")) {
+    cs_shutdown();
+    return 1;
+  }
+
+  cs_cart_t forged = reinterpret_cast<cs_cart_t>(static_cast<uintptr_t>(0x7fffff));
+  if (!check(cs_cart_clear(forged) == CS_ERROR_INVALID_ARGUMENT,
+             "A forged cart handle should be rejected.")) {
+    cs_shutdown();
+    return 1;
+  }
+
+  // Carts spanning several slabs stay independent.
+  std::vector<cs_cart_t> carts;
+  for (int i = 0; i < 200; ++i) {
+    cs_cart_t cart = nullptr;
+    if (!check(cs_cart_new(&cart) == CS_SUCCESS, "cs_cart_new in bulk failed.")) {
+      free_all(carts);
+      cs_shutdown();
+      return 1;
+    }
+    carts.push_back(cart);
+    if (!check(cs_cart_add_item_by_id(cart, "COFFEE", i + 1) == CS_SUCCESS,
+               "Adding to a bulk cart failed.")) {
+      free_all(carts);
+      cs_shutdown();
+      return 1;
+    }
+  }
+  for (int i = 0; i < 200; ++i) {
+    if (!check(cs_cart_get_total_cents(carts[i], &total_cents) == CS_SUCCESS &&
+                   total_cents == 500LL * (i + 1),
+               "Bulk cart totals should stay independent.")) {
+      free_all(carts);
+      cs_shutdown();
+      return 1;
+    }
+  }
+  free_all(carts);
+
+  cs_shutdown();
+  return 0;
+}
@@ -0,0 +1,195 @@
+#include "cashsloth_core.h"
+
+#include <cstring>
+#include <iostream>
+
+bool check(bool condition, const char* message) {
+  if (!condition) {
+    std::cerr << message << "\n";
+    return false;
+  }
+  return true;
+}
+
+int main() {
+  if (cs_init() != CS_SUCCESS) {
+    std::cerr << "cs_init failed: " << cs_last_error() << "\n";
+    return 1;
+  }
+
+  const char* initial_catalog =
+      "{\"items\":[{\"id\":\"COFFEE\",\"name\":\"Coffee\",\"unit_cents\":500},"
+      "{\"id\":\"TEA\",\"name\":\"Tea\",\"unit_cents\":400},"
+      "{\"id\":\"CAKE\",\"name\":\"Cake\",\"unit_cents\":300}]}";
+  if (!check(cs_catalog_load_json(initial_catalog) == CS_SUCCESS, "Initial catalog load failed.")) {
+    cs_shutdown();
+    return 1;
+  }
+
+  cs_cart_t cart = nullptr;
+  if (!check(cs_cart_new(&cart) == CS_SUCCESS, "cs_cart_new failed.")) {
+    cs_shutdown();
+    return 1;
+  }
+  if (!check(cs_cart_add_item_by_id(cart, "COFFEE", 2) == CS_SUCCESS &&
+                 cs_cart_add_item_by_id(cart, "TEA", 1) == CS_SUCCESS &&
+                 cs_cart_add_item_by_id(cart, "CAKE", 1) == CS_SUCCESS,
+             "Adding initial items failed.")) {
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+
+  if (!check(cs_cart_reprice(cart, 7, nullptr) == CS_ERROR_INVALID_ARGUMENT,
+             "Unknown reprice policy should fail.")) {
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+
+  // Price correction: items reordered, COFFEE cheaper, CAKE withdrawn.
+  const char* corrected_catalog =
+      "{\"items\":[{\"id\":\"MUFFIN\",\"name\":\"Muffin\",\"unit_cents\":350},"
+      "{\"id\":\"TEA\",\"name\":\"Tea\",\"unit_cents\":400},"
+      "{\"id\":\"COFFEE\",\"name\":\"Coffee\",\"unit_cents\":450}]}";
+  if (!check(cs_catalog_load_json(corrected_catalog) == CS_SUCCESS,
+             "Corrected catalog load failed.")) {
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+
+  long long total_cents = 0;
+  if (!check(cs_cart_get_total_cents(cart, &total_cents) == CS_SUCCESS && total_cents == 1700,
+             "Totals should keep stored prices until the cart is repriced.")) {
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+
+  char* report = nullptr;
+  if (!check(cs_cart_reprice(cart, CS_REPRICE_KEEP_VANISHED, &report) == CS_SUCCESS &&
+                 report != nullptr,
+             "cs_cart_reprice keep policy failed.")) {
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+  if (!check(std::strstr(report,
+                         "\"changed\":[{\"line_index\":0,\"id\":\"COFFEE\",\"old_unit_cents\":500,"
+                         "\"new_unit_cents\":450}]") != nullptr,
+             "Reprice report should list the changed COFFEE line.")) {
+    std::cerr << report << "\n";
+    cs_free(report);
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+  if (!check(std::strstr(report,
+                         "\"vanished\":[{\"line_index\":2,\"id\":\"CAKE\",\"old_unit_cents\":300,"
+                         "\"removed\":false}]") != nullptr,
+             "Reprice report should list the vanished CAKE line.")) {
+    std::cerr << report << "\n";
+    cs_free(report);
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+  cs_free(report);
+
+  if (!check(cs_cart_get_total_cents(cart, &total_cents) == CS_SUCCESS && total_cents == 1600,
+             "Total after reprice should use the corrected COFFEE price.")) {
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+
+  // Adding after the migration still merges into the existing line.
+  if (!check(cs_cart_add_item_by_id(cart, "COFFEE", 1) == CS_SUCCESS &&
+                 cs_cart_get_total_cents(cart, &total_cents) == CS_SUCCESS && total_cents == 2050,
+             "Adding COFFEE after reprice should merge into the repriced line.")) {
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+
+  char* lines_json = nullptr;
+  if (!check(cs_cart_get_lines_json(cart, &lines_json) == CS_SUCCESS,
+             "cs_cart_get_lines_json failed.")) {
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+  if (!check(std::strstr(lines_json, "\"id\":\"COFFEE\",\"name\":\"Coffee\",\"unit_cents\":450,\"qty\":3") !=
+                     nullptr &&
+                 std::strstr(lines_json, "\"id\":\"CAKE\",\"name\":\"\"") != nullptr,
+             "Lines JSON should reflect remapped items and the vanished CAKE line.")) {
+    std::cerr << lines_json << "\n";
+    cs_free(lines_json);
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+  cs_free(lines_json);
+
+  // Two reloads without cart activity: the cart skips a generation and falls back to id lookups.
+  const char* interim_catalog =
+      "{\"items\":[{\"id\":\"TEA\",\"name\":\"Tea\",\"unit_cents\":380}]}";
+  const char* final_catalog =
+      "{\"items\":[{\"id\":\"TEA\",\"name\":\"Tea\",\"unit_cents\":420},"
+      "{\"id\":\"COFFEE\",\"name\":\"Coffee\",\"unit_cents\":450}]}";
+  if (!check(cs_catalog_load_json(interim_catalog) == CS_SUCCESS &&
+                 cs_catalog_load_json(final_catalog) == CS_SUCCESS,
+             "Follow-up catalog loads failed.")) {
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+  if (!check(cs_cart_reprice(cart, CS_REPRICE_REMOVE_VANISHED, &report) == CS_SUCCESS,
+             "cs_cart_reprice remove policy failed.")) {
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+  if (!check(std::strstr(report, "\"generation\":4") != nullptr &&
+                 std::strstr(report, "\"id\":\"TEA\",\"old_unit_cents\":400,\"new_unit_cents\":420") !=
+                     nullptr &&
+                 std::strstr(report, "\"id\":\"CAKE\",\"old_unit_cents\":300,\"removed\":true") !=
+                     nullptr,
+             "Remove-policy report should list TEA as changed and CAKE as removed.")) {
+    std::cerr << report << "\n";
+    cs_free(report);
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+  cs_free(report);
+
+  if (!check(cs_cart_get_total_cents(cart, &total_cents) == CS_SUCCESS && total_cents == 1770,
+             "Total after remove-policy reprice should drop the CAKE line.")) {
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+  if (!check(cs_cart_remove_line(cart, 2) == CS_ERROR_INVALID_ARGUMENT,
+             "Removed vanished line should no longer be addressable.")) {
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+
+  // Repricing an up-to-date cart reports nothing.
+  if (!check(cs_cart_reprice(cart, CS_REPRICE_KEEP_VANISHED, &report) == CS_SUCCESS &&
+                 std::strstr(report, "\"changed\":[],\"vanished\":[]") != nullptr,
+             "Repricing an up-to-date cart should report no changes.")) {
+    cs_free(report);
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+  cs_free(report);
+
+  cs_cart_free(cart);
+  cs_shutdown();
+  return 0;
+}
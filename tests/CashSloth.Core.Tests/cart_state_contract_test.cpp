@@ -0,0 +1,211 @@
+#include "cashsloth_core.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+
+bool check(bool condition, const char* message) {
+  if (!condition) {
+    std::cerr << message << "\n";
+    return false;
+  }
+  return true;
+}
+
+constexpr const char* kStatePath = "cashsloth_cart_state_contract.bin";
+// A copy of the live file is what a crashed process leaves behind: the mapping's stores are
+// already in the page cache.
+constexpr const char* kCrashPath = "cashsloth_cart_state_contract_crash.bin";
+constexpr int kManyItems = 3000;
+
+std::string make_catalog() {
+  std::string json =
+      "{\"items\":[{\"id\":\"COFFEE\",\"name\":\"Coffee\",\"unit_cents\":500},"
+      "{\"id\":\"TEA\",\"name\":\"Tea\",\"unit_cents\":300}";
+  for (int i = 0; i < kManyItems; ++i) {
+    json += ",{\"id\":\"ITEM-WITH-A-LONG-ID-" + std::to_string(i) +
+            "\",\"name\":\"Item\",\"unit_cents\":100}";
+  }
+  return json + "]}";
+}
+
+std::string read_file(const char* path) {
+  std::ifstream in(path, std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+bool write_file(const char* path, const std::string& data) {
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  out.write(data.data(), static_cast<std::streamsize>(data.size()));
+  return static_cast<bool>(out);
+}
+
+bool snapshot_crash() {
+  return write_file(kCrashPath, read_file(kStatePath));
+}
+
+// Lines JSON plus the given amount, to compare a cart with its recovered copy.
+std::string cart_state(cs_cart_t cart) {
+  char* json = nullptr;
+  long long given = -1;
+  if (cs_cart_get_lines_json(cart, &json) != CS_SUCCESS ||
+      cs_payment_get_given_cents(cart, &given) != CS_SUCCESS) {
+    cs_free(json);
+    return "failed";
+  }
+  std::string result = std::string(json) + " given=" + std::to_string(given);
+  cs_free(json);
+  return result;
+}
+
+std::string recovered_state(cs_catalog_t catalog, const char* path) {
+  cs_cart_t recovered = nullptr;
+  if (cs_cart_recover(catalog, path, &recovered) != CS_SUCCESS) {
+    std::cerr << "cs_cart_recover failed: " << cs_last_error() << "\n";
+    return "failed";
+  }
+  const std::string result = cart_state(recovered);
+  cs_cart_free(recovered);
+  return result;
+}
+
+bool run_invalid_arguments(cs_catalog_t catalog, cs_cart_t cart) {
+  cs_cart_t recovered = nullptr;
+  bool ok = cs_cart_persist(nullptr, kStatePath) == CS_ERROR_INVALID_ARGUMENT &&
+            cs_last_error_code() == CS_ERRC_INVALID_HANDLE &&
+            cs_cart_persist(cart, "") == CS_ERROR_INVALID_ARGUMENT &&
+            cs_last_error_code() == CS_ERRC_NULL_ARGUMENT &&
+            cs_cart_flush(cart) == CS_ERROR_INVALID_ARGUMENT &&
+            cs_last_error_code() == CS_ERRC_INVALID_STATE &&
+            cs_cart_recover(catalog, kStatePath, nullptr) == CS_ERROR_INVALID_ARGUMENT &&
+            cs_last_error_code() == CS_ERRC_NULL_ARGUMENT;
+  // A missing file is not created by recovering it.
+  ok = ok && cs_cart_recover(catalog, kStatePath, &recovered) == CS_ERROR_INVALID_ARGUMENT &&
+       cs_last_error_code() == CS_ERRC_IO && read_file(kStatePath).empty();
+  ok = ok && write_file(kCrashPath, std::string(200, 'x')) &&
+       cs_cart_recover(catalog, kCrashPath, &recovered) == CS_ERROR_INVALID_ARGUMENT &&
+       cs_last_error_code() == CS_ERRC_INVALID_VALUE &&
+       cs_cart_persist(cart, kCrashPath) == CS_ERROR_INVALID_ARGUMENT &&
+       cs_last_error_code() == CS_ERRC_INVALID_STATE && read_file(kCrashPath) == std::string(200, 'x');
+  return check(ok && recovered == nullptr, "Invalid persist and recover calls should be rejected.");
+}
+
+bool run_recovery(cs_catalog_t catalog, cs_cart_t cart) {
+  // Lines added before persisting are written with the first state.
+  bool ok = cs_cart_add_item_by_id(cart, "TEA", 1) == CS_SUCCESS &&
+            cs_cart_persist(cart, kStatePath) == CS_SUCCESS &&
+            cs_cart_persist(cart, kStatePath) == CS_ERROR_INVALID_ARGUMENT &&
+            cs_last_error_code() == CS_ERRC_INVALID_STATE &&
+            cs_cart_add_item_by_id(cart, "COFFEE", 2) == CS_SUCCESS &&
+            cs_cart_add_item_by_id(cart, "TEA", 2) == CS_SUCCESS &&
+            cs_cart_add_item_by_id(cart, "ITEM-WITH-A-LONG-ID-7", 1) == CS_SUCCESS &&
+            cs_cart_set_line_qty(cart, 1, 4) == CS_SUCCESS &&
+            cs_cart_remove_line(cart, 0) == CS_SUCCESS &&
+            cs_payment_set_given_cents(cart, 5000) == CS_SUCCESS && snapshot_crash();
+  if (!check(ok, "Persisting and changing the cart failed.")) {
+    return false;
+  }
+  const std::string live = cart_state(cart);
+  if (!check(recovered_state(catalog, kCrashPath) == live,
+             "A recovered cart should match the cart at the crash.")) {
+    std::cerr << live << "\n" << recovered_state(catalog, kCrashPath) << "\n";
+    return false;
+  }
+
+  // Thousands of changes wrap the log into the other half several times.
+  for (int i = 0; i < 20000 && ok; ++i) {
+    ok = cs_cart_set_line_qty(cart, i % 2, 1 + i % 97) == CS_SUCCESS;
+  }
+  ok = ok && cs_cart_flush(cart) == CS_SUCCESS && snapshot_crash();
+  if (!check(ok && recovered_state(catalog, kCrashPath) == cart_state(cart),
+             "Recovery should follow the log across half switches.")) {
+    return false;
+  }
+
+  // More lines than the first halves hold grow the file.
+  for (int i = 0; i < kManyItems && ok; ++i) {
+    const std::string id = "ITEM-WITH-A-LONG-ID-" + std::to_string(i);
+    ok = cs_cart_add_item_by_id(cart, id.c_str(), 1 + i % 3) == CS_SUCCESS;
+  }
+  ok = ok && snapshot_crash();
+  const size_t grown_size = read_file(kStatePath).size();
+  if (!check(ok && grown_size > 64 + 2 * 65536 &&
+                 recovered_state(catalog, kCrashPath) == cart_state(cart),
+             "A grown state file should recover every line.")) {
+    return false;
+  }
+
+  // A recovered cart keeps persisting to its file.
+  cs_cart_t recovered = nullptr;
+  ok = cs_cart_clear(cart) == CS_SUCCESS && cs_cart_add_item_by_id(cart, "COFFEE", 1) == CS_SUCCESS &&
+       snapshot_crash() && cs_cart_recover(catalog, kCrashPath, &recovered) == CS_SUCCESS &&
+       cs_cart_add_item_by_id(recovered, "TEA", 3) == CS_SUCCESS &&
+       cs_payment_set_given_cents(recovered, 2000) == CS_SUCCESS;
+  const std::string continued = ok ? cart_state(recovered) : std::string();
+  cs_cart_free(recovered);
+  return check(ok && recovered_state(catalog, kCrashPath) == continued &&
+                   continued.find("\"qty\":3") != std::string::npos,
+               "A recovered cart should keep persisting its changes.");
+}
+
+// A fresh state file is the header, then records in the first 64 KiB half: here the COFFEE line
+// (9 + 12 + 6 bytes at offset 64), then the given amount (9 + 8 bytes at offset 91).
+bool run_torn_tail(cs_catalog_t catalog) {
+  std::remove(kStatePath);
+  cs_cart_t cart = nullptr;
+  bool ok = cs_cart_new_for_catalog(catalog, &cart) == CS_SUCCESS &&
+            cs_cart_persist(cart, kStatePath) == CS_SUCCESS &&
+            cs_cart_add_item_by_id(cart, "COFFEE", 2) == CS_SUCCESS &&
+            cs_payment_set_given_cents(cart, 1000) == CS_SUCCESS;
+  std::string image = read_file(kStatePath);
+  ok = ok && image.size() == 64 + 2 * 65536 && image.compare(0, 8, "CSCART01") == 0;
+  if (ok) {
+    image[91 + 16] ^= 0x40;
+    ok = write_file(kCrashPath, image);
+  }
+  const std::string recovered = recovered_state(catalog, kCrashPath);
+  cs_cart_free(cart);
+  return check(ok && recovered.find("\"id\":\"COFFEE\"") != std::string::npos &&
+                   recovered.find("given=0") != std::string::npos,
+               "A record failing its checksum should end the recovered log.");
+}
+
+void cleanup() {
+  std::remove(kStatePath);
+  std::remove(kCrashPath);
+}
+
+int main() {
+  cleanup();
+  if (cs_init() != CS_SUCCESS) {
+    std::cerr << "cs_init failed: " << cs_last_error() << "\n";
+    return 1;
+  }
+
+  const std::string catalog_json = make_catalog();
+  cs_catalog_t catalog = nullptr;
+  cs_cart_t cart = nullptr;
+  if (!check(cs_catalog_load_json(catalog_json.c_str()) == CS_SUCCESS &&
+                 cs_catalog_get_default(&catalog) == CS_SUCCESS &&
+                 cs_cart_new_concurrent(catalog, &cart) == CS_SUCCESS,
+             "Setup failed.")) {
+    cs_shutdown();
+    return 1;
+  }
+
+  if (!run_invalid_arguments(catalog, cart) || !run_recovery(catalog, cart) ||
+      !run_torn_tail(catalog)) {
+    cs_cart_free(cart);
+    cs_shutdown();
+    cleanup();
+    return 1;
+  }
+
+  cs_cart_free(cart);
+  cs_shutdown();
+  cleanup();
+  return 0;
+}
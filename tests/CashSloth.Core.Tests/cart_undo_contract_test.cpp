@@ -0,0 +1,220 @@
+#include "cashsloth_core.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+bool check(bool condition, const char* message) {
+  if (!condition) {
+    std::cerr << message << "\n";
+    return false;
+  }
+  return true;
+}
+
+constexpr int kManyItems = 300;
+// Checkpoints a cart's history keeps (docs/ABI.md).
+constexpr int kUndoSteps = 64;
+
+std::string make_catalog(int coffee_cents) {
+  std::string json = "{\"items\":[{\"id\":\"COFFEE\",\"name\":\"Coffee\",\"unit_cents\":" +
+                     std::to_string(coffee_cents) +
+                     "},{\"id\":\"TEA\",\"name\":\"Tea\",\"unit_cents\":300}";
+  for (int i = 0; i < kManyItems; ++i) {
+    json += ",{\"id\":\"I" + std::to_string(i) + "\",\"name\":\"Item\",\"unit_cents\":100}";
+  }
+  return json + "]}";
+}
+
+// Lines JSON plus the given amount.
+std::string cart_state(cs_cart_t cart) {
+  char* json = nullptr;
+  long long given = -1;
+  if (cs_cart_get_lines_json(cart, &json) != CS_SUCCESS ||
+      cs_payment_get_given_cents(cart, &given) != CS_SUCCESS) {
+    cs_free(json);
+    return "failed";
+  }
+  std::string result = std::string(json) + " given=" + std::to_string(given);
+  cs_free(json);
+  return result;
+}
+
+long long lines_live_bytes() {
+  char* json = nullptr;
+  if (cs_memory_usage_json(&json) != CS_SUCCESS) {
+    return -1;
+  }
+  const std::string usage(json);
+  cs_free(json);
+  const size_t pos = usage.find("\"lines\":{\"live_bytes\":");
+  return pos == std::string::npos ? -1 : std::atoll(usage.c_str() + pos + 22);
+}
+
+bool run_invalid_arguments(cs_cart_t cart) {
+  bool ok = cs_cart_checkpoint(nullptr) == CS_ERROR_INVALID_ARGUMENT &&
+            cs_last_error_code() == CS_ERRC_INVALID_HANDLE &&
+            cs_cart_undo(cart) == CS_ERROR_INVALID_ARGUMENT &&
+            cs_last_error_code() == CS_ERRC_INVALID_STATE &&
+            std::strcmp(cs_last_error(), "Nothing to undo.") == 0 &&
+            cs_cart_redo(cart) == CS_ERROR_INVALID_ARGUMENT &&
+            cs_last_error_code() == CS_ERRC_INVALID_STATE &&
+            cs_cart_clone(cart, nullptr) == CS_ERROR_INVALID_ARGUMENT &&
+            cs_last_error_code() == CS_ERRC_NULL_ARGUMENT;
+  // Without a checkpoint nothing is recorded.
+  ok = ok && cs_cart_add_item_by_id(cart, "COFFEE", 1) == CS_SUCCESS &&
+       cs_cart_undo(cart) == CS_ERROR_INVALID_ARGUMENT && cs_cart_clear(cart) == CS_SUCCESS;
+  return check(ok, "Invalid history calls should be rejected.");
+}
+
+bool run_undo_redo(cs_cart_t cart) {
+  const std::string empty = cart_state(cart);
+  bool ok = cs_cart_checkpoint(cart) == CS_SUCCESS &&
+            cs_cart_add_item_by_id(cart, "COFFEE", 1) == CS_SUCCESS;
+  const std::string one = cart_state(cart);
+  ok = ok && cs_cart_checkpoint(cart) == CS_SUCCESS &&
+       cs_cart_add_item_by_id(cart, "COFFEE", 1) == CS_SUCCESS;
+  const std::string two = cart_state(cart);
+  // Repeated checkpoints without changes in between add no empty steps.
+  ok = ok && cs_cart_checkpoint(cart) == CS_SUCCESS && cs_cart_checkpoint(cart) == CS_SUCCESS &&
+       cs_cart_add_item_by_id(cart, "TEA", 2) == CS_SUCCESS &&
+       cs_cart_set_line_qty(cart, 0, 5) == CS_SUCCESS;
+  const std::string tea = cart_state(cart);
+  ok = ok && cs_cart_checkpoint(cart) == CS_SUCCESS &&
+       cs_payment_set_given_cents(cart, 5000) == CS_SUCCESS;
+  const std::string paid = cart_state(cart);
+  if (!check(ok, "Changing the cart failed.")) {
+    return false;
+  }
+
+  ok = cs_cart_undo(cart) == CS_SUCCESS && cart_state(cart) == tea &&
+       cs_cart_undo(cart) == CS_SUCCESS && cart_state(cart) == two &&
+       cs_cart_undo(cart) == CS_SUCCESS && cart_state(cart) == one &&
+       cs_cart_undo(cart) == CS_SUCCESS && cart_state(cart) == empty &&
+       cs_cart_undo(cart) == CS_ERROR_INVALID_ARGUMENT;
+  if (!check(ok, "Undo should step back through the checkpoints.")) {
+    return false;
+  }
+  ok = cs_cart_redo(cart) == CS_SUCCESS && cart_state(cart) == one &&
+       cs_cart_redo(cart) == CS_SUCCESS && cart_state(cart) == two &&
+       cs_cart_redo(cart) == CS_SUCCESS && cart_state(cart) == tea &&
+       cs_cart_redo(cart) == CS_SUCCESS && cart_state(cart) == paid &&
+       cs_cart_redo(cart) == CS_ERROR_INVALID_ARGUMENT;
+  if (!check(ok, "Redo should reapply the undone steps.")) {
+    return false;
+  }
+
+  // A change after an undo discards the redo steps; removed lines come back in place.
+  ok = cs_cart_undo(cart) == CS_SUCCESS && cs_cart_undo(cart) == CS_SUCCESS &&
+       cs_cart_checkpoint(cart) == CS_SUCCESS && cs_cart_remove_line(cart, 0) == CS_SUCCESS &&
+       cs_cart_redo(cart) == CS_ERROR_INVALID_ARGUMENT && cs_cart_undo(cart) == CS_SUCCESS &&
+       cart_state(cart) == two;
+  if (!check(ok, "A new change should start a new branch.")) {
+    return false;
+  }
+
+  // Clearing is undoable too.
+  ok = cs_cart_add_item_by_id(cart, "TEA", 1) == CS_SUCCESS &&
+       cs_payment_set_given_cents(cart, 900) == CS_SUCCESS;
+  const std::string before_clear = cart_state(cart);
+  ok = ok && cs_cart_checkpoint(cart) == CS_SUCCESS && cs_cart_clear(cart) == CS_SUCCESS &&
+       cart_state(cart) == empty && cs_cart_undo(cart) == CS_SUCCESS &&
+       cart_state(cart) == before_clear && cs_cart_redo(cart) == CS_SUCCESS &&
+       cart_state(cart) == empty;
+  return check(ok, "Undo should restore a cleared cart.");
+}
+
+bool run_reprice(cs_cart_t cart) {
+  bool ok = cs_cart_add_item_by_id(cart, "COFFEE", 2) == CS_SUCCESS &&
+            cs_cart_add_item_by_id(cart, "TEA", 1) == CS_SUCCESS &&
+            cs_catalog_load_json(make_catalog(650).c_str()) == CS_SUCCESS;
+  const std::string old_prices = cart_state(cart);
+  long long total = 0;
+  ok = ok && cs_cart_checkpoint(cart) == CS_SUCCESS &&
+       cs_cart_reprice(cart, CS_REPRICE_KEEP_VANISHED, nullptr) == CS_SUCCESS &&
+       cs_cart_get_total_cents(cart, &total) == CS_SUCCESS && total == 1600 &&
+       cs_cart_undo(cart) == CS_SUCCESS && cart_state(cart) == old_prices &&
+       cs_cart_get_total_cents(cart, &total) == CS_SUCCESS && total == 1300;
+  return check(ok, "Undo should restore the prices before a reprice.");
+}
+
+// A checkpoint per keypress keeps only the changed lines of the latest steps, however long the
+// cart and however many presses.
+bool run_many_lines(cs_cart_t cart) {
+  bool ok = cs_cart_clear(cart) == CS_SUCCESS;
+  for (int i = 0; i < kManyItems && ok; ++i) {
+    ok = cs_cart_add_item_by_id(cart, ("I" + std::to_string(i)).c_str(), 1) == CS_SUCCESS;
+  }
+  const long long before = lines_live_bytes();
+  constexpr int kPresses = 2000;
+  std::string oldest;
+  for (int i = 0; i < kPresses && ok; ++i) {
+    if (i == kPresses - kUndoSteps) {
+      oldest = cart_state(cart);
+    }
+    ok = cs_cart_checkpoint(cart) == CS_SUCCESS &&
+         cs_cart_set_line_qty(cart, (i * 7) % kManyItems, 2 + i % 5) == CS_SUCCESS;
+  }
+  const long long growth = lines_live_bytes() - before;
+  if (!check(ok && before >= 0 && growth < kUndoSteps * 256,
+             "History should grow with the changed lines of the kept steps, not the cart.")) {
+    std::cerr << "lines grew by " << growth << " bytes\n";
+    return false;
+  }
+  for (int i = 0; i < kUndoSteps && ok; ++i) {
+    ok = cs_cart_undo(cart) == CS_SUCCESS;
+  }
+  ok = ok && cart_state(cart) == oldest && cs_cart_undo(cart) == CS_ERROR_INVALID_ARGUMENT &&
+       cs_last_error_code() == CS_ERRC_INVALID_STATE;
+  for (int i = 0; i < kUndoSteps && ok; ++i) {
+    ok = cs_cart_redo(cart) == CS_SUCCESS;
+  }
+  return check(ok && cs_cart_redo(cart) == CS_ERROR_INVALID_ARGUMENT,
+               "Undo should return through the kept steps only, and redo them all.");
+}
+
+bool run_clone(cs_cart_t cart) {
+  cs_cart_t copy = nullptr;
+  bool ok = cs_cart_clear(cart) == CS_SUCCESS &&
+            cs_cart_add_item_by_id(cart, "COFFEE", 3) == CS_SUCCESS &&
+            cs_cart_set_display_locale(cart, "de") == CS_SUCCESS &&
+            cs_payment_set_given_cents(cart, 4000) == CS_SUCCESS &&
+            cs_cart_checkpoint(cart) == CS_SUCCESS &&
+            cs_cart_clone(cart, &copy) == CS_SUCCESS && cart_state(copy) == cart_state(cart);
+  // The copy starts without history and changes independently.
+  ok = ok && cs_cart_undo(copy) == CS_ERROR_INVALID_ARGUMENT &&
+       cs_cart_add_item_by_id(copy, "TEA", 1) == CS_SUCCESS &&
+       cart_state(copy) != cart_state(cart) && cs_cart_add_item_by_id(cart, "I1", 1) == CS_SUCCESS &&
+       cart_state(copy).find("\"I1\"") == std::string::npos;
+  cs_cart_free(copy);
+  return check(ok, "A clone should copy the cart and then change on its own.");
+}
+
+int main() {
+  if (cs_init() != CS_SUCCESS) {
+    std::cerr << "cs_init failed: " << cs_last_error() << "\n";
+    return 1;
+  }
+
+  cs_catalog_t catalog = nullptr;
+  cs_cart_t cart = nullptr;
+  if (!check(cs_catalog_load_json(make_catalog(500).c_str()) == CS_SUCCESS &&
+                 cs_catalog_get_default(&catalog) == CS_SUCCESS &&
+                 cs_cart_new_concurrent(catalog, &cart) == CS_SUCCESS,
+             "Setup failed.")) {
+    cs_shutdown();
+    return 1;
+  }
+
+  if (!run_invalid_arguments(cart) || !run_undo_redo(cart) || !run_reprice(cart) ||
+      !run_many_lines(cart) || !run_clone(cart)) {
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+
+  cs_cart_free(cart);
+  cs_shutdown();
+  return 0;
+}
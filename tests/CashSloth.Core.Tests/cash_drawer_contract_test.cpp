@@ -0,0 +1,222 @@
+#include "cashsloth_core.h"
+
+#include <cstdio>
+#include <iostream>
+#include <string>
+
+bool check(bool condition, const char* message) {
+  if (!condition) {
+    std::cerr << message << "\n";
+    return false;
+  }
+  return true;
+}
+
+constexpr const char* kJournalPath = "cashsloth_cash_drawer_contract.bin";
+
+std::string drawer_json() {
+  char* json = nullptr;
+  if (cs_drawer_get_json(&json) != CS_SUCCESS) {
+    return "failed";
+  }
+  std::string result(json);
+  cs_free(json);
+  return result;
+}
+
+std::string breakdown(cs_cart_t cart) {
+  char* json = nullptr;
+  if (cs_payment_get_change_breakdown(cart, &json) != CS_SUCCESS) {
+    return "failed";
+  }
+  std::string result(json);
+  cs_free(json);
+  return result;
+}
+
+bool contains(const std::string& text, const char* part) {
+  return text.find(part) != std::string::npos;
+}
+
+// A cart holding one `item_id`, paid with `given_cents`.
+cs_cart_t priced_cart(cs_catalog_t catalog, const char* item_id, long long given_cents) {
+  cs_cart_t cart = nullptr;
+  if (cs_cart_new_for_catalog(catalog, &cart) != CS_SUCCESS ||
+      cs_cart_add_item_by_id(cart, item_id, 1) != CS_SUCCESS ||
+      cs_payment_set_given_cents(cart, given_cents) != CS_SUCCESS) {
+    cs_cart_free(cart);
+    return nullptr;
+  }
+  return cart;
+}
+
+bool run_no_drawer(cs_catalog_t catalog) {
+  cs_cart_t cart = priced_cart(catalog, "COFFEE", 1000);
+  char* json = nullptr;
+  const bool ok = cart != nullptr &&
+                  cs_payment_get_change_breakdown(cart, &json) == CS_ERROR_INVALID_ARGUMENT &&
+                  cs_last_error_code() == CS_ERRC_INVALID_STATE &&
+                  cs_drawer_get_json(&json) == CS_ERROR_INVALID_ARGUMENT &&
+                  cs_last_error_code() == CS_ERRC_INVALID_STATE;
+  cs_cart_free(cart);
+  return check(ok, "Without a drawer there should be no counts and no breakdown.");
+}
+
+bool run_round_trip() {
+  const bool ok =
+      cs_drawer_set_json("{\"currency\":\"GBP\",\"counts\":[{\"cents\":1000,\"count\":2},"
+                         "{\"cents\":1,\"count\":7}]}") == CS_SUCCESS &&
+      drawer_json() ==
+          "{\"currency\":\"GBP\",\"total_cents\":2007,\"uncounted_cents\":0,\"counts\":["
+          "{\"cents\":5000,\"count\":0},{\"cents\":2000,\"count\":0},{\"cents\":1000,\"count\":2},"
+          "{\"cents\":500,\"count\":0},{\"cents\":200,\"count\":0},{\"cents\":100,\"count\":0},"
+          "{\"cents\":50,\"count\":0},{\"cents\":20,\"count\":0},{\"cents\":10,\"count\":0},"
+          "{\"cents\":5,\"count\":0},{\"cents\":2,\"count\":0},{\"cents\":1,\"count\":7}]}" &&
+      cs_drawer_set_json(drawer_json().c_str()) == CS_SUCCESS &&
+      contains(drawer_json(), "\"total_cents\":2007,");
+  return check(ok, "Drawer JSON should list every denomination and load back.");
+}
+
+bool run_breakdowns(cs_catalog_t catalog) {
+  // 10.00 for 2.70 from a full drawer: 5.00, 2.00, 0.20 and 0.10.
+  cs_cart_t cart = priced_cart(catalog, "COFFEE", 1000);
+  bool ok = cart != nullptr &&
+            cs_drawer_set_json("{\"currency\":\"EUR\",\"counts\":[{\"cents\":500,\"count\":9},"
+                               "{\"cents\":200,\"count\":9},{\"cents\":20,\"count\":9},"
+                               "{\"cents\":10,\"count\":9}]}") == CS_SUCCESS &&
+            breakdown(cart) == "{\"change_cents\":730,\"piece_count\":4,\"pieces\":["
+                                "{\"cents\":500,\"count\":1},{\"cents\":200,\"count\":1},"
+                                "{\"cents\":20,\"count\":1},{\"cents\":10,\"count\":1}]}";
+  // No 5.00 left: the 2.00 coins cover it.
+  ok = ok &&
+       cs_drawer_set_json("{\"currency\":\"EUR\",\"counts\":[{\"cents\":200,\"count\":9},"
+                          "{\"cents\":20,\"count\":9},{\"cents\":10,\"count\":9}]}") ==
+           CS_SUCCESS &&
+       breakdown(cart) ==
+           "{\"change_cents\":730,\"piece_count\":10,\"pieces\":[{\"cents\":200,\"count\":3},"
+           "{\"cents\":20,\"count\":6},{\"cents\":10,\"count\":1}]}";
+  // Greedy takes the 0.50 coin for 0.60 and is left with 0.10 it cannot pay.
+  ok = ok && cs_payment_set_given_cents(cart, 330) == CS_SUCCESS &&
+       cs_drawer_set_json("{\"currency\":\"EUR\",\"counts\":[{\"cents\":50,\"count\":1},"
+                          "{\"cents\":20,\"count\":3}]}") == CS_SUCCESS &&
+       breakdown(cart) ==
+           "{\"change_cents\":60,\"piece_count\":3,\"pieces\":[{\"cents\":20,\"count\":3}]}";
+  // Nothing to give back.
+  ok = ok && cs_payment_set_given_cents(cart, 100) == CS_SUCCESS &&
+       breakdown(cart) == "{\"change_cents\":0,\"piece_count\":0,\"pieces\":[]}";
+  cs_cart_free(cart);
+
+  // Greedy would pay 0.30 as a quarter and five cents; three dimes are fewer pieces.
+  cart = priced_cart(catalog, "COFFEE", 300);
+  ok = ok &&
+       cs_drawer_set_json("{\"currency\":\"USD\",\"counts\":[{\"cents\":25,\"count\":1},"
+                          "{\"cents\":10,\"count\":3},{\"cents\":1,\"count\":5}]}") ==
+           CS_SUCCESS &&
+       breakdown(cart) ==
+           "{\"change_cents\":30,\"piece_count\":3,\"pieces\":[{\"cents\":10,\"count\":3}]}";
+  cs_cart_free(cart);
+
+  // Swiss francs have no 1 or 2 centime coins.
+  char* json = nullptr;
+  cart = priced_cart(catalog, "COFFEE", 273);
+  ok = ok &&
+       cs_drawer_set_json("{\"currency\":\"CHF\",\"counts\":[{\"cents\":5,\"count\":10}]}") ==
+           CS_SUCCESS &&
+       cs_payment_get_change_breakdown(cart, &json) == CS_ERROR_INVALID_ARGUMENT &&
+       cs_last_error_code() == CS_ERRC_INVALID_STATE &&
+       cs_payment_get_change_breakdown(cart, nullptr) == CS_ERROR_INVALID_ARGUMENT &&
+       cs_last_error_code() == CS_ERRC_NULL_ARGUMENT &&
+       cs_payment_get_change_breakdown(nullptr, &json) == CS_ERROR_INVALID_ARGUMENT &&
+       cs_last_error_code() == CS_ERRC_INVALID_HANDLE;
+  cs_cart_free(cart);
+  return check(ok, "Breakdowns should use the fewest pieces the drawer holds.");
+}
+
+bool commit(cs_cart_t cart, const char* payment_method, long long tip_cents) {
+  cs_sale_meta meta = {};
+  meta.struct_size = sizeof(cs_sale_meta);
+  meta.payment_method = payment_method;
+  meta.tip_cents = tip_cents;
+  meta.completed_unix_ms = 1000;
+  return cs_cart_commit_sale(cart, &meta, nullptr) == CS_SUCCESS;
+}
+
+bool run_commits(cs_catalog_t catalog) {
+  bool ok = cs_journal_open(kJournalPath, 0, nullptr) == CS_SUCCESS &&
+            cs_drawer_set_json("{\"currency\":\"EUR\",\"counts\":[{\"cents\":500,\"count\":1},"
+                               "{\"cents\":200,\"count\":2},{\"cents\":20,\"count\":2},"
+                               "{\"cents\":10,\"count\":2}]}") == CS_SUCCESS;
+  // The 10.00 note goes in and 7.30 comes out.
+  cs_cart_t cart = priced_cart(catalog, "COFFEE", 1000);
+  ok = ok && cart != nullptr && commit(cart, "CASH", 0) &&
+       contains(drawer_json(), "\"total_cents\":1230,\"uncounted_cents\":0,") &&
+       contains(drawer_json(), "{\"cents\":1000,\"count\":1},{\"cents\":500,\"count\":0},"
+                               "{\"cents\":200,\"count\":1}");
+  cs_cart_free(cart);
+  // Card sales leave the drawer alone.
+  cart = priced_cart(catalog, "COFFEE", 1000);
+  ok = ok && cart != nullptr && commit(cart, "Card", 0) &&
+       contains(drawer_json(), "\"total_cents\":1230,");
+  cs_cart_free(cart);
+  // A tip stays in the drawer: 5.00 paid, 2.70 plus 0.30 tip, 2.00 back.
+  cart = priced_cart(catalog, "COFFEE", 500);
+  ok = ok && cart != nullptr && commit(cart, "Cash", 30) &&
+       contains(drawer_json(), "\"total_cents\":1530,") &&
+       contains(drawer_json(), "{\"cents\":500,\"count\":1},{\"cents\":200,\"count\":0}");
+  cs_cart_free(cart);
+  // Change the counts cannot pay is recorded as uncounted; the sale still commits.
+  cart = priced_cart(catalog, "COFFEE", 5000);
+  ok = ok && cart != nullptr && commit(cart, "Cash", 0) &&
+       contains(drawer_json(), "\"total_cents\":6530,\"uncounted_cents\":-4730,");
+  cs_cart_free(cart);
+  ok = ok && cs_journal_close() == CS_SUCCESS;
+  return check(ok, "Cash sales should move their pieces through the drawer.");
+}
+
+bool run_invalid() {
+  auto rejected = [](const char* json) {
+    return cs_drawer_set_json(json) == CS_ERROR_INVALID_ARGUMENT &&
+           cs_last_error_code() == CS_ERRC_INVALID_VALUE;
+  };
+  char* json = nullptr;
+  const bool ok =
+      rejected("[]") && rejected("{\"currency\":\"XYZ\"}") && rejected("{\"counts\":[]}") &&
+      rejected("{\"currency\":\"EUR\",\"counts\":[{\"cents\":3,\"count\":1}]}") &&
+      rejected("{\"currency\":\"EUR\",\"counts\":[{\"cents\":5,\"count\":-1}]}") &&
+      rejected("{\"currency\":\"EUR\",\"counts\":[{\"cents\":5,\"count\":1.5}]}") &&
+      rejected("{\"currency\":\"EUR\",\"counts\":[{\"cents\":5,\"count\":1},"
+               "{\"cents\":5,\"count\":2}]}") &&
+      rejected("{\"currency\":\"EUR\",\"float\":1}") &&
+      // Rejected input keeps the drawer; null removes it.
+      contains(drawer_json(), "\"currency\":\"EUR\"") &&
+      cs_drawer_set_json(nullptr) == CS_SUCCESS &&
+      cs_drawer_get_json(&json) == CS_ERROR_INVALID_ARGUMENT &&
+      cs_drawer_get_json(nullptr) == CS_ERROR_INVALID_ARGUMENT &&
+      cs_last_error_code() == CS_ERRC_NULL_ARGUMENT;
+  return check(ok, "Invalid drawer JSON should be rejected.");
+}
+
+int main() {
+  std::remove(kJournalPath);
+  if (cs_init() != CS_SUCCESS) {
+    std::cerr << "cs_init failed: " << cs_last_error() << "\n";
+    return 1;
+  }
+
+  cs_catalog_t catalog = nullptr;
+  if (!check(cs_catalog_new("drawer", &catalog) == CS_SUCCESS &&
+                 cs_catalog_instance_load_json(
+                     catalog, "{\"items\":[{\"id\":\"COFFEE\",\"name\":\"Coffee\","
+                              "\"unit_cents\":270}]}") == CS_SUCCESS,
+             "Setup failed.")) {
+    cs_shutdown();
+    return 1;
+  }
+
+  const bool ok = run_no_drawer(catalog) && run_round_trip() && run_breakdowns(catalog) &&
+                  run_commits(catalog) && run_invalid();
+  cs_catalog_free(catalog);
+  cs_shutdown();
+  std::remove(kJournalPath);
+  return ok ? 0 : 1;
+}
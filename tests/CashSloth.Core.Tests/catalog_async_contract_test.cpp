@@ -0,0 +1,260 @@
+#include "cashsloth_core.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+
+bool check(bool condition, const char* message) {
+  if (!condition) {
+    std::cerr << message << "\n";
+    return false;
+  }
+  return true;
+}
+
+namespace {
+std::atomic<bool> g_release_worker{false};
+std::atomic<int> g_callback_count{0};
+
+void blocking_callback(cs_load_ticket_t, int, void*) {
+  while (!g_release_worker.load()) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
+
+void counting_callback(cs_load_ticket_t, int state, void* user_data) {
+  *static_cast<int*>(user_data) = state;
+  g_callback_count.fetch_add(1);
+}
+
+std::string build_catalog(int item_count, int unit_cents) {
+  std::string json = "{\"items\":[";
+  for (int i = 0; i < item_count; ++i) {
+    if (i > 0) {
+      json += ",";
+    }
+    json += "{\"id\":\"ITEM" + std::to_string(i) + "\",\"name\":\"Item\",\"unit_cents\":" +
+            std::to_string(unit_cents) + "}";
+  }
+  json += "]}";
+  return json;
+}
+}  // namespace
+
+int main() {
+  if (cs_init() != CS_SUCCESS) {
+    std::cerr << "cs_init failed: " << cs_last_error() << "\n";
+    return 1;
+  }
+
+  cs_catalog_t catalog = nullptr;
+  if (!check(cs_catalog_get_default(&catalog) == CS_SUCCESS, "cs_catalog_get_default failed.")) {
+    cs_shutdown();
+    return 1;
+  }
+  if (!check(cs_catalog_load_json(build_catalog(4, 100).c_str()) == CS_SUCCESS,
+             "Initial catalog load failed.")) {
+    cs_shutdown();
+    return 1;
+  }
+
+  cs_cart_t cart = nullptr;
+  if (!check(cs_cart_new(&cart) == CS_SUCCESS, "cs_cart_new failed.")) {
+    cs_shutdown();
+    return 1;
+  }
+
+  // A large background load completes and becomes visible to the cart.
+  const std::string large_catalog = build_catalog(20000, 250);
+  cs_load_ticket_t ticket = nullptr;
+  if (!check(cs_catalog_load_json_async(catalog, large_catalog.c_str(), nullptr, nullptr,
+                                        &ticket) == CS_SUCCESS &&
+                 ticket != nullptr,
+             "cs_catalog_load_json_async failed.")) {
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+  if (!check(cs_cart_add_item_by_id(cart, "ITEM1", 1) == CS_SUCCESS,
+             "Cart operations should keep working while a load is in flight.")) {
+    cs_load_ticket_free(ticket);
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+  int state = CS_LOAD_PENDING;
+  if (!check(cs_load_ticket_wait(ticket, -1, &state) == CS_SUCCESS && state == CS_LOAD_SUCCEEDED,
+             "Large async load should succeed.")) {
+    cs_load_ticket_free(ticket);
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+  cs_load_ticket_free(ticket);
+  if (!check(cs_cart_add_item_by_id(cart, "ITEM19999", 1) == CS_SUCCESS,
+             "Items from the async load should be visible after the swap.")) {
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+
+  // Invalid JSON fails on the worker and reports the parse error when polled.
+  if (!check(cs_catalog_load_json_async(catalog, "{invalid", nullptr, nullptr, &ticket) ==
+                 CS_SUCCESS,
+             "Submitting an invalid async load should succeed.")) {
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+  if (!check(cs_load_ticket_wait(ticket, -1, &state) == CS_SUCCESS && state == CS_LOAD_FAILED,
+             "Invalid async load should fail.")) {
+    cs_load_ticket_free(ticket);
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+  if (!check(std::strstr(cs_last_error(), "Invalid catalog JSON") != nullptr,
+             "Polling a failed load should expose the parse error.")) {
+    cs_load_ticket_free(ticket);
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+  cs_load_ticket_free(ticket);
+
+  // Hold the worker inside a callback so the following loads queue up behind it.
+  cs_load_ticket_t blocker = nullptr;
+  cs_load_ticket_t superseded = nullptr;
+  cs_load_ticket_t cancelled = nullptr;
+  cs_load_ticket_t latest = nullptr;
+  int latest_state = -1;
+  if (!check(cs_catalog_load_json_async(catalog, build_catalog(2, 100).c_str(), blocking_callback,
+                                        nullptr, &blocker) == CS_SUCCESS,
+             "Submitting the blocking load failed.")) {
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+  while (cs_load_ticket_poll(blocker, &state) == CS_SUCCESS && state != CS_LOAD_SUCCEEDED) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  cs_catalog_t other = nullptr;
+  if (!check(cs_catalog_new("async-other", &other) == CS_SUCCESS, "cs_catalog_new failed.")) {
+    g_release_worker = true;
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+  const bool submitted =
+      cs_catalog_load_json_async(catalog, build_catalog(3, 100).c_str(), nullptr, nullptr,
+                                 &superseded) == CS_SUCCESS &&
+      cs_catalog_load_json_async(other, build_catalog(3, 100).c_str(), nullptr, nullptr,
+                                 &cancelled) == CS_SUCCESS &&
+      cs_catalog_load_json_async(catalog, build_catalog(5, 300).c_str(), counting_callback,
+                                 &latest_state, &latest) == CS_SUCCESS;
+  const bool cancel_ok = cs_load_ticket_cancel(cancelled) == CS_SUCCESS;
+  g_release_worker = true;
+  if (!check(submitted && cancel_ok, "Queueing loads behind the blocker failed.")) {
+    cs_catalog_free(other);
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+
+  int superseded_state = -1;
+  int cancelled_state = -1;
+  cs_load_ticket_wait(superseded, -1, &superseded_state);
+  cs_load_ticket_wait(cancelled, -1, &cancelled_state);
+  cs_load_ticket_wait(latest, -1, &state);
+  if (!check(superseded_state == CS_LOAD_CANCELLED,
+             "A load superseded by a newer load for the same catalog should be cancelled.")) {
+    cs_catalog_free(other);
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+  if (!check(cancelled_state == CS_LOAD_CANCELLED, "An explicitly cancelled load should not run.")) {
+    cs_catalog_free(other);
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+  if (!check(state == CS_LOAD_SUCCEEDED && latest_state == CS_LOAD_SUCCEEDED &&
+                 g_callback_count.load() == 1,
+             "The latest load should succeed and invoke its callback once.")) {
+    cs_catalog_free(other);
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+  cs_load_ticket_free(blocker);
+  cs_load_ticket_free(superseded);
+  cs_load_ticket_free(cancelled);
+  cs_load_ticket_free(latest);
+  if (!check(cs_load_ticket_poll(latest, &state) == CS_ERROR_INVALID_ARGUMENT,
+             "A freed ticket should be rejected.")) {
+    cs_catalog_free(other);
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+
+  // File variant.
+  const char* path = "catalog_async_contract_test.json";
+  std::FILE* file = std::fopen(path, "wb");
+  if (!check(file != nullptr, "Unable to create temporary catalog file.")) {
+    cs_catalog_free(other);
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+  const std::string file_catalog =
+      "{\"items\":[{\"id\":\"FILE\",\"name\":\"From file\",\"unit_cents\":900}]}";
+  std::fwrite(file_catalog.data(), 1, file_catalog.size(), file);
+  std::fclose(file);
+  if (!check(cs_catalog_load_file_async(other, path, nullptr, nullptr, &ticket) == CS_SUCCESS,
+             "cs_catalog_load_file_async failed.")) {
+    std::remove(path);
+    cs_catalog_free(other);
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+  cs_load_ticket_wait(ticket, -1, &state);
+  cs_load_ticket_free(ticket);
+  std::remove(path);
+  cs_cart_t other_cart = nullptr;
+  if (!check(state == CS_LOAD_SUCCEEDED && cs_cart_new_for_catalog(other, &other_cart) == CS_SUCCESS &&
+                 cs_cart_add_item_by_id(other_cart, "FILE", 1) == CS_SUCCESS,
+             "File-based async load should publish its items.")) {
+    cs_cart_free(other_cart);
+    cs_catalog_free(other);
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+
+  if (!check(cs_catalog_load_file_async(other, "does-not-exist.json", nullptr, nullptr, &ticket) ==
+                     CS_SUCCESS &&
+                 cs_load_ticket_wait(ticket, -1, &state) == CS_SUCCESS && state == CS_LOAD_FAILED,
+             "Loading a missing file should fail.")) {
+    cs_load_ticket_free(ticket);
+    cs_cart_free(other_cart);
+    cs_catalog_free(other);
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+  cs_load_ticket_free(ticket);
+
+  cs_cart_free(other_cart);
+  cs_catalog_free(other);
+  cs_cart_free(cart);
+  cs_shutdown();
+  return 0;
+}
@@ -0,0 +1,254 @@
+#include "cashsloth_core.h"
+
+#include <cstring>
+#include <iostream>
+
+bool check(bool condition, const char* message) {
+  if (!condition) {
+    std::cerr << message << "\n";
+    return false;
+  }
+  return true;
+}
+
+int main() {
+  if (cs_init() != CS_SUCCESS) {
+    std::cerr << "cs_init failed: " << cs_last_error() << "\n";
+    return 1;
+  }
+
+  const char* default_catalog_json =
+      "{\"items\":[{\"id\":\"COFFEE\",\"name\":\"Coffee\",\"unit_cents\":500}]}";
+  if (!check(cs_catalog_load_json(default_catalog_json) == CS_SUCCESS,
+             "cs_catalog_load_json for default catalog failed.")) {
+    cs_shutdown();
+    return 1;
+  }
+
+  cs_catalog_t default_catalog = nullptr;
+  if (!check(cs_catalog_get_default(&default_catalog) == CS_SUCCESS && default_catalog != nullptr,
+             "cs_catalog_get_default failed.")) {
+    cs_shutdown();
+    return 1;
+  }
+  cs_catalog_t found = nullptr;
+  if (!check(cs_catalog_find("default", &found) == CS_SUCCESS && found == default_catalog,
+             "cs_catalog_find should resolve the default catalog by name.")) {
+    cs_shutdown();
+    return 1;
+  }
+  if (!check(cs_catalog_free(default_catalog) == CS_ERROR_INVALID_ARGUMENT,
+             "Freeing the default catalog should fail.")) {
+    cs_shutdown();
+    return 1;
+  }
+
+  cs_catalog_t festival = nullptr;
+  if (!check(cs_catalog_new("festival", &festival) == CS_SUCCESS && festival != nullptr,
+             "cs_catalog_new festival failed.")) {
+    cs_shutdown();
+    return 1;
+  }
+  cs_catalog_t duplicate = nullptr;
+  if (!check(cs_catalog_new("festival", &duplicate) == CS_ERROR_INVALID_ARGUMENT,
+             "Duplicate catalog names should fail.")) {
+    cs_catalog_free(festival);
+    cs_shutdown();
+    return 1;
+  }
+  if (!check(cs_catalog_find("festival", &found) == CS_SUCCESS && found == festival,
+             "cs_catalog_find festival failed.")) {
+    cs_catalog_free(festival);
+    cs_shutdown();
+    return 1;
+  }
+
+  const char* festival_json =
+      "{\"items\":[{\"id\":\"COFFEE\",\"name\":\"Festival Coffee\",\"unit_cents\":450},"
+      "{\"id\":\"BEER\",\"name\":\"Beer\",\"unit_cents\":700}]}";
+  if (!check(cs_catalog_instance_load_json(festival, festival_json) == CS_SUCCESS,
+             "cs_catalog_instance_load_json festival failed.")) {
+    cs_catalog_free(festival);
+    cs_shutdown();
+    return 1;
+  }
+
+  unsigned long long generation = 0;
+  if (!check(cs_catalog_get_generation(festival, &generation) == CS_SUCCESS && generation == 1,
+             "Festival catalog generation should be 1 after the first load.")) {
+    cs_catalog_free(festival);
+    cs_shutdown();
+    return 1;
+  }
+
+  char* catalog_json = nullptr;
+  if (!check(cs_catalog_instance_get_json(festival, &catalog_json) == CS_SUCCESS,
+             "cs_catalog_instance_get_json festival failed.")) {
+    cs_catalog_free(festival);
+    cs_shutdown();
+    return 1;
+  }
+  if (!check(std::strstr(catalog_json, "\"id\":\"BEER\"") != nullptr,
+             "Festival catalog JSON should contain BEER.")) {
+    cs_free(catalog_json);
+    cs_catalog_free(festival);
+    cs_shutdown();
+    return 1;
+  }
+  cs_free(catalog_json);
+
+  if (!check(cs_catalog_get_json(&catalog_json) == CS_SUCCESS,
+             "cs_catalog_get_json failed.")) {
+    cs_catalog_free(festival);
+    cs_shutdown();
+    return 1;
+  }
+  if (!check(std::strstr(catalog_json, "\"id\":\"BEER\"") == nullptr,
+             "Default catalog must not see items of another catalog.")) {
+    cs_free(catalog_json);
+    cs_catalog_free(festival);
+    cs_shutdown();
+    return 1;
+  }
+  cs_free(catalog_json);
+
+  cs_cart_t default_cart = nullptr;
+  cs_cart_t festival_cart = nullptr;
+  if (!check(cs_cart_new(&default_cart) == CS_SUCCESS, "cs_cart_new failed.")) {
+    cs_catalog_free(festival);
+    cs_shutdown();
+    return 1;
+  }
+  if (!check(cs_cart_new_for_catalog(festival, &festival_cart) == CS_SUCCESS,
+             "cs_cart_new_for_catalog failed.")) {
+    cs_cart_free(default_cart);
+    cs_catalog_free(festival);
+    cs_shutdown();
+    return 1;
+  }
+
+  if (!check(cs_cart_add_item_by_id(default_cart, "COFFEE", 1) == CS_SUCCESS &&
+                 cs_cart_add_item_by_id(festival_cart, "COFFEE", 1) == CS_SUCCESS,
+             "Adding COFFEE to both carts failed.")) {
+    cs_cart_free(festival_cart);
+    cs_cart_free(default_cart);
+    cs_catalog_free(festival);
+    cs_shutdown();
+    return 1;
+  }
+  if (!check(cs_cart_add_item_by_id(default_cart, "BEER", 1) == CS_ERROR_INVALID_ARGUMENT,
+             "BEER should be unknown in the default catalog.")) {
+    cs_cart_free(festival_cart);
+    cs_cart_free(default_cart);
+    cs_catalog_free(festival);
+    cs_shutdown();
+    return 1;
+  }
+
+  long long total_cents = 0;
+  if (!check(cs_cart_get_total_cents(default_cart, &total_cents) == CS_SUCCESS &&
+                 total_cents == 500,
+             "Default cart should use default catalog prices.")) {
+    cs_cart_free(festival_cart);
+    cs_cart_free(default_cart);
+    cs_catalog_free(festival);
+    cs_shutdown();
+    return 1;
+  }
+  if (!check(cs_cart_get_total_cents(festival_cart, &total_cents) == CS_SUCCESS &&
+                 total_cents == 450,
+             "Festival cart should use festival catalog prices.")) {
+    cs_cart_free(festival_cart);
+    cs_cart_free(default_cart);
+    cs_catalog_free(festival);
+    cs_shutdown();
+    return 1;
+  }
+
+  // Reloading the default catalog must not touch the festival cart or its names.
+  const char* default_reload =
+      "{\"items\":[{\"id\":\"COFFEE\",\"name\":\"House Coffee\",\"unit_cents\":550}]}";
+  if (!check(cs_catalog_load_json(default_reload) == CS_SUCCESS,
+             "Default catalog reload failed.")) {
+    cs_cart_free(festival_cart);
+    cs_cart_free(default_cart);
+    cs_catalog_free(festival);
+    cs_shutdown();
+    return 1;
+  }
+
+  char* lines_json = nullptr;
+  if (!check(cs_cart_get_lines_json(festival_cart, &lines_json) == CS_SUCCESS,
+             "cs_cart_get_lines_json festival cart failed.")) {
+    cs_cart_free(festival_cart);
+    cs_cart_free(default_cart);
+    cs_catalog_free(festival);
+    cs_shutdown();
+    return 1;
+  }
+  if (!check(std::strstr(lines_json, "\"name\":\"Festival Coffee\"") != nullptr &&
+                 std::strstr(lines_json, "\"total_cents\":450") != nullptr,
+             "Festival cart should be unaffected by a default catalog reload.")) {
+    cs_free(lines_json);
+    cs_cart_free(festival_cart);
+    cs_cart_free(default_cart);
+    cs_catalog_free(festival);
+    cs_shutdown();
+    return 1;
+  }
+  cs_free(lines_json);
+
+  // Rebinding keeps existing lines and resolves new items against the new catalog.
+  if (!check(cs_cart_bind_catalog(default_cart, festival) == CS_SUCCESS,
+             "cs_cart_bind_catalog failed.")) {
+    cs_cart_free(festival_cart);
+    cs_cart_free(default_cart);
+    cs_catalog_free(festival);
+    cs_shutdown();
+    return 1;
+  }
+  if (!check(cs_cart_add_item_by_id(default_cart, "BEER", 1) == CS_SUCCESS,
+             "BEER should be available after binding to the festival catalog.")) {
+    cs_cart_free(festival_cart);
+    cs_cart_free(default_cart);
+    cs_catalog_free(festival);
+    cs_shutdown();
+    return 1;
+  }
+  if (!check(cs_cart_get_total_cents(default_cart, &total_cents) == CS_SUCCESS &&
+                 total_cents == 1200,
+             "Rebound cart total should keep the stored COFFEE price.")) {
+    cs_cart_free(festival_cart);
+    cs_cart_free(default_cart);
+    cs_catalog_free(festival);
+    cs_shutdown();
+    return 1;
+  }
+
+  // Carts keep the catalog alive after its handle is released.
+  if (!check(cs_catalog_free(festival) == CS_SUCCESS, "cs_catalog_free festival failed.")) {
+    cs_cart_free(festival_cart);
+    cs_cart_free(default_cart);
+    cs_shutdown();
+    return 1;
+  }
+  if (!check(cs_catalog_instance_load_json(festival, festival_json) == CS_ERROR_INVALID_ARGUMENT,
+             "A freed catalog handle should be rejected.")) {
+    cs_cart_free(festival_cart);
+    cs_cart_free(default_cart);
+    cs_shutdown();
+    return 1;
+  }
+  if (!check(cs_cart_add_item_by_id(festival_cart, "BEER", 1) == CS_SUCCESS,
+             "Carts should keep working after their catalog handle is freed.")) {
+    cs_cart_free(festival_cart);
+    cs_cart_free(default_cart);
+    cs_shutdown();
+    return 1;
+  }
+
+  cs_cart_free(festival_cart);
+  cs_cart_free(default_cart);
+  cs_shutdown();
+  return 0;
+}
@@ -0,0 +1,191 @@
+#include "cashsloth_core.h"
+
+#include <cstring>
+#include <iostream>
+#include <string>
+
+bool check(bool condition, const char* message) {
+  if (!condition) {
+    std::cerr << message << "\n";
+    return false;
+  }
+  return true;
+}
+
+namespace {
+std::string cart_json(cs_cart_t cart) {
+  char* json = nullptr;
+  if (cs_cart_get_lines_json(cart, &json) != CS_SUCCESS) {
+    return std::string();
+  }
+  std::string result = json;
+  cs_free(json);
+  return result;
+}
+
+std::string catalog_json() {
+  char* json = nullptr;
+  if (cs_catalog_get_json(&json) != CS_SUCCESS) {
+    return std::string();
+  }
+  std::string result = json;
+  cs_free(json);
+  return result;
+}
+
+bool contains(const std::string& haystack, const char* needle) {
+  return haystack.find(needle) != std::string::npos;
+}
+}  // namespace
+
+int main() {
+  if (cs_init() != CS_SUCCESS) {
+    std::cerr << "cs_init failed: " << cs_last_error() << "\n";
+    return 1;
+  }
+
+  const char* localized_catalog =
+      "{\"items\":[{\"id\":\"COFFEE\",\"name\":\"Coffee\",\"unit_cents\":500,"
+      "\"names\":{\"de\":\"Kaffee\",\"fr\":\"Caf\\u00e9\"}},"
+      "{\"id\":\"TEA\",\"name\":\"Tea\",\"unit_cents\":400,\"names\":{\"de\":\"Tee\"}},"
+      "{\"id\":\"WATER\",\"name\":\"Water\",\"unit_cents\":200}]}";
+  if (!check(cs_catalog_load_json(localized_catalog) == CS_SUCCESS,
+             "Loading a localized catalog failed.")) {
+    cs_shutdown();
+    return 1;
+  }
+
+  const char* invalid_names =
+      "{\"items\":[{\"id\":\"COFFEE\",\"unit_cents\":500,\"names\":{\"de\":5}}]}";
+  if (!check(cs_catalog_load_json(invalid_names) == CS_ERROR_INVALID_ARGUMENT &&
+                 std::strstr(cs_last_error(), "names") != nullptr,
+             "Non-string translations should be rejected.")) {
+    cs_shutdown();
+    return 1;
+  }
+  if (!check(cs_catalog_load_json("{\"items\":[{\"id\":\"A\",\"unit_cents\":1,\"names\":[]}]}") ==
+                 CS_ERROR_INVALID_ARGUMENT,
+             "A names value that is not an object should be rejected.")) {
+    cs_shutdown();
+    return 1;
+  }
+
+  cs_catalog_t catalog = nullptr;
+  cs_catalog_get_default(&catalog);
+  unsigned long long generation_before = 0;
+  cs_catalog_get_generation(catalog, &generation_before);
+
+  cs_cart_t cart = nullptr;
+  if (!check(cs_cart_new(&cart) == CS_SUCCESS, "cs_cart_new failed.")) {
+    cs_shutdown();
+    return 1;
+  }
+  if (!check(cs_cart_add_item_by_id(cart, "COFFEE", 1) == CS_SUCCESS &&
+                 cs_cart_add_item_by_id(cart, "TEA", 1) == CS_SUCCESS &&
+                 cs_cart_add_item_by_id(cart, "WATER", 1) == CS_SUCCESS,
+             "Adding items failed.")) {
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+
+  std::string json = cart_json(cart);
+  if (!check(contains(json, "\"name\":\"Coffee\"") && contains(json, "\"name\":\"Tea\""),
+             "Without a display locale the base names should be used.")) {
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+
+  if (!check(cs_catalog_set_display_locale(catalog, "de") == CS_SUCCESS,
+             "cs_catalog_set_display_locale failed.")) {
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+  json = cart_json(cart);
+  if (!check(contains(json, "\"name\":\"Kaffee\"") && contains(json, "\"name\":\"Tee\"") &&
+                 contains(json, "\"name\":\"Water\""),
+             "The catalog display locale should select German names with base fallback.")) {
+    std::cerr << json << "\n";
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+
+  const std::string catalog_de = catalog_json();
+  if (!check(contains(catalog_de, "\"name\":\"Kaffee\"") &&
+                 contains(catalog_de, "\"names\":{\"de\":\"Kaffee\",\"fr\":\"Caf\xc3\xa9\"}") &&
+                 contains(catalog_de, "{\"id\":\"WATER\",\"name\":\"Water\",\"unit_cents\":200}"),
+             "Catalog JSON should emit the display name and the explicit translations.")) {
+    std::cerr << catalog_de << "\n";
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+
+  // A per-cart locale overrides the catalog's, and region tags fall back to the language.
+  if (!check(cs_cart_set_display_locale(cart, "fr-CH") == CS_SUCCESS,
+             "cs_cart_set_display_locale failed.")) {
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+  json = cart_json(cart);
+  if (!check(contains(json, "\"name\":\"Caf\xc3\xa9\"") && contains(json, "\"name\":\"Tea\""),
+             "The cart locale fr-CH should resolve to French names with base fallback.")) {
+    std::cerr << json << "\n";
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+
+  if (!check(cs_cart_set_display_locale(cart, "it") == CS_SUCCESS &&
+                 contains(cart_json(cart), "\"name\":\"Coffee\""),
+             "An unknown locale should fall back to base names.")) {
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+
+  if (!check(cs_cart_set_display_locale(cart, nullptr) == CS_SUCCESS &&
+                 contains(cart_json(cart), "\"name\":\"Kaffee\""),
+             "Clearing the cart locale should inherit the catalog locale.")) {
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+
+  unsigned long long generation_after = 0;
+  cs_catalog_get_generation(catalog, &generation_after);
+  if (!check(generation_after == generation_before,
+             "Switching the display locale must not reload the catalog.")) {
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+
+  // The display locale survives reloads.
+  const char* reloaded_catalog =
+      "{\"items\":[{\"id\":\"COFFEE\",\"name\":\"Coffee\",\"unit_cents\":500,"
+      "\"names\":{\"de\":\"Filterkaffee\"}}]}";
+  if (!check(cs_catalog_load_json(reloaded_catalog) == CS_SUCCESS &&
+                 contains(catalog_json(), "\"name\":\"Filterkaffee\""),
+             "The catalog display locale should apply to reloaded snapshots.")) {
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+
+  if (!check(cs_catalog_set_display_locale(catalog, "") == CS_SUCCESS &&
+                 contains(catalog_json(), "\"name\":\"Coffee\""),
+             "An empty display locale should restore base names.")) {
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+
+  cs_cart_free(cart);
+  cs_shutdown();
+  return 0;
+}
@@ -0,0 +1,159 @@
+#include "cashsloth_core.h"
+
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+bool check(bool condition, const char* message) {
+  if (!condition) {
+    std::cerr << message << "\n";
+    return false;
+  }
+  return true;
+}
+
+namespace {
+constexpr int kItemCount = 5000;
+
+std::string item_json(int index) {
+  return "{\"id\":\"ITEM" + std::to_string(index) + "\",\"name\":\"Item " + std::to_string(index) +
+         "\",\"unit_cents\":" + std::to_string(100 + index) + "}";
+}
+
+// Builds a large catalog and replaces selected positions with custom item JSON.
+std::string build_catalog(const std::vector<std::pair<int, std::string>>& overrides) {
+  std::string json = "{\"items\":[";
+  for (int i = 0; i < kItemCount; ++i) {
+    if (i > 0) {
+      json += ",";
+    }
+    std::string item = item_json(i);
+    for (const auto& entry : overrides) {
+      if (entry.first == i) {
+        item = entry.second;
+      }
+    }
+    json += item;
+  }
+  json += "]}";
+  return json;
+}
+
+struct LoadResult {
+  int code = 0;
+  std::string error;
+  std::string catalog;
+};
+
+LoadResult load_with_threads(const std::string& json, int threads) {
+  LoadResult result;
+  cs_catalog_set_load_threads(threads);
+  result.code = cs_catalog_load_json(json.c_str());
+  result.error = cs_last_error();
+  char* catalog_json = nullptr;
+  if (cs_catalog_get_json(&catalog_json) == CS_SUCCESS) {
+    result.catalog = catalog_json;
+    cs_free(catalog_json);
+  }
+  return result;
+}
+}  // namespace
+
+int main() {
+  if (cs_init() != CS_SUCCESS) {
+    std::cerr << "cs_init failed: " << cs_last_error() << "\n";
+    return 1;
+  }
+
+  if (!check(cs_catalog_set_load_threads(-1) == CS_ERROR_INVALID_ARGUMENT &&
+                 cs_catalog_set_load_threads(65) == CS_ERROR_INVALID_ARGUMENT,
+             "Out-of-range thread counts should be rejected.")) {
+    cs_shutdown();
+    return 1;
+  }
+
+  const std::vector<std::vector<std::pair<int, std::string>>> cases = {
+      {},
+      // Duplicate across chunks.
+      {{4500, "{\"id\":\"ITEM5\",\"unit_cents\":1}"}},
+      // Two duplicates; the earlier second occurrence must win.
+      {{4800, "{\"id\":\"ITEM1\",\"unit_cents\":1}"}, {3500, "{\"id\":\"ITEM3000\",\"unit_cents\":1}"}},
+      // A validation error before a duplicate.
+      {{2000, "{\"id\":\"BAD\",\"unit_cents\":-1}"}, {4000, "{\"id\":\"ITEM2\",\"unit_cents\":1}"}},
+      // A duplicate before a validation error.
+      {{2000, "{\"id\":\"ITEM3\",\"unit_cents\":1}"}, {4000, "{\"id\":\"BAD\",\"unit_cents\":1.5}"}},
+      // Duplicate id with an invalid price: the duplicate check runs first.
+      {{1500, "{\"id\":\"ITEM10\",\"unit_cents\":\"x\"}"}},
+      // Shape and id errors.
+      {{1500, "42"}},
+      {{1500, "{\"id\":7,\"unit_cents\":1}"}},
+      {{1500, "{\"id\":\"\",\"unit_cents\":1}"}},
+      {{4999, "{\"id\":\"LAST\",\"name\":5,\"unit_cents\":1}"}},
+      // Translations spread across chunks, then an invalid translation.
+      {{100, "{\"id\":\"ITEM100\",\"unit_cents\":5,\"names\":{\"de\":\"X\",\"fr\":\"Y\"}}"},
+       {4000, "{\"id\":\"ITEM4000\",\"unit_cents\":5,\"names\":{\"it\":\"Z\"}}"}},
+      {{100, "{\"id\":\"ITEM100\",\"unit_cents\":5,\"names\":{\"de\":\"X\"}}"},
+       {3000, "{\"id\":\"ITEM3000\",\"unit_cents\":5,\"names\":{\"de\":1}}"}},
+      // Id error after a duplicate in another shard.
+      {{2500, "{\"id\":\"ITEM0\",\"unit_cents\":1}"}, {2400, "[]"}},
+  };
+
+  for (size_t c = 0; c < cases.size(); ++c) {
+    const std::string json = build_catalog(cases[c]);
+    cs_catalog_load_json("{\"items\":[]}");
+    const LoadResult serial = load_with_threads(json, 1);
+    for (int threads : {2, 3, 4, 8}) {
+      cs_catalog_load_json("{\"items\":[]}");
+      const LoadResult parallel = load_with_threads(json, threads);
+      if (!check(parallel.code == serial.code,
+                 "Parallel load result code should match the serial path.")) {
+        std::cerr << "case " << c << ", threads " << threads << "\n";
+        cs_shutdown();
+        return 1;
+      }
+      if (!check(parallel.error == serial.error,
+                 "Parallel load error message should match the serial path.")) {
+        std::cerr << "case " << c << ", threads " << threads << ": '" << parallel.error
+                  << "' vs '" << serial.error << "'\n";
+        cs_shutdown();
+        return 1;
+      }
+      if (!check(parallel.catalog == serial.catalog,
+                 "Parallel load should produce the same catalog as the serial path.")) {
+        std::cerr << "case " << c << ", threads " << threads << "\n";
+        cs_shutdown();
+        return 1;
+      }
+    }
+  }
+
+  // Lookups go through the sharded index built by the parallel path.
+  cs_catalog_set_load_threads(8);
+  if (!check(cs_catalog_load_json(build_catalog({}).c_str()) == CS_SUCCESS,
+             "Parallel load of a valid catalog failed.")) {
+    cs_shutdown();
+    return 1;
+  }
+  cs_cart_t cart = nullptr;
+  if (!check(cs_cart_new(&cart) == CS_SUCCESS, "cs_cart_new failed.")) {
+    cs_shutdown();
+    return 1;
+  }
+  long long total_cents = 0;
+  if (!check(cs_cart_add_item_by_id(cart, "ITEM0", 1) == CS_SUCCESS &&
+                 cs_cart_add_item_by_id(cart, "ITEM4999", 1) == CS_SUCCESS &&
+                 cs_cart_add_item_by_id(cart, "ITEM5000", 1) == CS_ERROR_INVALID_ARGUMENT &&
+                 cs_cart_get_total_cents(cart, &total_cents) == CS_SUCCESS &&
+                 total_cents == 100 + 5099,
+             "Items should resolve through the parallel-built index.")) {
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+
+  cs_catalog_set_load_threads(1);
+  cs_cart_free(cart);
+  cs_shutdown();
+  return 0;
+}
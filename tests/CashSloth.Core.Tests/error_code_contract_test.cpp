@@ -0,0 +1,140 @@
+#include "cashsloth_core.h"
+
+#include <cstring>
+#include <iostream>
+#include <string>
+
+bool check(bool condition, const char* message) {
+  if (!condition) {
+    std::cerr << message << "\n";
+    return false;
+  }
+  return true;
+}
+
+bool last_error_is(int code, const std::string& message) {
+  return cs_last_error_code() == code && message == cs_last_error();
+}
+
+int main() {
+  if (cs_init() != CS_SUCCESS) {
+    std::cerr << "cs_init failed: " << cs_last_error() << "\n";
+    return 1;
+  }
+
+  const char* catalog_json =
+      "{\"items\":[{\"id\":\"COFFEE\",\"name\":\"Coffee\",\"unit_cents\":500},"
+      "{\"id\":\"GOLD\",\"name\":\"Gold bar\",\"unit_cents\":5000000000000000000},"
+      "{\"id\":\"PLATINUM\",\"name\":\"Platinum bar\",\"unit_cents\":5000000000000000000}]}";
+  cs_cart_t cart = nullptr;
+  if (!check(cs_catalog_load_json(catalog_json) == CS_SUCCESS && cs_cart_new(&cart) == CS_SUCCESS,
+             "Setup failed.")) {
+    cs_shutdown();
+    return 1;
+  }
+  if (!check(last_error_is(CS_ERRC_NONE, ""), "Success should clear the last error.")) {
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+
+  // Regular entry points keep their coarse return codes and report the detail code.
+  long long cents = 0;
+  if (!check(cs_cart_add_item_by_id(cart, "NOPE", 1) == CS_ERROR_INVALID_ARGUMENT &&
+                 last_error_is(CS_ERRC_UNKNOWN_ITEM, "Unknown item_id: NOPE"),
+             "Unknown items should report CS_ERRC_UNKNOWN_ITEM.")) {
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+  if (!check(cs_cart_add_item_by_id(cart, "COFFEE", 0) == CS_ERROR_INVALID_ARGUMENT &&
+                 cs_last_error_code() == CS_ERRC_QTY_OUT_OF_RANGE &&
+                 cs_cart_set_line_qty(cart, 3, 1) == CS_ERROR_INVALID_ARGUMENT &&
+                 cs_last_error_code() == CS_ERRC_LINE_INDEX_OUT_OF_RANGE &&
+                 cs_payment_set_given_cents(cart, -1) == CS_ERROR_INVALID_ARGUMENT &&
+                 cs_last_error_code() == CS_ERRC_AMOUNT_OUT_OF_RANGE &&
+                 cs_cart_get_total_cents(cart, nullptr) == CS_ERROR_INVALID_ARGUMENT &&
+                 cs_last_error_code() == CS_ERRC_NULL_ARGUMENT &&
+                 cs_cart_get_total_cents(nullptr, &cents) == CS_ERROR_INVALID_ARGUMENT &&
+                 cs_last_error_code() == CS_ERRC_INVALID_HANDLE &&
+                 cs_catalog_load_json("{") == CS_ERROR_INVALID_ARGUMENT &&
+                 cs_last_error_code() == CS_ERRC_INVALID_CATALOG,
+             "Each failure should report its own detail code.")) {
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+
+  // Fast variants return the detail code itself.
+  if (!check(cs_cart_add_item_by_id_fast(cart, "NOPE", 1) == CS_ERRC_UNKNOWN_ITEM &&
+                 cs_cart_remove_line_fast(cart, 0) == CS_ERRC_LINE_INDEX_OUT_OF_RANGE &&
+                 cs_cart_set_line_qty_fast(nullptr, 0, 1) == CS_ERRC_INVALID_HANDLE &&
+                 cs_payment_get_change_cents_fast(cart, nullptr) == CS_ERRC_NULL_ARGUMENT,
+             "Fast variants should return detail codes.")) {
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+
+  // A fast success leaves the previous error in place; the message is formatted on demand.
+  if (!check(cs_cart_add_item_by_id_fast(cart, "NOPE", 1) == CS_ERRC_UNKNOWN_ITEM &&
+                 cs_cart_add_item_by_id_fast(cart, "COFFEE", 2) == CS_ERRC_NONE &&
+                 cs_cart_get_total_cents_fast(cart, &cents) == CS_ERRC_NONE && cents == 1000 &&
+                 last_error_is(CS_ERRC_UNKNOWN_ITEM, "Unknown item_id: NOPE"),
+             "Fast successes should not touch the last error.")) {
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+  if (!check(cs_payment_set_given_cents_fast(cart, 1500) == CS_ERRC_NONE &&
+                 cs_payment_get_given_cents_fast(cart, &cents) == CS_ERRC_NONE && cents == 1500 &&
+                 cs_payment_get_change_cents_fast(cart, &cents) == CS_ERRC_NONE && cents == 500 &&
+                 cs_cart_clear_fast(cart) == CS_ERRC_NONE &&
+                 cs_cart_get_total_cents(cart, &cents) == CS_SUCCESS && cents == 0 &&
+                 last_error_is(CS_ERRC_NONE, ""),
+             "Fast payment calls failed.")) {
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+
+  // Ids longer than the deferred detail buffer still produce the exact message.
+  const std::string long_id(300, 'X');
+  if (!check(cs_cart_add_item_by_id_fast(cart, long_id.c_str(), 1) == CS_ERRC_UNKNOWN_ITEM &&
+                 last_error_is(CS_ERRC_UNKNOWN_ITEM, "Unknown item_id: " + long_id),
+             "Long details should be reported in full.")) {
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+
+  // Quantities and totals that do not fit are rejected instead of wrapping.
+  if (!check(cs_cart_add_item_by_id(cart, "GOLD", 2) == CS_ERROR_INVALID_ARGUMENT &&
+                 cs_last_error_code() == CS_ERRC_OVERFLOW &&
+                 cs_cart_add_item_by_id(cart, "COFFEE", 2147483647) == CS_SUCCESS &&
+                 cs_cart_add_item_by_id_fast(cart, "COFFEE", 1) == CS_ERRC_OVERFLOW &&
+                 cs_cart_clear(cart) == CS_SUCCESS,
+             "Line overflow should report CS_ERRC_OVERFLOW.")) {
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+  char* lines_json = nullptr;
+  if (!check(cs_cart_add_item_by_id(cart, "GOLD", 1) == CS_SUCCESS &&
+                 cs_cart_add_item_by_id(cart, "PLATINUM", 1) == CS_SUCCESS &&
+                 cs_cart_get_total_cents_fast(cart, &cents) == CS_ERRC_OVERFLOW &&
+                 cs_payment_get_change_cents(cart, &cents) == CS_ERROR_INVALID_ARGUMENT &&
+                 cs_last_error_code() == CS_ERRC_OVERFLOW &&
+                 cs_cart_get_lines_json(cart, &lines_json) == CS_ERROR_INVALID_ARGUMENT &&
+                 lines_json == nullptr && cs_last_error_code() == CS_ERRC_OVERFLOW,
+             "Total overflow should report CS_ERRC_OVERFLOW.")) {
+    cs_free(lines_json);
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+
+  cs_cart_free(cart);
+  cs_shutdown();
+  return 0;
+}
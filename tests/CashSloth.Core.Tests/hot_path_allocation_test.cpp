@@ -0,0 +1,187 @@
+#include "cashsloth_core.h"
+
+#include <iostream>
+
+bool check(bool condition, const char* message) {
+  if (!condition) {
+    std::cerr << message << "\n";
+    return false;
+  }
+  return true;
+}
+
+unsigned long long allocation_count() {
+  unsigned long long count = 0;
+  cs_debug_get_allocation_count(&count);
+  return count;
+}
+
+// One sale touching every call in the allocation-free set. Ids are longer than any small-string
+// buffer so a per-line string copy would show up in the count.
+bool run_sale(cs_cart_t cart) {
+  long long cents = 0;
+  bool ok = cs_cart_add_item_by_id(cart, "COFFEE-HOUSE-BLEND-LARGE", 2) == CS_SUCCESS;
+  ok = ok && cs_cart_add_item_by_id(cart, "CROISSANT-BUTTER-CLASSIC", 1) == CS_SUCCESS;
+  ok = ok && cs_cart_add_item_by_id(cart, "WATER-SPARKLING-HALF-LITRE", 3) == CS_SUCCESS;
+  ok = ok && cs_cart_add_item_by_id(cart, "COFFEE-HOUSE-BLEND-LARGE", 1) == CS_SUCCESS;
+  ok = ok && cs_cart_set_line_qty(cart, 1, 4) == CS_SUCCESS;
+  ok = ok && cs_cart_remove_line(cart, 0) == CS_SUCCESS;
+  ok = ok && cs_cart_add_item_by_id(cart, "COFFEE-HOUSE-BLEND-LARGE", 1) == CS_SUCCESS;
+  ok = ok && cs_cart_add_item_by_id(cart, "UNKNOWN", 1) == CS_ERROR_INVALID_ARGUMENT;
+  ok = ok && cs_cart_get_total_cents(cart, &cents) == CS_SUCCESS;
+  ok = ok && cs_payment_set_given_cents(cart, 5000) == CS_SUCCESS;
+  ok = ok && cs_payment_get_change_cents(cart, &cents) == CS_SUCCESS;
+  ok = ok && cs_payment_get_given_cents(cart, &cents) == CS_SUCCESS;
+  ok = ok && cs_cart_clear(cart) == CS_SUCCESS;
+
+  ok = ok && cs_cart_add_item_by_id_fast(cart, "COFFEE-HOUSE-BLEND-LARGE", 2) == CS_ERRC_NONE;
+  ok = ok && cs_cart_add_item_by_id_fast(cart, "CROISSANT-BUTTER-CLASSIC", 1) == CS_ERRC_NONE;
+  ok = ok && cs_cart_set_line_qty_fast(cart, 1, 2) == CS_ERRC_NONE;
+  ok = ok && cs_cart_remove_line_fast(cart, 0) == CS_ERRC_NONE;
+  ok = ok && cs_cart_add_item_by_id_fast(cart, "UNKNOWN", 1) == CS_ERRC_UNKNOWN_ITEM;
+  ok = ok && cs_cart_get_total_cents_fast(cart, &cents) == CS_ERRC_NONE;
+  ok = ok && cs_payment_set_given_cents_fast(cart, 5000) == CS_ERRC_NONE;
+  ok = ok && cs_payment_get_change_cents_fast(cart, &cents) == CS_ERRC_NONE;
+  ok = ok && cs_payment_get_given_cents_fast(cart, &cents) == CS_ERRC_NONE;
+  ok = ok && cs_cart_clear_fast(cart) == CS_ERRC_NONE;
+  return ok;
+}
+
+// The app's undo pattern: a checkpoint before every tap, with an undo and a redo. The sale is
+// never committed, so history keeps growing past the depth a cart keeps.
+bool run_checkpointed_sale(cs_cart_t cart) {
+  bool ok = true;
+  const auto tap = [cart, &ok](bool changed) {
+    ok = ok && changed && cs_cart_checkpoint(cart) == CS_SUCCESS;
+  };
+  tap(cs_cart_add_item_by_id(cart, "COFFEE-HOUSE-BLEND-LARGE", 2) == CS_SUCCESS);
+  tap(cs_cart_add_item_by_id(cart, "CROISSANT-BUTTER-CLASSIC", 1) == CS_SUCCESS);
+  tap(cs_cart_add_item_by_id_fast(cart, "WATER-SPARKLING-HALF-LITRE", 3) == CS_ERRC_NONE);
+  tap(cs_cart_set_line_qty(cart, 1, 4) == CS_SUCCESS);
+  tap(cs_cart_undo(cart) == CS_SUCCESS && cs_cart_redo(cart) == CS_SUCCESS);
+  tap(cs_cart_remove_line_fast(cart, 0) == CS_ERRC_NONE);
+  tap(cs_cart_add_item_by_id(cart, "COFFEE-HOUSE-BLEND-LARGE", 1) == CS_SUCCESS);
+  tap(cs_payment_set_given_cents(cart, 5000) == CS_SUCCESS);
+  tap(cs_cart_undo(cart) == CS_SUCCESS);
+  tap(cs_cart_clear(cart) == CS_SUCCESS);
+  return ok;
+}
+
+int main() {
+  if (cs_init() != CS_SUCCESS) {
+    std::cerr << "cs_init failed: " << cs_last_error() << "\n";
+    return 1;
+  }
+
+  unsigned long long count = 0;
+  if (!check(cs_debug_get_allocation_count(&count) == CS_SUCCESS,
+             "Allocation counting should be compiled in for this test.")) {
+    cs_shutdown();
+    return 1;
+  }
+
+  const char* catalog_json =
+      "{\"items\":["
+      "{\"id\":\"COFFEE-HOUSE-BLEND-LARGE\",\"name\":\"Coffee\",\"unit_cents\":500},"
+      "{\"id\":\"CROISSANT-BUTTER-CLASSIC\",\"name\":\"Croissant\",\"unit_cents\":350},"
+      "{\"id\":\"WATER-SPARKLING-HALF-LITRE\",\"name\":\"Water\",\"unit_cents\":250}]}";
+  if (!check(cs_catalog_load_json(catalog_json) == CS_SUCCESS, "cs_catalog_load_json failed.")) {
+    cs_shutdown();
+    return 1;
+  }
+
+  cs_cart_t cart = nullptr;
+  if (!check(cs_cart_new(&cart) == CS_SUCCESS, "cs_cart_new failed.")) {
+    cs_shutdown();
+    return 1;
+  }
+
+  // Warm-up sale: grows line storage, the id arena and the thread's error buffer.
+  const unsigned long long before_warm_up = allocation_count();
+  if (!check(run_sale(cart), "Warm-up sale failed.")) {
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+  if (!check(allocation_count() > before_warm_up,
+             "The warm-up sale should be counted; the allocation counter is not wired up.")) {
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+
+  const unsigned long long before_cleared_cart = allocation_count();
+  if (!check(run_sale(cart), "Sale on a cleared cart failed.")) {
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+  if (!check(allocation_count() == before_cleared_cart,
+             "A sale on a warm cleared cart must not allocate.")) {
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+
+  // A cart that reuses a pooled slot inherits its warm storage.
+  if (!check(cs_cart_free(cart) == CS_SUCCESS, "cs_cart_free failed.")) {
+    cs_shutdown();
+    return 1;
+  }
+  const unsigned long long before_pooled_cart = allocation_count();
+  if (!check(cs_cart_new(&cart) == CS_SUCCESS, "cs_cart_new from the pool failed.")) {
+    cs_shutdown();
+    return 1;
+  }
+  if (!check(run_sale(cart), "Sale on a pooled cart failed.")) {
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+  if (!check(allocation_count() == before_pooled_cart,
+             "A sale on a reused pooled cart must not allocate.")) {
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+
+  // Repeated add/remove inside one sale compacts the id arena instead of growing it.
+  const unsigned long long before_churn = allocation_count();
+  for (int i = 0; i < 100; ++i) {
+    if (!check(cs_cart_add_item_by_id(cart, "CROISSANT-BUTTER-CLASSIC", 1) == CS_SUCCESS &&
+                   cs_cart_remove_line(cart, 0) == CS_SUCCESS,
+               "Add/remove churn failed.")) {
+      cs_cart_free(cart);
+      cs_shutdown();
+      return 1;
+    }
+  }
+  if (!check(allocation_count() == before_churn, "Add/remove churn must not allocate.")) {
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+
+  // Undo history keeps a fixed number of steps, so once a checkpointed cart has filled it, more
+  // taps reuse its storage and the id arena compacts around it.
+  constexpr int kCheckpointedSales = 40;
+  bool checkpointed = cs_cart_checkpoint(cart) == CS_SUCCESS;
+  for (int i = 0; i < kCheckpointedSales && checkpointed; ++i) {
+    checkpointed = run_checkpointed_sale(cart);
+  }
+  const unsigned long long before_checkpointed = allocation_count();
+  for (int i = 0; i < kCheckpointedSales && checkpointed; ++i) {
+    checkpointed = run_checkpointed_sale(cart);
+  }
+  if (!check(checkpointed, "Checkpointed sale failed.") ||
+      !check(allocation_count() == before_checkpointed,
+             "A warm checkpointed cart must not allocate.")) {
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+
+  cs_cart_free(cart);
+  cs_shutdown();
+  return 0;
+}
@@ -0,0 +1,267 @@
+#include "cashsloth_core.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+bool check(bool condition, const char* message) {
+  if (!condition) {
+    std::cerr << message << "\n";
+    return false;
+  }
+  return true;
+}
+
+constexpr const char* kJournalPath = "cashsloth_live_metrics_contract.bin";
+constexpr long long kHourMs = 60 * 60 * 1000;
+// Half past an hour, so minute and hour buckets line up with the sales below.
+constexpr long long kSaleTime = 1700000000000 / kHourMs * kHourMs + 30 * 60 * 1000;
+constexpr int kUniqueItems = 300;
+
+std::string make_catalog() {
+  std::string json =
+      "{\"items\":[{\"id\":\"COFFEE\",\"name\":\"Coffee\",\"unit_cents\":500},"
+      "{\"id\":\"TEA\",\"name\":\"Tea\",\"unit_cents\":300},"
+      "{\"id\":\"HOT\",\"name\":\"Hot dog\",\"unit_cents\":400}";
+  for (int i = 0; i < kUniqueItems; ++i) {
+    json += ",{\"id\":\"U" + std::to_string(i) + "\",\"name\":\"Unique\",\"unit_cents\":100}";
+  }
+  return json + "]}";
+}
+
+std::string live_metrics(long long now_unix_ms, int top_n) {
+  char* json = nullptr;
+  if (cs_live_metrics_json(now_unix_ms, top_n, &json) != CS_SUCCESS) {
+    std::cerr << "cs_live_metrics_json failed: " << cs_last_error() << "\n";
+    return std::string();
+  }
+  std::string result(json);
+  cs_free(json);
+  return result;
+}
+
+bool contains(const std::string& json, const std::string& part) {
+  return json.find(part) != std::string::npos;
+}
+
+bool commit(cs_cart_t cart, long long completed_unix_ms, long long tip_cents, int is_showcase) {
+  long long total = 0;
+  cs_sale_meta meta = {};
+  meta.struct_size = sizeof(cs_sale_meta);
+  meta.register_name = "R1";
+  meta.tip_cents = tip_cents;
+  meta.completed_unix_ms = completed_unix_ms;
+  meta.is_showcase = is_showcase;
+  return cs_cart_get_total_cents(cart, &total) == CS_SUCCESS &&
+         cs_payment_set_given_cents(cart, total + tip_cents) == CS_SUCCESS &&
+         cs_cart_commit_sale(cart, &meta, nullptr) == CS_SUCCESS;
+}
+
+bool run_metrics(cs_cart_t cart) {
+  bool ok = cs_cart_add_item_by_id(cart, "COFFEE", 2) == CS_SUCCESS &&
+            cs_cart_add_item_by_id(cart, "TEA", 1) == CS_SUCCESS && commit(cart, kSaleTime, 200, 0);
+  ok = ok && cs_cart_add_item_by_id(cart, "COFFEE", 1) == CS_SUCCESS &&
+       commit(cart, kSaleTime + 60000, 0, 0);
+  ok = ok && cs_cart_add_item_by_id(cart, "COFFEE", 9) == CS_SUCCESS &&
+       commit(cart, kSaleTime, 0, 1);
+  ok = ok && cs_cart_add_item_by_id(cart, "TEA", 3) == CS_SUCCESS &&
+       commit(cart, kSaleTime - 2 * kHourMs, 0, 0);
+  if (!check(ok, "Committing the sales failed.")) {
+    return false;
+  }
+
+  const std::string json = live_metrics(kSaleTime + 90000, 2);
+  const std::string head = "{\"now_unix_ms\":" + std::to_string(kSaleTime + 90000) +
+                           ",\"latest_sale_unix_ms\":" + std::to_string(kSaleTime + 60000) +
+                           ",\"tickets\":3,\"revenue_cents\":2700,\"tip_cents\":200,\"items\":7,"
+                           "\"avg_basket_cents\":900,\"avg_basket_items\":2.33,\"minutes\":[";
+  if (!check(json.compare(0, head.size(), head) == 0,
+             "Totals should cover the regular sales only.")) {
+    std::cerr << json << "\n";
+    return false;
+  }
+  ok = contains(json, "{\"start_unix_ms\":" + std::to_string(kSaleTime) +
+                          ",\"tickets\":1,\"revenue_cents\":1300,\"tip_cents\":200}") &&
+       contains(json, "{\"start_unix_ms\":" + std::to_string(kSaleTime + 60000) +
+                          ",\"tickets\":1,\"revenue_cents\":500,\"tip_cents\":0}]") &&
+       contains(json, "{\"start_unix_ms\":" + std::to_string(kSaleTime - 30 * 60000) +
+                          ",\"tickets\":2,\"revenue_cents\":1800,\"tip_cents\":200}]") &&
+       contains(json, "{\"start_unix_ms\":" + std::to_string(kSaleTime - 30 * 60000 - 2 * kHourMs) +
+                          ",\"tickets\":1,\"revenue_cents\":900,\"tip_cents\":0}");
+  if (!check(ok, "Minute and hour buckets should hold the sales of their period.")) {
+    std::cerr << json << "\n";
+    return false;
+  }
+  ok = contains(json, "\"top_by_qty\":[{\"id\":\"TEA\",\"name\":\"Tea\",\"qty\":4,\"error\":0},"
+                      "{\"id\":\"COFFEE\",\"name\":\"Coffee\",\"qty\":3,\"error\":0}]") &&
+       contains(json, "\"top_by_revenue\":[{\"id\":\"COFFEE\",\"name\":\"Coffee\","
+                      "\"revenue_cents\":1500,\"error\":0},{\"id\":\"TEA\",\"name\":\"Tea\","
+                      "\"revenue_cents\":1200,\"error\":0}]}");
+  if (!check(ok, "Top sellers should be ordered by quantity and by revenue.")) {
+    std::cerr << json << "\n";
+    return false;
+  }
+
+  // The minute ring covers one hour; older minutes read as empty.
+  const std::string later = live_metrics(kSaleTime + 2 * kHourMs, 0);
+  return check(!contains(later.substr(0, later.find("\"hours\"")), "\"tickets\":1,") &&
+                   contains(later, "\"top_by_qty\":[],\"top_by_revenue\":[]}"),
+               "Minute buckets older than an hour should not be reported.");
+}
+
+// Hundreds of distinct items sold once each cannot push out one sold in every sale, and the
+// sketch keeps a fixed number of counters.
+bool run_heavy_hitters(cs_cart_t cart) {
+  for (int i = 0; i < kUniqueItems; ++i) {
+    const std::string id = "U" + std::to_string(i);
+    if (!check(cs_cart_add_item_by_id(cart, "HOT", 1) == CS_SUCCESS &&
+                   cs_cart_add_item_by_id(cart, id.c_str(), 1) == CS_SUCCESS &&
+                   commit(cart, kSaleTime + 120000, 0, 0),
+               "Committing the sales failed.")) {
+      return false;
+    }
+  }
+  const std::string json = live_metrics(kSaleTime + 180000, 64);
+  const size_t top = json.find("\"top_by_qty\":[{\"id\":\"HOT\",\"name\":\"Hot dog\",\"qty\":");
+  if (!check(top != std::string::npos, "The frequent item should lead the sketch.")) {
+    std::cerr << json << "\n";
+    return false;
+  }
+  const char* counts = json.c_str() + json.find("\"qty\":", top + 15);
+  const long long qty = std::atoll(counts + 6);
+  const long long error = std::atoll(std::strstr(counts, "\"error\":") + 8);
+  const std::string by_qty = json.substr(top, json.find("\"top_by_revenue\"") - top);
+  size_t counters = 0;
+  for (size_t pos = by_qty.find("{\"id\""); pos != std::string::npos;
+       pos = by_qty.find("{\"id\"", pos + 1)) {
+    ++counters;
+  }
+  return check(qty >= kUniqueItems && qty - error <= kUniqueItems && counters == 64,
+               "Sketch counts should bound the true count within their error.");
+}
+
+std::string query(const char* filter_json) {
+  char* json = nullptr;
+  if (cs_sales_query_json(filter_json, nullptr, &json) != CS_SUCCESS) {
+    std::cerr << "cs_sales_query_json failed: " << cs_last_error() << "\n";
+    return std::string();
+  }
+  std::string result(json);
+  cs_free(json);
+  return result;
+}
+
+long long number_after(const std::string& json, const char* key) {
+  const size_t pos = json.find(key);
+  return pos == std::string::npos ? -1 : std::atoll(json.c_str() + pos + std::strlen(key));
+}
+
+// Pricing rule discounts come off the stored line totals, so reports add up to the subtotal.
+bool run_discounts() {
+  const long long revenue_before =
+      number_after(live_metrics(kSaleTime + 180000, 0), "\"revenue_cents\":");
+  cs_catalog_t catalog = nullptr;
+  cs_cart_t cart = nullptr;
+  cs_sale_meta meta = {};
+  meta.struct_size = sizeof(cs_sale_meta);
+  meta.register_name = "R2";
+  meta.completed_unix_ms = kSaleTime + 120000;
+  unsigned long long sequence = 0;
+  long long total = 0;
+  char* json = nullptr;
+  bool ok = cs_catalog_get_default(&catalog) == CS_SUCCESS &&
+            cs_catalog_set_pricing_json(
+                catalog,
+                "{\"rules\":[{\"id\":\"HALF\",\"type\":\"percent\",\"items\":[\"TEA\"],"
+                "\"percent\":50}]}") == CS_SUCCESS &&
+            cs_cart_new(&cart) == CS_SUCCESS &&
+            cs_cart_add_item_by_id(cart, "TEA", 2) == CS_SUCCESS &&
+            cs_cart_add_item_by_id(cart, "COFFEE", 1) == CS_SUCCESS &&
+            cs_cart_get_total_cents(cart, &total) == CS_SUCCESS && total == 800 &&
+            cs_payment_set_given_cents(cart, total) == CS_SUCCESS &&
+            cs_cart_commit_sale(cart, &meta, &sequence) == CS_SUCCESS &&
+            cs_catalog_set_pricing_json(catalog, "{\"rules\":[]}") == CS_SUCCESS &&
+            cs_journal_read_json(kJournalPath, sequence, 1, &json) == CS_SUCCESS;
+  const std::string sale = ok ? std::string(json) : std::string();
+  cs_free(json);
+  cs_cart_free(cart);
+  ok = ok && contains(sale, "\"subtotal_cents\":800,") &&
+       contains(sale, "{\"id\":\"TEA\",\"name\":\"Tea\",\"unit_cents\":300,\"qty\":2,"
+                      "\"line_total_cents\":300,\"discount_cents\":300}") &&
+       contains(sale, "{\"id\":\"COFFEE\",\"name\":\"Coffee\",\"unit_cents\":500,"
+                      "\"qty\":1,\"line_total_cents\":500}]");
+  if (!check(ok, "A journaled sale should store its lines after discounts.")) {
+    std::cerr << sale << "\n";
+    return false;
+  }
+
+  const std::string report = query("{\"register\":\"R2\"}");
+  ok = contains(report, "\"subtotal_cents\":800,") &&
+       contains(report, "\"items\":[{\"id\":\"COFFEE\",\"name\":\"Coffee\",\"qty\":1,"
+                        "\"revenue_cents\":500},{\"id\":\"TEA\",\"name\":\"Tea\",\"qty\":2,"
+                        "\"revenue_cents\":300}]");
+  if (!check(ok, "Item revenue should add up to the discounted subtotal.")) {
+    std::cerr << report << "\n";
+    return false;
+  }
+  return check(number_after(live_metrics(kSaleTime + 180000, 0), "\"revenue_cents\":") ==
+                   revenue_before + 800,
+               "Live metrics should count the discounted sale.");
+}
+
+int main() {
+  std::remove(kJournalPath);
+  if (cs_init() != CS_SUCCESS) {
+    std::cerr << "cs_init failed: " << cs_last_error() << "\n";
+    return 1;
+  }
+
+  const std::string catalog_json = make_catalog();
+  cs_cart_t cart = nullptr;
+  char* json = nullptr;
+  if (!check(cs_catalog_load_json(catalog_json.c_str()) == CS_SUCCESS &&
+                 cs_cart_new(&cart) == CS_SUCCESS,
+             "Setup failed.")) {
+    cs_shutdown();
+    return 1;
+  }
+  bool ok = cs_live_metrics_json(0, 5, &json) == CS_ERROR_INVALID_ARGUMENT &&
+            cs_last_error_code() == CS_ERRC_INVALID_STATE &&
+            cs_journal_open(kJournalPath, 0, nullptr) == CS_SUCCESS &&
+            cs_live_metrics_json(0, 5, nullptr) == CS_ERROR_INVALID_ARGUMENT &&
+            cs_live_metrics_json(-1, 5, &json) == CS_ERROR_INVALID_ARGUMENT &&
+            cs_live_metrics_json(0, 65, &json) == CS_ERROR_INVALID_ARGUMENT &&
+            cs_live_metrics_json(0, -1, &json) == CS_ERROR_INVALID_ARGUMENT &&
+            cs_last_error_code() == CS_ERRC_INVALID_VALUE && json == nullptr;
+  if (!check(ok, "cs_live_metrics_json should validate its arguments and need a journal.")) {
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+
+  if (!run_metrics(cart) || !run_heavy_hitters(cart) || !run_discounts()) {
+    cs_cart_free(cart);
+    cs_shutdown();
+    std::remove(kJournalPath);
+    return 1;
+  }
+
+  // Reopening replays the journal into the same metrics.
+  const std::string live = live_metrics(kSaleTime + 180000, 10);
+  if (!check(cs_journal_close() == CS_SUCCESS &&
+                 cs_journal_open(kJournalPath, 0, nullptr) == CS_SUCCESS &&
+                 live_metrics(kSaleTime + 180000, 10) == live,
+             "A reopened journal should report the same live metrics.")) {
+    cs_cart_free(cart);
+    cs_shutdown();
+    std::remove(kJournalPath);
+    return 1;
+  }
+
+  cs_cart_free(cart);
+  cs_shutdown();
+  std::remove(kJournalPath);
+  return 0;
+}
@@ -0,0 +1,153 @@
+#include "cashsloth_core.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+bool check(bool condition, const char* message) {
+  if (!condition) {
+    std::cerr << message << "\n";
+    return false;
+  }
+  return true;
+}
+
+std::string memory_json() {
+  char* json = nullptr;
+  if (cs_memory_usage_json(&json) != CS_SUCCESS) {
+    return std::string();
+  }
+  std::string result(json);
+  cs_free(json);
+  return result;
+}
+
+// Reads `field` of a category object, or a top-level field when `category` is null.
+long long usage(const std::string& json, const char* category, const char* field) {
+  size_t pos = 0;
+  if (category) {
+    pos = json.find(std::string("\"") + category + "\":{");
+    if (pos == std::string::npos) {
+      return -1;
+    }
+  }
+  const std::string key = std::string("\"") + field + "\":";
+  pos = json.find(key, pos);
+  return pos == std::string::npos ? -1 : std::atoll(json.c_str() + pos + key.size());
+}
+
+std::string make_catalog(int count) {
+  std::string json = "{\"items\":[";
+  for (int i = 0; i < count; ++i) {
+    if (i > 0) {
+      json += ",";
+    }
+    json += "{\"id\":\"ITEM-" + std::to_string(i) + "\",\"name\":\"Item number " +
+            std::to_string(i) + "\",\"unit_cents\":" + std::to_string(100 + i) + "}";
+  }
+  json += "]}";
+  return json;
+}
+
+int main() {
+  if (cs_init() != CS_SUCCESS) {
+    std::cerr << "cs_init failed: " << cs_last_error() << "\n";
+    return 1;
+  }
+
+  if (!check(cs_memory_usage_json(nullptr) == CS_ERROR_INVALID_ARGUMENT,
+             "cs_memory_usage_json should reject a null output.")) {
+    cs_shutdown();
+    return 1;
+  }
+
+  const std::string large_catalog = make_catalog(2000);
+  if (!check(cs_catalog_load_json(large_catalog.c_str()) == CS_SUCCESS, "Large load failed.")) {
+    cs_shutdown();
+    return 1;
+  }
+  const std::string after_large = memory_json();
+  if (!check(usage(after_large, "catalog_items", "live_bytes") >= 2000 * 8 &&
+                 usage(after_large, "strings", "live_bytes") >= 2000 * 10 &&
+                 usage(after_large, "index", "live_bytes") > 0,
+             "Catalog items, strings and index should be accounted.")) {
+    std::cerr << after_large << "\n";
+    cs_shutdown();
+    return 1;
+  }
+  const long long large_parser_peak = usage(after_large, "parser", "peak_bytes");
+  if (!check(usage(after_large, "parser", "live_bytes") == 0 &&
+                 large_parser_peak > static_cast<long long>(large_catalog.size()),
+             "Parser memory should be released after a load and its peak reported.")) {
+    std::cerr << after_large << "\n";
+    cs_shutdown();
+    return 1;
+  }
+
+  const char* small_catalog =
+      "{\"items\":[{\"id\":\"COFFEE\",\"name\":\"Coffee\",\"unit_cents\":500}]}";
+  if (!check(cs_catalog_load_json(small_catalog) == CS_SUCCESS, "Small load failed.")) {
+    cs_shutdown();
+    return 1;
+  }
+  const std::string after_small = memory_json();
+  if (!check(usage(after_small, "parser", "peak_bytes") < large_parser_peak / 10 &&
+                 usage(after_small, "strings", "live_bytes") <
+                     usage(after_large, "strings", "live_bytes"),
+             "Parser peak should cover only the last load; replaced snapshots should be freed.")) {
+    std::cerr << after_small << "\n";
+    cs_shutdown();
+    return 1;
+  }
+
+  cs_cart_t cart = nullptr;
+  bool ok = cs_cart_new(&cart) == CS_SUCCESS;
+  ok = ok && cs_cart_add_item_by_id(cart, "COFFEE", 1) == CS_SUCCESS;
+  if (!check(ok, "Cart setup failed.")) {
+    cs_shutdown();
+    return 1;
+  }
+  const std::string with_cart = memory_json();
+  if (!check(usage(with_cart, nullptr, "open_carts") == 1 &&
+                 usage(with_cart, "carts", "live_bytes") > 0 &&
+                 usage(with_cart, "lines", "live_bytes") > 0,
+             "Open carts and their lines should be accounted.")) {
+    std::cerr << with_cart << "\n";
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+
+  // Buffers handed out and not yet freed show up as outstanding.
+  const long long buffers_before = usage(with_cart, "buffers", "live_blocks");
+  char* lines_json = nullptr;
+  ok = cs_cart_get_lines_json(cart, &lines_json) == CS_SUCCESS;
+  const std::string outstanding = memory_json();
+  cs_free(lines_json);
+  const std::string released = memory_json();
+  if (!check(ok && usage(outstanding, "buffers", "live_blocks") == buffers_before + 1 &&
+                 usage(outstanding, "buffers", "live_bytes") >
+                     static_cast<long long>(std::strlen("[]")) &&
+                 usage(released, "buffers", "live_blocks") == buffers_before,
+             "Outstanding buffers should be counted until cs_free.")) {
+    std::cerr << outstanding << "\n" << released << "\n";
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+
+  cs_cart_free(cart);
+  const std::string after_free = memory_json();
+  if (!check(usage(after_free, nullptr, "open_carts") == 0 &&
+                 usage(after_free, "carts", "live_bytes") ==
+                     usage(with_cart, "carts", "live_bytes"),
+             "Freed carts should return to the pool, which keeps its slabs.")) {
+    std::cerr << after_free << "\n";
+    cs_shutdown();
+    return 1;
+  }
+
+  cs_shutdown();
+  return 0;
+}
@@ -0,0 +1,306 @@
+#include "cashsloth_core.h"
+
+#include <iostream>
+#include <string>
+
+bool check(bool condition, const char* message) {
+  if (!condition) {
+    std::cerr << message << "\n";
+    return false;
+  }
+  return true;
+}
+
+// 1970-01-02 was a Friday.
+constexpr long long kFriday1800 = (24LL * 60 + 18 * 60) * 60 * 1000;
+constexpr long long kFriday2000 = (24LL * 60 + 20 * 60) * 60 * 1000;
+
+std::string lines_json(cs_cart_t cart) {
+  char* json = nullptr;
+  if (cs_cart_get_lines_json(cart, &json) != CS_SUCCESS) {
+    return "failed";
+  }
+  std::string result(json);
+  cs_free(json);
+  return result;
+}
+
+long long total_of(cs_cart_t cart) {
+  long long total = -1;
+  return cs_cart_get_total_cents(cart, &total) == CS_SUCCESS ? total : -1;
+}
+
+bool contains(const std::string& text, const char* part) {
+  return text.find(part) != std::string::npos;
+}
+
+cs_cart_t new_cart(cs_catalog_t catalog) {
+  cs_cart_t cart = nullptr;
+  return cs_cart_new_for_catalog(catalog, &cart) == CS_SUCCESS ? cart : nullptr;
+}
+
+bool run_catalog_category(cs_catalog_t catalog) {
+  char* json = nullptr;
+  bool ok = cs_catalog_instance_get_json(catalog, &json) == CS_SUCCESS &&
+            contains(json, "\"id\":\"COFFEE\",\"name\":\"Coffee\",\"unit_cents\":500,"
+                           "\"category\":\"drinks\"");
+  cs_free(json);
+  ok = ok &&
+       cs_catalog_load_json("{\"items\":[{\"id\":\"X\",\"name\":\"X\",\"unit_cents\":1,"
+                            "\"category\":7}]}") == CS_ERROR_INVALID_ARGUMENT &&
+       cs_last_error_code() == CS_ERRC_INVALID_CATALOG;
+  return check(ok, "Catalog items should keep a string category.");
+}
+
+bool run_percent(cs_catalog_t catalog) {
+  cs_cart_t cart = nullptr;
+  bool ok = cs_catalog_set_pricing_json(
+                catalog,
+                "{\"rules\":[{\"id\":\"TEA10\",\"type\":\"percent\",\"items\":[\"TEA\"],"
+                "\"percent\":10}]}") == CS_SUCCESS &&
+            (cart = new_cart(catalog)) != nullptr &&
+            cs_cart_add_item_by_id(cart, "TEA", 3) == CS_SUCCESS &&
+            cs_cart_add_item_by_id(cart, "COFFEE", 1) == CS_SUCCESS && total_of(cart) == 1310;
+  const std::string json = lines_json(cart);
+  ok = ok &&
+       contains(json,
+                "\"line_total_cents\":900,\"discounts\":[{\"rule\":\"TEA10\",\"cents\":90}]}") &&
+       contains(json, "\"line_total_cents\":500}") &&
+       contains(json, "\"discount_cents\":90,\"total_cents\":1310");
+  // Removing the line takes its discount with it.
+  ok = ok && cs_cart_remove_line(cart, 0) == CS_SUCCESS && total_of(cart) == 500 &&
+       !contains(lines_json(cart), "discount");
+  cs_cart_free(cart);
+  return check(ok, "A percent rule should discount its items' lines.");
+}
+
+bool run_happy_hour(cs_catalog_t catalog) {
+  cs_cart_t cart = nullptr;
+  bool ok = cs_catalog_set_pricing_json(
+                catalog,
+                "{\"rules\":[{\"id\":\"HAPPY\",\"type\":\"unit_price\",\"categories\":[\"drinks\"],"
+                "\"unit_cents\":250,\"days\":[5],\"from\":\"17:00\",\"to\":\"19:00\"}]}") ==
+                CS_SUCCESS &&
+            (cart = new_cart(catalog)) != nullptr &&
+            cs_cart_set_pricing_context(cart, nullptr, kFriday2000) == CS_SUCCESS &&
+            cs_cart_add_item_by_id(cart, "COFFEE", 2) == CS_SUCCESS &&
+            cs_cart_add_item_by_id(cart, "CAKE", 1) == CS_SUCCESS && total_of(cart) == 1400;
+  ok = ok && cs_cart_set_pricing_context(cart, nullptr, kFriday1800) == CS_SUCCESS &&
+       total_of(cart) == 900 &&
+       contains(lines_json(cart), "\"discounts\":[{\"rule\":\"HAPPY\",\"cents\":500}]");
+  ok = ok && cs_cart_set_pricing_context(cart, nullptr, -1) == CS_ERROR_INVALID_ARGUMENT &&
+       cs_last_error_code() == CS_ERRC_INVALID_VALUE && total_of(cart) == 900;
+  cs_cart_free(cart);
+  return check(ok, "A timed rule should only apply inside its window.");
+}
+
+bool run_multibuy(cs_catalog_t catalog) {
+  cs_cart_t cart = nullptr;
+  bool ok = cs_catalog_set_pricing_json(
+                catalog,
+                "{\"rules\":[{\"id\":\"3FOR2\",\"type\":\"multibuy\",\"categories\":[\"food\"],"
+                "\"buy\":3,\"pay\":2}]}") == CS_SUCCESS &&
+            (cart = new_cart(catalog)) != nullptr &&
+            cs_cart_add_item_by_id(cart, "CAKE", 2) == CS_SUCCESS && total_of(cart) == 800 &&
+            cs_cart_add_item_by_id(cart, "BAGEL", 2) == CS_SUCCESS && total_of(cart) == 1050 &&
+            contains(lines_json(cart), "\"discounts\":[{\"rule\":\"3FOR2\",\"cents\":250}]");
+  // Six units give two free ones, both bagels.
+  ok = ok && cs_cart_set_line_qty(cart, 0, 4) == CS_SUCCESS && total_of(cart) == 2100 - 500;
+  cs_cart_free(cart);
+  return check(ok, "A multi-buy rule should make the cheapest units free.");
+}
+
+bool run_bundle(cs_catalog_t catalog) {
+  cs_cart_t cart = nullptr;
+  bool ok = cs_catalog_set_pricing_json(
+                catalog,
+                "{\"rules\":[{\"id\":\"MEAL\",\"type\":\"bundle\",\"components\":["
+                "{\"items\":[\"COFFEE\"]},{\"categories\":[\"food\"],\"qty\":2}],"
+                "\"price_cents\":1000}]}") == CS_SUCCESS &&
+            (cart = new_cart(catalog)) != nullptr &&
+            cs_cart_add_item_by_id(cart, "COFFEE", 1) == CS_SUCCESS &&
+            cs_cart_add_item_by_id(cart, "CAKE", 1) == CS_SUCCESS && total_of(cart) == 900 &&
+            cs_cart_add_item_by_id(cart, "BAGEL", 3) == CS_SUCCESS;
+  // The set is the coffee, the cake and one bagel (1150), sold for 1000.
+  const std::string json = lines_json(cart);
+  ok = ok && total_of(cart) == 1500 &&
+       contains(json, "\"id\":\"COFFEE\",\"name\":\"Coffee\",\"unit_cents\":500,\"qty\":1,"
+                      "\"line_total_cents\":500,"
+                      "\"discounts\":[{\"rule\":\"MEAL\",\"cents\":65}]") &&
+       contains(json,
+                "\"line_total_cents\":400,\"discounts\":[{\"rule\":\"MEAL\",\"cents\":52}]") &&
+       contains(json,
+                "\"line_total_cents\":750,\"discounts\":[{\"rule\":\"MEAL\",\"cents\":33}]") &&
+       contains(json, "\"discount_cents\":150,");
+  cs_cart_free(cart);
+  return check(ok, "A bundle should sell each complete set for its price.");
+}
+
+bool run_codes(cs_catalog_t catalog) {
+  cs_cart_t cart = nullptr;
+  bool ok = cs_catalog_set_pricing_json(
+                catalog,
+                "{\"rules\":[{\"id\":\"STAFF\",\"type\":\"percent\",\"code\":\"STAFF\","
+                "\"percent\":50},{\"id\":\"TEA10\",\"type\":\"percent\",\"items\":[\"TEA\"],"
+                "\"percent\":10}]}") == CS_SUCCESS &&
+            (cart = new_cart(catalog)) != nullptr &&
+            cs_cart_add_item_by_id(cart, "TEA", 1) == CS_SUCCESS &&
+            cs_cart_add_item_by_id(cart, "CAKE", 1) == CS_SUCCESS && total_of(cart) == 670;
+  // Rules stack, each on the undiscounted lines.
+  ok = ok && cs_cart_set_pricing_context(cart, "VIP,STAFF", 0) == CS_SUCCESS &&
+       total_of(cart) == 700 - 350 - 30 &&
+       contains(lines_json(cart), "\"discounts\":[{\"rule\":\"STAFF\",\"cents\":150},"
+                                  "{\"rule\":\"TEA10\",\"cents\":30}]") &&
+       cs_cart_set_pricing_context(cart, "STAFFER", 0) == CS_SUCCESS && total_of(cart) == 670;
+  cs_cart_free(cart);
+  return check(ok, "A coded rule should only apply when the context lists its code.");
+}
+
+bool run_reprice_and_undo(cs_catalog_t catalog) {
+  cs_cart_t cart = nullptr;
+  cs_cart_t clone = nullptr;
+  char* report = nullptr;
+  bool ok = cs_catalog_set_pricing_json(
+                catalog,
+                "{\"rules\":[{\"id\":\"TEA10\",\"type\":\"percent\",\"items\":[\"TEA\"],"
+                "\"percent\":10}]}") == CS_SUCCESS &&
+            (cart = new_cart(catalog)) != nullptr &&
+            cs_cart_add_item_by_id(cart, "TEA", 10) == CS_SUCCESS && total_of(cart) == 2700;
+  // Open carts keep their rules until they are repriced.
+  ok = ok &&
+       cs_catalog_set_pricing_json(
+           catalog, "{\"rules\":[{\"id\":\"TEA20\",\"type\":\"percent\",\"items\":[\"TEA\"],"
+                    "\"percent\":20}]}") == CS_SUCCESS &&
+       total_of(cart) == 2700 && cs_cart_reprice(cart, CS_REPRICE_KEEP_VANISHED, &report) ==
+                                     CS_SUCCESS &&
+       total_of(cart) == 2400;
+  cs_free(report);
+
+  ok = ok && cs_cart_checkpoint(cart) == CS_SUCCESS &&
+       cs_cart_set_line_qty(cart, 0, 5) == CS_SUCCESS && total_of(cart) == 1200 &&
+       cs_cart_undo(cart) == CS_SUCCESS && total_of(cart) == 2400 &&
+       cs_cart_redo(cart) == CS_SUCCESS && total_of(cart) == 1200 &&
+       cs_cart_clone(cart, &clone) == CS_SUCCESS && total_of(clone) == 1200 &&
+       cs_cart_clear(cart) == CS_SUCCESS && total_of(cart) == 0;
+  cs_cart_free(clone);
+  cs_cart_free(cart);
+  return check(ok, "Discounts should follow reprice, undo and clones.");
+}
+
+// Discounts kept up to date change by change match a full evaluation in a clone.
+bool run_incremental(cs_catalog_t catalog) {
+  std::string rules = "{\"rules\":[";
+  for (int i = 0; i < 200; ++i) {
+    rules += i > 0 ? "," : "";
+    rules += "{\"id\":\"R" + std::to_string(i) + "\",\"type\":\"percent\",\"items\":[\"P" +
+             std::to_string(i) + "\"],\"percent\":5}";
+  }
+  rules +=
+      ",{\"id\":\"DRINK5\",\"type\":\"multibuy\",\"categories\":[\"drinks\"],\"buy\":5,\"pay\":4},"
+      "{\"id\":\"MEAL\",\"type\":\"bundle\",\"components\":[{\"items\":[\"COFFEE\",\"TEA\"]},"
+      "{\"categories\":[\"food\"]}],\"price_cents\":600}]}";
+  cs_cart_t cart = nullptr;
+  bool ok = cs_catalog_set_pricing_json(catalog, rules.c_str()) == CS_SUCCESS &&
+            (cart = new_cart(catalog)) != nullptr;
+  const char* items[] = {"COFFEE", "TEA", "CAKE", "BAGEL"};
+  unsigned seed = 7;
+  for (int step = 0; step < 400 && ok; ++step) {
+    seed = seed * 1103515245u + 12345u;
+    const unsigned pick = seed >> 16;
+    int count = 0;
+    const std::string json = lines_json(cart);
+    for (size_t pos = json.find("{\"id\":"); pos != std::string::npos;
+         pos = json.find("{\"id\":", pos + 1)) {
+      ++count;
+    }
+    if (count > 0 && pick % 5 == 0) {
+      ok = cs_cart_remove_line(cart, static_cast<int>(pick % count)) == CS_SUCCESS;
+    } else if (count > 0 && pick % 5 == 1) {
+      ok = cs_cart_set_line_qty(cart, static_cast<int>(pick % count), 1 + pick % 7) == CS_SUCCESS;
+    } else {
+      ok = cs_cart_add_item_by_id(cart, items[pick % 4], 1 + pick % 3) == CS_SUCCESS;
+    }
+    cs_cart_t clone = nullptr;
+    ok = ok && cs_cart_clone(cart, &clone) == CS_SUCCESS && total_of(clone) == total_of(cart) &&
+         lines_json(clone) == lines_json(cart);
+    cs_cart_free(clone);
+  }
+  cs_cart_free(cart);
+  return check(ok, "Incremental discounts should match a full evaluation.");
+}
+
+bool run_invalid_rules(cs_catalog_t catalog) {
+  const char* invalid[] = {
+      "[]",
+      "{\"rules\":{}}",
+      "{\"rules\":[{\"type\":\"percent\",\"percent\":5}]}",
+      "{\"rules\":[{\"id\":\"A\",\"type\":\"percent\",\"percent\":5},"
+      "{\"id\":\"A\",\"type\":\"percent\",\"percent\":5}]}",
+      "{\"rules\":[{\"id\":\"A\",\"type\":\"free\"}]}",
+      "{\"rules\":[{\"id\":\"A\",\"type\":\"percent\",\"percent\":0}]}",
+      "{\"rules\":[{\"id\":\"A\",\"type\":\"percent\",\"percent\":101}]}",
+      "{\"rules\":[{\"id\":\"A\",\"type\":\"percent\",\"percent\":5,\"price_cents\":1}]}",
+      "{\"rules\":[{\"id\":\"A\",\"type\":\"percent\",\"percent\":5,\"items\":[]}]}",
+      "{\"rules\":[{\"id\":\"A\",\"type\":\"percent\",\"percent\":5,\"days\":[8]}]}",
+      "{\"rules\":[{\"id\":\"A\",\"type\":\"percent\",\"percent\":5,\"from\":\"17:00\"}]}",
+      "{\"rules\":[{\"id\":\"A\",\"type\":\"percent\",\"percent\":5,\"from\":\"24:00\","
+      "\"to\":\"01:00\"}]}",
+      "{\"rules\":[{\"id\":\"A\",\"type\":\"percent\",\"percent\":5,\"code\":\"A,B\"}]}",
+      "{\"rules\":[{\"id\":\"A\",\"type\":\"unit_price\",\"unit_cents\":-1}]}",
+      "{\"rules\":[{\"id\":\"A\",\"type\":\"multibuy\",\"buy\":2,\"pay\":2}]}",
+      "{\"rules\":[{\"id\":\"A\",\"type\":\"bundle\",\"components\":[],\"price_cents\":1}]}",
+      "{\"rules\":[{\"id\":\"A\",\"type\":\"bundle\",\"components\":[{\"qty\":0}],"
+      "\"price_cents\":1}]}",
+  };
+  cs_cart_t cart = nullptr;
+  bool ok = cs_catalog_set_pricing_json(
+                catalog, "{\"rules\":[{\"id\":\"TEA10\",\"type\":\"percent\",\"items\":[\"TEA\"],"
+                         "\"percent\":10}]}") == CS_SUCCESS;
+  for (const char* json : invalid) {
+    if (cs_catalog_set_pricing_json(catalog, json) != CS_ERROR_INVALID_ARGUMENT ||
+        cs_last_error_code() != CS_ERRC_INVALID_VALUE) {
+      std::cerr << "accepted: " << json << "\n";
+      ok = false;
+    }
+  }
+  ok = ok && cs_catalog_set_pricing_json(catalog, nullptr) == CS_ERROR_INVALID_ARGUMENT &&
+       cs_last_error_code() == CS_ERRC_NULL_ARGUMENT &&
+       cs_catalog_set_pricing_json(nullptr, "{\"rules\":[]}") == CS_ERROR_INVALID_ARGUMENT &&
+       cs_last_error_code() == CS_ERRC_INVALID_HANDLE &&
+       cs_cart_set_pricing_context(nullptr, "", 0) == CS_ERROR_INVALID_ARGUMENT &&
+       cs_last_error_code() == CS_ERRC_INVALID_HANDLE;
+  // Rejected rules leave the previous ones in place.
+  ok = ok && (cart = new_cart(catalog)) != nullptr &&
+       cs_cart_add_item_by_id(cart, "TEA", 1) == CS_SUCCESS && total_of(cart) == 270;
+  cs_cart_free(cart);
+  return check(ok, "Invalid pricing rules should be rejected.");
+}
+
+int main() {
+  if (cs_init() != CS_SUCCESS) {
+    std::cerr << "cs_init failed: " << cs_last_error() << "\n";
+    return 1;
+  }
+
+  const char* catalog_json =
+      "{\"items\":[{\"id\":\"COFFEE\",\"name\":\"Coffee\",\"unit_cents\":500,"
+      "\"category\":\"drinks\"},{\"id\":\"TEA\",\"name\":\"Tea\",\"unit_cents\":300,"
+      "\"category\":\"drinks\"},{\"id\":\"CAKE\",\"name\":\"Cake\",\"unit_cents\":400,"
+      "\"category\":\"food\"},{\"id\":\"BAGEL\",\"name\":\"Bagel\",\"unit_cents\":250,"
+      "\"category\":\"food\"}]}";
+  cs_catalog_t catalog = nullptr;
+  if (!check(cs_catalog_new("pricing", &catalog) == CS_SUCCESS &&
+                 cs_catalog_instance_load_json(catalog, catalog_json) == CS_SUCCESS,
+             "Setup failed.")) {
+    cs_shutdown();
+    return 1;
+  }
+
+  const bool ok = run_catalog_category(catalog) && run_percent(catalog) &&
+                  run_happy_hour(catalog) && run_multibuy(catalog) && run_bundle(catalog) &&
+                  run_codes(catalog) && run_reprice_and_undo(catalog) &&
+                  run_incremental(catalog) && run_invalid_rules(catalog);
+  cs_catalog_free(catalog);
+  cs_shutdown();
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,175 @@
+#include "cashsloth_core.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+
+bool check(bool condition, const char* message) {
+  if (!condition) {
+    std::cerr << message << "\n";
+    return false;
+  }
+  return true;
+}
+
+std::string read_bytes(const char* path) {
+  std::ifstream file(path, std::ios::binary);
+  return std::string((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+}
+
+// A short register session: catalog load, a sale with a rejected scan, payment with a change
+// breakdown from the cash drawer, a commit into a fresh journal, reports on it, a cart recovered
+// after a crash and published to a display, and cleanup.
+bool run_session(const std::string& journal_path, const std::string& state_path) {
+  const char* catalog_json =
+      "{\"items\":[{\"id\":\"COFFEE\",\"name\":\"Coffee\",\"unit_cents\":500},"
+      "{\"id\":\"TEA\",\"name\":\"Tea\",\"unit_cents\":300}]}";
+  cs_catalog_t catalog = nullptr;
+  cs_cart_t cart = nullptr;
+  long long cents = 0;
+  char* json = nullptr;
+  cs_sale_meta meta = {};
+  meta.struct_size = sizeof(meta);
+  meta.register_name = "R1";
+  meta.payment_method = "Cash";
+  meta.completed_unix_ms = 1700000000000;
+  std::remove(journal_path.c_str());
+  bool ok = cs_journal_open(journal_path.c_str(), 0, nullptr) == CS_SUCCESS;
+  ok = ok && cs_catalog_get_default(&catalog) == CS_SUCCESS;
+  ok = ok && cs_catalog_load_json(catalog_json) == CS_SUCCESS;
+  ok = ok && cs_cart_new_for_catalog(catalog, &cart) == CS_SUCCESS;
+  ok = ok && cs_cart_add_item_by_id(cart, "COFFEE", 2) == CS_SUCCESS;
+  ok = ok && cs_cart_add_item_by_id(cart, "UNKNOWN", 1) == CS_ERROR_INVALID_ARGUMENT;
+  ok = ok && cs_cart_add_item_by_id(cart, "TEA", 1) == CS_SUCCESS;
+  ok = ok && cs_cart_set_line_qty(cart, 1, 3) == CS_SUCCESS;
+  ok = ok && cs_cart_get_total_cents(cart, &cents) == CS_SUCCESS && cents == 1900;
+  ok = ok && cs_cart_get_lines_json(cart, &json) == CS_SUCCESS;
+  cs_free(json);
+  ok = ok && cs_payment_set_given_cents(cart, 2000) == CS_SUCCESS;
+  ok = ok && cs_payment_get_change_cents(cart, &cents) == CS_SUCCESS && cents == 100;
+  ok = ok && cs_drawer_set_json("{\"currency\":\"USD\",\"counts\":[{\"cents\":100,\"count\":1},"
+                                "{\"cents\":25,\"count\":4}]}") == CS_SUCCESS;
+  ok = ok && cs_payment_get_change_breakdown(cart, &json) == CS_SUCCESS;
+  cs_free(json);
+  ok = ok && cs_cart_get_total_cents(cart, nullptr) == CS_ERROR_INVALID_ARGUMENT;
+  ok = ok && cs_cart_commit_sale(cart, nullptr, nullptr) == CS_ERROR_INVALID_ARGUMENT;
+  ok = ok && cs_cart_commit_sale(cart, &meta, nullptr) == CS_SUCCESS;
+  ok = ok && cs_cart_get_total_cents(cart, &cents) == CS_SUCCESS && cents == 0;
+  ok = ok && cs_drawer_get_json(&json) == CS_SUCCESS;
+  cs_free(json);
+  ok = ok && cs_sales_query_json("{\"register\":\"R1\"}", "payment_method", &json) == CS_SUCCESS;
+  cs_free(json);
+  ok = ok && cs_live_metrics_json(1700000060000, 3, &json) == CS_SUCCESS;
+  cs_free(json);
+  ok = ok && cs_journal_close() == CS_SUCCESS;
+  ok = ok && cs_journal_read_json(journal_path.c_str(), 0, 10, &json) == CS_SUCCESS;
+  cs_free(json);
+  ok = ok && cs_cart_free(cart) == CS_SUCCESS;
+  ok = ok && cs_cart_free(cart) == CS_ERROR_INVALID_ARGUMENT;
+
+  // Later calls on the recovered cart replay against the state it was recovered with.
+  std::remove(state_path.c_str());
+  cs_cart_t recovered = nullptr;
+  ok = ok && cs_cart_new_for_catalog(catalog, &cart) == CS_SUCCESS &&
+       cs_cart_persist(cart, state_path.c_str()) == CS_SUCCESS &&
+       cs_cart_add_item_by_id(cart, "TEA", 2) == CS_SUCCESS && cs_cart_flush(cart) == CS_SUCCESS &&
+       cs_cart_free(cart) == CS_SUCCESS;
+  ok = ok && cs_cart_recover(catalog, state_path.c_str(), &recovered) == CS_SUCCESS;
+  ok = ok && cs_cart_recover(catalog, "", &cart) == CS_ERROR_INVALID_ARGUMENT;
+  ok = ok && cs_cart_set_line_qty(recovered, 0, 3) == CS_SUCCESS;
+  ok = ok && cs_cart_get_total_cents(recovered, &cents) == CS_SUCCESS && cents == 900;
+  ok = ok && cs_cart_get_lines_json(recovered, &json) == CS_SUCCESS;
+  cs_free(json);
+
+  // Replay publishes under names of its own; the frame is read back as a display would.
+  cs_display_t published = nullptr;
+  cs_display_t display = nullptr;
+  unsigned long long version = 0;
+  int size = 0;
+  char frame[4096];
+  ok = ok && cs_cart_publish(recovered, "cashsloth_record_contract", 0, &published) == CS_SUCCESS;
+  ok = ok && cs_display_open("cashsloth_record_contract", &display) == CS_SUCCESS;
+  ok = ok && cs_cart_add_item_by_id(recovered, "COFFEE", 1) == CS_SUCCESS;
+  ok = ok && cs_display_get_version(display, &version) == CS_SUCCESS;
+  ok = ok && cs_display_read(display, nullptr, 0, &size, nullptr) == CS_ERROR_INVALID_ARGUMENT;
+  ok = ok && cs_display_read(display, frame, sizeof(frame), &size, &version) == CS_SUCCESS;
+  ok = ok && cs_display_close(display) == CS_SUCCESS && cs_display_close(published) == CS_SUCCESS;
+  ok = ok && cs_cart_free(recovered) == CS_SUCCESS;
+  std::remove(state_path.c_str());
+  return ok;
+}
+
+// Writes the recording to argv[1] when given, for the cs_replay test to pick up.
+int main(int argc, char** argv) {
+  const char* record_path = argc > 1 ? argv[1] : "cashsloth_record_contract.bin";
+  const std::string journal_path = std::string(record_path) + ".session-journal";
+  const std::string state_path = std::string(record_path) + ".session-cart";
+  if (cs_init() != CS_SUCCESS) {
+    std::cerr << "cs_init failed: " << cs_last_error() << "\n";
+    return 1;
+  }
+
+  if (!check(cs_record_start(nullptr) == CS_ERROR_INVALID_ARGUMENT &&
+                 cs_record_start("") == CS_ERROR_INVALID_ARGUMENT,
+             "cs_record_start should reject a null or empty path.")) {
+    cs_shutdown();
+    return 1;
+  }
+  if (!check(cs_record_stop() == CS_SUCCESS, "cs_record_stop without a recording should succeed.")) {
+    cs_shutdown();
+    return 1;
+  }
+
+  if (!check(cs_record_start(record_path) == CS_SUCCESS, "cs_record_start failed.")) {
+    std::cerr << cs_last_error() << "\n";
+    cs_shutdown();
+    return 1;
+  }
+  if (!check(cs_record_start(record_path) == CS_ERROR_INVALID_ARGUMENT,
+             "A second cs_record_start should be rejected while recording.")) {
+    cs_record_stop();
+    cs_shutdown();
+    return 1;
+  }
+  const bool session_ok = run_session(journal_path, state_path);
+  if (!check(cs_record_stop() == CS_SUCCESS && session_ok, "Recorded session failed.")) {
+    cs_shutdown();
+    return 1;
+  }
+
+  const std::string recorded = read_bytes(record_path);
+  if (!check(recorded.compare(0, 8, "CSREC001") == 0, "Record file should start with its magic.")) {
+    cs_shutdown();
+    return 1;
+  }
+  if (!check(recorded.find("cs_cart_add_item_by_id") != std::string::npos &&
+                 recorded.find("\"COFFEE\"") != std::string::npos &&
+                 recorded.find("UNKNOWN") != std::string::npos &&
+                 recorded.find(journal_path) != std::string::npos &&
+                 recorded.find(state_path) != std::string::npos &&
+                 recorded.find("CSCART01") != std::string::npos &&
+                 recorded.find("\"USD\"") != std::string::npos &&
+                 recorded.find("Cash") != std::string::npos &&
+                 recorded.find("payment_method") != std::string::npos,
+             "Record file should hold the API table and call arguments.")) {
+    cs_shutdown();
+    return 1;
+  }
+
+  // Calls after cs_record_stop are not recorded.
+  if (!check(run_session(journal_path, state_path) && read_bytes(record_path) == recorded,
+             "Calls after cs_record_stop must not be recorded.")) {
+    cs_shutdown();
+    return 1;
+  }
+
+  std::remove(journal_path.c_str());
+  if (argc <= 1) {
+    std::remove(record_path);
+  }
+  cs_shutdown();
+  return 0;
+}
@@ -0,0 +1,310 @@
+#include "cashsloth_core.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <vector>
+
+bool check(bool condition, const char* message) {
+  if (!condition) {
+    std::cerr << message << "\n";
+    return false;
+  }
+  return true;
+}
+
+constexpr const char* kJournalPath = "cashsloth_sale_journal_contract.bin";
+
+std::string read_bytes(const char* path) {
+  std::ifstream file(path, std::ios::binary);
+  return std::string((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+}
+
+void write_bytes(const char* path, const std::string& bytes, bool append) {
+  std::ofstream file(path, std::ios::binary | (append ? std::ios::app : std::ios::trunc));
+  file.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+}
+
+std::string take_json(char* json) {
+  std::string result(json ? json : "");
+  cs_free(json);
+  return result;
+}
+
+std::string read_journal(unsigned long long from_sequence, int max_sales) {
+  char* json = nullptr;
+  if (cs_journal_read_json(kJournalPath, from_sequence, max_sales, &json) != CS_SUCCESS) {
+    std::cerr << "cs_journal_read_json failed: " << cs_last_error() << "\n";
+    return std::string();
+  }
+  return take_json(json);
+}
+
+size_t count_of(const std::string& text, const char* needle) {
+  size_t count = 0;
+  for (size_t pos = text.find(needle); pos != std::string::npos; pos = text.find(needle, pos + 1)) {
+    ++count;
+  }
+  return count;
+}
+
+cs_sale_meta make_meta(const char* register_name, long long tip_cents) {
+  cs_sale_meta meta = {};
+  meta.struct_size = sizeof(cs_sale_meta);
+  meta.event_name = "Summer \"Fest\"";
+  meta.register_name = register_name;
+  meta.operator_username = "anna";
+  meta.payment_method = "Cash";
+  meta.tip_cents = tip_cents;
+  meta.completed_unix_ms = 1700000000000;
+  return meta;
+}
+
+// Fills `cart` with 2 coffees and a tea (1300 cents) paid with `given_cents`.
+bool fill_cart(cs_cart_t cart, long long given_cents) {
+  return cs_cart_add_item_by_id(cart, "COFFEE", 2) == CS_SUCCESS &&
+         cs_cart_add_item_by_id(cart, "TEA", 1) == CS_SUCCESS &&
+         cs_payment_set_given_cents(cart, given_cents) == CS_SUCCESS;
+}
+
+bool run_validation(cs_cart_t cart) {
+  cs_sale_meta meta = make_meta("R1", 0);
+  unsigned long long sequence = 0;
+  bool ok = cs_cart_commit_sale(cart, &meta, &sequence) == CS_ERROR_INVALID_ARGUMENT &&
+            cs_last_error_code() == CS_ERRC_INVALID_STATE;
+  ok = ok && fill_cart(cart, 1300);
+  ok = ok && cs_cart_commit_sale(cart, &meta, &sequence) == CS_ERROR_INVALID_ARGUMENT &&
+       cs_last_error_code() == CS_ERRC_INVALID_STATE &&
+       std::strcmp(cs_last_error(), "No sale journal is open.") == 0;
+  if (!check(ok, "Committing without a journal or lines should be rejected.")) {
+    return false;
+  }
+
+  char* report = nullptr;
+  ok = cs_journal_open(nullptr, 0, nullptr) == CS_ERROR_INVALID_ARGUMENT &&
+       cs_journal_open(kJournalPath, -1, nullptr) == CS_ERROR_INVALID_ARGUMENT &&
+       cs_journal_open(kJournalPath, 10001, nullptr) == CS_ERROR_INVALID_ARGUMENT &&
+       cs_journal_open(kJournalPath, 0, &report) == CS_SUCCESS &&
+       take_json(report) == "{\"records\":0,\"truncated_bytes\":0,\"next_sequence\":1}" &&
+       cs_journal_open(kJournalPath, 0, nullptr) == CS_ERROR_INVALID_ARGUMENT &&
+       cs_last_error_code() == CS_ERRC_INVALID_STATE;
+  if (!check(ok, "cs_journal_open should validate its arguments and open only once.")) {
+    return false;
+  }
+
+  ok = cs_cart_commit_sale(cart, nullptr, &sequence) == CS_ERROR_INVALID_ARGUMENT &&
+       cs_last_error_code() == CS_ERRC_NULL_ARGUMENT &&
+       cs_cart_commit_sale(nullptr, &meta, &sequence) == CS_ERROR_INVALID_ARGUMENT &&
+       cs_last_error_code() == CS_ERRC_INVALID_HANDLE;
+  meta.struct_size = 4;
+  ok = ok && cs_cart_commit_sale(cart, &meta, &sequence) == CS_ERROR_INVALID_ARGUMENT &&
+       cs_last_error_code() == CS_ERRC_INVALID_VALUE;
+  meta = make_meta("R1", -5);
+  ok = ok && cs_cart_commit_sale(cart, &meta, &sequence) == CS_ERROR_INVALID_ARGUMENT &&
+       cs_last_error_code() == CS_ERRC_AMOUNT_OUT_OF_RANGE;
+  meta = make_meta("R1", 1);
+  ok = ok && cs_cart_commit_sale(cart, &meta, &sequence) == CS_ERROR_INVALID_ARGUMENT &&
+       cs_last_error_code() == CS_ERRC_AMOUNT_OUT_OF_RANGE;
+  long long total = 0;
+  ok = ok && cs_cart_get_total_cents(cart, &total) == CS_SUCCESS && total == 1300;
+  return check(ok, "Rejected commits should report their detail code and keep the cart.") &&
+         check(read_journal(0, 0) == "{\"sales\":[],\"next_sequence\":1}",
+               "Rejected commits must not reach the journal.");
+}
+
+bool run_commit_and_read(cs_cart_t cart) {
+  cs_sale_meta meta = make_meta("R1", 200);
+  meta.is_showcase = 1;
+  unsigned long long sequence = 0;
+  long long total = -1;
+  long long given = -1;
+  bool ok = cs_payment_set_given_cents(cart, 2000) == CS_SUCCESS &&
+            cs_cart_commit_sale(cart, &meta, &sequence) == CS_SUCCESS && sequence == 1 &&
+            cs_cart_get_total_cents(cart, &total) == CS_SUCCESS && total == 0 &&
+            cs_payment_get_given_cents(cart, &given) == CS_SUCCESS && given == 0;
+  if (!check(ok, "A committed sale should get sequence 1 and clear the cart.")) {
+    return false;
+  }
+
+  const std::string expected =
+      "{\"sales\":[{\"sequence\":1,\"completed_unix_ms\":1700000000000,"
+      "\"event\":\"Summer \\\"Fest\\\"\",\"register\":\"R1\",\"operator\":\"anna\","
+      "\"payment_method\":\"Cash\",\"showcase\":true,\"subtotal_cents\":1300,\"tip_cents\":200,"
+      "\"total_cents\":1500,\"given_cents\":2000,\"change_cents\":500,\"lines\":["
+      "{\"id\":\"COFFEE\",\"name\":\"Coffee\",\"unit_cents\":500,\"qty\":2,"
+      "\"line_total_cents\":1000},"
+      "{\"id\":\"TEA\",\"name\":\"Tea\",\"unit_cents\":300,\"qty\":1,\"line_total_cents\":300}]}],"
+      "\"next_sequence\":2}";
+  if (!check(read_journal(0, 0) == expected, "The journal should hold the committed sale.")) {
+    std::cerr << read_journal(0, 0) << "\n";
+    return false;
+  }
+
+  // Null strings are stored as empty; a zero timestamp takes the commit time.
+  meta = make_meta(nullptr, 0);
+  meta.completed_unix_ms = 0;
+  ok = fill_cart(cart, 1300) && cs_cart_commit_sale(cart, &meta, nullptr) == CS_SUCCESS;
+  const std::string second = read_journal(2, 1);
+  return check(ok && second.find("\"sequence\":2,") != std::string::npos &&
+                   second.find("\"register\":\"\"") != std::string::npos &&
+                   second.find("\"completed_unix_ms\":1700000000000") == std::string::npos &&
+                   second.find("\"next_sequence\":3}") != std::string::npos,
+               "Reading from a sequence should return the later sales.");
+}
+
+// Threads commit at once under a long delay; the flusher writes them in shared batches.
+bool run_group_commit(cs_catalog_t catalog) {
+  constexpr int kThreads = 8;
+  constexpr int kSalesPerThread = 25;
+  char* report = nullptr;
+  if (!check(cs_journal_close() == CS_SUCCESS && cs_journal_open(kJournalPath, 5, &report) ==
+                                                     CS_SUCCESS,
+             "Reopening the journal failed.")) {
+    return false;
+  }
+  if (!check(take_json(report) == "{\"records\":2,\"truncated_bytes\":0,\"next_sequence\":3}",
+             "Reopening should find the committed sales.")) {
+    return false;
+  }
+
+  std::vector<std::thread> workers;
+  std::vector<int> failures(kThreads, 0);
+  for (int t = 0; t < kThreads; ++t) {
+    workers.emplace_back([&, t] {
+      cs_cart_t cart = nullptr;
+      if (cs_cart_new_for_catalog(catalog, &cart) != CS_SUCCESS) {
+        failures[t] = kSalesPerThread;
+        return;
+      }
+      const std::string register_name = "R" + std::to_string(t);
+      cs_sale_meta meta = make_meta(register_name.c_str(), 0);
+      for (int sale = 0; sale < kSalesPerThread; ++sale) {
+        if (!fill_cart(cart, 1300) || cs_cart_commit_sale(cart, &meta, nullptr) != CS_SUCCESS) {
+          ++failures[t];
+        }
+      }
+      cs_cart_free(cart);
+    });
+  }
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
+  int failed = 0;
+  for (int count : failures) {
+    failed += count;
+  }
+  const std::string all = read_journal(0, 0);
+  return check(failed == 0 && count_of(all, "\"sequence\":") == 2 + kThreads * kSalesPerThread &&
+                   all.find("\"next_sequence\":203}") != std::string::npos,
+               "Every concurrent commit should be durable with its own sequence.");
+}
+
+// A torn record at the tail is cut off on open; sequences continue after the last intact one.
+bool run_recovery(cs_cart_t cart) {
+  if (!check(cs_journal_close() == CS_SUCCESS, "cs_journal_close failed.")) {
+    return false;
+  }
+  const std::string intact = read_bytes(kJournalPath);
+  write_bytes(kJournalPath, std::string("\x40\x00\x00\x00\x12\x34", 6), true);
+  char* report = nullptr;
+  if (!check(cs_journal_open(kJournalPath, 0, &report) == CS_SUCCESS &&
+                 take_json(report) ==
+                     "{\"records\":202,\"truncated_bytes\":6,\"next_sequence\":203}" &&
+                 read_bytes(kJournalPath) == intact,
+             "A torn tail should be truncated on open.")) {
+    return false;
+  }
+
+  cs_sale_meta meta = make_meta("R1", 0);
+  unsigned long long sequence = 0;
+  if (!check(fill_cart(cart, 1300) && cs_cart_commit_sale(cart, &meta, &sequence) == CS_SUCCESS &&
+                 sequence == 203,
+             "Sequences should continue after recovery.")) {
+    return false;
+  }
+
+  // A flipped byte inside the last record fails its checksum; the record is dropped.
+  cs_journal_close();
+  std::string damaged = read_bytes(kJournalPath);
+  damaged[damaged.size() - 3] ^= 0x5A;
+  write_bytes(kJournalPath, damaged, false);
+  if (!check(cs_journal_open(kJournalPath, 0, &report) == CS_SUCCESS &&
+                 take_json(report).find("\"records\":202,") != std::string::npos &&
+                 read_bytes(kJournalPath) == intact,
+             "A record failing its checksum should be truncated on open.")) {
+    return false;
+  }
+  cs_journal_close();
+
+  write_bytes(kJournalPath, "not a journal", false);
+  char* json = nullptr;
+  return check(cs_journal_open(kJournalPath, 0, nullptr) == CS_ERROR_INVALID_ARGUMENT &&
+                   cs_last_error_code() == CS_ERRC_INVALID_VALUE &&
+                   read_bytes(kJournalPath) == "not a journal" &&
+                   cs_journal_read_json(kJournalPath, 0, 0, &json) == CS_ERROR_INVALID_ARGUMENT &&
+                   json == nullptr,
+               "Files without the journal magic should be rejected untouched.");
+}
+
+// Only cash must cover the total; other methods record what was tendered and no change. A cart
+// priced down to zero still commits.
+bool run_payment_methods(cs_cart_t cart) {
+  std::remove(kJournalPath);
+  if (!check(cs_journal_open(kJournalPath, 0, nullptr) == CS_SUCCESS, "cs_journal_open failed.")) {
+    return false;
+  }
+  cs_sale_meta meta = make_meta("R1", 0);
+  meta.payment_method = "Card";
+  bool ok = fill_cart(cart, 0) && cs_cart_commit_sale(cart, &meta, nullptr) == CS_SUCCESS;
+  ok = ok && cs_cart_add_item_by_id(cart, "WATER", 2) == CS_SUCCESS;
+  meta.payment_method = "cash";
+  ok = ok && cs_cart_commit_sale(cart, &meta, nullptr) == CS_SUCCESS;
+  const std::string all = read_journal(0, 0);
+  cs_journal_close();
+  return check(ok &&
+                   all.find("\"payment_method\":\"Card\",\"showcase\":false,"
+                            "\"subtotal_cents\":1300,\"tip_cents\":0,\"total_cents\":1300,"
+                            "\"given_cents\":0,\"change_cents\":0,") != std::string::npos &&
+                   all.find("\"subtotal_cents\":0,\"tip_cents\":0,\"total_cents\":0,"
+                            "\"given_cents\":0,\"change_cents\":0,") != std::string::npos,
+               "Card sales and free carts should commit without covering cash.");
+}
+
+int main() {
+  std::remove(kJournalPath);
+  if (cs_init() != CS_SUCCESS) {
+    std::cerr << "cs_init failed: " << cs_last_error() << "\n";
+    return 1;
+  }
+
+  const char* catalog_json =
+      "{\"items\":[{\"id\":\"COFFEE\",\"name\":\"Coffee\",\"unit_cents\":500},"
+      "{\"id\":\"TEA\",\"name\":\"Tea\",\"unit_cents\":300},"
+      "{\"id\":\"WATER\",\"name\":\"Water\",\"unit_cents\":0}]}";
+  cs_catalog_t catalog = nullptr;
+  cs_cart_t cart = nullptr;
+  if (!check(cs_catalog_load_json(catalog_json) == CS_SUCCESS &&
+                 cs_catalog_get_default(&catalog) == CS_SUCCESS &&
+                 cs_cart_new_for_catalog(catalog, &cart) == CS_SUCCESS,
+             "Setup failed.")) {
+    cs_shutdown();
+    return 1;
+  }
+
+  if (!run_validation(cart) || !run_commit_and_read(cart) || !run_group_commit(catalog) ||
+      !run_recovery(cart) || !run_payment_methods(cart)) {
+    cs_cart_free(cart);
+    cs_shutdown();
+    std::remove(kJournalPath);
+    return 1;
+  }
+
+  cs_cart_free(cart);
+  cs_shutdown();
+  std::remove(kJournalPath);
+  return 0;
+}
@@ -0,0 +1,228 @@
+#include "cashsloth_core.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+bool check(bool condition, const char* message) {
+  if (!condition) {
+    std::cerr << message << "\n";
+    return false;
+  }
+  return true;
+}
+
+constexpr const char* kJournalPath = "cashsloth_sales_query_contract.bin";
+constexpr int kThreads = 8;
+constexpr int kSalesPerThread = 300;
+
+std::string query(const char* filter_json, const char* group_by) {
+  char* json = nullptr;
+  if (cs_sales_query_json(filter_json, group_by, &json) != CS_SUCCESS) {
+    std::cerr << "cs_sales_query_json failed: " << cs_last_error() << "\n";
+    return std::string();
+  }
+  std::string result(json);
+  cs_free(json);
+  return result;
+}
+
+long long field(const std::string& json, const char* key) {
+  const size_t pos = json.find(std::string("\"") + key + "\":");
+  return pos == std::string::npos ? -1 : std::atoll(json.c_str() + pos + std::strlen(key) + 3);
+}
+
+bool commit(cs_cart_t cart, const char* event_name, const char* register_name,
+            const char* operator_username, const char* payment_method, int is_showcase,
+            long long tip_cents, long long completed_unix_ms, long long given_cents) {
+  cs_sale_meta meta = {};
+  meta.struct_size = sizeof(cs_sale_meta);
+  meta.event_name = event_name;
+  meta.register_name = register_name;
+  meta.operator_username = operator_username;
+  meta.payment_method = payment_method;
+  meta.is_showcase = is_showcase;
+  meta.tip_cents = tip_cents;
+  meta.completed_unix_ms = completed_unix_ms;
+  return cs_payment_set_given_cents(cart, given_cents) == CS_SUCCESS &&
+         cs_cart_commit_sale(cart, &meta, nullptr) == CS_SUCCESS;
+}
+
+bool run_small_history(cs_cart_t cart) {
+  bool ok = cs_cart_add_item_by_id(cart, "COFFEE", 2) == CS_SUCCESS &&
+            cs_cart_add_item_by_id(cart, "TEA", 1) == CS_SUCCESS &&
+            commit(cart, "Summer Fest", "R1", "anna", "Cash", 0, 200, 1000, 2000);
+  ok = ok && cs_cart_add_item_by_id(cart, "COFFEE", 1) == CS_SUCCESS &&
+       commit(cart, "summer fest", "R2", "bob", "Card", 0, 0, 2000, 500);
+  ok = ok && cs_cart_add_item_by_id(cart, "TEA", 1) == CS_SUCCESS &&
+       commit(cart, "Winter", "R1", "anna", "Cash", 1, 0, 3000, 300);
+  if (!check(ok, "Committing the sales failed.")) {
+    return false;
+  }
+
+  const std::string all = query(nullptr, nullptr);
+  const std::string expected =
+      "{\"sale_count\":2,\"subtotal_cents\":1800,\"tip_cents\":200,\"total_cents\":2000,"
+      "\"given_cents\":2500,\"change_cents\":500,\"line_count\":3,\"groups\":[],\"items\":["
+      "{\"id\":\"COFFEE\",\"name\":\"Coffee\",\"qty\":3,\"revenue_cents\":1500},"
+      "{\"id\":\"TEA\",\"name\":\"Tea\",\"qty\":1,\"revenue_cents\":300}]}";
+  if (!check(all == expected, "An unfiltered query should total the regular sales.")) {
+    std::cerr << all << "\n";
+    return false;
+  }
+
+  // Text filters compare case-insensitively; groups keep the first spelling.
+  ok = field(query("{\"event\":\"SUMMER FEST\",\"register\":\"r1\"}", nullptr), "sale_count") == 1 &&
+       field(query("{\"include_showcase\":true}", nullptr), "sale_count") == 3 &&
+       field(query("{\"operator\":\"anna\",\"include_showcase\":true}", nullptr),
+             "subtotal_cents") == 1600 &&
+       field(query("{\"payment_method\":\"card\"}", nullptr), "total_cents") == 500 &&
+       field(query("{\"from_unix_ms\":1500,\"to_unix_ms\":3000,\"include_showcase\":true}",
+                   nullptr),
+             "sale_count") == 1 &&
+       field(query("{\"register\":\"\"}", nullptr), "sale_count") == 2;
+  if (!check(ok, "Filters should select the matching sales.")) {
+    return false;
+  }
+
+  const std::string grouped = query("{\"include_showcase\":true}", "event");
+  ok = grouped.find("\"groups\":[{\"key\":\"Summer Fest\",\"sale_count\":2,\"subtotal_cents\":"
+                    "1800,") != std::string::npos &&
+       grouped.find("{\"key\":\"Winter\",\"sale_count\":1,\"subtotal_cents\":300,") !=
+           std::string::npos;
+  if (!check(ok, "group_by should split the totals by event.")) {
+    std::cerr << grouped << "\n";
+    return false;
+  }
+
+  const std::string none = query("{\"event\":\"Spring\"}", "register");
+  return check(none ==
+                   "{\"sale_count\":0,\"subtotal_cents\":0,\"tip_cents\":0,\"total_cents\":0,"
+                   "\"given_cents\":0,\"change_cents\":0,\"line_count\":0,\"groups\":[],"
+                   "\"items\":[]}",
+               "Unknown filter values should match nothing.");
+}
+
+bool run_invalid_arguments() {
+  char* json = nullptr;
+  bool ok = cs_sales_query_json(nullptr, nullptr, nullptr) == CS_ERROR_INVALID_ARGUMENT &&
+            cs_last_error_code() == CS_ERRC_NULL_ARGUMENT;
+  ok = ok && cs_sales_query_json(nullptr, "item", &json) == CS_ERROR_INVALID_ARGUMENT &&
+       cs_last_error_code() == CS_ERRC_INVALID_VALUE;
+  ok = ok && cs_sales_query_json("[1]", nullptr, &json) == CS_ERROR_INVALID_ARGUMENT &&
+       cs_last_error_code() == CS_ERRC_INVALID_VALUE;
+  ok = ok && cs_sales_query_json("{\"evnt\":\"x\"}", nullptr, &json) == CS_ERROR_INVALID_ARGUMENT &&
+       std::strcmp(cs_last_error(), "Invalid sales filter field: evnt") == 0;
+  ok = ok && cs_sales_query_json("{\"from_unix_ms\":-1}", nullptr, &json) ==
+                 CS_ERROR_INVALID_ARGUMENT;
+  return check(ok && json == nullptr, "Invalid queries should be rejected.");
+}
+
+// Enough sales from several threads to fill more than one block. Sale s of thread t sells
+// 1 + s % 3 coffees at register "T<t>" for event "A" or "B" by the parity of s.
+bool run_many_sales(cs_catalog_t catalog) {
+  std::vector<std::thread> workers;
+  std::vector<int> failures(kThreads, 0);
+  for (int t = 0; t < kThreads; ++t) {
+    workers.emplace_back([&, t] {
+      cs_cart_t cart = nullptr;
+      if (cs_cart_new_for_catalog(catalog, &cart) != CS_SUCCESS) {
+        failures[t] = kSalesPerThread;
+        return;
+      }
+      const std::string register_name = "T" + std::to_string(t);
+      for (int s = 0; s < kSalesPerThread; ++s) {
+        if (cs_cart_add_item_by_id(cart, "COFFEE", 1 + s % 3) != CS_SUCCESS ||
+            !commit(cart, s % 2 ? "B" : "A", register_name.c_str(), "op", "Cash", 0, 0,
+                    10000 + s, 5000)) {
+          ++failures[t];
+        }
+      }
+      cs_cart_free(cart);
+    });
+  }
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
+  for (int count : failures) {
+    if (!check(count == 0, "Concurrent commits failed.")) {
+      return false;
+    }
+  }
+
+  long long coffees_a = 0;
+  for (int s = 0; s < kSalesPerThread; s += 2) {
+    coffees_a += 1 + s % 3;
+  }
+  const std::string by_register = query("{\"event\":\"A\"}", "register");
+  bool ok = field(by_register, "sale_count") == kThreads * kSalesPerThread / 2 &&
+            field(by_register, "subtotal_cents") == kThreads * coffees_a * 500 &&
+            by_register.find("{\"key\":\"T3\",\"sale_count\":150,\"subtotal_cents\":" +
+                             std::to_string(coffees_a * 500) + ",") != std::string::npos;
+  ok = ok && field(query("{\"register\":\"T5\",\"from_unix_ms\":10100,\"to_unix_ms\":10200}",
+                         nullptr),
+                   "sale_count") == 100;
+  if (!check(ok, "Totals over many blocks should match the committed sales.")) {
+    std::cerr << by_register << "\n";
+    return false;
+  }
+
+  // Reopening rebuilds the same index from the journal file.
+  const std::string live_event = query("{\"include_showcase\":true}", "event");
+  const std::string live_register = query("{\"event\":\"a\"}", "register");
+  char* report = nullptr;
+  ok = cs_journal_close() == CS_SUCCESS &&
+       cs_sales_query_json(nullptr, nullptr, &report) == CS_ERROR_INVALID_ARGUMENT &&
+       cs_last_error_code() == CS_ERRC_INVALID_STATE &&
+       cs_journal_open(kJournalPath, 0, &report) == CS_SUCCESS;
+  cs_free(report);
+  return check(ok && query("{\"include_showcase\":true}", "event") == live_event &&
+                   query("{\"event\":\"a\"}", "register") == live_register,
+               "A reopened journal should report the same totals.");
+}
+
+int main() {
+  std::remove(kJournalPath);
+  if (cs_init() != CS_SUCCESS) {
+    std::cerr << "cs_init failed: " << cs_last_error() << "\n";
+    return 1;
+  }
+
+  const char* catalog_json =
+      "{\"items\":[{\"id\":\"COFFEE\",\"name\":\"Coffee\",\"unit_cents\":500},"
+      "{\"id\":\"TEA\",\"name\":\"Tea\",\"unit_cents\":300}]}";
+  cs_catalog_t catalog = nullptr;
+  cs_cart_t cart = nullptr;
+  char* json = nullptr;
+  if (!check(cs_catalog_load_json(catalog_json) == CS_SUCCESS &&
+                 cs_catalog_get_default(&catalog) == CS_SUCCESS &&
+                 cs_cart_new_for_catalog(catalog, &cart) == CS_SUCCESS,
+             "Setup failed.")) {
+    cs_shutdown();
+    return 1;
+  }
+  if (!check(cs_sales_query_json(nullptr, nullptr, &json) == CS_ERROR_INVALID_ARGUMENT &&
+                 cs_last_error_code() == CS_ERRC_INVALID_STATE,
+             "Queries need an open journal.") ||
+      !check(cs_journal_open(kJournalPath, 2, nullptr) == CS_SUCCESS, "cs_journal_open failed.")) {
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+
+  if (!run_small_history(cart) || !run_invalid_arguments() || !run_many_sales(catalog)) {
+    cs_cart_free(cart);
+    cs_shutdown();
+    std::remove(kJournalPath);
+    return 1;
+  }
+
+  cs_cart_free(cart);
+  cs_shutdown();
+  std::remove(kJournalPath);
+  return 0;
+}
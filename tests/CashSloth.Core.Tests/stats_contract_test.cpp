@@ -0,0 +1,149 @@
+#include "cashsloth_core.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+
+bool check(bool condition, const char* message) {
+  if (!condition) {
+    std::cerr << message << "\n";
+    return false;
+  }
+  return true;
+}
+
+std::string stats_json() {
+  char* json = nullptr;
+  if (cs_stats_get_json(&json) != CS_SUCCESS) {
+    return std::string();
+  }
+  std::string result(json);
+  cs_free(json);
+  return result;
+}
+
+bool contains(const std::string& json, const char* fragment) {
+  return json.find(fragment) != std::string::npos;
+}
+
+long long number_after(const std::string& json, const char* key) {
+  const size_t pos = json.find(key);
+  return pos == std::string::npos ? -1 : std::atoll(json.c_str() + pos + std::strlen(key));
+}
+
+int main() {
+  if (cs_init() != CS_SUCCESS) {
+    std::cerr << "cs_init failed: " << cs_last_error() << "\n";
+    return 1;
+  }
+
+  if (!check(cs_stats_get_json(nullptr) == CS_ERROR_INVALID_ARGUMENT,
+             "cs_stats_get_json should reject a null output.")) {
+    cs_shutdown();
+    return 1;
+  }
+
+  cs_cart_t cart = nullptr;
+  if (!check(cs_cart_new(&cart) == CS_SUCCESS, "cs_cart_new failed.")) {
+    cs_shutdown();
+    return 1;
+  }
+  if (!check(cs_stats_reset() == CS_SUCCESS, "cs_stats_reset failed.")) {
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+
+  const char* catalog_json =
+      "{\"items\":[{\"id\":\"COFFEE\",\"name\":\"Coffee\",\"unit_cents\":500}]}";
+  bool ok = cs_catalog_load_json(catalog_json) == CS_SUCCESS;
+  for (int i = 0; i < 3; ++i) {
+    ok = ok && cs_cart_add_item_by_id(cart, "COFFEE", 1) == CS_SUCCESS;
+  }
+  ok = ok && cs_cart_add_item_by_id(cart, "UNKNOWN", 1) == CS_ERROR_INVALID_ARGUMENT;
+  ok = ok && cs_cart_add_item_by_id(cart, "COFFEE", 0) == CS_ERROR_INVALID_ARGUMENT;
+  long long total_cents = 0;
+  ok = ok && cs_cart_get_total_cents(cart, &total_cents) == CS_SUCCESS;
+  char* lines_json = nullptr;
+  ok = ok && cs_cart_get_lines_json(cart, &lines_json) == CS_SUCCESS;
+  const size_t lines_bytes = lines_json ? std::strlen(lines_json) : 0;
+  cs_free(lines_json);
+  if (!check(ok, "Recording calls failed.")) {
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+
+  // Counters of a thread that has exited are kept.
+  std::thread worker([] {
+    cs_cart_t worker_cart = nullptr;
+    cs_cart_new(&worker_cart);
+    long long cents = 0;
+    for (int i = 0; i < 10; ++i) {
+      cs_cart_get_total_cents(worker_cart, &cents);
+    }
+    cs_cart_free(worker_cart);
+  });
+  worker.join();
+
+  const std::string json = stats_json();
+  if (!check(contains(json, "\"cs_cart_add_item_by_id\":{\"calls\":5,\"errors\":2,"),
+             "Add calls and errors should be counted.")) {
+    std::cerr << json << "\n";
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+  if (!check(contains(json, "\"cs_cart_get_total_cents\":{\"calls\":11,\"errors\":0,"),
+             "Calls from an exited thread should be merged.")) {
+    std::cerr << json << "\n";
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+  if (!check(contains(json, "\"cs_cart_new\":{\"calls\":1,"),
+             "Calls before cs_stats_reset should not be reported.")) {
+    std::cerr << json << "\n";
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+  if (!check(number_after(json, "\"latency_sample_interval\":") > 0 &&
+                 contains(json, "\"latency_buckets\":[{\"from_ns\":"),
+             "Sampled latencies should be reported.")) {
+    std::cerr << json << "\n";
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+  if (!check(number_after(json, "\"catalog_loads\":{\"count\":") == 1 &&
+                 number_after(json, "\"bytes_serialized\":") >= static_cast<long long>(lines_bytes) &&
+                 contains(json, "\"catalog_mutex\":{\"waits\":"),
+             "Catalog loads, mutex waits and serialized bytes should be reported.")) {
+    std::cerr << json << "\n";
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+
+  if (!check(cs_stats_reset() == CS_SUCCESS, "Second cs_stats_reset failed.")) {
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+  const std::string after_reset = stats_json();
+  if (!check(!contains(after_reset, "\"cs_cart_add_item_by_id\"") &&
+                 number_after(after_reset, "\"catalog_loads\":{\"count\":") == 0,
+             "cs_stats_reset should clear reported counts.")) {
+    std::cerr << after_reset << "\n";
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+
+  cs_cart_free(cart);
+  cs_shutdown();
+  return 0;
+}
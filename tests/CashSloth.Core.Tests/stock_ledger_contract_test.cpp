@@ -0,0 +1,431 @@
+#include "cashsloth_core.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+bool check(bool condition, const char* message) {
+  if (!condition) {
+    std::cerr << message << "\n";
+    return false;
+  }
+  return true;
+}
+
+constexpr const char* kJournalPath = "cashsloth_stock_ledger_contract.bin";
+constexpr long long kStressUnits = 2000;
+
+std::string stock_json(cs_catalog_t catalog) {
+  char* json = nullptr;
+  if (cs_stock_snapshot_json(catalog, &json) != CS_SUCCESS) {
+    return "failed";
+  }
+  std::string result(json);
+  cs_free(json);
+  return result;
+}
+
+// The number after `field` in `item_id`'s entry of a stock snapshot, or -1.
+long long stock_count(const std::string& json, const char* item_id, const char* field) {
+  const size_t item = json.find(std::string("{\"id\":\"") + item_id + "\"");
+  const size_t pos = item == std::string::npos ? item : json.find(field, item);
+  return pos == std::string::npos ? -1 : std::atoll(json.c_str() + pos + std::strlen(field));
+}
+
+bool counts_are(cs_catalog_t catalog, const char* item_id, long long available,
+                long long reserved, long long sold) {
+  const std::string json = stock_json(catalog);
+  return stock_count(json, item_id, "\"available\":") == available &&
+         stock_count(json, item_id, "\"reserved\":") == reserved &&
+         stock_count(json, item_id, "\"sold\":") == sold;
+}
+
+bool out_of_stock(int result) {
+  return result == CS_ERROR_INVALID_ARGUMENT && cs_last_error_code() == CS_ERRC_OUT_OF_STOCK;
+}
+
+long long total_cents(cs_cart_t cart) {
+  long long total = -1;
+  return cs_cart_get_total_cents(cart, &total) == CS_SUCCESS ? total : -1;
+}
+
+bool commit(cs_cart_t cart) {
+  long long total = total_cents(cart);
+  cs_sale_meta meta = {};
+  meta.struct_size = sizeof(cs_sale_meta);
+  meta.payment_method = "Card";
+  meta.completed_unix_ms = 1000;
+  return total > 0 && cs_payment_set_given_cents(cart, total) == CS_SUCCESS &&
+         cs_cart_commit_sale(cart, &meta, nullptr) == CS_SUCCESS;
+}
+
+bool run_no_stock(cs_catalog_t catalog) {
+  cs_cart_t cart = nullptr;
+  char* json = nullptr;
+  const bool ok = stock_json(catalog) == "{\"items\":[]}" &&
+                  cs_cart_new_for_catalog(catalog, &cart) == CS_SUCCESS &&
+                  cs_cart_add_item_by_id(cart, "SHIRT", 1000) == CS_SUCCESS &&
+                  cs_stock_snapshot_json(catalog, nullptr) == CS_ERROR_INVALID_ARGUMENT &&
+                  cs_last_error_code() == CS_ERRC_NULL_ARGUMENT &&
+                  cs_stock_snapshot_json(nullptr, &json) == CS_ERROR_INVALID_ARGUMENT &&
+                  cs_last_error_code() == CS_ERRC_INVALID_HANDLE;
+  cs_cart_free(cart);
+  return check(ok, "Without a ledger nothing should be limited.");
+}
+
+bool run_reservations(cs_catalog_t catalog) {
+  cs_cart_t first = nullptr;
+  cs_cart_t second = nullptr;
+  bool ok = cs_catalog_set_stock_json(
+                catalog, "{\"items\":[{\"id\":\"SHIRT\",\"available\":3},"
+                         "{\"id\":\"CAP\",\"available\":1}]}") == CS_SUCCESS &&
+            stock_json(catalog) ==
+                "{\"items\":[{\"id\":\"SHIRT\",\"available\":3,\"reserved\":0,\"sold\":0},"
+                "{\"id\":\"CAP\",\"available\":1,\"reserved\":0,\"sold\":0}]}" &&
+            cs_cart_new_for_catalog(catalog, &first) == CS_SUCCESS &&
+            cs_cart_new_for_catalog(catalog, &second) == CS_SUCCESS;
+  // Lines reserve as they are added; items the ledger does not list are not limited.
+  ok = ok && cs_cart_add_item_by_id(first, "SHIRT", 2) == CS_SUCCESS &&
+       cs_cart_add_item_by_id(first, "COFFEE", 50) == CS_SUCCESS &&
+       counts_are(catalog, "SHIRT", 1, 2, 0) &&
+       out_of_stock(cs_cart_add_item_by_id(second, "SHIRT", 2)) &&
+       cs_cart_add_item_by_id_fast(second, "SHIRT", 2) == CS_ERRC_OUT_OF_STOCK &&
+       cs_cart_add_item_by_id(second, "SHIRT", 1) == CS_SUCCESS &&
+       out_of_stock(cs_cart_add_item_by_id(second, "SHIRT", 1)) &&
+       counts_are(catalog, "SHIRT", 0, 3, 0);
+  // A failed add leaves the cart as it was.
+  ok = ok && total_cents(second) == 1500;
+  // Lowering a quantity, removing a line and clearing return units.
+  ok = ok && cs_cart_set_line_qty(first, 0, 1) == CS_SUCCESS &&
+       counts_are(catalog, "SHIRT", 1, 2, 0) &&
+       out_of_stock(cs_cart_set_line_qty(first, 0, 3)) &&
+       total_cents(first) == 1500 + 50 * 250 &&
+       cs_cart_remove_line(first, 0) == CS_SUCCESS && counts_are(catalog, "SHIRT", 2, 1, 0) &&
+       cs_cart_clear(second) == CS_SUCCESS && counts_are(catalog, "SHIRT", 3, 0, 0);
+  // A committed sale sells its units; freeing a cart returns them.
+  ok = ok && cs_cart_add_item_by_id(first, "SHIRT", 2) == CS_SUCCESS &&
+       cs_cart_add_item_by_id(first, "CAP", 1) == CS_SUCCESS && commit(first) &&
+       counts_are(catalog, "SHIRT", 1, 0, 2) && counts_are(catalog, "CAP", 0, 0, 1) &&
+       cs_cart_add_item_by_id(second, "SHIRT", 1) == CS_SUCCESS &&
+       counts_are(catalog, "SHIRT", 0, 1, 2) && cs_cart_free(second) == CS_SUCCESS &&
+       counts_are(catalog, "SHIRT", 1, 0, 2);
+  cs_cart_free(first);
+  return check(ok, "Carts should reserve, return and sell stock as their lines change.");
+}
+
+bool run_history_and_clones(cs_catalog_t catalog) {
+  cs_cart_t cart = nullptr;
+  cs_cart_t other = nullptr;
+  cs_cart_t clone = nullptr;
+  bool ok = cs_catalog_set_stock_json(
+                catalog, "{\"items\":[{\"id\":\"SHIRT\",\"available\":2}]}") == CS_SUCCESS &&
+            cs_cart_new_for_catalog(catalog, &cart) == CS_SUCCESS &&
+            cs_cart_new_for_catalog(catalog, &other) == CS_SUCCESS &&
+            cs_cart_checkpoint(cart) == CS_SUCCESS &&
+            cs_cart_add_item_by_id(cart, "SHIRT", 2) == CS_SUCCESS &&
+            cs_cart_checkpoint(cart) == CS_SUCCESS && cs_cart_clear(cart) == CS_SUCCESS &&
+            counts_are(catalog, "SHIRT", 2, 0, 0);
+  // Undoing the clear needs the units back; while another cart holds them it fails and changes
+  // nothing, and once they are free it takes them.
+  ok = ok && cs_cart_add_item_by_id(other, "SHIRT", 1) == CS_SUCCESS &&
+       out_of_stock(cs_cart_undo(cart)) && total_cents(cart) == 0 &&
+       counts_are(catalog, "SHIRT", 1, 1, 0) && cs_cart_clear(other) == CS_SUCCESS &&
+       cs_cart_undo(cart) == CS_SUCCESS && total_cents(cart) == 3000 &&
+       counts_are(catalog, "SHIRT", 0, 2, 0);
+  // Redoing the clear returns them; undoing back to the empty cart returns nothing twice.
+  ok = ok && cs_cart_redo(cart) == CS_SUCCESS && counts_are(catalog, "SHIRT", 2, 0, 0) &&
+       cs_cart_undo(cart) == CS_SUCCESS && cs_cart_undo(cart) == CS_SUCCESS &&
+       total_cents(cart) == 0 && counts_are(catalog, "SHIRT", 2, 0, 0) &&
+       cs_cart_redo(cart) == CS_SUCCESS && counts_are(catalog, "SHIRT", 0, 2, 0);
+  // A clone needs units of its own.
+  ok = ok && out_of_stock(cs_cart_clone(cart, &clone)) && clone == nullptr &&
+       cs_cart_set_line_qty(cart, 0, 1) == CS_SUCCESS &&
+       cs_cart_clone(cart, &clone) == CS_SUCCESS &&
+       counts_are(catalog, "SHIRT", 0, 2, 0) && cs_cart_free(clone) == CS_SUCCESS &&
+       counts_are(catalog, "SHIRT", 1, 1, 0);
+  cs_cart_free(cart);
+  cs_cart_free(other);
+  return check(ok && counts_are(catalog, "SHIRT", 2, 0, 0),
+               "Undo, redo and clones should hold exactly the stock their lines need.");
+}
+
+// A new ledger counts the units carts already hold: each item's available count becomes its new
+// count minus them, and carts with lines reserve against it from their next change on.
+bool run_replacement(cs_catalog_t catalog) {
+  cs_cart_t cart = nullptr;
+  cs_cart_t other = nullptr;
+  bool ok = cs_catalog_set_stock_json(
+                catalog, "{\"items\":[{\"id\":\"SHIRT\",\"available\":2}]}") == CS_SUCCESS &&
+            cs_cart_new_for_catalog(catalog, &cart) == CS_SUCCESS &&
+            cs_cart_new_for_catalog(catalog, &other) == CS_SUCCESS &&
+            cs_cart_add_item_by_id(cart, "SHIRT", 1) == CS_SUCCESS &&
+            cs_catalog_set_stock_json(
+                catalog, "{\"items\":[{\"id\":\"SHIRT\",\"available\":5}]}") == CS_SUCCESS &&
+            counts_are(catalog, "SHIRT", 4, 1, 0) &&
+            cs_cart_add_item_by_id(cart, "SHIRT", 4) == CS_SUCCESS &&
+            counts_are(catalog, "SHIRT", 0, 5, 0) &&
+            out_of_stock(cs_cart_add_item_by_id(other, "SHIRT", 1)) &&
+            out_of_stock(cs_cart_add_item_by_id(cart, "SHIRT", 1)) &&
+            cs_cart_add_item_by_id(other, "CAP", 2) == CS_SUCCESS;
+  // Lines of an item that becomes limited claim their units at the cart's next change; an item
+  // that is no longer listed gets its units back.
+  ok = ok &&
+       cs_catalog_set_stock_json(catalog, "{\"items\":[{\"id\":\"SHIRT\",\"available\":5},"
+                                          "{\"id\":\"CAP\",\"available\":3}]}") == CS_SUCCESS &&
+       counts_are(catalog, "SHIRT", 0, 5, 0) && counts_are(catalog, "CAP", 3, 0, 0) &&
+       cs_cart_set_line_qty(other, 0, 1) == CS_SUCCESS && counts_are(catalog, "CAP", 2, 1, 0) &&
+       out_of_stock(cs_cart_set_line_qty(other, 0, 4)) &&
+       cs_catalog_set_stock_json(
+           catalog, "{\"items\":[{\"id\":\"SHIRT\",\"available\":6}]}") == CS_SUCCESS &&
+       counts_are(catalog, "SHIRT", 1, 5, 0) &&
+       cs_cart_set_line_qty(other, 0, 9) == CS_SUCCESS && commit(cart) &&
+       counts_are(catalog, "SHIRT", 1, 0, 5);
+  // Relisting the item takes the units its lines hold from the new count.
+  ok = ok &&
+       cs_catalog_set_stock_json(catalog, "{\"items\":[{\"id\":\"CAP\",\"available\":3}]}") ==
+           CS_SUCCESS &&
+       cs_cart_add_item_by_id(other, "SHIRT", 1) == CS_SUCCESS &&
+       counts_are(catalog, "CAP", -6, 9, 0) && out_of_stock(cs_cart_add_item_by_id(cart, "CAP", 1));
+  cs_cart_free(cart);
+  cs_cart_free(other);
+  ok = ok && counts_are(catalog, "CAP", 3, 0, 0) &&
+       cs_catalog_set_stock_json(catalog, nullptr) == CS_SUCCESS &&
+       stock_json(catalog) == "{\"items\":[]}";
+  return check(ok, "A new ledger should count the units carts already hold.");
+}
+
+bool run_invalid(cs_catalog_t catalog) {
+  auto rejected = [catalog](const char* json) {
+    return cs_catalog_set_stock_json(catalog, json) == CS_ERROR_INVALID_ARGUMENT &&
+           cs_last_error_code() == CS_ERRC_INVALID_VALUE;
+  };
+  const bool ok =
+      cs_catalog_set_stock_json(catalog, "{\"items\":[{\"id\":\"CAP\",\"available\":4}]}") ==
+          CS_SUCCESS &&
+      rejected("[]") && rejected("{}") && rejected("{\"items\":[],\"extra\":1}") &&
+      rejected("{\"items\":[{\"id\":\"\",\"available\":1}]}") &&
+      rejected("{\"items\":[{\"id\":\"A\",\"available\":-1}]}") &&
+      rejected("{\"items\":[{\"id\":\"A\",\"available\":1.5}]}") &&
+      rejected("{\"items\":[{\"id\":\"A\",\"available\":1,\"price\":2}]}") &&
+      rejected("{\"items\":[{\"id\":\"A\",\"available\":1},{\"id\":\"A\",\"available\":2}]}") &&
+      // Rejected input keeps the ledger.
+      counts_are(catalog, "CAP", 4, 0, 0) &&
+      cs_catalog_set_stock_json(nullptr, nullptr) == CS_ERROR_INVALID_ARGUMENT &&
+      cs_last_error_code() == CS_ERRC_INVALID_HANDLE &&
+      cs_catalog_set_stock_json(catalog, nullptr) == CS_SUCCESS;
+  return check(ok, "Invalid stock JSON should be rejected.");
+}
+
+unsigned thread_count() {
+  const unsigned hardware = std::thread::hardware_concurrency();
+  return std::min(16u, std::max(4u, hardware));
+}
+
+// Every thread races its own carts for the same few units at once: exactly as many adds succeed
+// as there are units.
+bool run_last_units(cs_catalog_t catalog) {
+  const unsigned threads = thread_count();
+  const long long units = threads / 2;
+  if (cs_catalog_set_stock_json(catalog, ("{\"items\":[{\"id\":\"CAP\",\"available\":" +
+                                          std::to_string(units) + "}]}")
+                                             .c_str()) != CS_SUCCESS) {
+    return check(false, "Setting stock failed.");
+  }
+  std::vector<cs_cart_t> carts(threads, nullptr);
+  for (cs_cart_t& cart : carts) {
+    cs_cart_new_for_catalog(catalog, &cart);
+  }
+  std::atomic<unsigned> ready{0};
+  std::atomic<long long> added{0};
+  std::vector<std::thread> workers;
+  for (unsigned t = 0; t < threads; ++t) {
+    workers.emplace_back([&, t] {
+      ready.fetch_add(1);
+      while (ready.load() < threads) {
+      }
+      if (cs_cart_add_item_by_id_fast(carts[t], "CAP", 1) == CS_ERRC_NONE) {
+        added.fetch_add(1);
+      }
+    });
+  }
+  for (auto& worker : workers) {
+    worker.join();
+  }
+  const bool ok = added.load() == units && counts_are(catalog, "CAP", 0, units, 0);
+  for (cs_cart_t cart : carts) {
+    cs_cart_free(cart);
+  }
+  return check(ok && counts_are(catalog, "CAP", units, 0, 0),
+               "Racing carts should get exactly the units there are.");
+}
+
+uint32_t next_random(uint32_t* state) {
+  *state = *state * 1664525u + 1013904223u;
+  return *state >> 8;
+}
+
+bool set_stress_stock(cs_catalog_t catalog) {
+  return cs_catalog_set_stock_json(catalog, ("{\"items\":[{\"id\":\"SHIRT\",\"available\":" +
+                                             std::to_string(kStressUnits) +
+                                             "},{\"id\":\"CAP\",\"available\":1}]}")
+                                                .c_str()) == CS_SUCCESS;
+}
+
+// Threads add, change, remove, clear and commit limited lines until the item sells out, while a
+// reader keeps taking snapshots. Halfway through, a new ledger sets the count again while carts
+// hold units. Units are never sold twice: the new ledger sells exactly what the threads
+// committed after it was set, and no snapshot shows more sold or fewer available than possible.
+bool run_stress(cs_catalog_t catalog) {
+  if (!set_stress_stock(catalog)) {
+    return check(false, "Setting stock failed.");
+  }
+  const unsigned threads = thread_count();
+  std::atomic<long long> committed{0};
+  // 0 before the new ledger, 1 while it is set, 2 after. Units committed wholly after it are
+  // sold by it; those committed while it was set may be.
+  std::atomic<int> phase{0};
+  std::atomic<long long> committed_after{0};
+  std::atomic<long long> committed_during{0};
+  std::atomic<bool> failed{false};
+  std::atomic<bool> done{false};
+
+  std::thread reader([&] {
+    while (!done.load()) {
+      const std::string json = stock_json(catalog);
+      const long long available = stock_count(json, "SHIRT", "\"available\":");
+      const long long sold = stock_count(json, "SHIRT", "\"sold\":");
+      if (available < 0 || sold < 0 || available > kStressUnits || sold > kStressUnits ||
+          stock_count(json, "CAP", "\"available\":") < 0) {
+        failed.store(true);
+      }
+    }
+  });
+
+  std::vector<std::thread> workers;
+  for (unsigned t = 0; t < threads; ++t) {
+    workers.emplace_back([&, t] {
+      uint32_t random = 12345u + t;
+      cs_cart_t cart = nullptr;
+      if (cs_cart_new_for_catalog(catalog, &cart) != CS_SUCCESS) {
+        failed.store(true);
+        return;
+      }
+      long long held = 0;
+      int misses = 0;
+      while (misses < 64) {
+        const int qty = 1 + static_cast<int>(next_random(&random) % 3);
+        const int added = cs_cart_add_item_by_id_fast(cart, "SHIRT", qty);
+        if (added == CS_ERRC_NONE) {
+          held += qty;
+          misses = 0;
+        } else if (added != CS_ERRC_OUT_OF_STOCK) {
+          failed.store(true);
+          break;
+        } else {
+          ++misses;
+        }
+        // The CAP's single unit keeps changing hands.
+        if (cs_cart_add_item_by_id_fast(cart, "CAP", 1) == CS_ERRC_NONE &&
+            cs_cart_remove_line_fast(cart, held > 0 ? 1 : 0) != CS_ERRC_NONE) {
+          failed.store(true);
+        }
+        if (held == 0) {
+          continue;
+        }
+        switch (next_random(&random) % 8) {
+          case 0:
+            held = cs_cart_clear_fast(cart) == CS_ERRC_NONE ? 0 : held;
+            break;
+          case 1:
+            held = cs_cart_set_line_qty_fast(cart, 0, 1) == CS_ERRC_NONE ? 1 : held;
+            break;
+          case 2:
+          case 3: {
+            const int before = phase.load();
+            if (commit(cart)) {
+              committed.fetch_add(held);
+              if (before == 2) {
+                committed_after.fetch_add(held);
+              } else if (phase.load() != 0) {
+                committed_during.fetch_add(held);
+              }
+              held = 0;
+            } else {
+              failed.store(true);
+            }
+            break;
+          }
+          default:
+            break;
+        }
+      }
+      // Whatever is left goes back.
+      cs_cart_free(cart);
+    });
+  }
+  while (committed.load() < kStressUnits / 2 && !failed.load()) {
+    std::this_thread::yield();
+  }
+  phase.store(1);
+  if (!set_stress_stock(catalog)) {
+    failed.store(true);
+  }
+  phase.store(2);
+  for (auto& worker : workers) {
+    worker.join();
+  }
+  done.store(true);
+  reader.join();
+
+  const std::string json = stock_json(catalog);
+  const long long available = stock_count(json, "SHIRT", "\"available\":");
+  const long long sold = stock_count(json, "SHIRT", "\"sold\":");
+  const bool ok = !failed.load() && sold >= committed_after.load() &&
+                  sold <= committed_after.load() + committed_during.load() && sold > 0 &&
+                  available + sold == kStressUnits &&
+                  stock_count(json, "SHIRT", "\"reserved\":") == 0 &&
+                  counts_are(catalog, "CAP", 1, 0, 0);
+  if (!ok) {
+    std::cerr << "committed=" << committed.load() << " after=" << committed_after.load()
+              << " during=" << committed_during.load() << " snapshot=" << json << "\n";
+  }
+  return check(ok, "Concurrent carts should never sell more than the ledger holds.");
+}
+
+int main() {
+  std::remove(kJournalPath);
+  if (cs_init() != CS_SUCCESS) {
+    std::cerr << "cs_init failed: " << cs_last_error() << "\n";
+    return 1;
+  }
+
+  cs_catalog_t catalog = nullptr;
+  if (!check(cs_catalog_new("stock", &catalog) == CS_SUCCESS &&
+                 cs_catalog_instance_load_json(
+                     catalog, "{\"items\":[{\"id\":\"SHIRT\",\"name\":\"Shirt\","
+                              "\"unit_cents\":1500},{\"id\":\"CAP\",\"name\":\"Cap\","
+                              "\"unit_cents\":900},{\"id\":\"COFFEE\",\"name\":\"Coffee\","
+                              "\"unit_cents\":250}]}") == CS_SUCCESS &&
+                 cs_journal_open(kJournalPath, 1, nullptr) == CS_SUCCESS,
+             "Setup failed.")) {
+    cs_shutdown();
+    return 1;
+  }
+
+  const bool ok = run_no_stock(catalog) && run_reservations(catalog) &&
+                  run_history_and_clones(catalog) && run_replacement(catalog) &&
+                  run_invalid(catalog) &&
+                  run_last_units(catalog) && run_stress(catalog);
+  cs_journal_close();
+  cs_catalog_free(catalog);
+  cs_shutdown();
+  std::remove(kJournalPath);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,236 @@
+#include "cashsloth_core.h"
+
+#include <cstdio>
+#include <iostream>
+#include <string>
+
+bool check(bool condition, const char* message) {
+  if (!condition) {
+    std::cerr << message << "\n";
+    return false;
+  }
+  return true;
+}
+
+constexpr const char* kJournalPath = "cashsloth_tax_contract.bin";
+
+std::string lines_json(cs_cart_t cart) {
+  char* json = nullptr;
+  if (cs_cart_get_lines_json(cart, &json) != CS_SUCCESS) {
+    return "failed";
+  }
+  std::string result(json);
+  cs_free(json);
+  return result;
+}
+
+long long total_of(cs_cart_t cart) {
+  long long total = -1;
+  return cs_cart_get_total_cents(cart, &total) == CS_SUCCESS ? total : -1;
+}
+
+bool contains(const std::string& text, const char* part) {
+  return text.find(part) != std::string::npos;
+}
+
+cs_cart_t new_cart(cs_catalog_t catalog) {
+  cs_cart_t cart = nullptr;
+  return cs_cart_new_for_catalog(catalog, &cart) == CS_SUCCESS ? cart : nullptr;
+}
+
+bool run_catalog_round_trip(cs_catalog_t inclusive) {
+  char* json = nullptr;
+  const bool ok = cs_catalog_instance_get_json(inclusive, &json) == CS_SUCCESS &&
+                  contains(json, "\"id\":\"BEER\",\"name\":\"Beer\",\"unit_cents\":1190,"
+                                 "\"tax_class\":\"A\"}") &&
+                  contains(json, "\"tax_classes\":[{\"id\":\"A\",\"rate_basis_points\":1900},"
+                                 "{\"id\":\"B\",\"rate_basis_points\":700}],"
+                                 "\"prices_include_tax\":true}");
+  cs_free(json);
+  return check(ok, "Catalog JSON should keep the tax classes.");
+}
+
+bool run_inclusive(cs_catalog_t inclusive) {
+  cs_cart_t cart = new_cart(inclusive);
+  bool ok = cart != nullptr && cs_cart_add_item_by_id(cart, "BEER", 1) == CS_SUCCESS &&
+            cs_cart_add_item_by_id(cart, "BREAD", 3) == CS_SUCCESS &&
+            cs_cart_add_item_by_id(cart, "CARD", 1) == CS_SUCCESS && total_of(cart) == 2011;
+  ok = ok && contains(lines_json(cart),
+                      "\"taxes\":[{\"class\":\"A\",\"rate_basis_points\":1900,\"net_cents\":1000,"
+                      "\"tax_cents\":190,\"gross_cents\":1190},{\"class\":\"B\","
+                      "\"rate_basis_points\":700,\"net_cents\":300,\"tax_cents\":21,"
+                      "\"gross_cents\":321},{\"class\":\"\",\"rate_basis_points\":0,"
+                      "\"net_cents\":500,\"tax_cents\":0,\"gross_cents\":500}]}");
+  // Classes without lines are left out; an empty cart has no taxes.
+  ok = ok && cs_cart_remove_line(cart, 1) == CS_SUCCESS &&
+       !contains(lines_json(cart), "\"class\":\"B\"") && cs_cart_clear(cart) == CS_SUCCESS &&
+       contains(lines_json(cart), "\"taxes\":[]");
+  cs_cart_free(cart);
+  return check(ok, "Prices that include tax should split each class into net and tax.");
+}
+
+bool run_exclusive(cs_catalog_t exclusive) {
+  cs_cart_t cart = new_cart(exclusive);
+  // Two 9.5 cent shares round once on the class total, to 19 cents rather than 20.
+  bool ok = cart != nullptr && cs_cart_add_item_by_id(cart, "X", 1) == CS_SUCCESS &&
+            cs_cart_add_item_by_id(cart, "Y", 1) == CS_SUCCESS && total_of(cart) == 119 &&
+            contains(lines_json(cart), "\"total_cents\":119,") &&
+            contains(lines_json(cart), "\"net_cents\":100,\"tax_cents\":19,\"gross_cents\":119");
+  // A single 9.5 cent share rounds half up.
+  ok = ok && cs_cart_remove_line(cart, 1) == CS_SUCCESS && total_of(cart) == 60 &&
+       cs_cart_add_item_by_id(cart, "Z", 1) == CS_SUCCESS && total_of(cart) == 167 &&
+       contains(lines_json(cart), "\"net_cents\":50,\"tax_cents\":10,\"gross_cents\":60}") &&
+       contains(lines_json(cart), "\"net_cents\":100,\"tax_cents\":7,\"gross_cents\":107}");
+  cs_cart_free(cart);
+  return check(ok, "Prices without tax should add each class's tax to the total.");
+}
+
+bool run_incremental(cs_catalog_t inclusive) {
+  cs_cart_t cart = new_cart(inclusive);
+  const char* ids[] = {"BEER", "BREAD", "CARD"};
+  bool ok = cart != nullptr;
+  unsigned random = 7;
+  for (int i = 0; ok && i < 300; ++i) {
+    random = random * 1664525u + 1013904223u;
+    const int lines = static_cast<int>(contains(lines_json(cart), "BEER")) +
+                      static_cast<int>(contains(lines_json(cart), "BREAD")) +
+                      static_cast<int>(contains(lines_json(cart), "CARD"));
+    switch ((random >> 8) % 4) {
+      case 0:
+      case 1:
+        ok = cs_cart_add_item_by_id(cart, ids[(random >> 4) % 3], 1 + (random >> 12) % 3) ==
+             CS_SUCCESS;
+        break;
+      case 2:
+        ok = lines == 0 || cs_cart_remove_line(cart, static_cast<int>(random >> 4) % lines) ==
+                               CS_SUCCESS;
+        break;
+      default:
+        ok = lines == 0 ||
+             cs_cart_set_line_qty(cart, static_cast<int>(random >> 4) % lines,
+                                  1 + static_cast<int>((random >> 12) % 9)) == CS_SUCCESS;
+        break;
+    }
+    // A clone sums its lines from scratch.
+    cs_cart_t clone = nullptr;
+    ok = ok && cs_cart_clone(cart, &clone) == CS_SUCCESS && lines_json(clone) == lines_json(cart);
+    cs_cart_free(clone);
+  }
+  cs_cart_free(cart);
+  return check(ok, "Per-class sums kept per change should match a recount.");
+}
+
+bool run_discounts(cs_catalog_t inclusive) {
+  cs_cart_t cart = nullptr;
+  bool ok = cs_catalog_set_pricing_json(
+                inclusive,
+                "{\"rules\":[{\"id\":\"BEER10\",\"type\":\"percent\",\"items\":[\"BEER\"],"
+                "\"percent\":10}]}") == CS_SUCCESS &&
+            (cart = new_cart(inclusive)) != nullptr &&
+            cs_cart_add_item_by_id(cart, "BEER", 1) == CS_SUCCESS &&
+            cs_cart_add_item_by_id(cart, "BREAD", 1) == CS_SUCCESS && total_of(cart) == 1178;
+  // The discount comes off its own class before tax is taken out.
+  const std::string json = lines_json(cart);
+  ok = ok && contains(json, "\"discount_cents\":119,\"total_cents\":1178") &&
+       contains(json, "\"class\":\"A\",\"rate_basis_points\":1900,\"net_cents\":900,"
+                      "\"tax_cents\":171,\"gross_cents\":1071}") &&
+       contains(json, "\"class\":\"B\",\"rate_basis_points\":700,\"net_cents\":100,"
+                      "\"tax_cents\":7,\"gross_cents\":107}");
+  cs_cart_free(cart);
+  ok = ok && cs_catalog_set_pricing_json(inclusive, "{\"rules\":[]}") == CS_SUCCESS;
+  return check(ok, "Pricing discounts should reduce the taxed amounts.");
+}
+
+bool run_journal(cs_catalog_t exclusive) {
+  cs_sale_meta meta = {};
+  meta.struct_size = sizeof(cs_sale_meta);
+  meta.payment_method = "Cash";
+  meta.completed_unix_ms = 1000;
+  cs_cart_t cart = new_cart(exclusive);
+  char* json = nullptr;
+  bool ok = cart != nullptr && cs_journal_open(kJournalPath, 0, nullptr) == CS_SUCCESS &&
+            cs_cart_add_item_by_id(cart, "X", 1) == CS_SUCCESS &&
+            cs_payment_set_given_cents(cart, 100) == CS_SUCCESS &&
+            cs_cart_commit_sale(cart, &meta, nullptr) == CS_SUCCESS &&
+            cs_cart_add_item_by_id(cart, "X", 1) == CS_SUCCESS &&
+            cs_cart_add_item_by_id(cart, "Z", 2) == CS_SUCCESS &&
+            cs_payment_set_given_cents(cart, 500) == CS_SUCCESS &&
+            cs_cart_commit_sale(cart, &meta, nullptr) == CS_SUCCESS;
+  const std::string report =
+      ok && cs_sales_query_json(nullptr, nullptr, &json) == CS_SUCCESS ? json : "";
+  cs_free(json);
+  ok = ok &&
+       contains(report, "\"taxes\":[{\"class\":\"A\",\"rate_basis_points\":1900,\"net_cents\":100,"
+                        "\"tax_cents\":20,\"gross_cents\":120},{\"class\":\"B\","
+                        "\"rate_basis_points\":700,\"net_cents\":200,\"tax_cents\":14,"
+                        "\"gross_cents\":214}]}") &&
+       cs_journal_close() == CS_SUCCESS;
+  json = nullptr;
+  const std::string sales =
+      ok && cs_journal_read_json(kJournalPath, 0, 10, &json) == CS_SUCCESS ? json : "";
+  cs_free(json);
+  ok = ok &&
+       contains(sales, "\"line_total_cents\":50}],\"taxes\":[{\"class\":\"A\","
+                       "\"rate_basis_points\":1900,\"net_cents\":50,\"tax_cents\":10,"
+                       "\"gross_cents\":60}]}") &&
+       contains(sales, "\"subtotal_cents\":274,");
+  cs_cart_free(cart);
+  return check(ok, "Committed sales should keep their tax classes.");
+}
+
+bool run_invalid() {
+  auto rejected = [](const char* json) {
+    return cs_catalog_load_json(json) == CS_ERROR_INVALID_ARGUMENT &&
+           cs_last_error_code() == CS_ERRC_INVALID_CATALOG;
+  };
+  const bool ok =
+      rejected("{\"items\":[{\"id\":\"X\",\"name\":\"X\",\"unit_cents\":1,"
+               "\"tax_class\":\"A\"}]}") &&
+      rejected("{\"tax_classes\":[{\"id\":\"A\",\"rate_basis_points\":10001}],\"items\":[]}") &&
+      rejected("{\"tax_classes\":[{\"id\":\"A\",\"rate_basis_points\":1.5}],\"items\":[]}") &&
+      rejected("{\"tax_classes\":[{\"id\":\"\",\"rate_basis_points\":0}],\"items\":[]}") &&
+      rejected("{\"tax_classes\":[{\"id\":\"A\",\"rate_basis_points\":0},"
+               "{\"id\":\"A\",\"rate_basis_points\":1}],\"items\":[]}") &&
+      rejected("{\"prices_include_tax\":1,\"items\":[]}");
+  return check(ok, "Invalid tax classes should be rejected.");
+}
+
+int main() {
+  std::remove(kJournalPath);
+  if (cs_init() != CS_SUCCESS) {
+    std::cerr << "cs_init failed: " << cs_last_error() << "\n";
+    return 1;
+  }
+
+  const char* inclusive_json =
+      "{\"tax_classes\":[{\"id\":\"A\",\"rate_basis_points\":1900},"
+      "{\"id\":\"B\",\"rate_basis_points\":700}],\"items\":["
+      "{\"id\":\"BEER\",\"name\":\"Beer\",\"unit_cents\":1190,\"tax_class\":\"A\"},"
+      "{\"id\":\"BREAD\",\"name\":\"Bread\",\"unit_cents\":107,\"tax_class\":\"B\"},"
+      "{\"id\":\"CARD\",\"name\":\"Gift card\",\"unit_cents\":500}]}";
+  const char* exclusive_json =
+      "{\"prices_include_tax\":false,\"tax_classes\":[{\"id\":\"A\",\"rate_basis_points\":1900},"
+      "{\"id\":\"B\",\"rate_basis_points\":700}],\"items\":["
+      "{\"id\":\"X\",\"name\":\"X\",\"unit_cents\":50,\"tax_class\":\"A\"},"
+      "{\"id\":\"Y\",\"name\":\"Y\",\"unit_cents\":50,\"tax_class\":\"A\"},"
+      "{\"id\":\"Z\",\"name\":\"Z\",\"unit_cents\":100,\"tax_class\":\"B\"}]}";
+  cs_catalog_t inclusive = nullptr;
+  cs_catalog_t exclusive = nullptr;
+  if (!check(cs_catalog_new("inclusive", &inclusive) == CS_SUCCESS &&
+                 cs_catalog_instance_load_json(inclusive, inclusive_json) == CS_SUCCESS &&
+                 cs_catalog_new("exclusive", &exclusive) == CS_SUCCESS &&
+                 cs_catalog_instance_load_json(exclusive, exclusive_json) == CS_SUCCESS,
+             "Setup failed.")) {
+    cs_shutdown();
+    return 1;
+  }
+
+  const bool ok = run_catalog_round_trip(inclusive) && run_inclusive(inclusive) &&
+                  run_exclusive(exclusive) && run_incremental(inclusive) &&
+                  run_discounts(inclusive) && run_journal(exclusive) && run_invalid();
+  cs_catalog_free(inclusive);
+  cs_catalog_free(exclusive);
+  cs_shutdown();
+  std::remove(kJournalPath);
+  return ok ? 0 : 1;
+}
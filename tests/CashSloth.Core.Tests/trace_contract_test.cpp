@@ -0,0 +1,163 @@
+#include "cashsloth_core.h"
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+bool check(bool condition, const char* message) {
+  if (!condition) {
+    std::cerr << message << "\n";
+    return false;
+  }
+  return true;
+}
+
+std::string read_text(const char* path) {
+  std::ifstream file(path, std::ios::binary);
+  std::stringstream contents;
+  contents << file.rdbuf();
+  return contents.str();
+}
+
+size_t count_of(const std::string& text, const std::string& fragment) {
+  size_t count = 0;
+  for (size_t pos = text.find(fragment); pos != std::string::npos;
+       pos = text.find(fragment, pos + fragment.size())) {
+    ++count;
+  }
+  return count;
+}
+
+bool contains(const std::string& text, const char* fragment) {
+  return text.find(fragment) != std::string::npos;
+}
+
+int main() {
+  if (cs_init() != CS_SUCCESS) {
+    std::cerr << "cs_init failed: " << cs_last_error() << "\n";
+    return 1;
+  }
+
+  const char* trace_path = "cashsloth_trace_contract.json";
+  if (!check(cs_trace_dump(nullptr) == CS_ERROR_INVALID_ARGUMENT,
+             "cs_trace_dump should reject a null path.")) {
+    cs_shutdown();
+    return 1;
+  }
+
+  cs_cart_t cart = nullptr;
+  long long cents = 0;
+  if (!check(cs_cart_new(&cart) == CS_SUCCESS && cs_cart_get_total_cents(cart, &cents) == CS_SUCCESS,
+             "Untraced calls failed.")) {
+    cs_shutdown();
+    return 1;
+  }
+
+  if (!check(cs_trace_set_enabled(1) == CS_SUCCESS, "cs_trace_set_enabled failed.")) {
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+  const char* catalog_json =
+      "{\"items\":[{\"id\":\"COFFEE\",\"name\":\"Coffee\",\"unit_cents\":500},"
+      "{\"id\":\"TEA\",\"name\":\"Tea\",\"unit_cents\":300}]}";
+  bool ok = cs_catalog_load_json(catalog_json) == CS_SUCCESS;
+  ok = ok && cs_cart_add_item_by_id(cart, "COFFEE", 2) == CS_SUCCESS;
+  char* lines_json = nullptr;
+  ok = ok && cs_cart_get_lines_json(cart, &lines_json) == CS_SUCCESS;
+  cs_free(lines_json);
+
+  cs_catalog_t catalog = nullptr;
+  cs_load_ticket_t ticket = nullptr;
+  int state = CS_LOAD_PENDING;
+  ok = ok && cs_catalog_get_default(&catalog) == CS_SUCCESS;
+  ok = ok && cs_catalog_load_json_async(catalog, catalog_json, nullptr, nullptr, &ticket) ==
+                 CS_SUCCESS;
+  ok = ok && cs_load_ticket_wait(ticket, -1, &state) == CS_SUCCESS && state == CS_LOAD_SUCCEEDED;
+  cs_load_ticket_free(ticket);
+  if (!check(ok, "Traced calls failed.")) {
+    cs_trace_set_enabled(0);
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+
+  cs_trace_set_enabled(0);
+  cs_payment_get_given_cents(cart, &cents);
+
+  if (!check(cs_trace_dump(trace_path) == CS_SUCCESS, "cs_trace_dump failed.")) {
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+  const std::string trace = read_text(trace_path);
+  std::remove(trace_path);
+
+  if (!check(trace.rfind("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[", 0) == 0 &&
+                 trace.find("\n]}\n") == trace.size() - 4,
+             "Trace should be a trace-event JSON object.")) {
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+  if (!check(contains(trace, "\"name\":\"cs_cart_add_item_by_id\",\"cat\":\"api\",\"ph\":\"X\"") &&
+                 contains(trace, "\"name\":\"cs_cart_get_lines_json\""),
+             "Entry points should be traced as complete events.")) {
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+  if (!check(contains(trace, "\"name\":\"parse\",\"cat\":\"core\"") &&
+                 contains(trace, "\"name\":\"validate\"") &&
+                 contains(trace, "\"name\":\"index_build\"") &&
+                 contains(trace, "\"name\":\"serialize\"") &&
+                 contains(trace, "\"name\":\"snapshot_swap\""),
+             "Internal phases should be traced.")) {
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+  if (!check(contains(trace, "\"args\":{\"name\":\"catalog loader\"}"),
+             "Background loads should be traced on the named loader thread.")) {
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+  if (!check(!contains(trace, "\"name\":\"cs_cart_new\"") &&
+                 !contains(trace, "\"name\":\"cs_payment_get_given_cents\""),
+             "Calls made while tracing is off must not be recorded.")) {
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+
+
+  // The ring keeps only the newest events of a thread.
+  cs_trace_set_enabled(1);
+  for (int i = 0; i < 20000; ++i) {
+    cs_cart_get_total_cents(cart, &cents);
+  }
+  cs_trace_set_enabled(0);
+  if (!check(cs_trace_dump(trace_path) == CS_SUCCESS, "Second cs_trace_dump failed.")) {
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+  const std::string wrapped = read_text(trace_path);
+  std::remove(trace_path);
+  const size_t total_spans = count_of(wrapped, "\"name\":\"cs_cart_get_total_cents\"");
+  if (!check(total_spans >= 8000 && total_spans <= 8192 &&
+                 !contains(wrapped, "\"name\":\"cs_cart_add_item_by_id\"") &&
+                 contains(wrapped, "\"args\":{\"name\":\"catalog loader\"}"),
+             "Spans past the ring capacity should overwrite the oldest ones of that thread.")) {
+    cs_cart_free(cart);
+    cs_shutdown();
+    return 1;
+  }
+
+  cs_cart_free(cart);
+  cs_shutdown();
+  return 0;
+}
@@ -0,0 +1,1032 @@
+// cs_replay: replays a call log written by cs_record_start against the core library and reports
+// throughput, latency percentiles and calls whose outcome differs from the recording.
+#include "cashsloth_core.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#if defined(_WIN32)
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace {
+
+// Must match the recorder in core.cpp (see docs/ABI.md, "Call recording").
+constexpr char kRecordMagic[8] = {'C', 'S', 'R', 'E', 'C', '0', '0', '1'};
+constexpr unsigned char kRecordCall = 1;
+
+enum RecordTag : unsigned char {
+  kRecordInt = 1,
+  kRecordHandle = 2,
+  kRecordString = 3,
+  kRecordNullString = 4,
+  kRecordOutInt = 5,
+  kRecordOutHandle = 6,
+  kRecordOutText = 7,
+  kRecordOutNull = 8,
+};
+
+enum class Op {
+  kCatalogLoadJson,
+  kCatalogGetJson,
+  kCatalogSetLoadThreads,
+  kCatalogLoadJsonAsync,
+  kCatalogLoadFileAsync,
+  kLoadTicketPoll,
+  kLoadTicketWait,
+  kLoadTicketCancel,
+  kLoadTicketFree,
+  kCatalogNew,
+  kCatalogFree,
+  kCatalogGetDefault,
+  kCatalogFind,
+  kCatalogInstanceLoadJson,
+  kCatalogInstanceGetJson,
+  kCatalogSetDisplayLocale,
+  kCatalogGetGeneration,
+  kCartNew,
+  kCartNewForCatalog,
+  kCartNewConcurrent,
+  kCartBindCatalog,
+  kCartSetDisplayLocale,
+  kCartFree,
+  kCartClear,
+  kCartAddItemById,
+  kCartRemoveLine,
+  kCartSetLineQty,
+  kCartReprice,
+  kCartGetTotalCents,
+  kCartGetLinesJson,
+  kPaymentSetGivenCents,
+  kPaymentGetChangeCents,
+  kPaymentGetGivenCents,
+  kCartClearFast,
+  kCartAddItemByIdFast,
+  kCartRemoveLineFast,
+  kCartSetLineQtyFast,
+  kCartGetTotalCentsFast,
+  kPaymentSetGivenCentsFast,
+  kPaymentGetChangeCentsFast,
+  kPaymentGetGivenCentsFast,
+  kCartCheckpoint,
+  kCartUndo,
+  kCartRedo,
+  kCartClone,
+  kCatalogSetPricingJson,
+  kCartSetPricingContext,
+  kCatalogSetStockJson,
+  kStockSnapshotJson,
+  kJournalOpen,
+  kJournalClose,
+  kCartCommitSale,
+  kCartRecover,
+  kPaymentGetChangeBreakdown,
+  kDrawerSetJson,
+  kDrawerGetJson,
+  kJournalReadJson,
+  kSalesQueryJson,
+  kLiveMetricsJson,
+  kCartPersist,
+  kCartFlush,
+  kCartPublish,
+  kDisplayOpen,
+  kDisplayGetVersion,
+  kDisplayRead,
+  kDisplayClose,
+  kUnsupported,
+};
+
+// What a replay compares for a call.
+enum class Verify {
+  // Success or failure and the output.
+  kOutputs,
+  // Success or failure only. Ticket states, generations, stock counts, journal reports and
+  // sequences, sales reports, live metrics and display frames depend on timing, on other replay
+  // threads or on what the journal held before.
+  kOutcome,
+  // Outcome and output, but only when one thread replays. The cash drawer is process-wide, so
+  // with several threads every thread's cash sales land in the same counts.
+  kAlone,
+  // Nothing. Reading a journal file and opening a display by name depend on files and regions
+  // outside the replay: the recorded journal and publishers in other processes.
+  kNone,
+};
+
+struct OpInfo {
+  const char* name;
+  Op op;
+  Verify verify;
+};
+
+constexpr OpInfo kOps[] = {
+    {"cs_catalog_load_json", Op::kCatalogLoadJson, Verify::kOutputs},
+    {"cs_catalog_get_json", Op::kCatalogGetJson, Verify::kOutputs},
+    {"cs_catalog_set_load_threads", Op::kCatalogSetLoadThreads, Verify::kOutputs},
+    {"cs_catalog_load_json_async", Op::kCatalogLoadJsonAsync, Verify::kOutputs},
+    {"cs_catalog_load_file_async", Op::kCatalogLoadFileAsync, Verify::kOutputs},
+    {"cs_load_ticket_poll", Op::kLoadTicketPoll, Verify::kOutcome},
+    {"cs_load_ticket_wait", Op::kLoadTicketWait, Verify::kOutcome},
+    {"cs_load_ticket_cancel", Op::kLoadTicketCancel, Verify::kOutputs},
+    {"cs_load_ticket_free", Op::kLoadTicketFree, Verify::kOutputs},
+    {"cs_catalog_new", Op::kCatalogNew, Verify::kOutputs},
+    {"cs_catalog_free", Op::kCatalogFree, Verify::kOutputs},
+    {"cs_catalog_get_default", Op::kCatalogGetDefault, Verify::kOutputs},
+    {"cs_catalog_find", Op::kCatalogFind, Verify::kOutputs},
+    {"cs_catalog_instance_load_json", Op::kCatalogInstanceLoadJson, Verify::kOutputs},
+    {"cs_catalog_instance_get_json", Op::kCatalogInstanceGetJson, Verify::kOutputs},
+    {"cs_catalog_set_display_locale", Op::kCatalogSetDisplayLocale, Verify::kOutputs},
+    {"cs_catalog_get_generation", Op::kCatalogGetGeneration, Verify::kOutcome},
+    {"cs_cart_new", Op::kCartNew, Verify::kOutputs},
+    {"cs_cart_new_for_catalog", Op::kCartNewForCatalog, Verify::kOutputs},
+    {"cs_cart_new_concurrent", Op::kCartNewConcurrent, Verify::kOutputs},
+    {"cs_cart_bind_catalog", Op::kCartBindCatalog, Verify::kOutputs},
+    {"cs_cart_set_display_locale", Op::kCartSetDisplayLocale, Verify::kOutputs},
+    {"cs_cart_free", Op::kCartFree, Verify::kOutputs},
+    {"cs_cart_clear", Op::kCartClear, Verify::kOutputs},
+    {"cs_cart_add_item_by_id", Op::kCartAddItemById, Verify::kOutputs},
+    {"cs_cart_remove_line", Op::kCartRemoveLine, Verify::kOutputs},
+    {"cs_cart_set_line_qty", Op::kCartSetLineQty, Verify::kOutputs},
+    {"cs_cart_reprice", Op::kCartReprice, Verify::kOutputs},
+    {"cs_cart_get_total_cents", Op::kCartGetTotalCents, Verify::kOutputs},
+    {"cs_cart_get_lines_json", Op::kCartGetLinesJson, Verify::kOutputs},
+    {"cs_payment_set_given_cents", Op::kPaymentSetGivenCents, Verify::kOutputs},
+    {"cs_payment_get_change_cents", Op::kPaymentGetChangeCents, Verify::kOutputs},
+    {"cs_payment_get_given_cents", Op::kPaymentGetGivenCents, Verify::kOutputs},
+    {"cs_cart_clear_fast", Op::kCartClearFast, Verify::kOutputs},
+    {"cs_cart_add_item_by_id_fast", Op::kCartAddItemByIdFast, Verify::kOutputs},
+    {"cs_cart_remove_line_fast", Op::kCartRemoveLineFast, Verify::kOutputs},
+    {"cs_cart_set_line_qty_fast", Op::kCartSetLineQtyFast, Verify::kOutputs},
+    {"cs_cart_get_total_cents_fast", Op::kCartGetTotalCentsFast, Verify::kOutputs},
+    {"cs_payment_set_given_cents_fast", Op::kPaymentSetGivenCentsFast, Verify::kOutputs},
+    {"cs_payment_get_change_cents_fast", Op::kPaymentGetChangeCentsFast, Verify::kOutputs},
+    {"cs_payment_get_given_cents_fast", Op::kPaymentGetGivenCentsFast, Verify::kOutputs},
+    {"cs_cart_checkpoint", Op::kCartCheckpoint, Verify::kOutputs},
+    {"cs_cart_undo", Op::kCartUndo, Verify::kOutputs},
+    {"cs_cart_redo", Op::kCartRedo, Verify::kOutputs},
+    {"cs_cart_clone", Op::kCartClone, Verify::kOutputs},
+    {"cs_catalog_set_pricing_json", Op::kCatalogSetPricingJson, Verify::kOutputs},
+    {"cs_cart_set_pricing_context", Op::kCartSetPricingContext, Verify::kOutputs},
+    {"cs_catalog_set_stock_json", Op::kCatalogSetStockJson, Verify::kOutputs},
+    {"cs_stock_snapshot_json", Op::kStockSnapshotJson, Verify::kOutcome},
+    {"cs_journal_open", Op::kJournalOpen, Verify::kOutcome},
+    {"cs_journal_close", Op::kJournalClose, Verify::kOutputs},
+    {"cs_cart_commit_sale", Op::kCartCommitSale, Verify::kOutcome},
+    {"cs_cart_recover", Op::kCartRecover, Verify::kOutputs},
+    {"cs_payment_get_change_breakdown", Op::kPaymentGetChangeBreakdown, Verify::kAlone},
+    {"cs_drawer_set_json", Op::kDrawerSetJson, Verify::kAlone},
+    {"cs_drawer_get_json", Op::kDrawerGetJson, Verify::kAlone},
+    {"cs_journal_read_json", Op::kJournalReadJson, Verify::kNone},
+    {"cs_sales_query_json", Op::kSalesQueryJson, Verify::kOutcome},
+    {"cs_live_metrics_json", Op::kLiveMetricsJson, Verify::kOutcome},
+    {"cs_cart_persist", Op::kCartPersist, Verify::kOutputs},
+    {"cs_cart_flush", Op::kCartFlush, Verify::kOutputs},
+    {"cs_cart_publish", Op::kCartPublish, Verify::kOutputs},
+    {"cs_display_open", Op::kDisplayOpen, Verify::kNone},
+    {"cs_display_get_version", Op::kDisplayGetVersion, Verify::kOutcome},
+    {"cs_display_read", Op::kDisplayRead, Verify::kOutcome},
+    {"cs_display_close", Op::kDisplayClose, Verify::kOutputs},
+};
+
+struct Arg {
+  unsigned char tag = 0;
+  // Integer value, handle value, or text length for kRecordOutText.
+  long long value = 0;
+  uint64_t hash = 0;
+  std::string text;
+};
+
+struct Call {
+  size_t api = 0;
+  uint64_t thread = 0;
+  uint64_t start_ns = 0;
+  uint64_t duration_ns = 0;
+  bool failed = false;
+  std::vector<Arg> args;
+};
+
+struct RecordLog {
+  std::vector<std::string> api_names;
+  std::vector<const OpInfo*> ops;
+  std::vector<Call> calls;
+};
+
+uint64_t fnv1a(const char* data, size_t size) {
+  uint64_t hash = 14695981039346656037ull;
+  for (size_t i = 0; i < size; ++i) {
+    hash = (hash ^ static_cast<unsigned char>(data[i])) * 1099511628211ull;
+  }
+  return hash;
+}
+
+class Reader {
+ public:
+  explicit Reader(const std::vector<char>& data) : data_(data) {}
+
+  bool done() const { return pos_ == data_.size(); }
+
+  bool byte(unsigned char* out) {
+    if (pos_ >= data_.size()) {
+      return false;
+    }
+    *out = static_cast<unsigned char>(data_[pos_++]);
+    return true;
+  }
+
+  bool varint(uint64_t* out) {
+    uint64_t value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+      unsigned char b = 0;
+      if (!byte(&b)) {
+        return false;
+      }
+      value |= static_cast<uint64_t>(b & 0x7f) << shift;
+      if ((b & 0x80) == 0) {
+        *out = value;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool zigzag(long long* out) {
+    uint64_t bits = 0;
+    if (!varint(&bits)) {
+      return false;
+    }
+    *out = static_cast<long long>((bits >> 1) ^ (~(bits & 1) + 1));
+    return true;
+  }
+
+  bool string(std::string* out) {
+    uint64_t size = 0;
+    if (!varint(&size) || size > data_.size() - pos_) {
+      return false;
+    }
+    out->assign(data_.data() + pos_, static_cast<size_t>(size));
+    pos_ += static_cast<size_t>(size);
+    return true;
+  }
+
+  bool bytes(char* out, size_t size) {
+    if (size > data_.size() - pos_) {
+      return false;
+    }
+    std::memcpy(out, data_.data() + pos_, size);
+    pos_ += size;
+    return true;
+  }
+
+ private:
+  const std::vector<char>& data_;
+  size_t pos_ = 0;
+};
+
+bool read_arg(Reader& reader, Arg* arg) {
+  if (!reader.byte(&arg->tag)) {
+    return false;
+  }
+  uint64_t bits = 0;
+  switch (arg->tag) {
+    case kRecordInt:
+    case kRecordOutInt:
+      return reader.zigzag(&arg->value);
+    case kRecordHandle:
+    case kRecordOutHandle:
+      if (!reader.varint(&bits)) {
+        return false;
+      }
+      arg->value = static_cast<long long>(bits);
+      return true;
+    case kRecordString:
+      return reader.string(&arg->text);
+    case kRecordNullString:
+    case kRecordOutNull:
+      return true;
+    case kRecordOutText: {
+      unsigned char hash[8];
+      if (!reader.varint(&bits) || !reader.bytes(reinterpret_cast<char*>(hash), sizeof(hash))) {
+        return false;
+      }
+      arg->value = static_cast<long long>(bits);
+      for (int i = 7; i >= 0; --i) {
+        arg->hash = (arg->hash << 8) | hash[i];
+      }
+      return true;
+    }
+    default:
+      return false;
+  }
+}
+
+bool read_log(const char* path, RecordLog* log, std::string* error) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    *error = std::string("Unable to open record file: ") + path;
+    return false;
+  }
+  const std::vector<char> data((std::istreambuf_iterator<char>(file)),
+                               std::istreambuf_iterator<char>());
+  Reader reader(data);
+  char magic[sizeof(kRecordMagic)];
+  uint64_t api_count = 0;
+  if (!reader.bytes(magic, sizeof(magic)) ||
+      std::memcmp(magic, kRecordMagic, sizeof(magic)) != 0 || !reader.varint(&api_count)) {
+    *error = "Not a CashSloth record file.";
+    return false;
+  }
+  for (uint64_t i = 0; i < api_count; ++i) {
+    std::string name;
+    if (!reader.string(&name)) {
+      *error = "Truncated record file header.";
+      return false;
+    }
+    const OpInfo* op = nullptr;
+    for (const OpInfo& info : kOps) {
+      if (name == info.name) {
+        op = &info;
+      }
+    }
+    log->api_names.push_back(name);
+    log->ops.push_back(op);
+  }
+  // A recording cut short by a crash ends in a partial record; everything before it is kept.
+  while (!reader.done()) {
+    unsigned char kind = 0;
+    unsigned char failed = 0;
+    unsigned char arg_count = 0;
+    uint64_t api = 0;
+    Call call;
+    if (!reader.byte(&kind) || kind != kRecordCall || !reader.varint(&api) ||
+        api >= api_count || !reader.varint(&call.thread) || !reader.varint(&call.start_ns) ||
+        !reader.varint(&call.duration_ns) || !reader.byte(&failed) ||
+        !reader.byte(&arg_count)) {
+      std::fprintf(stderr, "cs_replay: ignoring truncated record after %zu calls\n",
+                   log->calls.size());
+      break;
+    }
+    call.api = static_cast<size_t>(api);
+    call.failed = failed != 0;
+    call.args.resize(arg_count);
+    bool complete = true;
+    for (Arg& arg : call.args) {
+      complete = complete && read_arg(reader, &arg);
+    }
+    if (!complete) {
+      std::fprintf(stderr, "cs_replay: ignoring truncated record after %zu calls\n",
+                   log->calls.size());
+      break;
+    }
+    log->calls.push_back(std::move(call));
+  }
+  return true;
+}
+
+// The journal the replay commits into instead of the recorded one. The core has one journal per
+// process, so replay threads share it: it opens with the first thread that replays
+// cs_journal_open and closes with the last one that replays cs_journal_close.
+class ScratchJournal {
+ public:
+  explicit ScratchJournal(std::string path) : path_(std::move(path)) {}
+
+  const char* path() const { return path_.c_str(); }
+
+  int open(int max_commit_delay_ms, char** out_report_json) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (users_ == 0) {
+      const int result = cs_journal_open(path_.c_str(), max_commit_delay_ms, out_report_json);
+      if (result != CS_SUCCESS) {
+        return result;
+      }
+    }
+    ++users_;
+    return CS_SUCCESS;
+  }
+
+  int close() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (users_ > 0 && --users_ == 0) {
+      return cs_journal_close();
+    }
+    return CS_SUCCESS;
+  }
+
+ private:
+  std::string path_;
+  std::mutex mutex_;
+  int users_ = 0;
+};
+
+struct Outcome {
+  bool executed = false;
+  uint64_t ns = 0;
+  std::string mismatch;
+};
+
+// Replays calls in log order with its own handle map, so several replayers can run at once.
+// Recovered and persisted carts use the replayer's own scratch state files, named after
+// `scratch_prefix`. Published carts use the recorded name followed by `display_suffix`.
+class Replayer {
+ public:
+  // `alone` is set when this is the only replay thread.
+  Replayer(const RecordLog& log, bool verify, bool alone, ScratchJournal& journal,
+           std::string scratch_prefix, std::string display_suffix)
+      : log_(log),
+        verify_(verify),
+        alone_(alone),
+        journal_(journal),
+        scratch_prefix_(std::move(scratch_prefix)),
+        display_suffix_(std::move(display_suffix)) {}
+
+  const std::vector<std::string>& scratch_files() const { return scratch_files_; }
+
+  Outcome run(const Call& call) {
+    Outcome outcome;
+    const OpInfo* info = log_.ops[call.api];
+    if (!info) {
+      return outcome;
+    }
+    Inputs in(*this, call);
+    if (!in.valid()) {
+      return outcome;
+    }
+
+    void* out_handle = nullptr;
+    char* out_text = nullptr;
+    long long out_cents = 0;
+    int out_state = 0;
+    unsigned long long out_generation = 0;
+    unsigned long long out_version = 0;
+    int out_size = 0;
+    const Arg* out = in.out();
+    const bool want_out = out && out->tag != kRecordOutNull;
+    auto handle_out = [&] { return want_out ? &out_handle : nullptr; };
+    auto text_out = [&] { return want_out ? &out_text : nullptr; };
+    auto cents_out = [&] { return want_out ? &out_cents : nullptr; };
+    auto state_out = [&] { return want_out ? &out_state : nullptr; };
+
+    const auto start = std::chrono::steady_clock::now();
+    int result = CS_SUCCESS;
+    switch (info->op) {
+      case Op::kCatalogLoadJson:
+        result = cs_catalog_load_json(in.text(0));
+        break;
+      case Op::kCatalogGetJson:
+        result = cs_catalog_get_json(text_out());
+        break;
+      case Op::kCatalogSetLoadThreads:
+        result = cs_catalog_set_load_threads(static_cast<int>(in.number(0)));
+        break;
+      case Op::kCatalogLoadJsonAsync:
+        result = cs_catalog_load_json_async(in.handle(0), in.text(1), nullptr, nullptr,
+                                            handle_out());
+        break;
+      case Op::kCatalogLoadFileAsync:
+        result = cs_catalog_load_file_async(in.handle(0), in.text(1), nullptr, nullptr,
+                                            handle_out());
+        break;
+      case Op::kLoadTicketPoll:
+        result = cs_load_ticket_poll(in.handle(0), state_out());
+        break;
+      case Op::kLoadTicketWait:
+        result = cs_load_ticket_wait(in.handle(0), static_cast<int>(in.number(1)), state_out());
+        break;
+      case Op::kLoadTicketCancel:
+        result = cs_load_ticket_cancel(in.handle(0));
+        break;
+      case Op::kLoadTicketFree:
+        result = cs_load_ticket_free(in.handle(0));
+        break;
+      case Op::kCatalogNew:
+        result = cs_catalog_new(in.text(0), handle_out());
+        break;
+      case Op::kCatalogFree:
+        result = cs_catalog_free(in.handle(0));
+        break;
+      case Op::kCatalogGetDefault:
+        result = cs_catalog_get_default(handle_out());
+        break;
+      case Op::kCatalogFind:
+        result = cs_catalog_find(in.text(0), handle_out());
+        break;
+      case Op::kCatalogInstanceLoadJson:
+        result = cs_catalog_instance_load_json(in.handle(0), in.text(1));
+        break;
+      case Op::kCatalogInstanceGetJson:
+        result = cs_catalog_instance_get_json(in.handle(0), text_out());
+        break;
+      case Op::kCatalogSetDisplayLocale:
+        result = cs_catalog_set_display_locale(in.handle(0), in.text(1));
+        break;
+      case Op::kCatalogGetGeneration:
+        result = cs_catalog_get_generation(in.handle(0), want_out ? &out_generation : nullptr);
+        break;
+      case Op::kCartNew:
+        result = cs_cart_new(handle_out());
+        break;
+      case Op::kCartNewForCatalog:
+        result = cs_cart_new_for_catalog(in.handle(0), handle_out());
+        break;
+      case Op::kCartNewConcurrent:
+        result = cs_cart_new_concurrent(in.handle(0), handle_out());
+        break;
+      case Op::kCartBindCatalog:
+        result = cs_cart_bind_catalog(in.handle(0), in.handle(1));
+        break;
+      case Op::kCartSetDisplayLocale:
+        result = cs_cart_set_display_locale(in.handle(0), in.text(1));
+        break;
+      case Op::kCartFree:
+        result = cs_cart_free(in.handle(0));
+        break;
+      case Op::kCartClear:
+        result = cs_cart_clear(in.handle(0));
+        break;
+      case Op::kCartAddItemById:
+        result = cs_cart_add_item_by_id(in.handle(0), in.text(1), static_cast<int>(in.number(2)));
+        break;
+      case Op::kCartRemoveLine:
+        result = cs_cart_remove_line(in.handle(0), static_cast<int>(in.number(1)));
+        break;
+      case Op::kCartSetLineQty:
+        result = cs_cart_set_line_qty(in.handle(0), static_cast<int>(in.number(1)),
+                                      static_cast<int>(in.number(2)));
+        break;
+      case Op::kCartReprice:
+        result = cs_cart_reprice(in.handle(0), static_cast<int>(in.number(1)), text_out());
+        break;
+      case Op::kCartGetTotalCents:
+        result = cs_cart_get_total_cents(in.handle(0), cents_out());
+        break;
+      case Op::kCartGetLinesJson:
+        result = cs_cart_get_lines_json(in.handle(0), text_out());
+        break;
+      case Op::kPaymentSetGivenCents:
+        result = cs_payment_set_given_cents(in.handle(0), in.number(1));
+        break;
+      case Op::kPaymentGetChangeCents:
+        result = cs_payment_get_change_cents(in.handle(0), cents_out());
+        break;
+      case Op::kPaymentGetGivenCents:
+        result = cs_payment_get_given_cents(in.handle(0), cents_out());
+        break;
+      case Op::kCartClearFast:
+        result = cs_cart_clear_fast(in.handle(0));
+        break;
+      case Op::kCartAddItemByIdFast:
+        result = cs_cart_add_item_by_id_fast(in.handle(0), in.text(1),
+                                             static_cast<int>(in.number(2)));
+        break;
+      case Op::kCartRemoveLineFast:
+        result = cs_cart_remove_line_fast(in.handle(0), static_cast<int>(in.number(1)));
+        break;
+      case Op::kCartSetLineQtyFast:
+        result = cs_cart_set_line_qty_fast(in.handle(0), static_cast<int>(in.number(1)),
+                                           static_cast<int>(in.number(2)));
+        break;
+      case Op::kCartGetTotalCentsFast:
+        result = cs_cart_get_total_cents_fast(in.handle(0), cents_out());
+        break;
+      case Op::kPaymentSetGivenCentsFast:
+        result = cs_payment_set_given_cents_fast(in.handle(0), in.number(1));
+        break;
+      case Op::kPaymentGetChangeCentsFast:
+        result = cs_payment_get_change_cents_fast(in.handle(0), cents_out());
+        break;
+      case Op::kPaymentGetGivenCentsFast:
+        result = cs_payment_get_given_cents_fast(in.handle(0), cents_out());
+        break;
+      case Op::kCartCheckpoint:
+        result = cs_cart_checkpoint(in.handle(0));
+        break;
+      case Op::kCartUndo:
+        result = cs_cart_undo(in.handle(0));
+        break;
+      case Op::kCartRedo:
+        result = cs_cart_redo(in.handle(0));
+        break;
+      case Op::kCartClone:
+        result = cs_cart_clone(in.handle(0), handle_out());
+        break;
+      case Op::kCatalogSetPricingJson:
+        result = cs_catalog_set_pricing_json(in.handle(0), in.text(1));
+        break;
+      case Op::kCartSetPricingContext:
+        result = cs_cart_set_pricing_context(in.handle(0), in.text(1), in.number(2));
+        break;
+      case Op::kCatalogSetStockJson:
+        result = cs_catalog_set_stock_json(in.handle(0), in.text(1));
+        break;
+      case Op::kStockSnapshotJson:
+        result = cs_stock_snapshot_json(in.handle(0), text_out());
+        break;
+      case Op::kJournalOpen:
+        result = journal_.open(static_cast<int>(in.number(1)), text_out());
+        break;
+      case Op::kJournalClose:
+        result = journal_.close();
+        break;
+      case Op::kCartCommitSale: {
+        // Sale details follow the cart: struct_size (-1 for null), the four strings, tip,
+        // completion time and showcase flag.
+        cs_sale_meta meta = {};
+        meta.struct_size = static_cast<unsigned int>(in.number(1));
+        meta.event_name = in.text(2);
+        meta.register_name = in.text(3);
+        meta.operator_username = in.text(4);
+        meta.payment_method = in.text(5);
+        meta.tip_cents = in.number(6);
+        meta.completed_unix_ms = in.number(7);
+        meta.is_showcase = static_cast<int>(in.number(8));
+        result = cs_cart_commit_sale(in.handle(0), in.number(1) < 0 ? nullptr : &meta,
+                                     want_out ? &out_generation : nullptr);
+        break;
+      }
+      case Op::kCartRecover:
+        // The state file's recorded contents follow the path; the original file is not used.
+        result = cs_cart_recover(in.handle(0),
+                                 in.text(1) ? scratch_state_file(in.bytes(2)) : nullptr,
+                                 handle_out());
+        break;
+      case Op::kPaymentGetChangeBreakdown:
+        result = cs_payment_get_change_breakdown(in.handle(0), text_out());
+        break;
+      case Op::kDrawerSetJson:
+        result = cs_drawer_set_json(in.text(0));
+        break;
+      case Op::kDrawerGetJson:
+        result = cs_drawer_get_json(text_out());
+        break;
+      case Op::kJournalReadJson:
+        // Reads the scratch journal, which holds only the replayed sales.
+        result = cs_journal_read_json(in.text(0) ? journal_.path() : nullptr,
+                                      static_cast<unsigned long long>(in.number(1)),
+                                      static_cast<int>(in.number(2)), text_out());
+        break;
+      case Op::kSalesQueryJson:
+        result = cs_sales_query_json(in.text(0), in.text(1), text_out());
+        break;
+      case Op::kLiveMetricsJson:
+        result = cs_live_metrics_json(in.number(0), static_cast<int>(in.number(1)), text_out());
+        break;
+      case Op::kCartPersist:
+        result = cs_cart_persist(in.handle(0), in.text(1) ? scratch_state_file(nullptr) : nullptr);
+        break;
+      case Op::kCartFlush:
+        result = cs_cart_flush(in.handle(0));
+        break;
+      case Op::kCartPublish:
+        result = cs_cart_publish(in.handle(0), scratch_display_name(in.text(1)),
+                                 static_cast<int>(in.number(2)), handle_out());
+        break;
+      case Op::kDisplayOpen:
+        result = cs_display_open(scratch_display_name(in.text(0)), handle_out());
+        break;
+      case Op::kDisplayGetVersion:
+        result = cs_display_get_version(in.handle(0), want_out ? &out_version : nullptr);
+        break;
+      case Op::kDisplayRead:
+        // The frame is not recorded, only the buffer size, the size output and the version.
+        frame_.resize(static_cast<size_t>(std::max(0LL, in.number(1))));
+        result = cs_display_read(in.handle(0), frame_.empty() ? nullptr : frame_.data(),
+                                 static_cast<int>(in.number(1)),
+                                 in.present(2) ? &out_size : nullptr,
+                                 want_out ? &out_version : nullptr);
+        break;
+      case Op::kDisplayClose:
+        result = cs_display_close(in.handle(0));
+        break;
+      case Op::kUnsupported:
+        return outcome;
+    }
+    outcome.ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                           std::chrono::steady_clock::now() - start)
+                                           .count());
+    outcome.executed = true;
+
+    const bool failed = result != CS_SUCCESS;
+    const bool verify = verify_ && info->verify != Verify::kNone &&
+                        (info->verify != Verify::kAlone || alone_);
+    if (verify && failed != call.failed) {
+      outcome.mismatch = call.failed ? "recorded failure, replay succeeded"
+                                     : std::string("recorded success, replay failed: ") +
+                                           cs_last_error();
+    } else if (verify && !failed && want_out && info->verify != Verify::kOutcome) {
+      // The only verified integer outputs are amounts in cents.
+      if (out->tag == kRecordOutInt) {
+        if (out_cents != out->value) {
+          outcome.mismatch = "output " + std::to_string(out_cents) + " != recorded " +
+                             std::to_string(out->value);
+        }
+      } else if (out->tag == kRecordOutText) {
+        const size_t size = out_text ? std::strlen(out_text) : 0;
+        if (static_cast<long long>(size) != out->value ||
+            (out_text ? fnv1a(out_text, size) : 0) != out->hash) {
+          outcome.mismatch = "returned text differs from the recording";
+        }
+      }
+    }
+    if (!failed && want_out && out->tag == kRecordOutHandle && out->value != 0) {
+      handles_[static_cast<uint64_t>(out->value)] = out_handle;
+    }
+    cs_free(out_text);
+    return outcome;
+  }
+
+ private:
+  // Decoded inputs of one call. Handles are translated through the replayer's map; a call that
+  // names a handle never produced during replay is skipped.
+  class Inputs {
+   public:
+    Inputs(const Replayer& replayer, const Call& call) : call_(call) {
+      for (const Arg& arg : call.args) {
+        if (arg.tag == kRecordHandle && arg.value != 0) {
+          auto it = replayer.handles_.find(static_cast<uint64_t>(arg.value));
+          if (it == replayer.handles_.end()) {
+            valid_ = false;
+            return;
+          }
+          handles_.push_back(it->second);
+        } else {
+          handles_.push_back(nullptr);
+        }
+      }
+    }
+
+    bool valid() const { return valid_; }
+
+    void* handle(size_t i) const { return i < handles_.size() ? handles_[i] : nullptr; }
+
+    const char* text(size_t i) const {
+      return i < call_.args.size() && call_.args[i].tag == kRecordString
+                 ? call_.args[i].text.c_str()
+                 : nullptr;
+    }
+
+    long long number(size_t i) const {
+      return i < call_.args.size() ? call_.args[i].value : 0;
+    }
+
+    // Like text(), for strings that may hold zero bytes.
+    const std::string* bytes(size_t i) const {
+      return i < call_.args.size() && call_.args[i].tag == kRecordString ? &call_.args[i].text
+                                                                         : nullptr;
+    }
+
+    // False for a null output pointer.
+    bool present(size_t i) const {
+      return i < call_.args.size() && call_.args[i].tag != kRecordOutNull;
+    }
+
+    // Every replayed function but cs_display_read has at most one output, recorded last.
+    const Arg* out() const {
+      if (call_.args.empty()) {
+        return nullptr;
+      }
+      const Arg& last = call_.args.back();
+      return last.tag >= kRecordOutInt ? &last : nullptr;
+    }
+
+   private:
+    const Call& call_;
+    std::vector<void*> handles_;
+    bool valid_ = true;
+  };
+
+  // Writes `contents` to a new scratch file and returns its path. Without contents (the recorded
+  // file could not be read, or the cart persists to it) the path names no file, so recovery
+  // fails as it did.
+  const char* scratch_state_file(const std::string* contents) {
+    scratch_files_.push_back(scratch_prefix_ + std::to_string(scratch_files_.size()));
+    const std::string& path = scratch_files_.back();
+    std::remove(path.c_str());
+    if (contents) {
+      std::ofstream file(path, std::ios::binary);
+      file.write(contents->data(), static_cast<std::streamsize>(contents->size()));
+    }
+    return path.c_str();
+  }
+
+  // Keeps a replay off the recorded region and off other threads' regions. Null and empty names
+  // (private regions) are kept.
+  const char* scratch_display_name(const char* name) {
+    if (!name || name[0] == '\0') {
+      return name;
+    }
+    display_name_ = name;
+    display_name_ += display_suffix_;
+    return display_name_.c_str();
+  }
+
+  const RecordLog& log_;
+  bool verify_;
+  bool alone_;
+  ScratchJournal& journal_;
+  std::string scratch_prefix_;
+  std::string display_suffix_;
+  std::string display_name_;
+  std::vector<char> frame_;
+  std::vector<std::string> scratch_files_;
+  std::unordered_map<uint64_t, void*> handles_;
+};
+
+struct ThreadResult {
+  std::vector<std::vector<uint64_t>> latencies;
+  std::vector<std::string> scratch_files;
+  size_t skipped = 0;
+  size_t mismatches = 0;
+  std::vector<std::string> examples;
+};
+
+uint64_t percentile(const std::vector<uint64_t>& sorted, double p) {
+  if (sorted.empty()) {
+    return 0;
+  }
+  const size_t index = static_cast<size_t>(p * static_cast<double>(sorted.size() - 1) + 0.5);
+  return sorted[std::min(index, sorted.size() - 1)];
+}
+
+void print_latencies(const char* label, std::vector<uint64_t> values) {
+  std::sort(values.begin(), values.end());
+  std::printf("%-9s p50 %9llu  p90 %9llu  p99 %9llu  p99.9 %9llu  max %9llu ns\n", label,
+              static_cast<unsigned long long>(percentile(values, 0.50)),
+              static_cast<unsigned long long>(percentile(values, 0.90)),
+              static_cast<unsigned long long>(percentile(values, 0.99)),
+              static_cast<unsigned long long>(percentile(values, 0.999)),
+              static_cast<unsigned long long>(values.empty() ? 0 : values.back()));
+}
+
+unsigned long process_id() {
+#if defined(_WIN32)
+  return static_cast<unsigned long>(_getpid());
+#else
+  return static_cast<unsigned long>(getpid());
+#endif
+}
+
+void print_usage() {
+  std::fprintf(stderr,
+               "usage: cs_replay <record-file> [--threads N] [--pace original|fast] "
+               "[--no-verify]\n");
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const char* path = nullptr;
+  size_t threads = 1;
+  bool original_pace = false;
+  bool verify = true;
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (arg == "--threads" && i + 1 < argc) {
+      threads = static_cast<size_t>(std::max(1, std::atoi(argv[++i])));
+    } else if (arg == "--pace" && i + 1 < argc) {
+      const std::string pace = argv[++i];
+      if (pace != "original" && pace != "fast") {
+        print_usage();
+        return 2;
+      }
+      original_pace = pace == "original";
+    } else if (arg == "--no-verify") {
+      verify = false;
+
+    } else if (!path && arg[0] != '-') {
+      path = argv[i];
+    } else {
+      print_usage();
+      return 2;
+    }
+  }
+  if (!path) {
+    print_usage();
+    return 2;
+  }
+
+  RecordLog log;
+  std::string error;
+  if (!read_log(path, &log, &error)) {
+    std::fprintf(stderr, "cs_replay: %s\n", error.c_str());
+    return 2;
+  }
+  if (cs_init() != CS_SUCCESS) {
+    std::fprintf(stderr, "cs_replay: cs_init failed: %s\n", cs_last_error());
+    return 2;
+  }
+  // Commits go to a fresh scratch journal next to the log, never to the one that was recorded.
+  const std::string journal_path = std::string(path) + ".journal";
+  std::remove(journal_path.c_str());
+  ScratchJournal journal(journal_path);
+
+  // Each thread replays the whole log with its own handles. Catalogs are shared, so logs that
+  // load different catalogs into one instance may legitimately diverge with several threads.
+  // Published carts get names of their own per process and thread, so concurrent replays of one
+  // log never meet each other or the recording's regions.
+  const std::string display_suffix = ".replay" + std::to_string(process_id()) + ".t";
+  const uint64_t first_start = log.calls.empty() ? 0 : log.calls.front().start_ns;
+  std::vector<ThreadResult> results(threads);
+  const auto replay_start = std::chrono::steady_clock::now();
+  std::vector<std::thread> workers;
+  for (size_t t = 0; t < threads; ++t) {
+    workers.emplace_back([&, t] {
+      ThreadResult& result = results[t];
+      result.latencies.resize(log.api_names.size());
+      Replayer replayer(log, verify, threads == 1, journal,
+                        std::string(path) + ".t" + std::to_string(t) + ".cart",
+                        display_suffix + std::to_string(t));
+      for (size_t i = 0; i < log.calls.size(); ++i) {
+        const Call& call = log.calls[i];
+        if (original_pace && call.start_ns > first_start) {
+          std::this_thread::sleep_until(replay_start +
+                                        std::chrono::nanoseconds(call.start_ns - first_start));
+        }
+        const Outcome outcome = replayer.run(call);
+        if (!outcome.executed) {
+          ++result.skipped;
+          continue;
+        }
+        result.latencies[call.api].push_back(outcome.ns);
+        if (!outcome.mismatch.empty()) {
+          ++result.mismatches;
+          if (result.examples.size() < 5) {
+            result.examples.push_back("call " + std::to_string(i) + " " +
+                                      log.api_names[call.api] + ": " + outcome.mismatch);
+          }
+        }
+      }
+      result.scratch_files = replayer.scratch_files();
+    });
+  }
+  for (auto& worker : workers) {
+    worker.join();
+  }
+  const double seconds =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - replay_start).count();
+  cs_shutdown();
+  std::remove(journal_path.c_str());
+  for (const ThreadResult& result : results) {
+    for (const std::string& file : result.scratch_files) {
+      std::remove(file.c_str());
+    }
+  }
+
+  size_t executed = 0;
+  size_t skipped = 0;
+  size_t mismatches = 0;
+  std::vector<uint64_t> all_replayed;
+  std::vector<uint64_t> all_recorded;
+  std::vector<std::vector<uint64_t>> by_api(log.api_names.size());
+  for (const ThreadResult& result : results) {
+    skipped += result.skipped;
+    mismatches += result.mismatches;
+    for (size_t api = 0; api < by_api.size(); ++api) {
+      executed += result.latencies[api].size();
+      by_api[api].insert(by_api[api].end(), result.latencies[api].begin(),
+                         result.latencies[api].end());
+    }
+  }
+  for (const auto& values : by_api) {
+    all_replayed.insert(all_replayed.end(), values.begin(), values.end());
+  }
+  for (const Call& call : log.calls) {
+    if (log.ops[call.api]) {
+      all_recorded.push_back(call.duration_ns);
+    }
+  }
+
+  std::printf("cs_replay: %zu recorded calls x %zu threads, %s pace\n", log.calls.size(), threads,
+              original_pace ? "original" : "fast");
+  std::printf("executed %zu calls in %.3f s (%.0f calls/s), %zu skipped, %zu mismatches\n",
+              executed, seconds, seconds > 0 ? static_cast<double>(executed) / seconds : 0.0,
+              skipped, mismatches);
+  print_latencies("recorded", all_recorded);
+  print_latencies("replayed", all_replayed);
+  for (size_t api = 0; api < by_api.size(); ++api) {
+    if (by_api[api].empty()) {
+      continue;
+    }
+    std::vector<uint64_t> values = by_api[api];
+    std::sort(values.begin(), values.end());
+    std::printf("  %-32s %9zu calls  p50 %9llu  p99 %9llu ns\n", log.api_names[api].c_str(),
+                values.size(), static_cast<unsigned long long>(percentile(values, 0.50)),
+                static_cast<unsigned long long>(percentile(values, 0.99)));
+  }
+  for (const ThreadResult& result : results) {
+    for (const std::string& example : result.examples) {
+      std::printf("mismatch: %s\n", example.c_str());
+    }
+  }
+  return mismatches == 0 ? 0 : 1;
+}